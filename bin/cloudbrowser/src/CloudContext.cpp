@@ -13,6 +13,7 @@
 #include <QSettings>
 #include <QStandardPaths>
 #include <QUrl>
+#include <thread>
 #include <unordered_set>
 #include "File.h"
 #include "GenerateThumbnail.h"
@@ -22,8 +23,14 @@
 using namespace cloudstorage;
 
 namespace {
+IHttpServerFactory::Pointer create_http_server_factory() {
+  IHttpServerFactory::Options options;
+  options.thread_pool_size_ = std::thread::hardware_concurrency();
+  return IHttpServerFactory::create(options);
+}
+
 std::shared_ptr<ServerWrapperFactory> http_server_factory =
-    util::make_unique<ServerWrapperFactory>(IHttpServerFactory::create());
+    util::make_unique<ServerWrapperFactory>(create_http_server_factory());
 }  // namespace
 
 int ProviderListModel::rowCount(const QModelIndex&) const {
@@ -100,7 +107,7 @@ CloudContext::CloudContext(QObject* parent)
         return QJsonDocument::fromJson(file.readAll());
       }()),
       http_server_factory_(http_server_factory),
-      http_(IHttp::create()),
+      http_(IHttp::create(std::thread::hardware_concurrency())),
       thread_pool_(IThreadPool::create(2)),
       context_thread_pool_(IThreadPool::create(1)),
       thumbnailer_thread_pool_(IThreadPool::create(2)),
@@ -388,7 +395,7 @@ IItem::List CloudContext::cachedDirectory(ListDirectoryCacheKey key) {
 }
 
 void CloudContext::schedule(std::function<void()> f) {
-  context_thread_pool_->schedule(f);
+  context_thread_pool_->schedule(std::move(f));
 }
 
 std::shared_ptr<IThreadPool> CloudContext::thumbnailer_thread_pool() const {
@@ -465,6 +472,7 @@ ICloudProvider::Pointer CloudContext::provider(const std::string& name,
         : thread_pool_(thread_pool) {}
 
     void schedule(const Task& f) override { thread_pool_->schedule(f); }
+    void schedule(Task&& f) override { thread_pool_->schedule(std::move(f)); }
 
    private:
     std::shared_ptr<IThreadPool> thread_pool_;
@@ -40,13 +40,105 @@ std::string id(std::shared_ptr<ICloudProvider> p, IItem::Pointer i) {
   return util::json::to_string(json);
 }
 
+Range fit(Range r, uint64_t size) {
+  r.start_ = std::min(r.start_, size - 1);
+  r.size_ = std::min(r.size_, size - r.start_);
+  return r;
+}
+
+bool inside(Range r1, Range r2, uint64_t size) {
+  r1 = fit(r1, size);
+  r2 = fit(r2, size);
+  return r1.start_ >= r2.start_ && r1.start_ + r1.size_ <= r2.start_ + r2.size_;
+}
+
+uint64_t align_up(uint64_t offset) {
+  return (offset + ReadCache::BlockSize - 1) / ReadCache::BlockSize *
+         ReadCache::BlockSize;
+}
+
+class StringBuffer : public IFileSystem::IBuffer {
+ public:
+  StringBuffer(std::string data) : data_(std::move(data)) {}
+
+  const char* data() const override { return data_.data(); }
+  uint64_t size() const override { return data_.size(); }
+
+ private:
+  std::string data_;
+};
+
+// part of another buffer, which is kept alive while the part is used
+class SliceBuffer : public IFileSystem::IBuffer {
+ public:
+  SliceBuffer(IFileSystem::IBuffer::Pointer buffer, uint64_t offset,
+              uint64_t size)
+      : buffer_(buffer), offset_(offset), size_(size) {}
+
+  const char* data() const override { return buffer_->data() + offset_; }
+  uint64_t size() const override { return size_; }
+  int descriptor() const override { return buffer_->descriptor(); }
+  uint64_t offset() const override { return buffer_->offset() + offset_; }
+
+ private:
+  IFileSystem::IBuffer::Pointer buffer_;
+  uint64_t offset_;
+  uint64_t size_;
+};
+
+IFileSystem::IBuffer::Pointer string_buffer(std::string data) {
+  return std::make_shared<StringBuffer>(std::move(data));
+}
+
+IFileSystem::IBuffer::Pointer slice(IFileSystem::IBuffer::Pointer buffer,
+                                    uint64_t offset, uint64_t size) {
+  offset = std::min(offset, buffer->size());
+  return std::make_shared<SliceBuffer>(buffer, offset,
+                                       std::min(size, buffer->size() - offset));
+}
+
+class CacheBuffer : public IFileSystem::IBuffer {
+ public:
+  CacheBuffer(ReadCache::Buffer buffer) : buffer_(std::move(buffer)) {}
+
+  const char* data() const override { return buffer_.data(); }
+  uint64_t size() const override { return buffer_.size(); }
+  int descriptor() const override { return buffer_.descriptor(); }
+  uint64_t offset() const override { return buffer_.offset(); }
+
+ private:
+  ReadCache::Buffer buffer_;
+};
+
 }  // namespace
 
-FileSystem::Node::Node() : parent_(), inode_(), size_() {}
+FileSystem::Node::Node()
+    : parent_(),
+      inode_(),
+      size_(),
+      chunk_size_(),
+      store_size_(),
+      sequential_(),
+      version_(),
+      uploaded_version_() {}
 
 FileSystem::Node::Node(std::shared_ptr<ICloudProvider> p, IItem::Pointer item,
                        FileId parent, FileId inode, uint64_t size)
-    : provider_(p), item_(item), parent_(parent), inode_(inode), size_(size) {}
+    : provider_(p),
+      item_(item),
+      parent_(parent),
+      inode_(inode),
+      size_(size),
+      chunk_size_(),
+      read_cache_key_(p && !item->id().empty() &&
+                              size != IItem::UnknownSize
+                          ? ReadCache::key(p->name(), item->id(), size,
+                                           item->timestamp())
+                          : ""),
+      store_size_(),
+      sequential_(),
+      version_(),
+      uploaded_version_() {}
 
 FileSystem::Node::~Node() {
   if (store_) (void)std::remove(cache_filename_.c_str());
@@ -60,8 +152,6 @@ std::chrono::system_clock::time_point FileSystem::Node::timestamp() const {
 
 uint64_t FileSystem::Node::size() const { return size_; }
 
-void FileSystem::Node::set_size(uint64_t size) { size_ = size; }
-
 std::string FileSystem::Node::filename() const { return item_->filename(); }
 
 IItem::FileType FileSystem::Node::type() const { return item_->type(); }
@@ -76,17 +166,17 @@ std::shared_ptr<IGenericRequest> FileSystem::Node::upload_request() const {
   return upload_request_;
 }
 
-void FileSystem::Node::set_upload_request(std::shared_ptr<IGenericRequest> r) {
-  upload_request_ = r;
-}
-
 FileSystem::FileSystem(const std::vector<ProviderEntry>& provider,
                        IHttp::Pointer http,
-                       const std::string& temporary_directory)
+                       const std::string& temporary_directory,
+                       uint64_t read_cache_size)
     : next_(1),
+      next_handle_(1),
       running_(true),
       http_(std::move(http)),
       temporary_directory_(temporary_directory),
+      read_cache_(temporary_directory + "cloudstorage-cache/",
+                  read_cache_size),
       cancelled_request_thread_(std::async(
           std::launch::async, std::bind(&FileSystem::cancelled, this))),
       cleanup_(std::async(std::launch::async,
@@ -111,6 +201,22 @@ FileSystem::FileSystem(const std::vector<ProviderEntry>& provider,
 }
 
 FileSystem::~FileSystem() {
+  std::vector<Node::Pointer> nodes;
+  {
+    std::lock_guard<mutex> lock(node_data_mutex_);
+    for (auto&& n : node_map_) nodes.push_back(n.second);
+  }
+  for (auto&& node : nodes) {
+    std::vector<Notification> notifications;
+    {
+      std::lock_guard<mutex> lock(node->mutex_);
+      if (node->upload_ && !node->upload_->end_) {
+        node->upload_->aborted_ = true;
+        node->upload_->resolve(notifications);
+      }
+    }
+    for (auto&& n : notifications) n();
+  }
   running_ = false;
   request_data_condition_.notify_one();
   cancelled_request_condition_.notify_one();
@@ -185,9 +291,12 @@ void FileSystem::set(FileId idx, Node::Pointer node) {
   if (node->item()) {
     node_map_[idx] = node;
     node_id_map_[id(node->provider(), node->item())] = node;
+    node_listing_.erase(node->parent_);
   } else {
+    node_listing_.erase(idx);
     auto it1 = node_map_.find(idx);
     if (it1 != std::end(node_map_)) {
+      node_listing_.erase(it1->second->parent_);
       auto it2 =
           node_id_map_.find(id(it1->second->provider(), it1->second->item()));
       if (it2 != std::end(node_id_map_)) node_id_map_.erase(it2);
@@ -205,15 +314,12 @@ IFileSystem::FileId FileSystem::mknod(FileId parent, const char* name) {
   auto node = add(p->provider(), parent,
                   std::make_shared<Item>(name, "", 0, IItem::UnknownTimeStamp,
                                          IItem::FileType::Unknown));
-  node->cache_filename_ =
-      temporary_directory_ + "cloudstorage" + std::to_string(node->inode());
-  node->store_ = util::make_unique<std::fstream>(
-      node->cache_filename_,
-      std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+  stage(*node);
   {
     std::lock_guard<mutex> lock(node_data_mutex_);
     auto it = node_directory_.find(node->parent_);
     if (it != node_directory_.end()) it->second.insert(node->inode());
+    node_listing_.erase(node->parent_);
   }
   return node->inode();
 }
@@ -229,11 +335,12 @@ FileSystem::Node::Pointer FileSystem::get(FileId node) {
 
 void FileSystem::lookup(FileId parent_node, const std::string& name,
                         GetItemCallback cb) {
-  readdir(parent_node, [=](EitherError<INode::List> e) {
-    if (auto lst = e.right()) {
-      for (auto&& i : *lst)
-        if (this->sanitize(i->filename()) == name) return cb(i);
-      cb(Error{IHttpRequest::Bad, "not found"});
+  list(parent_node, [=](EitherError<Listing> e) {
+    if (auto listing = e.right()) {
+      auto it = listing->index_.find(name);
+      if (it == listing->index_.end())
+        return cb(Error{IHttpRequest::Bad, "not found"});
+      cb(listing->nodes_[it->second]);
     } else {
       cb(e.left());
     }
@@ -255,7 +362,7 @@ void FileSystem::getattr(FileId node, GetItemCallback cb) {
                           response.headers_.end())
                         return this->download_item_async(
                             n->provider(), n->item(), FullRange,
-                            [=](EitherError<std::string> e) {
+                            [=](EitherError<IBuffer> e) {
                               if (e.left()) return cb(e.left());
                               auto nnode = std::make_shared<Node>(
                                   n->provider(), n->item(), n->parent_, node,
@@ -315,26 +422,49 @@ void FileSystem::write(FileId inode, const char* data, uint32_t size,
                        uint64_t offset, WriteDataCallback callback) {
   getattr(inode, [=](EitherError<INode> e) {
     if (e.left()) return callback(0);
-    auto n = static_cast<Node*>(e.right().get());
-    std::lock_guard<mutex> lock(n->mutex_);
-    if (!n->store_) {
-      n->cache_filename_ =
-          temporary_directory_ + "cloudstorage" + std::to_string(n->inode());
-      n->store_ = util::make_unique<std::fstream>(
-          n->cache_filename_,
-          std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    auto n = std::static_pointer_cast<Node>(e.right());
+    std::vector<Notification> notifications;
+    bool stream = false;
+    {
+      std::lock_guard<mutex> lock(n->mutex_);
+      if (!n->store_) stage(*n);
+      util::log("writing", n->filename(), offset, "-", offset + size - 1);
+      n->store_->clear();
+      n->store_->seekp(offset);
+      n->store_->write(data, size);
+      if (!*n->store_) return callback(0);
+      if (offset != n->store_size_) n->sequential_ = false;
+      n->store_size_ = std::max<uint64_t>(n->store_size_, offset + size);
+      n->size_ = n->store_size_;
+      n->version_++;
+      auto upload = n->upload_;
+      if (upload && upload->streamed_ && !upload->end_) {
+        if (!n->sequential_) {
+          log("random write to", n->filename(), "aborting streamed upload");
+          upload->aborted_ = true;
+        }
+        upload->resolve(notifications);
+      } else if (!upload && n->sequential_ &&
+                 n->store_size_ >= WRITE_BACK_THRESHOLD && streaming(*n)) {
+        stream = true;
+      }
     }
-    util::log("writing", e.right()->filename(), offset, "-", offset + size - 1);
-    n->store_->seekp(offset);
-    n->store_->write(data, size);
-    if (!n->store_)
-      return callback(0);
-    else
-      return callback(size);
+    for (auto&& notify : notifications) notify();
+    if (stream) this->upload(n, true, {});
+    callback(size);
   });
 }
 
 void FileSystem::readdir(FileId node, ListDirectoryCallback cb) {
+  list(node, [=](EitherError<Listing> e) {
+    if (e.left()) return cb(e.left());
+    auto listing = e.right();
+    cb(std::shared_ptr<INode::List>(listing, &listing->nodes_));
+  });
+}
+
+void FileSystem::list(FileId node,
+                      std::function<void(EitherError<Listing>)> cb) {
   {
     std::lock_guard<mutex> lock(node_data_mutex_);
     auto node_timestamp_it = node_timestamp_.find(node);
@@ -342,11 +472,13 @@ void FileSystem::readdir(FileId node, ListDirectoryCallback cb) {
         (node_timestamp_it != node_timestamp_.end() &&
          std::chrono::system_clock::now() - node_timestamp_it->second <
              CACHE_DIRECTORY_DURATION)) {
+      auto listing_it = node_listing_.find(node);
+      if (listing_it != node_listing_.end()) return cb(listing_it->second);
       auto it = node_directory_.find(node);
       if (it != std::end(node_directory_)) {
-        INode::List ret;
-        for (auto&& r : it->second) ret.push_back(get(r));
-        return cb(ret);
+        auto listing = this->listing(it->second);
+        node_listing_[node] = listing;
+        return cb(listing);
       }
     }
   }
@@ -358,99 +490,161 @@ void FileSystem::readdir(FileId node, ListDirectoryCallback cb) {
           std::unordered_set<FileId> ret;
           for (auto&& i : *lst)
             ret.insert(this->add(nd->provider(), node, i)->inode());
+          std::shared_ptr<Listing> listing;
           {
             std::lock_guard<mutex> lock(node_data_mutex_);
             node_directory_[node] = ret;
             node_timestamp_[node] = std::chrono::system_clock::now();
+            listing = this->listing(ret);
+            node_listing_[node] = listing;
           }
-          INode::List nodes;
-          for (auto&& r : ret) nodes.push_back(this->get(r));
-          cb(nodes);
+          cb(listing);
         } else {
           auto item = auth_item(nd->provider()->authorizeLibraryUrl());
-          cb(INode::List(
-              1, std::make_shared<Node>(nd->provider(), item, node,
-                                        auth_node_[nd->provider()->name()],
-                                        item->size())));
+          auto listing = std::make_shared<Listing>();
+          listing->nodes_.push_back(std::make_shared<Node>(
+              nd->provider(), item, node, auth_node_[nd->provider()->name()],
+              item->size()));
+          listing->index_[sanitize(item->filename())] = 0;
+          cb(listing);
         }
       });
 }
 
-void FileSystem::read(FileId node, size_t offset, size_t sz,
+std::shared_ptr<FileSystem::Listing> FileSystem::listing(
+    const std::unordered_set<FileId>& directory) {
+  auto listing = std::make_shared<Listing>();
+  for (auto&& r : directory) listing->nodes_.push_back(get(r));
+  std::sort(listing->nodes_.begin(), listing->nodes_.end(),
+            [](const INode::Pointer& n1, const INode::Pointer& n2) {
+              return n1->filename() < n2->filename();
+            });
+  for (size_t i = 0; i < listing->nodes_.size(); i++)
+    listing->index_.emplace(sanitize(listing->nodes_[i]->filename()), i);
+  return listing;
+}
+
+IFileSystem::FileHandle FileSystem::open(FileId) { return next_handle_++; }
+
+void FileSystem::release(FileId node, FileHandle handle) {
+  auto nd = get(node);
+  std::lock_guard<mutex> lock(nd->mutex_);
+  nd->stream_.erase(handle);
+}
+
+void FileSystem::read(FileId node, FileHandle handle, size_t offset, size_t sz,
                       DownloadItemCallback cb) {
   getattr(node, [=](EitherError<INode> e) {
     if (e.left()) return cb(e.left());
     auto nd = std::static_pointer_cast<Node>(e.right());
     if (nd->size() == IItem::UnknownSize || nd->size() == 0 || !nd->provider())
-      return cb(std::string());
+      return cb(string_buffer(""));
     if (nd->item()->id() == AUTH_ITEM_ID) {
       auto data = authorize_file(nd->provider()->authorizeLibraryUrl());
       auto start = std::min<size_t>(offset, data.size() - 1);
       auto size = std::min<size_t>(data.size() - start, sz);
-      auto d = data.substr(start, size);
-      return cb(d);
+      return cb(string_buffer(data.substr(start, size)));
     }
-    auto fit = [=](Range r) {
-      r.start_ =
-          std::min<size_t>(r.start_, static_cast<size_t>(nd->size() - 1));
-      r.size_ =
-          std::min<size_t>(r.size_, static_cast<size_t>(nd->size() - r.start_));
-      return r;
-    };
-    Range range = fit({offset, sz});
+    auto range = fit({offset, sz}, nd->size());
     std::unique_lock<mutex> lock(nd->mutex_);
-    auto inside = [=](Range r1, Range r2) {
-      r1 = fit(r1);
-      r2 = fit(r2);
-      return r1.start_ >= r2.start_ &&
-             r1.start_ + r1.size_ <= r2.start_ + r2.size_;
-    };
-    auto download = [=](Range range) {
-      for (auto&& download_range : nd->pending_download_)
-        if (inside(range, download_range)) return;
-      range = fit({range.start_, std::max<size_t>(range.size_, READ_AHEAD)});
-      nd->pending_download_.push_back(range);
-      download_item_async(
-          nd->provider(), nd->item(), range, [=](EitherError<std::string> e) {
-            std::unique_lock<mutex> lock(nd->mutex_);
-            auto requests = nd->read_request_;
-            for (auto&& read : requests)
-              if (inside(read.range_, range)) {
-                if (e.left())
-                  read.callback_(e.left());
-                else
-                  read.callback_(e.right()->substr(
-                      read.range_.start_ - range.start_, read.range_.size_));
-                auto it = std::find(nd->read_request_.begin(),
-                                    nd->read_request_.end(), read);
-                if (it != nd->read_request_.end()) nd->read_request_.erase(it);
-              }
-            auto it = std::find(nd->pending_download_.begin(),
-                                nd->pending_download_.end(), range);
-            if (it != nd->pending_download_.end())
-              nd->pending_download_.erase(it);
-            if (e.right()) {
-              nd->chunk_.push_back({range, std::move(*e.right())});
-              if (nd->chunk_.size() >= CACHED_CHUNK_COUNT)
-                nd->chunk_.pop_front();
-            }
-          });
-    };
-    bool read_ahead = true;
-    for (auto&& chunk : nd->chunk_)
-      if (inside(Range{range.start_ + READ_AHEAD / 2, READ_AHEAD / 2},
-                 chunk.range_))
-        read_ahead = false;
-    if (read_ahead) download(Range{range.start_ + READ_AHEAD / 2, range.size_});
+    this->read_ahead(nd, handle, range);
+    ReadCache::Buffer buffer;
+    if (read_cache_.get(nd->read_cache_key_, range.start_, range.size_, buffer))
+      return cb(IBuffer::Pointer(
+          std::make_shared<CacheBuffer>(std::move(buffer))));
     for (auto&& chunk : nd->chunk_)
-      if (inside(range, chunk.range_))
-        return cb(chunk.data_.substr(range.start_ - chunk.range_.start_,
-                                     range.size_));
+      if (inside(range, chunk.range_, nd->size()))
+        return cb(slice(chunk.data_, range.start_ - chunk.range_.start_,
+                        range.size_));
     nd->read_request_.push_back({range, cb});
-    download(range);
+    this->download(nd, range);
   });
 }
 
+void FileSystem::read_ahead(Node::Pointer nd, FileHandle handle,
+                            Range range) {
+  auto end = range.start_ + range.size_;
+  auto it = nd->stream_.find(handle);
+  if (it == nd->stream_.end() || range.start_ + READ_AHEAD < it->second.next_ ||
+      range.start_ > it->second.next_ + READ_AHEAD) {
+    nd->stream_[handle] = {end, 0, align_up(end)};
+    return;
+  }
+  auto& stream = it->second;
+  stream.next_ = std::max(stream.next_, end);
+  stream.ahead_ = std::max(stream.ahead_, align_up(end));
+  if (stream.window_ == 0)
+    stream.window_ = READ_AHEAD;
+  else if (stream.ahead_ < stream.next_ + stream.window_ &&
+           nd->pending_download_.size() < MAX_PENDING_DOWNLOADS)
+    stream.window_ = std::min<uint64_t>(2 * stream.window_, MAX_READ_AHEAD);
+  auto unit =
+      std::max<uint64_t>(READ_AHEAD, stream.window_ / MAX_PENDING_DOWNLOADS);
+  auto target = std::min(stream.next_ + stream.window_, nd->size());
+  while (stream.ahead_ < target &&
+         nd->pending_download_.size() < MAX_PENDING_DOWNLOADS) {
+    auto r = fit({stream.ahead_, unit}, nd->size());
+    if (!available(*nd, r)) download(nd, r);
+    stream.ahead_ = r.start_ + r.size_;
+  }
+}
+
+bool FileSystem::available(Node& nd, Range range) {
+  for (auto&& chunk : nd.chunk_)
+    if (inside(range, chunk.range_, nd.size())) return true;
+  return read_cache_.contains(nd.read_cache_key_, range.start_, range.size_);
+}
+
+void FileSystem::download(Node::Pointer nd, Range range) {
+  for (auto&& download_range : nd->pending_download_)
+    if (inside(range, download_range, nd->size())) return;
+  auto start = range.start_ / ReadCache::BlockSize * ReadCache::BlockSize;
+  range = fit({start, align_up(range.start_ + range.size_) - start}, nd->size());
+  nd->pending_download_.push_back(range);
+  download_item_async(
+      nd->provider(), nd->item(), range, [=](EitherError<IBuffer> e) {
+        auto answer = [&]() {
+          auto requests = nd->read_request_;
+          for (auto&& read : requests)
+            if (inside(read.range_, range, nd->size())) {
+              if (e.left())
+                read.callback_(e.left());
+              else
+                read.callback_(slice(e.right(),
+                                     read.range_.start_ - range.start_,
+                                     read.range_.size_));
+              auto it = std::find(nd->read_request_.begin(),
+                                  nd->read_request_.end(), read);
+              if (it != nd->read_request_.end()) nd->read_request_.erase(it);
+            }
+        };
+        // waiting reads don't wait for the data to be synced to the read
+        // cache, the ones which come in meanwhile are answered after it
+        {
+          std::unique_lock<mutex> lock(nd->mutex_);
+          answer();
+        }
+        // without the read cache, readahead is kept in memory
+        bool cached =
+            e.right() && read_cache_.put(nd->read_cache_key_, nd->size(),
+                                         range.start_, e.right()->data(),
+                                         e.right()->size());
+        std::unique_lock<mutex> lock(nd->mutex_);
+        if (e.right() && !cached) {
+          nd->chunk_.push_back({range, e.right()});
+          nd->chunk_size_ += e.right()->size();
+          while (nd->chunk_size_ > MAX_READ_AHEAD) {
+            nd->chunk_size_ -= nd->chunk_.front().data_->size();
+            nd->chunk_.pop_front();
+          }
+        }
+        answer();
+        auto it = std::find(nd->pending_download_.begin(),
+                            nd->pending_download_.end(), range);
+        if (it != nd->pending_download_.end()) nd->pending_download_.erase(it);
+      });
+}
+
 void FileSystem::invalidate(FileId root) {
   std::lock_guard<mutex> lock(node_data_mutex_);
   auto it = node_directory_.find(root);
@@ -461,6 +655,7 @@ void FileSystem::invalidate(FileId root) {
     }
     node_directory_.erase(it);
   }
+  node_listing_.erase(root);
 }
 
 void FileSystem::rename(FileId parent, const char* name, FileId newparent,
@@ -495,6 +690,8 @@ void FileSystem::rename(FileId parent, const char* name, FileId newparent,
             auto nit = node_directory_.find(newparent);
             if (nit != std::end(node_directory_))
               nit->second.insert(node->inode());
+            node_listing_.erase(parent);
+            node_listing_.erase(newparent);
             this->set(node->inode(),
                       std::make_shared<Node>(p, e.right(), node->parent_,
                                              node->inode(), node->size()));
@@ -514,8 +711,18 @@ void FileSystem::remove(FileId parent, const char* name,
       auto d = it->second.find(node->inode());
       if (d != it->second.end()) it->second.erase(d);
     }
+    node_listing_.erase(parent);
   };
   auto remove_file = [=](Node::Pointer node) {
+    std::vector<Notification> notifications;
+    {
+      std::lock_guard<mutex> lock(node->mutex_);
+      if (node->upload_) {
+        node->upload_->aborted_ = true;
+        node->upload_->resolve(notifications);
+      }
+    }
+    for (auto&& notify : notifications) notify();
     std::lock_guard<mutex> lock(node_data_mutex_);
     if (node->upload_request()) {
       this->cancel(node->upload_request());
@@ -549,64 +756,181 @@ void FileSystem::remove(FileId parent, const char* name,
 
 void FileSystem::fsync(FileId inode, DataSynchronizedCallback cb) {
   auto node = get(inode);
-  auto parent_node = get(node->parent_);
-  auto p = parent_node->provider();
-  if (!p) return cb(Error{IHttpRequest::ServiceUnavailable, ""});
+  std::vector<Notification> notifications;
+  std::vector<Upload::Sync> sync;
   {
     std::lock_guard<mutex> lock(node->mutex_);
     if (!node->store_) return cb(nullptr);
-  }
-  class UploadCallback : public IUploadFileCallback {
-   public:
-    UploadCallback(FileSystem* ctx, std::shared_ptr<ICloudProvider> provider,
-                   Node::Pointer node, DeleteItemCallback cb)
-        : fuse_(ctx), provider_(provider), node_(node), callback_(cb) {
-      node_->store_->seekg(0, std::ios::end);
-      size_ = node_->store_->tellg();
-      node_->store_->seekg(std::ios::beg);
+    if (auto upload = node->upload_) {
+      if (upload->streamed_ && !upload->end_ && !upload->aborted_) {
+        log("finishing streamed upload of", node->filename(),
+            node->store_size_);
+        upload->end_ = true;
+        upload->version_ = node->version_;
+        upload->size_ = node->store_size_;
+        upload->resolve(notifications);
+      }
+      upload->sync_.push_back({node->version_, cb});
+    } else if (node->version_ == node->uploaded_version_) {
+      return cb(nullptr);
+    } else {
+      log("fsync", node->filename());
+      sync.push_back({node->version_, cb});
     }
+  }
+  for (auto&& notify : notifications) notify();
+  if (!sync.empty()) upload(node, false, sync);
+}
+
+void FileSystem::stage(Node& node) {
+  node.cache_filename_ =
+      temporary_directory_ + "cloudstorage" + std::to_string(node.inode());
+  node.store_ = util::make_unique<std::fstream>(
+      node.cache_filename_,
+      std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+  node.store_size_ = 0;
+  node.sequential_ = true;
+  node.version_++;
+}
 
-    uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
-      node_->store_->seekg(offset);
-      node_->store_->read(data, maxlength);
-      return node_->store_->gcount();
+void FileSystem::upload(Node::Pointer node, bool streamed,
+                        std::vector<Upload::Sync> sync) {
+  auto parent_node = get(node->parent_);
+  auto p = parent_node->provider();
+  if (!p) {
+    for (auto&& s : sync)
+      s.callback_(Error{IHttpRequest::ServiceUnavailable, ""});
+    return;
+  }
+  Upload::Pointer upload;
+  std::string filename;
+  {
+    std::lock_guard<mutex> lock(node->mutex_);
+    if (node->upload_) {
+      // another upload started meanwhile, it's redone if it's older than sync
+      for (auto&& s : sync) node->upload_->sync_.push_back(s);
+      return;
     }
+    upload = std::make_shared<Upload>(this, node, streamed);
+    upload->sync_ = std::move(sync);
+    node->upload_ = upload;
+    filename = node->filename();
+  }
+  std::shared_ptr<IGenericRequest> request =
+      p->uploadFileAsync(parent_node->item(), filename, upload);
+  {
+    std::lock_guard<mutex> lock(node->mutex_);
+    // the upload could have finished already
+    if (node->upload_ == upload) node->upload_request_ = request;
+  }
+  add({p, request});
+}
 
-    uint64_t size() override { return size_; }
+bool FileSystem::streaming(Node& node) {
+  return node.provider_ && (node.provider_->supportedOperations() &
+                            ICloudProvider::UploadFileStream);
+}
 
-    void done(EitherError<IItem> e) override {
-      if (e.left()) return callback_(e.left());
-      std::lock_guard<mutex> lock(fuse_->node_data_mutex_);
-      fuse_->set(node_->inode_,
-                 std::make_shared<Node>(provider_, e.right(), node_->parent_,
-                                        node_->inode_, e.right()->size()));
-      log("fsynced", node_->filename());
-      callback_(nullptr);
-    }
+FileSystem::Upload::Upload(FileSystem* fuse, Node::Pointer node, bool streamed)
+    : fuse_(fuse),
+      node_(node),
+      streamed_(streamed),
+      end_(!streamed),
+      aborted_(),
+      version_(node->version_),
+      size_(node->store_size_) {}
 
-    void progress(uint64_t, uint64_t now) override {
-      std::lock_guard<mutex> lock(fuse_->node_data_mutex_);
-      auto node = fuse_->get(node_->inode_);
-      node->set_size(now);
-      fuse_->set(node_->inode_, node);
+uint32_t FileSystem::Upload::putData(char* data, uint32_t maxlength,
+                                     uint64_t offset) {
+  std::lock_guard<mutex> lock(node_->mutex_);
+  // writes which came after the size was settled belong to the next upload
+  if (end_)
+    maxlength = static_cast<uint32_t>(
+        std::min<uint64_t>(maxlength, size_ - std::min(size_, offset)));
+  node_->store_->clear();
+  node_->store_->seekg(offset);
+  node_->store_->read(data, maxlength);
+  return node_->store_->gcount();
+}
+
+uint64_t FileSystem::Upload::size() {
+  return streamed_ ? IItem::UnknownSize : size_;
+}
+
+void FileSystem::Upload::waitData(
+    uint64_t offset, uint64_t length,
+    std::function<void(EitherError<uint64_t>)> ready) {
+  std::vector<Notification> notifications;
+  {
+    std::lock_guard<mutex> lock(node_->mutex_);
+    wait_.push_back({offset, length, ready});
+    resolve(notifications);
+  }
+  for (auto&& notify : notifications) notify();
+}
+
+void FileSystem::Upload::resolve(std::vector<Notification>& notifications) {
+  auto size = end_ ? size_ : node_->store_size_;
+  for (auto it = wait_.begin(); it != wait_.end();) {
+    auto ready = it->ready_;
+    if (aborted_) {
+      notifications.push_back([=] {
+        ready(Error{IHttpRequest::Aborted, util::Error::ABORTED});
+      });
+    } else if (end_ || size >= it->offset_ + it->length_) {
+      auto available =
+          std::min(it->length_, size - std::min(size, it->offset_));
+      notifications.push_back([=] { ready(available); });
+    } else {
+      ++it;
+      continue;
     }
+    it = wait_.erase(it);
+  }
+}
 
-   private:
-    FileSystem* fuse_;
-    std::shared_ptr<ICloudProvider> provider_;
-    Node::Pointer node_;
-    DeleteItemCallback callback_;
-    uint64_t size_;
-  };
-  auto filename = node->filename();
-  log("fsync", filename);
-  std::shared_ptr<IGenericRequest> upload_request = p->uploadFileAsync(
-      parent_node->item(), filename,
-      util::make_unique<UploadCallback>(this, p, std::move(node), cb));
-  get(inode)->set_upload_request(upload_request);
-  add({p, upload_request});
+void FileSystem::Upload::done(EitherError<IItem> e) {
+  std::vector<Sync> sync, retry;
+  {
+    std::lock_guard<mutex> lock(node_->mutex_);
+    if (node_->upload_.get() == this) {
+      node_->upload_ = nullptr;
+      node_->upload_request_ = nullptr;
+    }
+    if (auto item = e.right()) {
+      log("uploaded", item->filename(), "version", version_);
+      node_->item_ = item;
+      node_->uploaded_version_ = std::max(node_->uploaded_version_, version_);
+      if (node_->version_ == version_) {
+        node_->size_ = node_->store_size_;
+        node_->read_cache_key_ =
+            ReadCache::key(node_->provider_->name(), item->id(),
+                           node_->store_size_, item->timestamp());
+        node_->chunk_.clear();
+        node_->chunk_size_ = 0;
+        if (!node_->upload_) {
+          // the file is clean, it's read from the provider from now on
+          node_->store_ = nullptr;
+          (void)std::remove(node_->cache_filename_.c_str());
+        }
+      }
+      for (auto&& s : sync_)
+        (s.version_ <= version_ ? sync : retry).push_back(s);
+    } else if (streamed_) {
+      log("streamed upload of", node_->filename(), "failed",
+          e.left()->description_);
+      node_->sequential_ = false;
+      retry = sync_;
+    } else {
+      sync = sync_;
+    }
+  }
+  if (!retry.empty()) fuse_->upload(node_, false, retry);
+  for (auto&& s : sync) s.callback_(e.left());
 }
 
+void FileSystem::Upload::progress(uint64_t, uint64_t) {}
+
 void FileSystem::mkdir(FileId parent, const char* name,
                        GetItemCallback callback) {
   auto node = get(parent);
@@ -619,6 +943,7 @@ void FileSystem::mkdir(FileId parent, const char* name,
          auto node = this->add(p, parent, e.right());
          auto it = node_directory_.find(parent);
          if (it != node_directory_.end()) it->second.insert(node->inode());
+         node_listing_.erase(parent);
          callback(std::static_pointer_cast<INode>(node));
        })});
 }
@@ -662,7 +987,7 @@ void FileSystem::download_item_async(std::shared_ptr<ICloudProvider> p,
         : start_(std::chrono::system_clock::now()), callback_(cb) {}
 
     void receivedData(const char* data, uint32_t length) override {
-      buffer_ += std::string(data, length);
+      buffer_.append(data, length);
     }
 
     void done(EitherError<void> e) override {
@@ -670,7 +995,7 @@ void FileSystem::download_item_async(std::shared_ptr<ICloudProvider> p,
                              std::chrono::system_clock::now() - start_)
                              .count());
       if (e.left()) return callback_(e.left());
-      callback_(buffer_);
+      callback_(string_buffer(std::move(buffer_)));
     }
 
     void progress(uint64_t, uint64_t) override {}
@@ -700,8 +1025,9 @@ std::string FileSystem::sanitize(const std::string& name) {
 
 IFileSystem::Pointer IFileSystem::create(
     const std::vector<ProviderEntry>& p, IHttp::Pointer http,
-    const std::string& temporary_directory) {
-  return util::make_unique<FileSystem>(p, std::move(http), temporary_directory);
+    const std::string& temporary_directory, uint64_t read_cache_size) {
+  return util::make_unique<FileSystem>(p, std::move(http), temporary_directory,
+                                       read_cache_size);
 }
 
 }  // namespace cloudstorage
@@ -5,6 +5,7 @@
 #include <condition_variable>
 #include <deque>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iomanip>
 #include <iostream>
@@ -14,15 +15,25 @@
 
 #include "ICloudStorage.h"
 #include "IFileSystem.h"
+#include "ReadCache.h"
 #include "Utility/Utility.h"
 
 namespace cloudstorage {
 
+// readahead window of a sequential stream starts at READ_AHEAD and doubles up
+// to MAX_READ_AHEAD while the stream keeps consuming it
 const int READ_AHEAD = 2 * 1024 * 1024;
-const int CACHED_CHUNK_COUNT = 4;
+const int MAX_READ_AHEAD = 64 * 1024 * 1024;
+const int MAX_PENDING_DOWNLOADS = 4;
+// sequentially written files are uploaded while they are being written once
+// they grow over WRITE_BACK_THRESHOLD, if the provider supports it
+const int WRITE_BACK_THRESHOLD = 8 * 1024 * 1024;
 const auto CACHE_DIRECTORY_DURATION = std::chrono::seconds(10);
 
 class FileSystem : public IFileSystem {
+ private:
+  class Upload;
+
  public:
   using mutex = std::recursive_mutex;
 
@@ -44,17 +55,10 @@ class FileSystem : public IFileSystem {
     IItem::Pointer item() const;
     std::shared_ptr<ICloudProvider> provider() const;
     std::shared_ptr<IGenericRequest> upload_request() const;
-    void set_upload_request(std::shared_ptr<IGenericRequest> r);
-    void set_size(uint64_t size);
 
    private:
     friend class FileSystem;
 
-    struct Chunk {
-      Range range_;
-      std::string data_;
-    };
-
     struct ReadRequest {
       Range range_;
       DownloadItemCallback callback_;
@@ -62,6 +66,20 @@ class FileSystem : public IFileSystem {
       bool operator==(const ReadRequest &r) const { return range_ == r.range_; }
     };
 
+    struct Chunk {
+      Range range_;
+      IBuffer::Pointer data_;
+    };
+
+    struct Stream {
+      // offset at which the stream's next read is expected
+      uint64_t next_;
+      // readahead window, 0 until the stream turns out to be sequential
+      uint64_t window_;
+      // end of data which was already downloaded or requested
+      uint64_t ahead_;
+    };
+
     mutex mutex_;
     std::shared_ptr<ICloudProvider> provider_;
     IItem::Pointer item_;
@@ -71,13 +89,27 @@ class FileSystem : public IFileSystem {
     std::shared_ptr<IGenericRequest> upload_request_;
     std::vector<ReadRequest> read_request_;
     std::vector<Range> pending_download_;
+    // stream of every handle which read the node
+    std::unordered_map<FileHandle, Stream> stream_;
+    // downloaded data which couldn't be put into read_cache_, oldest first, at
+    // most MAX_READ_AHEAD bytes of it
     std::deque<Chunk> chunk_;
+    uint64_t chunk_size_;
+    std::string read_cache_key_;
     std::string cache_filename_;
+    // staging file with everything written to the node
     std::unique_ptr<std::fstream> store_;
+    uint64_t store_size_;
+    // whether all writes so far appended to store_
+    bool sequential_;
+    // bumped by every write; store_ is clean if it equals uploaded_version_
+    uint64_t version_;
+    uint64_t uploaded_version_;
+    std::shared_ptr<Upload> upload_;
   };
 
   FileSystem(const std::vector<ProviderEntry> &, IHttp::Pointer http,
-             const std::string &temporary_directory);
+             const std::string &temporary_directory, uint64_t read_cache_size);
   ~FileSystem();
 
   FileId mknod(FileId parent, const char *name) override;
@@ -88,7 +120,9 @@ class FileSystem : public IFileSystem {
   void write(FileId node, const char *data, uint32_t size, uint64_t offset,
              WriteDataCallback) override;
   void readdir(FileId node, ListDirectoryCallback) override;
-  void read(FileId node, size_t offset, size_t size,
+  FileHandle open(FileId node) override;
+  void release(FileId node, FileHandle) override;
+  void read(FileId node, FileHandle, size_t offset, size_t size,
             DownloadItemCallback) override;
   void rename(FileId parent, const char *name, FileId newparent,
               const char *newname, RenameItemCallback) override;
@@ -103,6 +137,66 @@ class FileSystem : public IFileSystem {
     std::shared_ptr<IGenericRequest> request_;
   };
 
+  using Notification = std::function<void()>;
+
+  // snapshot of directory's children ordered by filename, kept until the
+  // directory changes
+  struct Listing {
+    INode::List nodes_;
+    // sanitized filename -> index in nodes_
+    std::unordered_map<std::string, size_t> index_;
+  };
+
+  /**
+   * Uploads node's staging file. Streamed upload is started before the size
+   * of the file is known and reads data as it's written; it's given the size
+   * by the first fsync. Callbacks of fsyncs are called once a version of the
+   * file at least as recent as the one they were waiting for is uploaded.
+   */
+  class Upload : public IUploadFileCallback {
+   public:
+    using Pointer = std::shared_ptr<Upload>;
+
+    Upload(FileSystem *, Node::Pointer, bool streamed);
+
+    uint32_t putData(char *data, uint32_t maxlength, uint64_t offset) override;
+    uint64_t size() override;
+    void waitData(uint64_t offset, uint64_t length,
+                  std::function<void(EitherError<uint64_t>)> ready) override;
+    void done(EitherError<IItem> e) override;
+    void progress(uint64_t, uint64_t) override;
+
+   private:
+    friend class FileSystem;
+
+    struct Wait {
+      uint64_t offset_;
+      uint64_t length_;
+      std::function<void(EitherError<uint64_t>)> ready_;
+    };
+
+    struct Sync {
+      uint64_t version_;
+      DataSynchronizedCallback callback_;
+    };
+
+    // answers waits which can be answered, has to be called with node's mutex
+    // locked and notifications have to be called after it's unlocked
+    void resolve(std::vector<Notification> &);
+
+    FileSystem *fuse_;
+    Node::Pointer node_;
+    bool streamed_;
+    // whether the size of the file is known
+    bool end_;
+    bool aborted_;
+    uint64_t version_;
+    // size of the uploaded version, once end_ is set
+    uint64_t size_;
+    std::vector<Wait> wait_;
+    std::vector<Sync> sync_;
+  };
+
   void add(RequestData r);
   Node::Pointer add(std::shared_ptr<ICloudProvider>, FileId parent,
                     IItem::Pointer);
@@ -110,8 +204,18 @@ class FileSystem : public IFileSystem {
   void set(FileId, Node::Pointer);
 
   Node::Pointer get(FileId node);
+  void list(FileId node, std::function<void(EitherError<Listing>)>);
+  std::shared_ptr<Listing> listing(const std::unordered_set<FileId> &);
   void get_path(FileId node, const std::string &path, GetItemCallback);
 
+  void read_ahead(Node::Pointer, FileHandle, Range);
+  bool available(Node &, Range);
+  void download(Node::Pointer, Range);
+
+  void stage(Node &);
+  void upload(Node::Pointer, bool streamed, std::vector<Upload::Sync>);
+  bool streaming(Node &);
+
   void invalidate(FileId);
   void cleanup();
   void cancelled();
@@ -132,15 +236,18 @@ class FileSystem : public IFileSystem {
   std::unordered_map<FileId, Node::Pointer> node_map_;
   std::unordered_map<std::string, Node::Pointer> node_id_map_;
   std::unordered_map<FileId, std::unordered_set<FileId>> node_directory_;
+  std::unordered_map<FileId, std::shared_ptr<Listing>> node_listing_;
   std::unordered_map<FileId, std::chrono::system_clock::time_point>
       node_timestamp_;
   std::unordered_map<std::string, FileId> auth_node_;
   FileId next_;
+  std::atomic<FileHandle> next_handle_;
   std::deque<RequestData> request_data_;
   std::deque<std::shared_ptr<IGenericRequest>> cancelled_request_;
   std::atomic_bool running_;
   IHttp::Pointer http_;
   std::string temporary_directory_;
+  ReadCache read_cache_;
   std::condition_variable_any cancelled_request_condition_;
   std::condition_variable_any request_data_condition_;
   std::future<void> cancelled_request_thread_;
@@ -67,6 +67,10 @@ IHttpRequest::Pointer HttpWrapper::create(const std::string &url,
 
 void ThreadPoolWrapper::schedule(const Task &f) { thread_pool_->schedule(f); }
 
+void ThreadPoolWrapper::schedule(Task &&f) {
+  thread_pool_->schedule(std::move(f));
+}
+
 IHttpServer::IResponse::Pointer HttpServerCallback::handle(
     const IHttpServer::IRequest &request) {
   auto code = request.get("code");
@@ -138,9 +142,12 @@ int fuse_run(fuse_args *args, fuse_cmdline_opts *opts, Json::Value &json) {
   auto temporary_directory = json["temporary_directory"].asString();
   if (temporary_directory.empty())
     temporary_directory = util::temporary_directory();
+  uint64_t read_cache_size = IFileSystem::DefaultReadCacheSize;
+  if (json.isMember("read_cache_size"))
+    read_cache_size = json["read_cache_size"].asUInt64();
   auto p = providers(json["providers"], http, thread_pool, temporary_directory);
   *ctx = IFileSystem::create(p, util::make_unique<HttpWrapper>(http),
-                             temporary_directory)
+                             temporary_directory, read_cache_size)
              .release();
   int ret = fuse.run(opts->singlethread, opts->clone_fd);
   for (size_t i = 0; i < p.size(); i++) {
@@ -36,6 +36,7 @@ class ThreadPoolWrapper : public IThreadPool {
       : thread_pool_(thread_pool) {}
 
   void schedule(const Task &f) override;
+  void schedule(Task &&f) override;
 
  private:
   std::shared_ptr<IThreadPool> thread_pool_;
@@ -47,7 +47,26 @@ int getattr(const char *path, struct FUSE_STAT *stat) {
 
 int opendir(const char *, struct fuse_file_info *) { return 0; }
 
-int open(const char *, struct fuse_file_info *f) { return 0; }
+int open(const char *path, struct fuse_file_info *fi) {
+  std::promise<IFileSystem::FileId> ret;
+  auto ctx = context();
+  ctx->getattr(path, [&](EitherError<IFileSystem::INode> e) {
+    ret.set_value(e.right() ? e.right()->inode() : 0);
+  });
+  fi->fh = ctx->open(ret.get_future().get());
+  return 0;
+}
+
+int release(const char *path, struct fuse_file_info *fi) {
+  std::promise<void> ret;
+  auto ctx = context();
+  ctx->getattr(path, [&](EitherError<IFileSystem::INode> e) {
+    if (e.right()) ctx->release(e.right()->inode(), fi->fh);
+    ret.set_value();
+  });
+  ret.get_future().get();
+  return 0;
+}
 
 int readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t,
             struct fuse_file_info *) {
@@ -68,13 +87,13 @@ int readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t,
 }
 
 int read(const char *path, char *buffer, size_t size, off_t offset,
-         struct fuse_file_info *) {
+         struct fuse_file_info *fi) {
   std::promise<int> ret;
   auto ctx = context();
   ctx->getattr(path, [&](EitherError<IFileSystem::INode> e) {
     if (e.left()) return ret.set_value(-ENOENT);
-    ctx->read(e.right()->inode(), offset, size,
-              [&](EitherError<std::string> e) {
+    ctx->read(e.right()->inode(), fi->fh, offset, size,
+              [&](EitherError<IFileSystem::IBuffer> e) {
                 if (e.left()) return ret.set_value(-EIO);
                 memcpy(buffer, e.right()->data(), e.right()->size());
                 ret.set_value(e.right()->size());
@@ -197,6 +216,7 @@ fuse_operations high_level_operations() {
   operations.readdir = readdir;
   operations.read = read;
   operations.open = open;
+  operations.release = release;
   operations.rename = rename;
   operations.mkdir = mkdir;
   operations.rmdir = remove;
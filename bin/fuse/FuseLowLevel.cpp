@@ -22,6 +22,26 @@ IFileSystem *context(fuse_req_t req) {
   return *static_cast<IFileSystem **>(fuse_req_userdata(req));
 }
 
+// snapshot of directory's children taken by opendir, offsets passed to
+// readdir index it
+using DirectoryHandle = std::shared_ptr<IFileSystem::INode::List>;
+
+fuse_entry_param entry(IFileSystem::INode::Pointer node) {
+  fuse_entry_param entry = {};
+  entry.ino = node->inode();
+  entry.attr = item_to_stat(node);
+  entry.attr_timeout = 1;
+  entry.entry_timeout = 1;
+  entry.generation = 1;
+  return entry;
+}
+
+void init(void *, struct fuse_conn_info *conn) {
+  if (conn->capable & FUSE_CAP_SPLICE_WRITE)
+    conn->want |= FUSE_CAP_SPLICE_WRITE;
+  if (conn->capable & FUSE_CAP_SPLICE_MOVE) conn->want |= FUSE_CAP_SPLICE_MOVE;
+}
+
 void getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *) {
   context(req)->getattr(ino, [=](EitherError<IFileSystem::INode> e) {
     if (auto i = e.right()) {
@@ -34,14 +54,73 @@ void getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *) {
   });
 }
 
-void opendir(fuse_req_t req, fuse_ino_t, struct fuse_file_info *fi) {
-  fuse_reply_open(req, fi);
+void opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+  auto info = *fi;
+  context(req)->readdir(
+      ino, [=](EitherError<std::vector<IFileSystem::INode::Pointer>> e) {
+        if (auto lst = e.right()) {
+          auto file_info = info;
+          file_info.fh = reinterpret_cast<uintptr_t>(new DirectoryHandle(lst));
+          if (fuse_reply_open(req, &file_info) != 0)
+            delete reinterpret_cast<DirectoryHandle *>(file_info.fh);
+        } else {
+          log("opendir:", e.left()->code_, e.left()->description_);
+          fuse_reply_err(req, ENOENT);
+        }
+      });
 }
 
-void open(fuse_req_t req, fuse_ino_t, struct fuse_file_info *fi) {
+void releasedir(fuse_req_t req, fuse_ino_t, struct fuse_file_info *fi) {
+  delete reinterpret_cast<DirectoryHandle *>(fi->fh);
+  fuse_reply_err(req, 0);
+}
+
+void reply_directory(fuse_req_t req, size_t size, off_t off,
+                     struct fuse_file_info *fi, bool plus) {
+  const auto &lst = **reinterpret_cast<DirectoryHandle *>(fi->fh);
+  // reused by all replies of the thread, fuse_reply_buf copies it
+  thread_local std::vector<char> buffer;
+  buffer.resize(size);
+  size_t length = 0;
+  for (size_t i = off; i < lst.size(); i++) {
+    auto name = context(req)->sanitize(lst[i]->filename());
+    size_t entry_size;
+    if (plus) {
+      auto param = entry(lst[i]);
+      entry_size = fuse_add_direntry_plus(req, buffer.data() + length,
+                                          size - length, name.c_str(), &param,
+                                          i + 1);
+    } else {
+      auto stat = item_to_stat(lst[i]);
+      entry_size = fuse_add_direntry(req, buffer.data() + length,
+                                     size - length, name.c_str(), &stat, i + 1);
+    }
+    if (length + entry_size > size) break;
+    length += entry_size;
+  }
+  fuse_reply_buf(req, buffer.data(), length);
+}
+
+void readdir(fuse_req_t req, fuse_ino_t, size_t size, off_t off,
+             struct fuse_file_info *fi) {
+  reply_directory(req, size, off, fi, false);
+}
+
+void readdirplus(fuse_req_t req, fuse_ino_t, size_t size, off_t off,
+                 struct fuse_file_info *fi) {
+  reply_directory(req, size, off, fi, true);
+}
+
+void open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+  fi->fh = context(req)->open(ino);
   fuse_reply_open(req, fi);
 }
 
+void release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+  context(req)->release(ino, fi->fh);
+  fuse_reply_err(req, 0);
+}
+
 void fsync(fuse_req_t req, fuse_ino_t ino, int, struct fuse_file_info *) {
   context(req)->fsync(ino, [=](EitherError<void> e) {
     if (e.left()) {
@@ -57,41 +136,25 @@ void flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *f) {
 }
 
 void read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
-          struct fuse_file_info *) {
-  context(req)->read(ino, off, size, [=](EitherError<std::string> e) {
-    if (auto data = e.right()) {
-      fuse_reply_buf(req, data->data(), data->size());
-    } else {
-      log("read:", e.left()->code_, e.left()->description_);
-      fuse_reply_err(req, ENOENT);
-    }
-  });
-}
-
-void readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
-             struct fuse_file_info *) {
-  context(req)->readdir(
-      ino, [=](EitherError<std::vector<IFileSystem::INode::Pointer>> e) {
-        if (auto lst = e.right()) {
-          std::string data;
-          for (size_t i = off; i < lst->size(); i++) {
-            auto item = lst->at(i);
-            auto name = context(req)->sanitize(item->filename());
-            auto sz =
-                fuse_add_direntry(req, nullptr, 0, name.c_str(), nullptr, 0);
-            if (data.size() + sz > size) {
-              fuse_reply_buf(req, data.data(), data.size());
-              return;
-            }
-            std::vector<char> buffer(sz);
-            auto stat = item_to_stat(lst->at(i));
-            fuse_add_direntry(req, buffer.data(), buffer.size(), name.c_str(),
-                              &stat, i + 1);
-            data += std::string(buffer.begin(), buffer.end());
+          struct fuse_file_info *fi) {
+  context(req)->read(
+      ino, fi->fh, off, size, [=](EitherError<IFileSystem::IBuffer> e) {
+        if (auto data = e.right()) {
+          // data backed by a cache file is spliced into the reply if the
+          // kernel supports it; data is consumed before fuse_reply_data
+          // returns
+          fuse_bufvec buffer = FUSE_BUFVEC_INIT(data->size());
+          if (data->descriptor() != -1) {
+            buffer.buf[0].flags =
+                static_cast<fuse_buf_flags>(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+            buffer.buf[0].fd = data->descriptor();
+            buffer.buf[0].pos = data->offset();
+          } else {
+            buffer.buf[0].mem = const_cast<char *>(data->data());
           }
-          fuse_reply_buf(req, data.data(), data.size());
+          fuse_reply_data(req, &buffer, FUSE_BUF_SPLICE_MOVE);
         } else {
-          log("readdir:", e.left()->code_, e.left()->description_);
+          log("read:", e.left()->code_, e.left()->description_);
           fuse_reply_err(req, ENOENT);
         }
       });
@@ -100,13 +163,8 @@ void readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
 void lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
   context(req)->lookup(parent, name, [=](EitherError<IFileSystem::INode> e) {
     if (auto node = e.right()) {
-      fuse_entry_param entry = {};
-      entry.ino = node->inode();
-      entry.attr = item_to_stat(node);
-      entry.attr_timeout = 1;
-      entry.entry_timeout = 1;
-      entry.generation = 1;
-      fuse_reply_entry(req, &entry);
+      auto param = entry(node);
+      fuse_reply_entry(req, &param);
     } else {
       log("lookup:", name, e.left()->code_, e.left()->description_);
       fuse_reply_err(req, ENOENT);
@@ -132,14 +190,8 @@ void mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t) {
       log("mkdir:", e.left()->code_, e.left()->description_);
       fuse_reply_err(req, ENOSYS);
     } else {
-      auto node = e.right();
-      fuse_entry_param entry = {};
-      entry.ino = node->inode();
-      entry.attr = item_to_stat(node);
-      entry.attr_timeout = 1;
-      entry.entry_timeout = 1;
-      entry.generation = 1;
-      fuse_reply_entry(req, &entry);
+      auto param = entry(e.right());
+      fuse_reply_entry(req, &param);
     }
   });
 }
@@ -191,12 +243,16 @@ void write(fuse_req_t req, fuse_ino_t ino, const char *data, size_t size,
 
 fuse_lowlevel_ops low_level_operations() {
   fuse_lowlevel_ops operations = {};
+  operations.init = init;
   operations.getattr = getattr;
   operations.opendir = opendir;
   operations.readdir = readdir;
+  operations.readdirplus = readdirplus;
+  operations.releasedir = releasedir;
   operations.lookup = lookup;
   operations.read = read;
   operations.open = open;
+  operations.release = release;
   operations.rename = rename;
   operations.mkdir = mkdir;
   operations.rmdir = remove;
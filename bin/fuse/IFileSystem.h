@@ -15,9 +15,11 @@ class IFileSystem {
   class INode;
 
   using FileId = uint64_t;
+  using FileHandle = uint64_t;
   using Pointer = std::unique_ptr<IFileSystem>;
 
   static constexpr int NotEmpty = 1001;
+  static constexpr uint64_t DefaultReadCacheSize = 512 * 1024 * 1024;
 
   class INode {
    public:
@@ -33,9 +35,30 @@ class IFileSystem {
     virtual IItem::FileType type() const = 0;
   };
 
+  /**
+   * Read-only view of data read from a file, valid as long as the view exists.
+   * If the data is backed by a file, descriptor() can be used to read it at
+   * offset() without copying it through user space.
+   */
+  class IBuffer {
+   public:
+    using Pointer = std::shared_ptr<IBuffer>;
+
+    virtual ~IBuffer() = default;
+
+    virtual const char *data() const = 0;
+    virtual uint64_t size() const = 0;
+
+    /**
+     * @return file descriptor holding the data or -1
+     */
+    virtual int descriptor() const { return -1; }
+    virtual uint64_t offset() const { return 0; }
+  };
+
   using ListDirectoryCallback = GenericCallback<EitherError<INode::List>>;
   using GetItemCallback = GenericCallback<EitherError<INode>>;
-  using DownloadItemCallback = GenericCallback<EitherError<std::string>>;
+  using DownloadItemCallback = GenericCallback<EitherError<IBuffer>>;
   using WriteDataCallback = GenericCallback<EitherError<uint32_t>>;
   using DataSynchronizedCallback = GenericCallback<EitherError<void>>;
 
@@ -46,9 +69,14 @@ class IFileSystem {
 
   virtual ~IFileSystem() = default;
 
+  /**
+   * @param read_cache_size maximum size of blocks cached in
+   * temporary_directory, 0 disables the cache
+   */
   static IFileSystem::Pointer create(const std::vector<ProviderEntry> &,
                                      IHttp::Pointer http,
-                                     const std::string &temporary_directory);
+                                     const std::string &temporary_directory,
+                                     uint64_t read_cache_size);
 
   virtual std::string sanitize(const std::string &filename) = 0;
 
@@ -66,7 +94,15 @@ class IFileSystem {
 
   virtual void readdir(FileId node, ListDirectoryCallback) = 0;
 
-  virtual void read(FileId node, size_t offset, size_t size,
+  /**
+   * Returns a new handle for reading node; sequential reads are detected and
+   * read ahead separately for every handle.
+   */
+  virtual FileHandle open(FileId node) = 0;
+
+  virtual void release(FileId node, FileHandle) = 0;
+
+  virtual void read(FileId node, FileHandle, size_t offset, size_t size,
                     DownloadItemCallback) = 0;
 
   virtual void rename(FileId parent, const char *name, FileId newparent,
@@ -0,0 +1,445 @@
+#include "ReadCache.h"
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+constexpr uint64_t ReadCache::BlockSize;
+
+std::string ReadCache::key(const std::string& provider, const std::string& id,
+                           uint64_t size,
+                           std::chrono::system_clock::time_point timestamp) {
+  return provider + "/" + std::to_string(size) + "/" +
+         std::to_string(timestamp.time_since_epoch().count()) + "/" + id;
+}
+
+#ifndef _WIN32
+
+namespace {
+
+const std::string INDEX_EXTENSION = ".blocks";
+
+std::string file_name(const std::string& key) {
+  uint64_t hash = 14695981039346656037ull;
+  for (auto c : key) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ull;
+  }
+  std::stringstream stream;
+  stream << std::hex << std::setfill('0') << std::setw(16) << hash;
+  return stream.str();
+}
+
+}  // namespace
+
+ReadCache::Buffer::Buffer() : cache_(), data_(), size_() {}
+
+ReadCache::Buffer::Buffer(Buffer&& buffer)
+    : cache_(buffer.cache_),
+      file_(std::move(buffer.file_)),
+      data_(buffer.data_),
+      size_(buffer.size_) {
+  buffer.cache_ = nullptr;
+}
+
+ReadCache::Buffer& ReadCache::Buffer::operator=(Buffer&& buffer) {
+  if (this != &buffer) {
+    release();
+    cache_ = buffer.cache_;
+    file_ = std::move(buffer.file_);
+    data_ = buffer.data_;
+    size_ = buffer.size_;
+    buffer.cache_ = nullptr;
+  }
+  return *this;
+}
+
+ReadCache::Buffer::~Buffer() { release(); }
+
+int ReadCache::Buffer::descriptor() const {
+  return file_ ? file_->descriptor_ : -1;
+}
+
+uint64_t ReadCache::Buffer::offset() const {
+  return file_ ? data_ - file_->map_ : 0;
+}
+
+void ReadCache::Buffer::release() {
+  if (!cache_) return;
+  std::lock_guard<std::mutex> lock(cache_->mutex_);
+  file_->readers_--;
+  file_ = nullptr;
+  cache_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+ReadCache::File::File(const std::string& key, const std::string& path,
+                      uint64_t size, int descriptor, Lru::iterator end)
+    : key_(key),
+      path_(path),
+      size_(size),
+      descriptor_(descriptor),
+      map_(),
+      readers_(),
+      cached_(),
+      block_((size + BlockSize - 1) / BlockSize, end),
+      busy_(block_.size()),
+      busy_count_(),
+      removed_(),
+      version_(),
+      saved_version_() {}
+
+ReadCache::File::~File() {
+  if (map_) munmap(map_, size_);
+  close(descriptor_);
+}
+
+ReadCache::ReadCache(const std::string& directory, uint64_t size_limit)
+    : directory_(directory), size_limit_(size_limit), size_() {
+  if (size_limit_ == 0) return;
+  if (mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+    util::log("couldn't create read cache directory", directory_);
+    size_limit_ = 0;
+    return;
+  }
+  load();
+}
+
+ReadCache::~ReadCache() {
+  lru_.clear();
+  file_.clear();
+}
+
+bool ReadCache::get(const std::string& key, uint64_t offset, uint64_t length,
+                    Buffer& buffer) {
+  buffer.release();
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto file = find(key);
+  if (!file || !cached(*file, offset, length)) return false;
+  if (!file->map_) {
+    auto map = mmap(nullptr, file->size_, PROT_READ, MAP_SHARED,
+                    file->descriptor_, 0);
+    if (map == MAP_FAILED) return false;
+    file->map_ = static_cast<char*>(map);
+  }
+  for (auto i = offset / BlockSize; i * BlockSize < offset + length; i++)
+    lru_.splice(lru_.begin(), lru_, file->block_[i]);
+  file->readers_++;
+  buffer.cache_ = this;
+  buffer.file_ = file;
+  buffer.data_ = file->map_ + offset;
+  buffer.size_ = length;
+  return true;
+}
+
+bool ReadCache::contains(const std::string& key, uint64_t offset,
+                         uint64_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto file = find(key);
+  return file && cached(*file, offset, length);
+}
+
+bool ReadCache::put(const std::string& key, uint64_t size, uint64_t offset,
+                    const char* data, uint64_t length) {
+  if (key.empty() || size == 0 || size_limit_ == 0) return false;
+  std::shared_ptr<File> file;
+  std::vector<uint64_t> blocks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file = find(key);
+    if (!file) file = create(key, size);
+    if (!file) return false;
+    for (auto i = (offset + BlockSize - 1) / BlockSize;
+         i < file->block_.size(); i++) {
+      auto end = i * BlockSize + block_size(*file, i);
+      if (end > offset + length) break;
+      if (file->block_[i] != lru_.end() || file->busy_[i]) continue;
+      busy(*file, i, true);
+      blocks.push_back(i);
+    }
+  }
+  std::vector<uint64_t> written;
+  for (auto i : blocks) {
+    auto start = i * BlockSize;
+    auto length = block_size(*file, i);
+    auto result =
+        pwrite(file->descriptor_, data + (start - offset), length, start);
+    if (result != static_cast<ssize_t>(length)) break;
+    written.push_back(i);
+  }
+  if (!written.empty() && fdatasync(file->descriptor_) != 0) written.clear();
+  std::vector<Index> indexes;
+  std::vector<Eviction> evicted;
+  bool stored;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto i : blocks) busy(*file, i, false);
+    if (!file->removed_) {
+      for (auto i : written) insert(*file, i, true);
+      if (!written.empty()) indexes.push_back(index(file));
+      evict(indexes, evicted);
+    }
+    stored = !file->removed_ && cached(*file, offset, length);
+    if (!file->removed_ && file->cached_ == 0 && file->busy_count_ == 0)
+      remove(file);
+  }
+  finish(indexes, evicted);
+  return stored;
+}
+
+std::shared_ptr<ReadCache::File> ReadCache::find(const std::string& key) {
+  auto it = file_.find(key);
+  return it == file_.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<ReadCache::File> ReadCache::create(const std::string& key,
+                                                   uint64_t size) {
+  auto path = directory_ + file_name(key);
+  auto collision = std::find_if(
+      file_.begin(), file_.end(),
+      [&](const std::pair<const std::string, std::shared_ptr<File>>& f) {
+        return f.second->path_ == path;
+      });
+  if (collision != file_.end()) remove(collision->second);
+  int descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if (descriptor == -1) return nullptr;
+  if (ftruncate(descriptor, size) != 0) {
+    close(descriptor);
+    unlink(path.c_str());
+    return nullptr;
+  }
+  auto file =
+      std::make_shared<File>(key, path, size, descriptor, lru_.end());
+  file_[key] = file;
+  return file;
+}
+
+bool ReadCache::cached(const File& file, uint64_t offset,
+                       uint64_t length) const {
+  if (length == 0 || offset + length > file.size_) return false;
+  for (auto i = offset / BlockSize; i * BlockSize < offset + length; i++)
+    if (file.block_[i] == lru_.end()) return false;
+  return true;
+}
+
+uint64_t ReadCache::block_size(const File& file, uint64_t index) const {
+  return std::min(BlockSize, file.size_ - index * BlockSize);
+}
+
+void ReadCache::insert(File& file, uint64_t index, bool front) {
+  auto it = lru_.insert(front ? lru_.begin() : lru_.end(), {&file, index});
+  file.block_[index] = it;
+  file.cached_++;
+  size_ += block_size(file, index);
+}
+
+void ReadCache::busy(File& file, uint64_t index, bool busy) {
+  file.busy_[index] = busy;
+  if (busy)
+    file.busy_count_++;
+  else
+    file.busy_count_--;
+}
+
+ReadCache::Index ReadCache::index(std::shared_ptr<File> file) {
+  std::string bitmap((file->block_.size() + 7) / 8, 0);
+  for (size_t i = 0; i < file->block_.size(); i++)
+    if (file->block_[i] != lru_.end()) bitmap[i / 8] |= 1 << (i % 8);
+  return {file, bitmap, ++file->version_};
+}
+
+void ReadCache::save(const Index& index) {
+  auto& file = *index.file_;
+  std::lock_guard<std::mutex> lock(file.index_mutex_);
+  if (file.removed_ || index.version_ <= file.saved_version_) return;
+  std::ofstream stream(file.path_ + INDEX_EXTENSION,
+                       std::ios::binary | std::ios::trunc);
+  stream << file.key_ << "\n" << file.size_ << "\n" << index.bitmap_;
+  file.saved_version_ = index.version_;
+}
+
+void ReadCache::remove(std::shared_ptr<File> file) {
+  for (auto&& block : file->block_)
+    if (block != lru_.end()) {
+      size_ -= block_size(*file, block->index_);
+      lru_.erase(block);
+      block = lru_.end();
+    }
+  file->cached_ = 0;
+  {
+    std::lock_guard<std::mutex> lock(file->index_mutex_);
+    file->removed_ = true;
+    unlink((file->path_ + INDEX_EXTENSION).c_str());
+    unlink(file->path_.c_str());
+  }
+  file_.erase(file->key_);
+}
+
+void ReadCache::evict(std::vector<Index>& indexes,
+                      std::vector<Eviction>& evicted) {
+  std::vector<File*> modified;
+  auto it = lru_.end();
+  while (size_ > size_limit_ && it != lru_.begin()) {
+    auto block = std::prev(it);
+    auto file = block->file_;
+    if (file->readers_ > 0) {
+      it = block;
+      continue;
+    }
+    size_ -= block_size(*file, block->index_);
+    file->block_[block->index_] = lru_.end();
+    file->cached_--;
+    if (std::find(modified.begin(), modified.end(), file) == modified.end())
+      modified.push_back(file);
+    evicted.push_back({file_[file->key_], block->index_});
+    lru_.erase(block);
+  }
+  for (auto file : modified)
+    if (file->cached_ == 0 && file->busy_count_ == 0) {
+      remove(file_[file->key_]);
+    } else {
+      indexes.push_back(index(file_[file->key_]));
+    }
+  evicted.erase(std::remove_if(evicted.begin(), evicted.end(),
+                               [](const Eviction& e) {
+                                 return e.file_->removed_;
+                               }),
+                evicted.end());
+  for (auto&& e : evicted) busy(*e.file_, e.index_, true);
+}
+
+void ReadCache::finish(const std::vector<Index>& indexes,
+                       const std::vector<Eviction>& evicted) {
+  // indexes drop evicted blocks before their data is punched out
+  for (auto&& index : indexes) save(index);
+  if (evicted.empty()) return;
+#ifdef FALLOC_FL_PUNCH_HOLE
+  for (auto&& e : evicted)
+    (void)fallocate(e.file_->descriptor_,
+                    FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    e.index_ * BlockSize, block_size(*e.file_, e.index_));
+#endif
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto&& e : evicted) busy(*e.file_, e.index_, false);
+  for (auto&& e : evicted)
+    if (!e.file_->removed_ && e.file_->cached_ == 0 &&
+        e.file_->busy_count_ == 0)
+      remove(e.file_);
+}
+
+void ReadCache::load() {
+  struct Entry {
+    time_t time_;
+    std::shared_ptr<File> file_;
+    std::string bitmap_;
+  };
+  std::vector<Entry> entries;
+  auto directory = opendir(directory_.c_str());
+  if (!directory) return;
+  while (auto entry = readdir(directory)) {
+    std::string name = entry->d_name;
+    if (name.size() <= INDEX_EXTENSION.size() ||
+        name.compare(name.size() - INDEX_EXTENSION.size(),
+                     INDEX_EXTENSION.size(), INDEX_EXTENSION) != 0)
+      continue;
+    auto path = directory_ + name.substr(0, name.size() - INDEX_EXTENSION.size());
+    std::ifstream stream(path + INDEX_EXTENSION, std::ios::binary);
+    std::string key, size;
+    std::getline(stream, key);
+    std::getline(stream, size);
+    std::string bitmap{std::istreambuf_iterator<char>(stream),
+                       std::istreambuf_iterator<char>()};
+    struct stat status;
+    int descriptor = open(path.c_str(), O_RDWR);
+    std::shared_ptr<File> file;
+    if (descriptor != -1 && fstat(descriptor, &status) == 0 &&
+        file_name(key) == path.substr(directory_.size())) {
+      try {
+        file = std::make_shared<File>(key, path, std::stoull(size), descriptor,
+                                      lru_.end());
+      } catch (const std::exception&) {
+      }
+    }
+    if (!file || file->size_ == 0 ||
+        static_cast<uint64_t>(status.st_size) != file->size_ ||
+        bitmap.size() != (file->block_.size() + 7) / 8) {
+      if (!file && descriptor != -1) close(descriptor);
+      unlink((path + INDEX_EXTENSION).c_str());
+      unlink(path.c_str());
+      continue;
+    }
+    entries.push_back({status.st_mtime, file, bitmap});
+  }
+  closedir(directory);
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& e1, const Entry& e2) { return e1.time_ > e2.time_; });
+  for (auto&& entry : entries) {
+    auto& file = *entry.file_;
+    for (uint64_t i = 0; i < file.block_.size(); i++)
+      if (entry.bitmap_[i / 8] & (1 << (i % 8))) insert(file, i, false);
+    if (file.cached_ == 0) {
+      unlink((file.path_ + INDEX_EXTENSION).c_str());
+      unlink(file.path_.c_str());
+    } else {
+      file_[file.key_] = entry.file_;
+    }
+  }
+  std::vector<Index> indexes;
+  std::vector<Eviction> evicted;
+  evict(indexes, evicted);
+  finish(indexes, evicted);
+}
+
+#else
+
+ReadCache::Buffer::Buffer() : cache_(), data_(), size_() {}
+
+ReadCache::Buffer::Buffer(Buffer&&) : cache_(), data_(), size_() {}
+
+ReadCache::Buffer& ReadCache::Buffer::operator=(Buffer&&) { return *this; }
+
+ReadCache::Buffer::~Buffer() {}
+
+int ReadCache::Buffer::descriptor() const { return -1; }
+
+uint64_t ReadCache::Buffer::offset() const { return 0; }
+
+void ReadCache::Buffer::release() {}
+
+ReadCache::ReadCache(const std::string& directory, uint64_t)
+    : directory_(directory), size_limit_(), size_() {}
+
+ReadCache::~ReadCache() {}
+
+bool ReadCache::get(const std::string&, uint64_t, uint64_t, Buffer&) {
+  return false;
+}
+
+bool ReadCache::contains(const std::string&, uint64_t, uint64_t) {
+  return false;
+}
+
+bool ReadCache::put(const std::string&, uint64_t, uint64_t, const char*,
+                    uint64_t) {
+  return false;
+}
+
+#endif  // _WIN32
+
+}  // namespace cloudstorage
@@ -0,0 +1,170 @@
+#ifndef READ_CACHE_H
+#define READ_CACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cloudstorage {
+
+/**
+ * Persistent cache of file blocks read through the FileSystem, shared by all
+ * of its nodes.
+ *
+ * Every cached file is kept as a sparse file in the cache directory, named
+ * after a hash of its key, next to a "<name>.blocks" index holding the key and
+ * a bitmap of cached blocks, so the cache survives remounts. Blocks are synced
+ * to disk before the index lists them. Once the cache grows over its size
+ * limit, least recently used blocks are evicted and punched out of their files.
+ * Hits are served from a shared memory mapping of the file, blocks are pinned
+ * until the returned Buffer is destroyed.
+ *
+ * Block data and indexes are written without holding the cache's lock, blocks
+ * being written or punched out are busy and skipped by other writers.
+ *
+ * The cache is always disabled on Windows.
+ */
+class ReadCache {
+ private:
+  struct File;
+
+ public:
+  static constexpr uint64_t BlockSize = 1024 * 1024;
+
+  class Buffer {
+   public:
+    Buffer();
+    Buffer(Buffer&&);
+    Buffer& operator=(Buffer&&);
+    ~Buffer();
+
+    const char* data() const { return data_; }
+    uint64_t size() const { return size_; }
+    // cache file holding the data and data's position in it
+    int descriptor() const;
+    uint64_t offset() const;
+
+   private:
+    friend class ReadCache;
+
+    void release();
+
+    ReadCache* cache_;
+    std::shared_ptr<File> file_;
+    const char* data_;
+    uint64_t size_;
+  };
+
+  /**
+   * @param directory existing directory or directory which can be created,
+   * with a trailing separator
+   * @param size_limit maximum number of cached bytes, 0 disables the cache
+   */
+  ReadCache(const std::string& directory, uint64_t size_limit);
+  ~ReadCache();
+
+  /**
+   * @return whether blocks can be cached, false if the cache was disabled or
+   * its directory couldn't be created
+   */
+  bool enabled() const { return size_limit_ > 0; }
+
+  /**
+   * Files whose size or timestamp changed get a different key.
+   */
+  static std::string key(const std::string& provider, const std::string& id,
+                         uint64_t size,
+                         std::chrono::system_clock::time_point timestamp);
+
+  /**
+   * @return whether all blocks covering the range were cached; if so, buffer
+   * points to the range's data
+   */
+  bool get(const std::string& key, uint64_t offset, uint64_t length,
+           Buffer& buffer);
+
+  bool contains(const std::string& key, uint64_t offset, uint64_t length);
+
+  /**
+   * Stores blocks fully covered by data, the last block of the file is covered
+   * if data reaches the end of the file.
+   *
+   * @return whether the whole range of data can be read from the cache
+   */
+  bool put(const std::string& key, uint64_t size, uint64_t offset,
+           const char* data, uint64_t length);
+
+ private:
+  struct Block {
+    File* file_;
+    uint64_t index_;
+  };
+
+  using Lru = std::list<Block>;
+
+  // bitmap of file's cached blocks, saved after version_ was bumped to version
+  struct Index {
+    std::shared_ptr<File> file_;
+    std::string bitmap_;
+    uint64_t version_;
+  };
+
+  // evicted block which is still to be punched out of its file
+  struct Eviction {
+    std::shared_ptr<File> file_;
+    uint64_t index_;
+  };
+
+  struct File {
+    File(const std::string& key, const std::string& path, uint64_t size,
+         int descriptor, Lru::iterator end);
+    ~File();
+
+    std::string key_;
+    std::string path_;
+    uint64_t size_;
+    int descriptor_;
+    char* map_;
+    uint32_t readers_;
+    uint64_t cached_;
+    // lru entry of every block or Lru::end if the block isn't cached
+    std::vector<Lru::iterator> block_;
+    // blocks being written or punched out
+    std::vector<bool> busy_;
+    uint32_t busy_count_;
+    bool removed_;
+    uint64_t version_;
+    // guards the index file, removed_ is also set under it
+    std::mutex index_mutex_;
+    uint64_t saved_version_;
+  };
+
+  std::shared_ptr<File> find(const std::string& key);
+  std::shared_ptr<File> create(const std::string& key, uint64_t size);
+  bool cached(const File&, uint64_t offset, uint64_t length) const;
+  uint64_t block_size(const File&, uint64_t index) const;
+  void insert(File&, uint64_t index, bool front);
+  void busy(File&, uint64_t index, bool);
+  Index index(std::shared_ptr<File>);
+  void save(const Index&);
+  void remove(std::shared_ptr<File>);
+  void evict(std::vector<Index>&, std::vector<Eviction>&);
+  void finish(const std::vector<Index>&, const std::vector<Eviction>&);
+  void load();
+
+  std::mutex mutex_;
+  std::string directory_;
+  uint64_t size_limit_;
+  uint64_t size_;
+  Lru lru_;
+  std::unordered_map<std::string, std::shared_ptr<File>> file_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // READ_CACHE_H
@@ -0,0 +1,28 @@
+#!/bin/sh
+# Measures sequential read throughput of libcloudstorage-fuse with dd at
+# several block sizes.
+#
+# usage: read_benchmark.sh FILE [REGION_MB]
+#
+# FILE should be a large file on a mount of a local provider, e.g. one created
+# with "dd if=/dev/urandom of=<local provider path>/big bs=1M count=2048". Every
+# block size reads its own REGION_MB (default 256) megabytes of the file, so
+# runs aren't served from data cached by the previous ones; the file has to be
+# at least 5 * REGION_MB megabytes large.
+
+file="$1"
+region="${2:-256}"
+
+if [ -z "$file" ]; then
+  echo "usage: $0 FILE [REGION_MB]" >&2
+  exit 1
+fi
+
+index=0
+for bs in 4K 64K 128K 1M 4M; do
+  printf "%-6s" "$bs"
+  dd if="$file" of=/dev/null bs="$bs" iflag=skip_bytes,count_bytes \
+    skip=$((index * region * 1024 * 1024)) count=$((region * 1024 * 1024)) \
+    2>&1 | tail -n 1
+  index=$((index + 1))
+done
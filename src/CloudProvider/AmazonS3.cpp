@@ -26,9 +26,11 @@
 #include <json/json.h>
 #include <tinyxml2.h>
 #include <algorithm>
-#include <iomanip>
+#include <cctype>
+#include <ctime>
 
-#include "Request/RecursiveRequest.h"
+#include "Request/ParallelTasks.h"
+#include "Request/UploadFileRequest.h"
 #include "Utility/Utility.h"
 
 using namespace std::placeholders;
@@ -37,6 +39,70 @@ namespace cloudstorage {
 
 namespace {
 
+const uint64_t DEFAULT_UPLOAD_PART_SIZE = 16 * 1024 * 1024;
+const uint64_t MIN_UPLOAD_PART_SIZE = 5 * 1024 * 1024;
+const uint64_t MAX_PART_COUNT = 10000;
+const uint64_t MAX_OBJECT_SIZE = 5ull * 1024 * 1024 * 1024 * 1024;
+const uint64_t MAX_COPY_OBJECT_SIZE = 5ull * 1024 * 1024 * 1024;
+const uint64_t COPY_PART_SIZE = 1024 * 1024 * 1024;
+const uint32_t DELETE_BATCH_SIZE = 1000;
+const uint32_t BULK_PARALLELISM = 16;
+const std::string SERVICE = "s3";
+
+std::string escapeXml(const std::string& str) {
+  std::string result;
+  for (auto c : str)
+    switch (c) {
+      case '&':
+        result += "&amp;";
+        break;
+      case '<':
+        result += "&lt;";
+        break;
+      case '>':
+        result += "&gt;";
+        break;
+      default:
+        result += c;
+    }
+  return result;
+}
+
+/**
+ * Parses S3's xml response; some requests report errors with 200 OK, those
+ * are thrown like parse errors.
+ */
+tinyxml2::XMLElement* parseResponse(tinyxml2::XMLDocument& document,
+                                    std::istream& response) {
+  std::stringstream sstream;
+  sstream << response.rdbuf();
+  if (document.Parse(sstream.str().c_str()) != tinyxml2::XML_SUCCESS)
+    throw std::logic_error(util::Error::FAILED_TO_PARSE_XML);
+  if (document.RootElement()->Name() == std::string("Error"))
+    throw std::logic_error(sstream.str());
+  return document.RootElement();
+}
+
+EitherError<void> copyResult(EitherError<Response> e) {
+  if (e.left()) return e.left();
+  try {
+    tinyxml2::XMLDocument document;
+    parseResponse(document, e.right()->output());
+    return nullptr;
+  } catch (const std::exception& e) {
+    return Error{IHttpRequest::Failure, e.what()};
+  }
+}
+
+void writeCompleteMultipartUpload(std::ostream& stream,
+                                  const std::vector<std::string>& tags) {
+  stream << "<CompleteMultipartUpload>";
+  for (size_t i = 0; i < tags.size(); i++)
+    stream << "<Part><PartNumber>" << i + 1 << "</PartNumber><ETag>"
+           << tags[i] << "</ETag></Part>";
+  stream << "</CompleteMultipartUpload>";
+}
+
 std::string escapePath(const std::string& str) {
   std::string data = util::Url::escape(str);
   std::string slash = util::Url::escape("/");
@@ -52,34 +118,57 @@ std::string escapePath(const std::string& str) {
   return result;
 }
 
-std::string currentDate() {
-  auto time =
+// sets date to YYYYMMDD and time to YYYYMMDDTHHMMSSZ of the same moment
+void currentDateAndTime(std::string& date, std::string& time) {
+  auto tm =
       util::gmtime(std::chrono::duration_cast<std::chrono::seconds>(
                        std::chrono::system_clock::now().time_since_epoch())
                        .count());
-  std::stringstream ss;
-  ss << std::put_time(&time, "%Y%m%d");
-  return ss.str();
+  char buffer[sizeof("YYYYMMDDTHHMMSSZ")];
+  strftime(buffer, sizeof(buffer), "%Y%m%dT%H%M%SZ", &tm);
+  time = buffer;
+  date = time.substr(0, 8);
+}
+
+void appendEscaped(std::string& buffer, const std::string& value) {
+  const char* digits = "0123456789ABCDEF";
+  for (auto c : value) {
+    if (std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ||
+        c == '.' || c == '~') {
+      buffer += c;
+    } else {
+      buffer += '%';
+      buffer += digits[static_cast<unsigned char>(c) >> 4];
+      buffer += digits[c & 0xF];
+    }
+  }
 }
 
-std::string currentDateAndTime() {
-  auto time =
-      util::gmtime(std::chrono::duration_cast<std::chrono::seconds>(
-                       std::chrono::system_clock::now().time_since_epoch())
-                       .count());
-  std::stringstream ss;
-  ss << std::put_time(&time, "%Y%m%dT%H%M%SZ");
-  return ss.str();
+void appendLower(std::string& buffer, const std::string& value) {
+  for (auto c : value) buffer += std::tolower(static_cast<unsigned char>(c));
+}
+
+bool lessIgnoreCase(const std::string& s1, const std::string& s2) {
+  return std::lexicographical_compare(
+      s1.begin(), s1.end(), s2.begin(), s2.end(), [](char c1, char c2) {
+        return std::tolower(static_cast<unsigned char>(c1)) <
+               std::tolower(static_cast<unsigned char>(c2));
+      });
 }
 
 }  // namespace
 
-AmazonS3::AmazonS3() : CloudProvider(util::make_unique<Auth>()) {}
+AmazonS3::AmazonS3()
+    : CloudProvider(util::make_unique<Auth>()),
+      part_size_(DEFAULT_UPLOAD_PART_SIZE) {}
 
 void AmazonS3::initialize(InitData&& init_data) {
   if (init_data.token_.empty())
     init_data.token_ = credentialsToString(Json::Value(Json::objectValue));
   unpackCredentials(init_data.token_);
+  setWithHint(init_data.hints_, "upload_part_size", [this](std::string v) {
+    part_size_ = std::max<uint64_t>(std::stoull(v), MIN_UPLOAD_PART_SIZE);
+  });
   CloudProvider::initialize(std::move(init_data));
 }
 
@@ -163,76 +252,16 @@ AuthorizeRequest::Pointer AmazonS3::authorizeAsync() {
 ICloudProvider::MoveItemRequest::Pointer AmazonS3::moveItemAsync(
     IItem::Pointer source, IItem::Pointer destination,
     MoveItemCallback callback) {
-  using Request = RecursiveRequest<EitherError<IItem>>;
-  auto visitor = [=](Request::Pointer r, IItem::Pointer item,
-                     Request::CompleteCallback callback) {
-    auto l = getPath("/" + source->id()).length();
-    std::string new_path = destination->id() + item->id().substr(l);
-    r->request(
-        [=](util::Output) {
-          auto request = http()->create(endpoint() + "/" + new_path, "PUT");
-          if (item->type() != IItem::FileType::Directory)
-            request->setHeaderParameter(
-                "x-amz-copy-source", bucket() + "/" + escapePath(item->id()));
-          return request;
-        },
-        [=](EitherError<Response> e) {
-          if (e.left()) return callback(e.left());
-          r->request(
-              [=](util::Output) {
-                return http()->create(endpoint() + "/" + escapePath(item->id()),
-                                      "DELETE");
-              },
-              [=](EitherError<Response> e) {
-                if (e.left()) return callback(e.left());
-                IItem::Pointer renamed = std::make_shared<Item>(
-                    getFilename(new_path), new_path, item->size(),
-                    item->timestamp(), item->type());
-                callback(renamed);
-              });
-        });
-  };
-  return std::make_shared<Request>(shared_from_this(), source, callback,
-                                   visitor)
-      ->run();
+  auto l = getPath("/" + source->id()).length();
+  return transferItemAsync(source, destination->id() + source->id().substr(l),
+                           callback);
 }
 
 ICloudProvider::RenameItemRequest::Pointer AmazonS3::renameItemAsync(
     IItem::Pointer root, const std::string& name, RenameItemCallback callback) {
-  using Request = RecursiveRequest<EitherError<IItem>>;
-  auto new_prefix = (getPath("/" + root->id()) + "/" + name).substr(1);
-  auto visitor = [=](Request::Pointer r, IItem::Pointer item,
-                     Request::CompleteCallback callback) {
-    auto new_path = new_prefix + "/" + item->id().substr(root->id().length());
-    if (!new_path.empty() && new_path.back() == '/' &&
-        item->type() != IItem::FileType::Directory)
-      new_path.pop_back();
-    r->request(
-        [=](util::Output) {
-          auto request = http()->create(endpoint() + "/" + new_path, "PUT");
-          if (item->type() != IItem::FileType::Directory)
-            request->setHeaderParameter(
-                "x-amz-copy-source", bucket() + "/" + escapePath(item->id()));
-          return request;
-        },
-        [=](EitherError<Response> e) {
-          if (e.left()) return callback(e.left());
-          r->request(
-              [=](util::Output) {
-                return http()->create(endpoint() + "/" + escapePath(item->id()),
-                                      "DELETE");
-              },
-              [=](EitherError<Response> e) {
-                if (e.left()) return callback(e.left());
-                IItem::Pointer renamed = std::make_shared<Item>(
-                    getFilename(new_path), new_path, item->size(),
-                    item->timestamp(), item->type());
-                callback(renamed);
-              });
-        });
-  };
-  return std::make_shared<Request>(shared_from_this(), root, callback, visitor)
-      ->run();
+  auto new_path = (getPath("/" + root->id()) + "/" + name).substr(1);
+  if (root->type() == IItem::FileType::Directory) new_path += "/";
+  return transferItemAsync(root, new_path, callback);
 }
 
 IHttpRequest::Pointer AmazonS3::createDirectoryRequest(const IItem& parent,
@@ -252,22 +281,27 @@ IItem::Pointer AmazonS3::createDirectoryResponse(const IItem& parent,
 
 ICloudProvider::DeleteItemRequest::Pointer AmazonS3::deleteItemAsync(
     IItem::Pointer item, DeleteItemCallback callback) {
-  using Request = RecursiveRequest<EitherError<void>>;
-  auto visitor = [=](Request::Pointer r, IItem::Pointer item,
-                     Request::CompleteCallback complete) {
-    r->request(
-        [=](util::Output) {
-          return http()->create(endpoint() + "/" + escapePath(item->id()),
-                                "DELETE");
-        },
-        [=](EitherError<Response> e) {
-          if (e.left())
-            complete(e.left());
-          else
-            complete(nullptr);
-        });
+  using Request = Request<EitherError<void>>;
+  auto resolver = [=](Request::Pointer r) {
+    if (item->type() != IItem::FileType::Directory)
+      return r->request(
+          [=](util::Output) {
+            return http()->create(endpoint() + "/" + escapePath(item->id()),
+                                  "DELETE");
+          },
+          [=](EitherError<Response> e) {
+            if (e.left())
+              r->done(e.left());
+            else
+              r->done(nullptr);
+          });
+    auto objects = std::make_shared<ObjectList>();
+    listObjects(r, item->id(), "", objects, [=](EitherError<void> e) {
+      if (e.left()) return r->done(e);
+      deleteObjects(r, objects, [=](EitherError<void> e) { r->done(e); });
+    });
   };
-  return std::make_shared<Request>(shared_from_this(), item, callback, visitor)
+  return std::make_shared<Request>(shared_from_this(), callback, resolver)
       ->run();
 }
 
@@ -365,11 +399,84 @@ IItem::Pointer AmazonS3::uploadFileResponse(const IItem& item,
                                  IItem::FileType::Unknown);
 }
 
+uint64_t AmazonS3::uploadMaxSize() const { return MAX_OBJECT_SIZE; }
+
+uint64_t AmazonS3::uploadSessionPartSize() const { return part_size_; }
+
+uint64_t AmazonS3::uploadSessionMaxPartCount() const { return MAX_PART_COUNT; }
+
+bool AmazonS3::uploadSessionStreaming() const { return true; }
+
+IHttpRequest::Pointer AmazonS3::uploadSessionStartRequest(
+    const IItem& directory, const std::string& filename, uint64_t,
+    std::ostream&) const {
+  auto request = http()->create(
+      endpoint() + "/" + escapePath(directory.id() + filename), "POST");
+  request->setParameter("uploads", "");
+  return request;
+}
+
+IHttpRequest::Pointer AmazonS3::uploadPartRequest(
+    const IItem& directory, const std::string& filename,
+    const UploadSession& session, uint64_t part, std::ostream&,
+    std::ostream&) const {
+  auto request = http()->create(
+      endpoint() + "/" + escapePath(directory.id() + filename), "PUT");
+  request->setParameter("partNumber", std::to_string(part + 1));
+  request->setParameter("uploadId", session.id_);
+  return request;
+}
+
+IHttpRequest::Pointer AmazonS3::uploadSessionCommitRequest(
+    const IItem& directory, const std::string& filename,
+    const UploadSession& session, std::ostream& input_stream) const {
+  auto request = http()->create(
+      endpoint() + "/" + escapePath(directory.id() + filename), "POST");
+  request->setParameter("uploadId", session.id_);
+  writeCompleteMultipartUpload(input_stream, session.parts_);
+  return request;
+}
+
+IHttpRequest::Pointer AmazonS3::uploadSessionAbortRequest(
+    const IItem& directory, const std::string& filename,
+    const UploadSession& session, std::ostream&) const {
+  auto request = http()->create(
+      endpoint() + "/" + escapePath(directory.id() + filename), "DELETE");
+  request->setParameter("uploadId", session.id_);
+  return request;
+}
+
 IHttpRequest::Pointer AmazonS3::downloadFileRequest(const IItem& item,
                                                     std::ostream&) const {
   return http()->create(endpoint() + "/" + escapePath(item.id()), "GET");
 }
 
+std::string AmazonS3::uploadSessionStartResponse(
+    const IHttpRequest::HeaderParameters&, std::istream& response) const {
+  tinyxml2::XMLDocument document;
+  auto upload_id =
+      parseResponse(document, response)->FirstChildElement("UploadId");
+  if (!upload_id || !upload_id->GetText())
+    throw std::logic_error(util::Error::INVALID_XML);
+  return upload_id->GetText();
+}
+
+std::string AmazonS3::uploadPartResponse(
+    const UploadSession&, uint64_t, const IHttpRequest::HeaderParameters& h,
+    std::istream&) const {
+  auto etag = h.find("etag");
+  if (etag == h.end()) throw std::logic_error("no etag header");
+  return etag->second;
+}
+
+IItem::Pointer AmazonS3::uploadSessionCommitResponse(
+    const IItem& directory, const std::string& filename,
+    const UploadSession& session, std::istream& response) const {
+  tinyxml2::XMLDocument document;
+  parseResponse(document, response);
+  return uploadFileResponse(directory, filename, session.size_, response);
+}
+
 IItem::List AmazonS3::listDirectoryResponse(
     const IItem& parent, std::istream& stream,
     std::string& next_page_token) const {
@@ -424,10 +531,18 @@ IItem::List AmazonS3::listDirectoryResponse(
 }
 
 void AmazonS3::authorizeRequest(IHttpRequest& request) const {
+  using Parameter = std::pair<const std::string, std::string>;
+  // reused by all requests signed on the thread, so that signing doesn't
+  // allocate once they grow large enough
+  thread_local std::string buffer;
+  thread_local std::vector<const Parameter*> headers, parameters;
+  thread_local std::vector<std::pair<size_t, size_t>> escaped;
+
   if (!crypto()) throw std::runtime_error("no crypto functions provided");
-  std::string current_date = currentDate();
-  std::string time = currentDateAndTime();
-  std::string scope = current_date + "/" + region() + "/s3/aws4_request";
+  std::string date, time;
+  currentDateAndTime(date, time);
+  auto region = this->region();
+  std::string scope = date + "/" + region + "/" + SERVICE + "/aws4_request";
   util::Url url(request.url());
   request.setParameter("X-Amz-Algorithm", "AWS4-HMAC-SHA256");
   request.setParameter("X-Amz-Credential", access_id() + "/" + scope);
@@ -435,64 +550,85 @@ void AmazonS3::authorizeRequest(IHttpRequest& request) const {
   request.setParameter("X-Amz-Expires", "86400");
   request.setHeaderParameter("host", url.host());
 
-  std::vector<std::pair<std::string, std::string>> header_parameters;
-  for (auto q : request.headerParameters())
-    header_parameters.push_back({util::to_lower(q.first), q.second});
-  std::sort(header_parameters.begin(), header_parameters.end());
-
+  headers.clear();
+  for (auto&& h : request.headerParameters()) headers.push_back(&h);
+  std::sort(headers.begin(), headers.end(),
+            [](const Parameter* h1, const Parameter* h2) {
+              return lessIgnoreCase(h1->first, h2->first) ||
+                     (!lessIgnoreCase(h2->first, h1->first) &&
+                      h1->second < h2->second);
+            });
   std::string signed_headers;
-  {
-    bool first = false;
-    for (auto q : header_parameters) {
-      if (first)
-        signed_headers += ";";
-      else
-        first = true;
-      signed_headers += q.first;
-    }
-    request.setParameter("X-Amz-SignedHeaders", signed_headers);
+  for (auto h : headers) {
+    if (!signed_headers.empty()) signed_headers += ";";
+    appendLower(signed_headers, h->first);
   }
-
-  std::vector<std::pair<std::string, std::string>> query_parameters;
-  for (auto q : request.parameters())
-    query_parameters.push_back({q.first, q.second});
-  std::sort(query_parameters.begin(), query_parameters.end());
-
-  std::string canonical_request = request.method() + "\n" + url.path() + "\n";
-
-  bool first = false;
-  for (auto q : query_parameters) {
-    if (first)
-      canonical_request += "&";
-    else
-      first = true;
-    canonical_request +=
-        util::Url::escape(q.first) + "=" + util::Url::escape(q.second);
+  request.setParameter("X-Amz-SignedHeaders", signed_headers);
+
+  parameters.clear();
+  for (auto&& p : request.parameters()) parameters.push_back(&p);
+  std::sort(parameters.begin(), parameters.end(),
+            [](const Parameter* p1, const Parameter* p2) {
+              return p1->first < p2->first;
+            });
+
+  buffer.clear();
+  buffer += request.method();
+  buffer += '\n';
+  buffer += url.path();
+  buffer += '\n';
+  escaped.clear();
+  for (auto p : parameters) {
+    if (!escaped.empty()) buffer += '&';
+    appendEscaped(buffer, p->first);
+    buffer += '=';
+    auto position = buffer.size();
+    appendEscaped(buffer, p->second);
+    escaped.push_back({position, buffer.size() - position});
   }
-  canonical_request += "\n";
-
-  for (auto q : header_parameters)
-    canonical_request += util::Url::escape(q.first) + ":" + q.second + "\n";
-  canonical_request += "\n";
-  canonical_request += signed_headers + "\n";
-  canonical_request += "UNSIGNED-PAYLOAD";
-
-  auto hash = std::bind(&ICrypto::sha256, crypto(), _1);
-  auto sign = std::bind(&ICrypto::hmac_sha256, crypto(), _1, _2);
-  auto hex = std::bind(&ICrypto::hex, crypto(), _1);
-
-  std::string string_to_sign = "AWS4-HMAC-SHA256\n" + time + "\n" + scope +
-                               "\n" + hex(hash(canonical_request));
-  std::string key =
-      sign(sign(sign(sign("AWS4" + secret(), current_date), region()), "s3"),
-           "aws4_request");
-  std::string signature = hex(sign(key, string_to_sign));
-
-  request.setParameter("X-Amz-Signature", signature);
-
-  auto params = request.parameters();
-  for (auto p : params)
-    request.setParameter(p.first, util::Url::escape(p.second));
+  buffer += '\n';
+  for (auto h : headers) {
+    appendLower(buffer, h->first);
+    buffer += ':';
+    buffer += h->second;
+    buffer += '\n';
+  }
+  buffer += '\n';
+  buffer += signed_headers;
+  buffer += "\nUNSIGNED-PAYLOAD";
+  auto hash = crypto()->sha256_hash();
+  hash->update(buffer.data(), buffer.size());
+  auto canonical_request_hash = crypto()->hex(hash->digest());
+
+  // parameters are sent escaped
+  for (size_t i = 0; i < parameters.size(); i++)
+    request.setParameter(
+        parameters[i]->first,
+        buffer.substr(escaped[i].first, escaped[i].second));
+
+  buffer.clear();
+  buffer += "AWS4-HMAC-SHA256\n";
+  buffer += time;
+  buffer += '\n';
+  buffer += scope;
+  buffer += '\n';
+  buffer += canonical_request_hash;
+  request.setParameter(
+      "X-Amz-Signature",
+      crypto()->hex(crypto()->hmac_sha256(signingKey(date, region), buffer)));
+}
+
+std::string AmazonS3::signingKey(const std::string& date,
+                                 const std::string& region) const {
+  auto lock = auth_lock();
+  if (signing_key_.date_ != date || signing_key_.region_ != region) {
+    auto sign = std::bind(&ICrypto::hmac_sha256, crypto(), _1, _2);
+    signing_key_ = {
+        date, region,
+        sign(sign(sign(sign("AWS4" + secret_, date), region), SERVICE),
+             "aws4_request")};
+  }
+  return signing_key_.key_;
 }
 
 bool AmazonS3::reauthorize(int code,
@@ -535,6 +671,7 @@ bool AmazonS3::unpackCredentials(const std::string& code) {
     auto json = credentialsFromString(code);
     access_id_ = json["username"].asString();
     secret_ = json["password"].asString();
+    signing_key_ = {};
     bucket_ = json["bucket"].asString();
     region_ = "us-east-1";
     return true;
@@ -553,6 +690,264 @@ std::string AmazonS3::getUrl(const Item& item) const {
   return request->url() + "?" + parameters;
 }
 
+ICloudProvider::MoveItemRequest::Pointer AmazonS3::transferItemAsync(
+    IItem::Pointer item, const std::string& new_id, MoveItemCallback callback) {
+  using Request = Request<EitherError<IItem>>;
+  auto resolver = [=](Request::Pointer r) {
+    auto transferred = [=](EitherError<void> e) {
+      if (e.left()) return r->done(e.left());
+      r->done(EitherError<IItem>(
+          std::make_shared<Item>(getFilename(new_id), new_id, item->size(),
+                                 item->timestamp(), item->type())));
+    };
+    auto objects = std::make_shared<ObjectList>();
+    auto copy = [=](EitherError<void> e) {
+      if (e.left()) return transferred(e);
+      std::make_shared<ParallelTasks>(
+          objects->size(), BULK_PARALLELISM, [=] { return r->is_cancelled(); },
+          [=](uint64_t index, Completed complete) {
+            const auto& object = (*objects)[index];
+            copyObject(r, object,
+                       new_id + object.key_.substr(item->id().size()),
+                       complete);
+          },
+          [=](EitherError<void> e) {
+            if (e.left()) return transferred(e);
+            deleteObjects(r, objects, transferred);
+          })
+          ->start();
+    };
+    if (item->type() != IItem::FileType::Directory) {
+      objects->push_back({item->id(), item->size()});
+      return copy(nullptr);
+    }
+    listObjects(r, item->id(), "", objects, [=](EitherError<void> e) {
+      if (e.left() || std::any_of(objects->begin(), objects->end(),
+                                  [=](const Object& object) {
+                                    return object.key_ == item->id();
+                                  }))
+        return copy(e);
+      r->request(
+          [=](util::Output) {
+            return http()->create(endpoint() + "/" + escapePath(new_id),
+                                  "PUT");
+          },
+          [=](EitherError<Response> e) {
+            if (e.left())
+              copy(e.left());
+            else
+              copy(nullptr);
+          });
+    });
+  };
+  return std::make_shared<Request>(shared_from_this(), callback, resolver)
+      ->run();
+}
+
+template <class T>
+void AmazonS3::listObjects(std::shared_ptr<Request<T>> r,
+                           const std::string& prefix,
+                           const std::string& page_token,
+                           std::shared_ptr<ObjectList> objects,
+                           Completed complete) const {
+  r->request(
+      [=](util::Output) {
+        auto request = http()->create(endpoint() + "/", "GET");
+        request->setParameter("list-type", "2");
+        request->setParameter("prefix", prefix);
+        if (!page_token.empty())
+          request->setParameter("continuation-token", page_token);
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        if (e.left()) return complete(e.left());
+        std::string next_page_token;
+        try {
+          tinyxml2::XMLDocument document;
+          auto root = parseResponse(document, e.right()->output());
+          for (auto child = root->FirstChildElement("Contents"); child;
+               child = child->NextSiblingElement("Contents")) {
+            auto key = child->FirstChildElement("Key");
+            auto size = child->FirstChildElement("Size");
+            if (!key || !key->GetText() || !size || !size->GetText())
+              throw std::logic_error(util::Error::INVALID_XML);
+            objects->push_back({key->GetText(), std::stoull(size->GetText())});
+          }
+          auto is_truncated = root->FirstChildElement("IsTruncated");
+          if (is_truncated && is_truncated->GetText() == std::string("true")) {
+            auto next_token = root->FirstChildElement("NextContinuationToken");
+            if (!next_token || !next_token->GetText())
+              throw std::logic_error(util::Error::INVALID_XML);
+            next_page_token = next_token->GetText();
+          }
+        } catch (const std::exception& e) {
+          return complete(Error{IHttpRequest::Failure, e.what()});
+        }
+        if (next_page_token.empty()) return complete(nullptr);
+        listObjects(r, prefix, next_page_token, objects, complete);
+      });
+}
+
+template <class T>
+void AmazonS3::deleteObjects(std::shared_ptr<Request<T>> r,
+                             std::shared_ptr<ObjectList> objects,
+                             Completed complete) const {
+  auto batch_count =
+      (objects->size() + DELETE_BATCH_SIZE - 1) / DELETE_BATCH_SIZE;
+  auto task = [=](uint64_t batch, Completed complete) {
+    r->request(
+        [=](util::Output input) {
+          std::stringstream body;
+          body << "<Delete><Quiet>true</Quiet>";
+          for (auto i = batch * DELETE_BATCH_SIZE;
+               i < std::min<uint64_t>((batch + 1) * DELETE_BATCH_SIZE,
+                                      objects->size());
+               i++)
+            body << "<Object><Key>" << escapeXml((*objects)[i].key_)
+                 << "</Key></Object>";
+          body << "</Delete>";
+          auto request = http()->create(endpoint() + "/", "POST");
+          request->setParameter("delete", "");
+          request->setHeaderParameter("x-amz-sdk-checksum-algorithm",
+                                      "SHA256");
+          request->setHeaderParameter(
+              "x-amz-checksum-sha256",
+              util::to_base64(crypto()->sha256(body.str())));
+          *input << body.str();
+          return request;
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return complete(e.left());
+          try {
+            tinyxml2::XMLDocument document;
+            auto root = parseResponse(document, e.right()->output());
+            if (auto error = root->FirstChildElement("Error")) {
+              auto key = error->FirstChildElement("Key");
+              auto code = error->FirstChildElement("Code");
+              return complete(Error{
+                  IHttpRequest::Failure,
+                  std::string("couldn't delete ") +
+                      (key && key->GetText() ? key->GetText() : "") + ": " +
+                      (code && code->GetText() ? code->GetText() : "")});
+            }
+          } catch (const std::exception& e) {
+            return complete(Error{IHttpRequest::Failure, e.what()});
+          }
+          complete(nullptr);
+        });
+  };
+  std::make_shared<ParallelTasks>(batch_count, BULK_PARALLELISM,
+                                  [=] { return r->is_cancelled(); }, task,
+                                  complete)
+      ->start();
+}
+
+template <class T>
+void AmazonS3::copyObject(std::shared_ptr<Request<T>> r, const Object& source,
+                          const std::string& destination,
+                          Completed complete) const {
+  if (source.size_ != IItem::UnknownSize &&
+      source.size_ > MAX_COPY_OBJECT_SIZE)
+    return copyObjectInParts(r, source, destination, complete);
+  auto key = source.key_;
+  r->request(
+      [=](util::Output) {
+        auto request =
+            http()->create(endpoint() + "/" + escapePath(destination), "PUT");
+        request->setHeaderParameter("x-amz-copy-source",
+                                    bucket() + "/" + escapePath(key));
+        return request;
+      },
+      [=](EitherError<Response> e) { complete(copyResult(e)); });
+}
+
+template <class T>
+void AmazonS3::copyObjectInParts(std::shared_ptr<Request<T>> r,
+                                 const Object& source,
+                                 const std::string& destination,
+                                 Completed complete) const {
+  auto key = source.key_;
+  auto size = source.size_;
+  auto part_size = std::max(COPY_PART_SIZE,
+                            (size + MAX_PART_COUNT - 1) / MAX_PART_COUNT);
+  auto part_count = (size + part_size - 1) / part_size;
+  auto url = endpoint() + "/" + escapePath(destination);
+  r->request(
+      [=](util::Output) {
+        auto request = http()->create(url, "POST");
+        request->setParameter("uploads", "");
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        if (e.left()) return complete(e.left());
+        std::string upload_id;
+        try {
+          upload_id = uploadSessionStartResponse({}, e.right()->output());
+        } catch (const std::exception& e) {
+          return complete(Error{IHttpRequest::Failure, e.what()});
+        }
+        auto abort = [=](EitherError<void> e) {
+          r->request(
+              [=](util::Output) {
+                auto request = http()->create(url, "DELETE");
+                request->setParameter("uploadId", upload_id);
+                return request;
+              },
+              [=](EitherError<Response>) { complete(e); });
+        };
+        auto tags = std::make_shared<std::vector<std::string>>(part_count);
+        auto task = [=](uint64_t part, Completed complete) {
+          r->request(
+              [=](util::Output) {
+                auto request = http()->create(url, "PUT");
+                request->setParameter("partNumber", std::to_string(part + 1));
+                request->setParameter("uploadId", upload_id);
+                request->setHeaderParameter("x-amz-copy-source",
+                                            bucket() + "/" + escapePath(key));
+                request->setHeaderParameter(
+                    "x-amz-copy-source-range",
+                    "bytes=" + std::to_string(part * part_size) + "-" +
+                        std::to_string(
+                            std::min(size, (part + 1) * part_size) - 1));
+                return request;
+              },
+              [=](EitherError<Response> e) {
+                if (e.left()) return complete(e.left());
+                try {
+                  tinyxml2::XMLDocument document;
+                  auto etag = parseResponse(document, e.right()->output())
+                                  ->FirstChildElement("ETag");
+                  if (!etag || !etag->GetText())
+                    throw std::logic_error(util::Error::INVALID_XML);
+                  (*tags)[part] = etag->GetText();
+                } catch (const std::exception& e) {
+                  return complete(Error{IHttpRequest::Failure, e.what()});
+                }
+                complete(nullptr);
+              });
+        };
+        auto commit = [=](EitherError<void> e) {
+          if (e.left()) return abort(e);
+          r->request(
+              [=](util::Output input) {
+                auto request = http()->create(url, "POST");
+                request->setParameter("uploadId", upload_id);
+                writeCompleteMultipartUpload(*input, *tags);
+                return request;
+              },
+              [=](EitherError<Response> e) {
+                auto result = copyResult(e);
+                if (result.left()) return abort(result);
+                complete(nullptr);
+              });
+        };
+        std::make_shared<ParallelTasks>(part_count, BULK_PARALLELISM,
+                                        [=] { return r->is_cancelled(); },
+                                        task, commit)
+            ->start();
+      });
+}
+
 std::string AmazonS3::Auth::authorizeLibraryUrl() const {
   return redirect_uri() + "/login?state=" + state();
 }
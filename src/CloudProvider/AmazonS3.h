@@ -37,6 +37,10 @@ namespace cloudstorage {
  * are listed as root directory's children, renaming and moving them doesn't
  * work. Token in this case is a base64 encoded json with fields
  * username (access_id), password (secret_key), region.
+ *
+ * Files larger than upload_part_size hint are uploaded with multipart uploads;
+ * S3 allows up to 10000 parts per upload, so parts of larger files are made
+ * bigger, and objects of up to 5 TiB.
  */
 class AmazonS3 : public CloudProvider {
  public:
@@ -74,6 +78,24 @@ class AmazonS3 : public CloudProvider {
   IHttpRequest::Pointer downloadFileRequest(
       const IItem&, std::ostream& input_stream) const override;
 
+  uint64_t uploadMaxSize() const override;
+  uint64_t uploadSessionPartSize() const override;
+  uint64_t uploadSessionMaxPartCount() const override;
+  bool uploadSessionStreaming() const override;
+  IHttpRequest::Pointer uploadSessionStartRequest(
+      const IItem& directory, const std::string& filename, uint64_t size,
+      std::ostream& input_stream) const override;
+  IHttpRequest::Pointer uploadPartRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, uint64_t part, std::ostream& prefix_stream,
+      std::ostream& suffix_stream) const override;
+  IHttpRequest::Pointer uploadSessionCommitRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const override;
+  IHttpRequest::Pointer uploadSessionAbortRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const override;
+
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
   IItem::Pointer createDirectoryResponse(const IItem& parent,
@@ -82,6 +104,15 @@ class AmazonS3 : public CloudProvider {
   IItem::Pointer uploadFileResponse(const IItem& parent,
                                     const std::string& filename, uint64_t,
                                     std::istream& response) const override;
+  std::string uploadSessionStartResponse(
+      const IHttpRequest::HeaderParameters&,
+      std::istream& response) const override;
+  std::string uploadPartResponse(const UploadSession&, uint64_t part,
+                                 const IHttpRequest::HeaderParameters&,
+                                 std::istream& response) const override;
+  IItem::Pointer uploadSessionCommitResponse(
+      const IItem& directory, const std::string& filename,
+      const UploadSession&, std::istream& response) const override;
 
   void authorizeRequest(IHttpRequest&) const override;
   bool reauthorize(int, const IHttpRequest::HeaderParameters&) const override;
@@ -108,13 +139,64 @@ class AmazonS3 : public CloudProvider {
   };
 
  private:
+  struct Object {
+    std::string key_;
+    uint64_t size_;
+  };
+  using ObjectList = std::vector<Object>;
+  // SigV4 key derived from the secret, valid for a date and region
+  struct SigningKey {
+    std::string date_;
+    std::string region_;
+    std::string key_;
+  };
+  using Completed = std::function<void(EitherError<void>)>;
+
   bool unpackCredentials(const std::string&) override;
   std::string getUrl(const Item&) const;
+  std::string signingKey(const std::string& date,
+                         const std::string& region) const;
+
+  /**
+   * Copies item, and everything under it if it's a directory, to new_id and
+   * removes the originals.
+   */
+  MoveItemRequest::Pointer transferItemAsync(IItem::Pointer item,
+                                             const std::string& new_id,
+                                             MoveItemCallback);
+
+  /**
+   * Appends all objects whose keys start with prefix to objects.
+   */
+  template <class T>
+  void listObjects(std::shared_ptr<Request<T>>, const std::string& prefix,
+                   const std::string& page_token, std::shared_ptr<ObjectList>,
+                   Completed) const;
+
+  /**
+   * Removes objects with DeleteObjects, up to 1000 keys per request.
+   */
+  template <class T>
+  void deleteObjects(std::shared_ptr<Request<T>>, std::shared_ptr<ObjectList>,
+                     Completed) const;
+
+  /**
+   * Server side copy; objects which are too large for CopyObject are copied
+   * with UploadPartCopy.
+   */
+  template <class T>
+  void copyObject(std::shared_ptr<Request<T>>, const Object& source,
+                  const std::string& destination, Completed) const;
+  template <class T>
+  void copyObjectInParts(std::shared_ptr<Request<T>>, const Object& source,
+                         const std::string& destination, Completed) const;
 
   std::string access_id_;
   std::string secret_;
   std::string region_;
   std::string bucket_;
+  uint64_t part_size_;
+  mutable SigningKey signing_key_;
 };
 
 }  // namespace cloudstorage
@@ -30,6 +30,7 @@
 #include "Utility/Utility.h"
 
 const std::string BOXAPI_ENDPOINT = "https://api.box.com";
+const int EVENTS_LIMIT = 500;
 
 namespace cloudstorage {
 
@@ -86,6 +87,8 @@ IHttpRequest::Pointer Box::listDirectoryRequest(const IItem& item,
   return request;
 }
 
+bool Box::listDirectoryOffsetTokens() const { return true; }
+
 IHttpRequest::Pointer Box::uploadFileRequest(
     const IItem& directory, const std::string& filename,
     std::ostream& prefix_stream, std::ostream& suffix_stream) const {
@@ -110,6 +113,17 @@ IHttpRequest::Pointer Box::uploadFileRequest(
   return request;
 }
 
+bool Box::hasChangeFeed() const { return true; }
+
+IHttpRequest::Pointer Box::listChangesRequest(const std::string& cursor,
+                                              std::ostream&) const {
+  auto request = http()->create(endpoint() + "/2.0/events", "GET");
+  request->setParameter("stream_type", "changes");
+  request->setParameter("stream_position", cursor.empty() ? "now" : cursor);
+  request->setParameter("limit", std::to_string(EVENTS_LIMIT));
+  return request;
+}
+
 IItem::Pointer Box::uploadFileResponse(const IItem&, const std::string&,
                                        uint64_t, std::istream& response) const {
   return toItem(util::json::from_stream(response)["entries"][0]);
@@ -213,6 +227,32 @@ IItem::List Box::listDirectoryResponse(const IItem&, std::istream& stream,
   return result;
 }
 
+ChangeSet Box::listChangesResponse(std::istream& stream,
+                                   bool& has_more) const {
+  auto response = util::json::from_stream(stream);
+  ChangeSet result;
+  for (const Json::Value& v : response["entries"]) {
+    const auto& source = v["source"];
+    auto type = source["type"].asString();
+    if (type != "file" && type != "folder") continue;
+    if (v["event_type"].asString() == "ITEM_TRASH") {
+      result.changes_.push_back(
+          {FileId(type == "folder", source["id"].asString()), nullptr});
+    } else {
+      auto item = toItem(source);
+      if (source["parent"].isObject())
+        static_cast<Item*>(item.get())
+            ->set_parents({FileId(true, source["parent"]["id"].asString())});
+      result.changes_.push_back({item->id(), item});
+    }
+  }
+  result.cursor_ = response["next_stream_position"].asString();
+  // a chunk may be shorter than the limit while more events are available,
+  // the stream is exhausted only when it returns no events
+  has_more = response["chunk_size"].asInt() > 0;
+  return result;
+}
+
 IItem::Pointer Box::toItem(const Json::Value& v) const {
   IItem::FileType type = IItem::FileType::Unknown;
   if (v["type"].asString() == "folder") type = IItem::FileType::Directory;
@@ -47,6 +47,10 @@ class Box : public CloudProvider {
   IHttpRequest::Pointer listDirectoryRequest(
       const IItem&, const std::string& page_token,
       std::ostream& input_stream) const override;
+  bool listDirectoryOffsetTokens() const override;
+  bool hasChangeFeed() const override;
+  IHttpRequest::Pointer listChangesRequest(
+      const std::string& cursor, std::ostream& input_stream) const override;
   IHttpRequest::Pointer uploadFileRequest(const IItem& directory,
                                           const std::string& filename,
                                           std::ostream&,
@@ -68,6 +72,8 @@ class Box : public CloudProvider {
   IItem::Pointer getItemDataResponse(std::istream& response) const override;
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
+  ChangeSet listChangesResponse(std::istream&,
+                                bool& has_more) const override;
   std::string getItemUrlResponse(const IItem& item,
                                  const IHttpRequest::HeaderParameters&,
                                  std::istream& response) const override;
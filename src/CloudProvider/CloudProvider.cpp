@@ -24,12 +24,18 @@
 #include "CloudProvider.h"
 
 #include <json/json.h>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <fstream>
+#include <random>
 #include <sstream>
 
+#include "Utility/BlockCache.h"
 #include "Utility/FileServer.h"
 #include "Utility/Item.h"
+#include "Utility/MetadataCache.h"
+#include "Utility/Timer.h"
 #include "Utility/Utility.h"
 
 #include "Request/CreateDirectoryRequest.h"
@@ -39,6 +45,7 @@
 #include "Request/GetItemDataRequest.h"
 #include "Request/GetItemRequest.h"
 #include "Request/GetItemUrlRequest.h"
+#include "Request/ListChangesRequest.h"
 #include "Request/ListDirectoryPageRequest.h"
 #include "Request/ListDirectoryRequest.h"
 #include "Request/MoveItemRequest.h"
@@ -51,9 +58,29 @@ using namespace std::placeholders;
 
 const std::string DEFAULT_STATE = "DEFAULT_STATE";
 const std::string DEFAULT_FILE_URL = "http://127.0.0.1:12346";
+const uint32_t DEFAULT_UPLOAD_PARALLELISM = 4;
+const uint32_t DEFAULT_LIST_DIRECTORY_PARALLELISM = 4;
+const uint32_t DEFAULT_RECURSIVE_REQUEST_PARALLELISM = 1;
+const auto TOKEN_REFRESH_MARGIN = std::chrono::minutes(5);
 
 namespace {
 
+// request which finished before it was returned
+template <class ReturnValue>
+class DoneRequest : public cloudstorage::IRequest<ReturnValue> {
+ public:
+  DoneRequest(const ReturnValue& result) : result_(result) {}
+
+  void finish() override {}
+  void cancel() override {}
+  void pause() override {}
+  void resume() override {}
+  ReturnValue result() override { return result_; }
+
+ private:
+  ReturnValue result_;
+};
+
 class ListDirectoryCallback : public cloudstorage::IListDirectoryCallback {
  public:
   ListDirectoryCallback(cloudstorage::ListDirectoryCallback callback)
@@ -129,7 +156,13 @@ class UploadFileCallback : public cloudstorage::IUploadFileCallback {
 namespace cloudstorage {
 
 CloudProvider::CloudProvider(IAuth::Pointer auth)
-    : auth_(std::move(auth)), http_(), deleted_() {}
+    : auth_(std::move(auth)),
+      http_(),
+      token_refresh_timer_(std::make_shared<Timer>()),
+      upload_parallelism_(DEFAULT_UPLOAD_PARALLELISM),
+      list_directory_parallelism_(DEFAULT_LIST_DIRECTORY_PARALLELISM),
+      recursive_request_parallelism_(DEFAULT_RECURSIVE_REQUEST_PARALLELISM),
+      deleted_() {}
 
 void CloudProvider::initialize(InitData&& data) {
   auto lock = auth_lock();
@@ -161,6 +194,32 @@ void CloudProvider::initialize(InitData&& data) {
               [this](std::string v) { auth()->set_error_page(v); });
   setWithHint(data.hints_, "file_url",
               [this](std::string v) { file_url_ = v; });
+  uint64_t file_cache_memory_size = 0;
+  uint64_t file_cache_disk_size = 0;
+  temporary_directory_ = util::temporary_directory();
+  std::chrono::seconds metadata_cache_ttl(0);
+  setWithHint(data.hints_, "file_cache_memory_size",
+              [&](std::string v) { file_cache_memory_size = std::stoull(v); });
+  setWithHint(data.hints_, "file_cache_disk_size",
+              [&](std::string v) { file_cache_disk_size = std::stoull(v); });
+  setWithHint(data.hints_, "temporary_directory",
+              [this](std::string v) { temporary_directory_ = v; });
+  setWithHint(data.hints_, "upload_parallelism", [this](std::string v) {
+    upload_parallelism_ = std::max<uint32_t>(std::stoul(v), 1);
+  });
+  setWithHint(data.hints_, "list_directory_parallelism",
+              [this](std::string v) {
+                list_directory_parallelism_ =
+                    std::max<uint32_t>(std::stoul(v), 1);
+              });
+  setWithHint(data.hints_, "recursive_request_parallelism",
+              [this](std::string v) {
+                recursive_request_parallelism_ =
+                    std::max<uint32_t>(std::stoul(v), 1);
+              });
+  setWithHint(data.hints_, "metadata_cache_ttl", [&](std::string v) {
+    metadata_cache_ttl = std::chrono::seconds(std::stoull(v));
+  });
 
 #ifdef WITH_CRYPTOPP
   if (!crypto_) crypto_ = ICrypto::create();
@@ -180,6 +239,17 @@ void CloudProvider::initialize(InitData&& data) {
   if (!http_server_)
     throw std::runtime_error("No http server module specified.");
 
+  std::string file_cache_path;
+  if (file_cache_disk_size > 0) {
+    std::stringstream stream;
+    stream << temporary_directory_ << "libcloudstorage-" << name() << "-"
+           << std::hex << std::random_device()() << ".cache";
+    file_cache_path = stream.str();
+  }
+  block_cache_ = std::make_shared<BlockCache>(
+      file_cache_memory_size, file_cache_path, file_cache_disk_size);
+  metadata_cache_ = std::make_shared<MetadataCache>(metadata_cache_ttl);
+  change_snapshot_ = std::make_shared<ChangeSnapshot>();
   file_daemon_ = FileServer::create(shared_from_this(), auth()->state());
   if (file_url_.empty()) file_url_ = DEFAULT_FILE_URL;
 
@@ -207,6 +277,13 @@ void CloudProvider::destroy() {
       lock.lock();
     }
   }
+  token_refresh_timer_->cancel();
+  AuthorizeRequest::Pointer token_refresh;
+  {
+    std::lock_guard<std::mutex> lock(current_authorization_mutex_);
+    token_refresh = token_refresh_.lock();
+  }
+  if (token_refresh) token_refresh->cancel();
   file_daemon_ = nullptr;
 }
 
@@ -274,9 +351,30 @@ IItem::Pointer CloudProvider::rootDirectory() const {
 }
 
 ICloudProvider::OperationSet CloudProvider::supportedOperations() const {
-  return ExchangeCode | GetItemUrl | ListDirectoryPage | ListDirectory |
-         GetItem | DownloadFile | UploadFile | DeleteItem | CreateDirectory |
-         MoveItem | RenameItem;
+  OperationSet operations = ExchangeCode | GetItemUrl | ListDirectoryPage |
+                            ListDirectory | GetItem | DownloadFile |
+                            UploadFile | DeleteItem | CreateDirectory |
+                            MoveItem | RenameItem | ListChanges;
+  if (uploadSessionPartSize() > 0 && uploadSessionStreaming())
+    operations |= UploadFileStream;
+  return operations;
+}
+
+ICloudProvider::CacheStatistics ICloudProvider::metadataCacheStatistics()
+    const {
+  return {};
+}
+
+ICloudProvider::ListChangesRequest::Pointer ICloudProvider::listChangesAsync(
+    const std::string&, ListChangesCallback callback) {
+  EitherError<ChangeSet> result =
+      Error{IHttpRequest::Failure, util::Error::UNIMPLEMENTED};
+  callback(result);
+  return util::make_unique<DoneRequest<EitherError<ChangeSet>>>(result);
+}
+
+ICloudProvider::CacheStatistics CloudProvider::metadataCacheStatistics() const {
+  return metadata_cache_->statistics();
 }
 
 ICloudProvider::IAuthCallback* CloudProvider::auth_callback() const {
@@ -285,6 +383,22 @@ ICloudProvider::IAuthCallback* CloudProvider::auth_callback() const {
 
 std::string CloudProvider::file_url() const { return file_url_; }
 
+std::shared_ptr<BlockCache> CloudProvider::block_cache() const {
+  return block_cache_;
+}
+
+std::string CloudProvider::temporary_directory() const {
+  return temporary_directory_;
+}
+
+std::shared_ptr<MetadataCache> CloudProvider::metadata_cache() const {
+  return metadata_cache_;
+}
+
+std::shared_ptr<ChangeSnapshot> CloudProvider::change_snapshot() const {
+  return change_snapshot_;
+}
+
 ICrypto* CloudProvider::crypto() const { return crypto_.get(); }
 
 IHttp* CloudProvider::http() const { return http_.get(); }
@@ -360,6 +474,39 @@ AuthorizeRequest::Pointer CloudProvider::authorizeAsync() {
   return std::make_shared<AuthorizeRequest>(shared_from_this());
 }
 
+void CloudProvider::scheduleTokenRefresh() {
+  int expires_in = -1;
+  {
+    auto lock = auth_lock();
+    auto token = auth()->access_token();
+    if (token && !token->refresh_token_.empty())
+      expires_in = token->expires_in_;
+  }
+  if (expires_in <= 0) return token_refresh_timer_->cancel();
+  std::chrono::steady_clock::duration lifetime =
+      std::chrono::seconds(expires_in);
+  std::weak_ptr<CloudProvider> provider = shared_from_this();
+  token_refresh_timer_->schedule(
+      lifetime - std::min<std::chrono::steady_clock::duration>(
+                     TOKEN_REFRESH_MARGIN, lifetime / 2),
+      [provider] {
+        if (auto p = provider.lock()) p->refreshToken();
+      });
+}
+
+void CloudProvider::refreshToken() {
+  AuthorizeRequest::Pointer r;
+  {
+    std::lock_guard<std::mutex> lock(current_authorization_mutex_);
+    // the running authorization schedules the next refresh
+    if (current_authorization_) return;
+    r = authorizeAsync();
+    current_authorization_ = r;
+    token_refresh_ = r;
+  }
+  r->run();
+}
+
 std::unique_lock<std::mutex> CloudProvider::auth_lock() const {
   return std::unique_lock<std::mutex>(auth_mutex_);
 }
@@ -379,6 +526,11 @@ std::string CloudProvider::defaultFileDaemonUrl(const IItem& item,
          "&state=" + util::Url::escape(auth()->state());
 }
 
+void CloudProvider::setTokenRefreshTimer(std::shared_ptr<Timer> timer) {
+  token_refresh_timer_->cancel();
+  token_refresh_timer_ = timer;
+}
+
 ICloudProvider::DownloadFileRequest::Pointer
 CloudProvider::makeDownloadFileRequest(
     IItem::Pointer file, Range range,
@@ -569,6 +721,30 @@ ICloudProvider::GeneralDataRequest::Pointer CloudProvider::getGeneralDataAsync(
       ->run();
 }
 
+ICloudProvider::ListChangesRequest::Pointer CloudProvider::listChangesAsync(
+    const std::string& cursor, ListChangesCallback callback) {
+  if (hasChangeFeed())
+    return std::make_shared<cloudstorage::ListChangesRequest>(
+               shared_from_this(), cursor, callback)
+        ->run();
+  bool expired;
+  {
+    std::lock_guard<std::mutex> lock(change_snapshot_->mutex_);
+    expired = !cursor.empty() && cursor != change_snapshot_->cursor_;
+  }
+  if (expired)
+    return std::make_shared<Request<EitherError<ChangeSet>>>(
+               shared_from_this(), callback,
+               [=](Request<EitherError<ChangeSet>>::Pointer r) {
+                 r->done(Error{IHttpRequest::Bad,
+                               util::Error::CHANGE_CURSOR_EXPIRED});
+               })
+        ->run();
+  return std::make_shared<SnapshotChangesRequest>(shared_from_this(), cursor,
+                                                  callback)
+      ->run();
+}
+
 ICloudProvider::GetItemUrlRequest::Pointer CloudProvider::getFileDaemonUrlAsync(
     IItem::Pointer item, GetItemUrlCallback cb) {
   auto resolver = [=](Request<EitherError<std::string>>::Pointer r) {
@@ -619,6 +795,16 @@ IHttpRequest::Pointer CloudProvider::listDirectoryRequest(const IItem&,
   return nullptr;
 }
 
+bool CloudProvider::listDirectoryOffsetTokens() const { return false; }
+
+uint32_t CloudProvider::listDirectoryParallelism() const {
+  return list_directory_parallelism_;
+}
+
+uint32_t CloudProvider::recursiveRequestParallelism() const {
+  return recursive_request_parallelism_;
+}
+
 IHttpRequest::Pointer CloudProvider::uploadFileRequest(const IItem&,
                                                        const std::string&,
                                                        std::ostream&,
@@ -626,6 +812,43 @@ IHttpRequest::Pointer CloudProvider::uploadFileRequest(const IItem&,
   return nullptr;
 }
 
+uint64_t CloudProvider::uploadMaxSize() const { return IItem::UnknownSize; }
+
+uint64_t CloudProvider::uploadSessionPartSize() const { return 0; }
+
+uint32_t CloudProvider::uploadSessionParallelism() const {
+  return upload_parallelism_;
+}
+
+uint64_t CloudProvider::uploadSessionMaxPartCount() const { return 0; }
+
+bool CloudProvider::uploadSessionStreaming() const { return false; }
+
+bool CloudProvider::uploadSessionLastPartAfterOthers() const { return false; }
+
+IHttpRequest::Pointer CloudProvider::uploadSessionStartRequest(
+    const IItem&, const std::string&, uint64_t, std::ostream&) const {
+  return nullptr;
+}
+
+IHttpRequest::Pointer CloudProvider::uploadPartRequest(
+    const IItem&, const std::string&, const UploadSession&, uint64_t,
+    std::ostream&, std::ostream&) const {
+  return nullptr;
+}
+
+IHttpRequest::Pointer CloudProvider::uploadSessionCommitRequest(
+    const IItem&, const std::string&, const UploadSession&,
+    std::ostream&) const {
+  return nullptr;
+}
+
+IHttpRequest::Pointer CloudProvider::uploadSessionAbortRequest(
+    const IItem&, const std::string&, const UploadSession&,
+    std::ostream&) const {
+  return nullptr;
+}
+
 IHttpRequest::Pointer CloudProvider::downloadFileRequest(const IItem&,
                                                          std::ostream&) const {
   return nullptr;
@@ -664,6 +887,17 @@ IHttpRequest::Pointer CloudProvider::getGeneralDataRequest(
   return nullptr;
 }
 
+bool CloudProvider::hasChangeFeed() const { return false; }
+
+IHttpRequest::Pointer CloudProvider::listChangesRequest(const std::string&,
+                                                        std::ostream&) const {
+  return nullptr;
+}
+
+bool CloudProvider::listChangesExpired(const Error& e) const {
+  return e.code_ == IHttpRequest::Gone;
+}
+
 IItem::Pointer CloudProvider::getItemDataResponse(std::istream&) const {
   return nullptr;
 }
@@ -689,6 +923,32 @@ GeneralData CloudProvider::getGeneralDataResponse(std::istream&) const {
   return {};
 }
 
+ChangeSet CloudProvider::listChangesResponse(std::istream&, bool&) const {
+  return {};
+}
+
+std::string CloudProvider::uploadSessionStartResponse(
+    const IHttpRequest::HeaderParameters&, std::istream&) const {
+  return "";
+}
+
+std::string CloudProvider::uploadPartResponse(
+    const UploadSession&, uint64_t, const IHttpRequest::HeaderParameters&,
+    std::istream&) const {
+  return "";
+}
+
+bool CloudProvider::uploadPartUploaded(const UploadSession&, uint64_t,
+                                       const Error&) const {
+  return false;
+}
+
+IItem::Pointer CloudProvider::uploadSessionCommitResponse(
+    const IItem& directory, const std::string& filename,
+    const UploadSession& session, std::istream& response) const {
+  return uploadFileResponse(directory, filename, session.size_, response);
+}
+
 std::string CloudProvider::getItemUrlResponse(
     const IItem&, const IHttpRequest::HeaderParameters&,
     std::istream& stream) const {
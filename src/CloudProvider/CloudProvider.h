@@ -24,6 +24,7 @@
 #ifndef CLOUDPROVIDER_H
 #define CLOUDPROVIDER_H
 
+#include <chrono>
 #include <cstdint>
 #include <mutex>
 #include <sstream>
@@ -36,6 +37,12 @@
 
 namespace cloudstorage {
 
+class BlockCache;
+class MetadataCache;
+class Timer;
+struct ChangeSnapshot;
+struct UploadSession;
+
 class CloudProvider : public ICloudProvider,
                       public std::enable_shared_from_this<CloudProvider> {
  public:
@@ -54,12 +61,17 @@ class CloudProvider : public ICloudProvider,
   std::string token() const override;
   IItem::Pointer rootDirectory() const override;
   OperationSet supportedOperations() const override;
+  CacheStatistics metadataCacheStatistics() const override;
   ICrypto* crypto() const;
   IHttp* http() const;
   IHttpServerFactory* http_server() const;
   IThreadPool* thread_pool() const;
   IAuthCallback* auth_callback() const;
   std::string file_url() const;
+  std::shared_ptr<BlockCache> block_cache() const;
+  std::string temporary_directory() const;
+  std::shared_ptr<MetadataCache> metadata_cache() const;
+  std::shared_ptr<ChangeSnapshot> change_snapshot() const;
 
   virtual bool isSuccess(int code, const IHttpRequest::HeaderParameters&) const;
 
@@ -109,6 +121,8 @@ class CloudProvider : public ICloudProvider,
                                              const std::string& filename,
                                              UploadFileCallback) override;
   GeneralDataRequest::Pointer getGeneralDataAsync(GeneralDataCallback) override;
+  ListChangesRequest::Pointer listChangesAsync(const std::string& cursor,
+                                               ListChangesCallback) override;
   GetItemUrlRequest::Pointer getFileDaemonUrlAsync(IItem::Pointer,
                                                    GetItemUrlCallback) override;
 
@@ -136,6 +150,28 @@ class CloudProvider : public ICloudProvider,
       const IItem&, const std::string& page_token,
       std::ostream& input_stream) const;
 
+  /**
+   * Used by default implementation of listDirectoryAsync; when page tokens
+   * are offsets of page's first item (empty token standing for 0), following
+   * pages are requested before the previous ones are fetched.
+   *
+   * @return whether page tokens are item offsets, false by default
+   */
+  virtual bool listDirectoryOffsetTokens() const;
+
+  /**
+   * @return count of directory pages fetched or buffered at once, by default
+   * set with list_directory_parallelism hint
+   */
+  virtual uint32_t listDirectoryParallelism() const;
+
+  /**
+   * @return count of directory listings and item visits run at once by
+   * requests which walk whole trees, by default set with
+   * recursive_request_parallelism hint
+   */
+  virtual uint32_t recursiveRequestParallelism() const;
+
   /**
    * Used by default implementation of uploadFileAsync.
    *
@@ -149,6 +185,108 @@ class CloudProvider : public ICloudProvider,
       const IItem& directory, const std::string& filename,
       std::ostream& prefix_stream, std::ostream& suffix_stream) const;
 
+  /**
+   * Used by default implementation of uploadFileAsync; larger files are
+   * rejected before anything is sent.
+   *
+   * @return maximum size of an uploaded file, IItem::UnknownSize (no limit) by
+   * default
+   */
+  virtual uint64_t uploadMaxSize() const;
+
+  /**
+   * Used by default implementation of uploadFileAsync; files larger than
+   * returned size are uploaded in parts using upload session methods.
+   *
+   * @return part size, 0 if chunked uploads aren't supported
+   */
+  virtual uint64_t uploadSessionPartSize() const;
+
+  /**
+   * @return count of parts of a chunked upload which may be uploaded at once,
+   * by default set with upload_parallelism hint
+   */
+  virtual uint32_t uploadSessionParallelism() const;
+
+  /**
+   * Parts of chunked uploads of known size are made larger than
+   * uploadSessionPartSize() to keep their count within the limit.
+   *
+   * @return maximum count of parts of a chunked upload, 0 (no limit) by
+   * default
+   */
+  virtual uint64_t uploadSessionMaxPartCount() const;
+
+  /**
+   * Whether upload sessions can be started before the size of the file is
+   * known; if so, files of unknown size are uploaded as they are being
+   * written, uploadSessionStartRequest receives IItem::UnknownSize and
+   * session's size is set before uploading the last part.
+   *
+   * @return false by default
+   */
+  virtual bool uploadSessionStreaming() const;
+
+  /**
+   * Whether the last part of a chunked upload of known size has to be
+   * uploaded after all the other parts, e.g. because it closes the session.
+   *
+   * @return false by default
+   */
+  virtual bool uploadSessionLastPartAfterOthers() const;
+
+  /**
+   * Used by chunked uploads, should start a new upload session.
+   *
+   * @param directory
+   * @param filename
+   * @param size size of the whole file, IItem::UnknownSize for streamed
+   * uploads
+   * @param input_stream request body
+   * @return http request
+   */
+  virtual IHttpRequest::Pointer uploadSessionStartRequest(
+      const IItem& directory, const std::string& filename, uint64_t size,
+      std::ostream& input_stream) const;
+
+  /**
+   * Used by chunked uploads, should upload one part of the file. Parts may be
+   * uploaded concurrently, out of order and more than once.
+   *
+   * @param session
+   * @param part part index, part's data is at session.offset(part)
+   * @param prefix_stream what should be sent before the part in request's body
+   * @param suffix_stream what should be sent after the part in request's body
+   * @return http request
+   */
+  virtual IHttpRequest::Pointer uploadPartRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, uint64_t part, std::ostream& prefix_stream,
+      std::ostream& suffix_stream) const;
+
+  /**
+   * Used by chunked uploads, should assemble the file from uploaded parts.
+   *
+   * @param session session with parts_ set
+   * @param input_stream request body
+   * @return http request
+   */
+  virtual IHttpRequest::Pointer uploadSessionCommitRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const;
+
+  /**
+   * Used by chunked uploads when the upload is cancelled, should discard the
+   * session and parts uploaded so far. The response is ignored.
+   *
+   * @param session
+   * @param input_stream request body
+   * @return http request, nullptr by default
+   */
+  virtual IHttpRequest::Pointer uploadSessionAbortRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const;
+
   /**
    * Used by default implementation of downloadFileAsync.
    *
@@ -211,6 +349,32 @@ class CloudProvider : public ICloudProvider,
 
   virtual IHttpRequest::Pointer getGeneralDataRequest(std::ostream&) const;
 
+  /**
+   * Used by default implementation of listChangesAsync; providers without a
+   * change feed get changes by comparing snapshots of the whole tree.
+   *
+   * @return whether listChangesRequest and listChangesResponse are
+   * implemented, false by default
+   */
+  virtual bool hasChangeFeed() const;
+
+  /**
+   * Used by default implementation of listChangesAsync.
+   *
+   * @param cursor position in the change feed, empty to request the current
+   * position
+   * @param input_stream request body
+   * @return http request
+   */
+  virtual IHttpRequest::Pointer listChangesRequest(
+      const std::string& cursor, std::ostream& input_stream) const;
+
+  /**
+   * @return whether the error of listChangesRequest means that the cursor
+   * expired, by default true for http code 410
+   */
+  virtual bool listChangesExpired(const Error&) const;
+
   /**
    * Used by default implementation of getItemDataAsync, should translate
    * reponse into IItem object.
@@ -252,6 +416,49 @@ class CloudProvider : public ICloudProvider,
                                             std::istream& response) const;
   virtual GeneralData getGeneralDataResponse(std::istream& response) const;
 
+  /**
+   * Used by default implementation of listChangesAsync, should extract
+   * changes and the cursor which follows them.
+   *
+   * @param response
+   * @param has_more set to true if more changes can be fetched right away with
+   * the returned cursor
+   * @return changes
+   */
+  virtual ChangeSet listChangesResponse(std::istream& response,
+                                        bool& has_more) const;
+
+  /**
+   * @return upload session identifier
+   */
+  virtual std::string uploadSessionStartResponse(
+      const IHttpRequest::HeaderParameters&, std::istream& response) const;
+
+  /**
+   * @return identifier of uploaded part which will be passed to
+   * uploadSessionCommitRequest, empty by default
+   */
+  virtual std::string uploadPartResponse(const UploadSession&, uint64_t part,
+                                         const IHttpRequest::HeaderParameters&,
+                                         std::istream& response) const;
+
+  /**
+   * Called when a retry of uploadPartRequest fails; the attempt whose response
+   * was lost might have stored the part.
+   *
+   * @return whether the error means that the part is already uploaded, false
+   * by default
+   */
+  virtual bool uploadPartUploaded(const UploadSession&, uint64_t part,
+                                  const Error&) const;
+
+  /**
+   * By default calls uploadFileResponse.
+   */
+  virtual IItem::Pointer uploadSessionCommitResponse(
+      const IItem& directory, const std::string& filename,
+      const UploadSession&, std::istream& response) const;
+
   /**
    * Used by default implementation of createDirectoryAsync, should translate
    * response into new directory's item object.
@@ -303,6 +510,13 @@ class CloudProvider : public ICloudProvider,
                    std::function<void(std::string)>) const;
   std::string defaultFileDaemonUrl(const IItem& item, uint64_t size) const;
 
+  /**
+   * Replaces the timer which runs background token refreshes, e.g. with one
+   * following another clock; should be called before the provider is
+   * initialized.
+   */
+  void setTokenRefreshTimer(std::shared_ptr<Timer>);
+
  private:
   friend class AuthorizeRequest;
   template <class T>
@@ -313,6 +527,18 @@ class CloudProvider : public ICloudProvider,
       std::function<IHttpRequest::Pointer(const IItem&, std::ostream&)>,
       IDownloadFileCallback::Pointer);
 
+  /**
+   * Schedules a background token refresh shortly before the current access
+   * token expires; should be called after authorization succeeded.
+   */
+  void scheduleTokenRefresh();
+
+  /**
+   * Starts refreshing the access token unless an authorization is already
+   * running; requests keep using the old token until the new one arrives.
+   */
+  void refreshToken();
+
   IAuth::Pointer auth_;
   IAuthCallback::Pointer callback_;
   ICrypto::Pointer crypto_;
@@ -320,12 +546,23 @@ class CloudProvider : public ICloudProvider,
   IHttpServerFactory::Pointer http_server_;
   IThreadPool::Pointer thread_pool_;
   AuthorizeRequest::Pointer current_authorization_;
+  // kept alive by current_authorization_ while it runs
+  std::weak_ptr<AuthorizeRequest> token_refresh_;
+  // runs background token refreshes
+  std::shared_ptr<Timer> token_refresh_timer_;
   std::unordered_map<IGenericRequest*,
                      std::vector<AuthorizeRequest::AuthorizeCompleted>>
       auth_callbacks_;
   std::unordered_set<std::shared_ptr<ICloudProvider::DownloadFileRequest>>
       stream_requests_;
   std::string file_url_;
+  std::shared_ptr<BlockCache> block_cache_;
+  std::shared_ptr<MetadataCache> metadata_cache_;
+  std::shared_ptr<ChangeSnapshot> change_snapshot_;
+  std::string temporary_directory_;
+  uint32_t upload_parallelism_;
+  uint32_t list_directory_parallelism_;
+  uint32_t recursive_request_parallelism_;
   IHttpServer::Pointer file_daemon_;
   std::mutex stream_request_mutex_;
   std::mutex current_authorization_mutex_;
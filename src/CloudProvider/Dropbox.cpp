@@ -31,68 +31,63 @@
 #include "Utility/Utility.h"
 
 #include "Request/Request.h"
+#include "Request/UploadFileRequest.h"
 
 const std::string DROPBOXAPI_ENDPOINT = "https://api.dropboxapi.com";
-const int CHUNK_SIZE = 60 * 1024 * 1024;
+const std::string UPLOAD_SESSION_ENDPOINT =
+    "https://content.dropboxapi.com/2/files/upload_session";
+// parts of concurrent upload sessions have to be multiples of 4 MiB
+const uint64_t UPLOAD_PART_ALIGNMENT = 4 * 1024 * 1024;
+const uint64_t DEFAULT_UPLOAD_PART_SIZE = 60 * 1024 * 1024;
+// a single append can't carry more than 150 MiB
+const uint64_t MAX_UPLOAD_PART_SIZE = 150 * 1024 * 1024;
+const uint32_t MAX_COMMIT_BATCH = 1000;
+
+using namespace std::placeholders;
 
 namespace cloudstorage {
 
 namespace {
-void upload(Request<EitherError<IItem>>::Pointer r,
-            const std::string& session_id, const std::string& path, int sent,
-            IUploadFileCallback* callback) {
-  int size = callback->size();
-  auto length = std::make_shared<int>(0);
-  r->send(
-      [=](util::Output stream) {
-        std::vector<char> buffer(CHUNK_SIZE);
-        if (sent < size)
-          *length = callback->putData(buffer.data(), CHUNK_SIZE, sent);
-        std::string upload_url =
-            "https://content.dropboxapi.com/2/files/upload_session";
-        Json::Value json;
-        if (sent == 0)
-          upload_url += "/start";
-        else if (sent + *length >= size) {
-          json["commit"]["path"] = path;
-          json["commit"]["mode"] = "overwrite";
-          upload_url += "/finish";
-        } else
-          upload_url += "/append_v2";
-        auto request = r->provider()->http()->create(upload_url, "POST");
-        if (sent != 0) {
-          json["cursor"]["session_id"] = session_id;
-          json["cursor"]["offset"] = sent;
-        }
-        request->setHeaderParameter("Content-Type", "application/octet-stream");
-        request->setHeaderParameter("Dropbox-API-Arg",
-                                    util::json::to_string(json));
-        stream->write(buffer.data(), *length);
-        return request;
-      },
-      [=](EitherError<Response> e) {
-        if (e.left()) return r->done(e.left());
-        try {
-          auto json = util::json::from_stream(e.right()->output());
-          if (sent < size)
-            upload(
-                r,
-                session_id.empty() ? json["session_id"].asString() : session_id,
-                path, sent + *length, callback);
-          else
-            r->done(Dropbox::toItem(json));
-        } catch (const Json::Exception&) {
-          r->done(Error{IHttpRequest::Failure, e.right()->output().str()});
-        }
-      },
-      [] { return std::make_shared<std::stringstream>(); },
-      std::make_shared<std::stringstream>(), nullptr,
-      [=](uint64_t, uint64_t now) { callback->progress(size, sent + now); },
-      true);
+IHttpRequest::Pointer uploadSessionRequest(const IHttp* http,
+                                           const std::string& operation,
+                                           const Json::Value& argument) {
+  auto request =
+      http->create(UPLOAD_SESSION_ENDPOINT + "/" + operation, "POST");
+  request->setHeaderParameter("Content-Type", "application/octet-stream");
+  request->setHeaderParameter("Dropbox-API-Arg",
+                              util::json::to_string(argument));
+  return request;
+}
+
+Json::Value cursor(const std::string& session_id, uint64_t offset) {
+  Json::Value json;
+  json["session_id"] = session_id;
+  json["offset"] = Json::UInt64(offset);
+  return json;
+}
+
+Json::Value commitInfo(const std::string& path) {
+  Json::Value json;
+  json["path"] = path;
+  json["mode"] = "overwrite";
+  return json;
 }
 }  // namespace
 
-Dropbox::Dropbox() : CloudProvider(util::make_unique<Auth>()) {}
+Dropbox::Dropbox()
+    : CloudProvider(util::make_unique<Auth>()),
+      part_size_(DEFAULT_UPLOAD_PART_SIZE),
+      committing_() {}
+
+void Dropbox::initialize(InitData&& init_data) {
+  setWithHint(init_data.hints_, "upload_part_size", [this](std::string v) {
+    part_size_ = std::max<uint64_t>(
+        std::min<uint64_t>(std::stoull(v), MAX_UPLOAD_PART_SIZE) /
+            UPLOAD_PART_ALIGNMENT * UPLOAD_PART_ALIGNMENT,
+        UPLOAD_PART_ALIGNMENT);
+  });
+  CloudProvider::initialize(std::move(init_data));
+}
 
 std::string Dropbox::name() const { return "dropbox"; }
 
@@ -112,12 +107,36 @@ bool Dropbox::reauthorize(int code,
 ICloudProvider::UploadFileRequest::Pointer Dropbox::uploadFileAsync(
     IItem::Pointer parent, const std::string& filename,
     IUploadFileCallback::Pointer cb) {
-  auto callback = cb.get();
+  auto size = cb->size();
+  if (size == IItem::UnknownSize || size > uploadSessionPartSize())
+    return CloudProvider::uploadFileAsync(parent, filename, cb);
+  auto path = parent->id() + "/" + filename;
+  auto stream_wrapper = std::make_shared<UploadStreamWrapper>(
+      std::bind(&IUploadFileCallback::putData, cb.get(), _1, _2, _3), size);
+  auto resolver = [=](Request<EitherError<IItem>>::Pointer r) {
+    r->send(
+        [=](util::Output) {
+          stream_wrapper->reset();
+          Json::Value argument;
+          argument["close"] = true;
+          return uploadSessionRequest(http(), "start", argument);
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return r->done(e.left());
+          try {
+            commitUpload({uploadSessionStartResponse({}, e.right()->output()),
+                          path, size, r});
+          } catch (const Json::Exception&) {
+            r->done(Error{IHttpRequest::Failure, e.right()->output().str()});
+          }
+        },
+        [=] { return std::make_shared<std::iostream>(stream_wrapper.get()); },
+        std::make_shared<std::stringstream>(), nullptr,
+        std::bind(&IUploadFileCallback::progress, cb, _1, _2), true);
+  };
   return std::make_shared<Request<EitherError<IItem>>>(
              shared_from_this(), [=](EitherError<IItem> e) { cb->done(e); },
-             [=](Request<EitherError<IItem>>::Pointer r) {
-               upload(r, "", parent->id() + "/" + filename, 0, callback);
-             })
+             resolver)
       ->run();
 }
 
@@ -213,6 +232,37 @@ IHttpRequest::Pointer Dropbox::listDirectoryRequest(
   return request;
 }
 
+bool Dropbox::hasChangeFeed() const { return true; }
+
+IHttpRequest::Pointer Dropbox::listChangesRequest(
+    const std::string& cursor, std::ostream& input_stream) const {
+  Json::Value input;
+  IHttpRequest::Pointer request;
+  if (cursor.empty()) {
+    request = http()->create(
+        endpoint() + "/2/files/list_folder/get_latest_cursor", "POST");
+    input["path"] = rootDirectory()->id();
+    input["recursive"] = true;
+  } else {
+    request =
+        http()->create(endpoint() + "/2/files/list_folder/continue", "POST");
+    input["cursor"] = cursor;
+  }
+  request->setHeaderParameter("Content-Type", "application/json");
+  input_stream << util::json::to_string(input);
+  return request;
+}
+
+bool Dropbox::listChangesExpired(const Error& e) const {
+  if (e.code_ != 409) return false;
+  try {
+    return util::json::from_string(e.description_)["error"][".tag"]
+               .asString() == "reset";
+  } catch (const Json::Exception&) {
+    return false;
+  }
+}
+
 void Dropbox::authorizeRequest(IHttpRequest& r) const {
   r.setHeaderParameter("Authorization", "Bearer " + token());
 }
@@ -292,6 +342,151 @@ IHttpRequest::Pointer Dropbox::renameItemRequest(const IItem& item,
   return request;
 }
 
+uint64_t Dropbox::uploadSessionPartSize() const { return part_size_; }
+
+bool Dropbox::uploadSessionLastPartAfterOthers() const {
+  // nothing can be appended once the last part closes the session
+  return true;
+}
+
+IHttpRequest::Pointer Dropbox::uploadSessionStartRequest(const IItem&,
+                                                         const std::string&,
+                                                         uint64_t,
+                                                         std::ostream&) const {
+  Json::Value argument;
+  argument["session_type"] = "concurrent";
+  return uploadSessionRequest(http(), "start", argument);
+}
+
+IHttpRequest::Pointer Dropbox::uploadPartRequest(const IItem&,
+                                                 const std::string&,
+                                                 const UploadSession& session,
+                                                 uint64_t part, std::ostream&,
+                                                 std::ostream&) const {
+  Json::Value argument;
+  argument["cursor"] = cursor(session.id_, session.offset(part));
+  argument["close"] = part + 1 == session.part_count();
+  return uploadSessionRequest(http(), "append_v2", argument);
+}
+
+IHttpRequest::Pointer Dropbox::uploadSessionCommitRequest(
+    const IItem& directory, const std::string& filename,
+    const UploadSession& session, std::ostream&) const {
+  Json::Value argument;
+  argument["cursor"] = cursor(session.id_, session.size_);
+  argument["commit"] = commitInfo(directory.id() + "/" + filename);
+  return uploadSessionRequest(http(), "finish", argument);
+}
+
+std::string Dropbox::uploadSessionStartResponse(
+    const IHttpRequest::HeaderParameters&, std::istream& response) const {
+  auto session_id = util::json::from_stream(response)["session_id"];
+  if (!session_id.isString()) throw Json::LogicError("no session id");
+  return session_id.asString();
+}
+
+bool Dropbox::uploadPartUploaded(const UploadSession& session, uint64_t part,
+                                 const Error& e) const {
+  // append_v2 isn't idempotent; the retry of an append which was stored is
+  // rejected with the offset of the data following it
+  if (e.code_ != 409) return false;
+  try {
+    auto error = util::json::from_string(e.description_)["error"];
+    return error[".tag"].asString() == "incorrect_offset" &&
+           error["correct_offset"].asUInt64() ==
+               session.offset(part) + session.length(part);
+  } catch (const Json::Exception&) {
+    return false;
+  }
+}
+
+IItem::Pointer Dropbox::uploadSessionCommitResponse(
+    const IItem&, const std::string&, const UploadSession&,
+    std::istream& response) const {
+  return toItem(util::json::from_stream(response));
+}
+
+void Dropbox::commitUpload(const Commit& commit) {
+  {
+    std::lock_guard<std::mutex> lock(commit_mutex_);
+    commits_.push_back(commit);
+    if (committing_) return;
+    committing_ = true;
+  }
+  sendCommits();
+}
+
+void Dropbox::sendCommits() {
+  auto batch = std::make_shared<std::vector<Commit>>();
+  std::vector<Commit> cancelled;
+  {
+    std::lock_guard<std::mutex> lock(commit_mutex_);
+    while (!commits_.empty() && batch->size() < MAX_COMMIT_BATCH) {
+      if (commits_.front().request_->is_cancelled())
+        cancelled.push_back(commits_.front());
+      else
+        batch->push_back(commits_.front());
+      commits_.pop_front();
+    }
+    if (batch->empty()) committing_ = false;
+  }
+  for (auto&& c : cancelled)
+    c.request_->done(Error{IHttpRequest::Aborted, util::Error::ABORTED});
+  if (batch->empty()) return;
+  auto self = std::static_pointer_cast<Dropbox>(shared_from_this());
+  // the batch is committed on behalf of its first upload; if that one gets
+  // cancelled, the rest of the batch is queued again
+  batch->front().request_->request(
+      [=](util::Output input) {
+        Json::Value json;
+        for (auto&& c : *batch) {
+          Json::Value entry;
+          entry["cursor"] = cursor(c.session_id_, c.size_);
+          entry["commit"] = commitInfo(c.path_);
+          json["entries"].append(entry);
+        }
+        *input << util::json::to_string(json);
+        auto request = http()->create(
+            endpoint() + "/2/files/upload_session/finish_batch_v2", "POST");
+        request->setHeaderParameter("Content-Type", "application/json");
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        std::vector<Commit> retried;
+        if (e.left()) {
+          for (auto&& c : *batch)
+            if (e.left()->code_ == IHttpRequest::Aborted &&
+                !c.request_->is_cancelled())
+              retried.push_back(c);
+            else
+              c.request_->done(e.left());
+        } else {
+          try {
+            auto json = util::json::from_stream(e.right()->output());
+            const auto& entries = json["entries"];
+            if (!entries.isArray() || entries.size() != batch->size())
+              throw Json::LogicError("invalid batch result");
+            for (Json::ArrayIndex i = 0; i < entries.size(); i++)
+              if (entries[i][".tag"].asString() == "success")
+                (*batch)[i].request_->done(toItem(entries[i]));
+              else
+                (*batch)[i].request_->done(Error{
+                    IHttpRequest::Failure, util::json::to_string(entries[i])});
+          } catch (const Json::Exception&) {
+            for (auto&& c : *batch)
+              c.request_->done(
+                  Error{IHttpRequest::Failure, e.right()->output().str()});
+          }
+        }
+        {
+          std::lock_guard<std::mutex> lock(self->commit_mutex_);
+          self->commits_.insert(self->commits_.begin(), retried.begin(),
+                                retried.end());
+        }
+        self->sendCommits();
+      });
+}
+
 IItem::List Dropbox::listDirectoryResponse(const IItem&, std::istream& stream,
                                            std::string& next_page_token) const {
   auto response = util::json::from_stream(stream);
@@ -303,6 +498,27 @@ IItem::List Dropbox::listDirectoryResponse(const IItem&, std::istream& stream,
   return result;
 }
 
+ChangeSet Dropbox::listChangesResponse(std::istream& stream,
+                                       bool& has_more) const {
+  auto response = util::json::from_stream(stream);
+  ChangeSet result;
+  for (const Json::Value& v : response["entries"]) {
+    auto path = v.isMember("path_display") ? v["path_display"].asString()
+                                           : v["path_lower"].asString();
+    if (v[".tag"].asString() == "deleted") {
+      result.changes_.push_back({path, nullptr});
+    } else {
+      auto item = toItem(v);
+      static_cast<Item*>(item.get())
+          ->set_parents({path.substr(0, path.find_last_of('/'))});
+      result.changes_.push_back({path, item});
+    }
+  }
+  result.cursor_ = response["cursor"].asString();
+  has_more = response["has_more"].asBool();
+  return result;
+}
+
 IItem::Pointer Dropbox::createDirectoryResponse(const IItem&,
                                                 const std::string&,
                                                 std::istream& response) const {
@@ -25,15 +25,25 @@
 #define DROPBOX_H
 
 #include <json/forwards.h>
+#include <deque>
+#include <mutex>
 
 #include "CloudProvider.h"
 
 namespace cloudstorage {
 
+/**
+ * Files larger than upload part size are appended to a concurrent upload
+ * session, several parts at once. Smaller files are uploaded to their own
+ * closed sessions; the sessions are committed together with finish_batch,
+ * commits which come while a batch is being committed go to the next one.
+ */
 class Dropbox : public CloudProvider {
  public:
   Dropbox();
 
+  void initialize(InitData&&) override;
+
   std::string name() const override;
   std::string endpoint() const override;
   IItem::Pointer rootDirectory() const override;
@@ -51,6 +61,10 @@ class Dropbox : public CloudProvider {
   IHttpRequest::Pointer listDirectoryRequest(
       const IItem&, const std::string& page_token,
       std::ostream& input_stream) const override;
+  bool hasChangeFeed() const override;
+  IHttpRequest::Pointer listChangesRequest(
+      const std::string& cursor, std::ostream& input_stream) const override;
+  bool listChangesExpired(const Error&) const override;
   IHttpRequest::Pointer downloadFileRequest(
       const IItem&, std::ostream& input_stream) const override;
   IHttpRequest::Pointer getThumbnailRequest(
@@ -66,8 +80,31 @@ class Dropbox : public CloudProvider {
                                           const std::string& name,
                                           std::ostream&) const override;
 
+  uint64_t uploadSessionPartSize() const override;
+  bool uploadSessionLastPartAfterOthers() const override;
+  IHttpRequest::Pointer uploadSessionStartRequest(
+      const IItem& directory, const std::string& filename, uint64_t size,
+      std::ostream& input_stream) const override;
+  IHttpRequest::Pointer uploadPartRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, uint64_t part, std::ostream& prefix_stream,
+      std::ostream& suffix_stream) const override;
+  IHttpRequest::Pointer uploadSessionCommitRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const override;
+  std::string uploadSessionStartResponse(
+      const IHttpRequest::HeaderParameters&,
+      std::istream& response) const override;
+  bool uploadPartUploaded(const UploadSession&, uint64_t part,
+                          const Error&) const override;
+  IItem::Pointer uploadSessionCommitResponse(
+      const IItem& directory, const std::string& filename,
+      const UploadSession&, std::istream& response) const override;
+
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
+  ChangeSet listChangesResponse(std::istream&,
+                                bool& has_more) const override;
   std::string getItemUrlResponse(const IItem& item,
                                  const IHttpRequest::HeaderParameters&,
                                  std::istream& response) const override;
@@ -85,6 +122,21 @@ class Dropbox : public CloudProvider {
   static IItem::Pointer toItem(const Json::Value&);
 
  private:
+  struct Commit {
+    std::string session_id_;
+    std::string path_;
+    uint64_t size_;
+    Request<EitherError<IItem>>::Pointer request_;
+  };
+
+  void commitUpload(const Commit&);
+  void sendCommits();
+
+  uint64_t part_size_;
+  std::mutex commit_mutex_;
+  std::deque<Commit> commits_;
+  bool committing_;
+
   class Auth : public cloudstorage::Auth {
    public:
     void initialize(IHttp*, IHttpServerFactory*) override;
@@ -148,6 +148,23 @@ IHttpRequest::Pointer GoogleDrive::listDirectoryRequest(
   return request;
 }
 
+bool GoogleDrive::hasChangeFeed() const { return true; }
+
+IHttpRequest::Pointer GoogleDrive::listChangesRequest(const std::string& cursor,
+                                                      std::ostream&) const {
+  if (cursor.empty())
+    return http()->create(endpoint() + "/drive/v3/changes/startPageToken",
+                          "GET");
+  auto request = http()->create(endpoint() + "/drive/v3/changes", "GET");
+  request->setParameter("pageToken", cursor);
+  request->setParameter("pageSize", "1000");
+  request->setParameter("fields",
+                        "changes(changeType,fileId,removed,file(id,name,"
+                        "thumbnailLink,trashed,mimeType,iconLink,parents,size,"
+                        "modifiedTime)),nextPageToken,newStartPageToken");
+  return request;
+}
+
 IHttpRequest::Pointer GoogleDrive::uploadFileRequest(
     const IItem& f, const std::string& filename, std::ostream& prefix_stream,
     std::ostream& suffix_stream) const {
@@ -320,6 +337,28 @@ IItem::List GoogleDrive::listDirectoryResponse(
   return result;
 }
 
+ChangeSet GoogleDrive::listChangesResponse(std::istream& stream,
+                                           bool& has_more) const {
+  auto response = util::json::from_stream(stream);
+  ChangeSet result;
+  for (const Json::Value& v : response["changes"]) {
+    if (v.isMember("changeType") && v["changeType"].asString() != "file")
+      continue;
+    result.changes_.push_back(
+        {v["fileId"].asString(),
+         v["removed"].asBool() ? nullptr : toItem(v["file"])});
+  }
+  if (response.isMember("nextPageToken")) {
+    result.cursor_ = response["nextPageToken"].asString();
+    has_more = true;
+  } else if (response.isMember("newStartPageToken")) {
+    result.cursor_ = response["newStartPageToken"].asString();
+  } else {
+    result.cursor_ = response["startPageToken"].asString();
+  }
+  return result;
+}
+
 GeneralData GoogleDrive::getGeneralDataResponse(std::istream& response) const {
   auto json = util::json::from_stream(response);
   GeneralData data;
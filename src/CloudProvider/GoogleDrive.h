@@ -51,6 +51,9 @@ class GoogleDrive : public CloudProvider {
   IHttpRequest::Pointer listDirectoryRequest(
       const IItem&, const std::string& page_token,
       std::ostream& input_stream) const override;
+  bool hasChangeFeed() const override;
+  IHttpRequest::Pointer listChangesRequest(
+      const std::string& cursor, std::ostream& input_stream) const override;
   IHttpRequest::Pointer uploadFileRequest(
       const IItem& directory, const std::string& filename,
       std::ostream& prefix_stream, std::ostream& suffix_stream) const override;
@@ -73,6 +76,8 @@ class GoogleDrive : public CloudProvider {
                                  std::istream& response) const override;
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
+  ChangeSet listChangesResponse(std::istream&,
+                                bool& has_more) const override;
   GeneralData getGeneralDataResponse(std::istream& response) const override;
 
   IHttpRequest::Pointer upload(const IItem& f, const std::string& url,
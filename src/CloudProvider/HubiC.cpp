@@ -22,12 +22,49 @@
  *****************************************************************************/
 #include "HubiC.h"
 
-#include "Request/RecursiveRequest.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "Request/ParallelTasks.h"
+#include "Request/UploadFileRequest.h"
 #include "Utility/Item.h"
 
 namespace cloudstorage {
 
-HubiC::HubiC() : CloudProvider(util::make_unique<Auth>()) {}
+namespace {
+
+const std::string CONTAINER = "default";
+const std::string SEGMENT_CONTAINER = "default_segments";
+const uint64_t DEFAULT_UPLOAD_PART_SIZE = 64 * 1024 * 1024;
+const uint64_t MIN_UPLOAD_PART_SIZE = 1024 * 1024;
+const uint32_t LIST_LIMIT = 10000;
+const uint32_t DELETE_BATCH_SIZE = 1000;
+const uint64_t MAX_SEGMENT_COUNT = 1000;
+const uint32_t BULK_PARALLELISM = 16;
+
+std::string joinPath(const std::string& directory, const std::string& name) {
+  return directory + (directory.empty() ? "" : "/") + name;
+}
+
+EitherError<void> result(EitherError<Response> e) {
+  if (e.left()) return e.left();
+  return nullptr;
+}
+
+}  // namespace
+
+HubiC::HubiC()
+    : CloudProvider(util::make_unique<Auth>()),
+      part_size_(DEFAULT_UPLOAD_PART_SIZE),
+      bulk_delete_(true) {}
+
+void HubiC::initialize(InitData&& init_data) {
+  setWithHint(init_data.hints_, "upload_part_size", [this](std::string v) {
+    part_size_ = std::max<uint64_t>(std::stoull(v), MIN_UPLOAD_PART_SIZE);
+  });
+  CloudProvider::initialize(std::move(init_data));
+}
 
 std::string HubiC::name() const { return "hubic"; }
 
@@ -160,100 +197,28 @@ AuthorizeRequest::Pointer HubiC::authorizeAsync() {
 ICloudProvider::MoveItemRequest::Pointer HubiC::moveItemAsync(
     IItem::Pointer source, IItem::Pointer destination,
     MoveItemCallback callback) {
-  using Request = RecursiveRequest<EitherError<IItem>>;
-  auto visitor = [=](Request::Pointer r, IItem::Pointer item,
-                     Request::CompleteCallback callback) {
-    auto l = getPath("/" + source->id()).length();
-    std::string new_id = destination->id() +
-                         (destination->id().empty() ? "" : "/") +
-                         item->id().substr(l == 0 ? 0 : l);
-    r->request(
-        [=](util::Output) {
-          auto r = http()->create(openstack_endpoint() + "/default/" +
-                                      util::Url::escape(item->id()),
-                                  "COPY");
-          r->setHeaderParameter("Destination",
-                                "/default/" + util::Url::escape(new_id));
-          return r;
-        },
-        [=](EitherError<Response> e) {
-          if (e.left()) return callback(e.left());
-          r->request(
-              [=](util::Output) {
-                return http()->create(openstack_endpoint() + "/default/" +
-                                          util::Url::escape(item->id()),
-                                      "DELETE");
-              },
-              [=](EitherError<Response> e) {
-                if (e.left()) return callback(e.left());
-                IItem::Pointer renamed = std::make_shared<Item>(
-                    getFilename(new_id), new_id, item->size(),
-                    item->timestamp(), item->type());
-                callback(renamed);
-              });
-        });
-  };
-  return std::make_shared<Request>(shared_from_this(), source, callback,
-                                   visitor)
-      ->run();
+  auto l = getPath("/" + source->id()).length();
+  return transferItemAsync(
+      source, joinPath(destination->id(), source->id().substr(l)), callback);
 }
 
 ICloudProvider::MoveItemRequest::Pointer HubiC::renameItemAsync(
     IItem::Pointer root, const std::string &name, RenameItemCallback callback) {
-  using Request = RecursiveRequest<EitherError<IItem>>;
-  auto new_prefix = (getPath("/" + root->id()) + "/" + name).substr(1);
-  auto visitor = [=](Request::Pointer r, IItem::Pointer item,
-                     Request::CompleteCallback callback) {
-    std::string new_id = new_prefix + item->id().substr(root->id().length());
-    r->request(
-        [=](util::Output) {
-          auto r = http()->create(openstack_endpoint() + "/default/" +
-                                      util::Url::escape(item->id()),
-                                  "COPY");
-          r->setHeaderParameter("Destination",
-                                "/default/" + util::Url::escape(new_id));
-          return r;
-        },
-        [=](EitherError<Response> e) {
-          if (e.left()) return callback(e.left());
-          r->request(
-              [=](util::Output) {
-                return http()->create(openstack_endpoint() + "/default/" +
-                                          util::Url::escape(item->id()),
-                                      "DELETE");
-              },
-              [=](EitherError<Response> e) {
-                if (e.left()) return callback(e.left());
-                IItem::Pointer renamed = std::make_shared<Item>(
-                    getFilename(new_id), new_id, item->size(),
-                    item->timestamp(), item->type());
-                callback(renamed);
-              });
-        });
-  };
-  return std::make_shared<Request>(shared_from_this(), root, callback, visitor)
-      ->run();
+  return transferItemAsync(
+      root, (getPath("/" + root->id()) + "/" + name).substr(1), callback);
 }
 
 ICloudProvider::DeleteItemRequest::Pointer HubiC::deleteItemAsync(
     IItem::Pointer item, DeleteItemCallback callback) {
-  using Request = RecursiveRequest<EitherError<void>>;
-  auto visitor = [=](Request::Pointer r, IItem::Pointer item,
-                     Request::CompleteCallback callback) {
-    r->request(
-        [=](util::Output) {
-          return http()->create(openstack_endpoint() + "/default/" +
-                                    util::Url::escape(item->id()),
-                                "DELETE");
-        },
-        [=](EitherError<Response> e) {
-          if (e.left())
-            callback(e.left());
-          else
-            callback(nullptr);
-        });
+  using Request = Request<EitherError<void>>;
+  auto resolver = [=](Request::Pointer r) {
+    auto objects = std::make_shared<ObjectList>();
+    listObjects(r, item, objects, [=](EitherError<void> e) {
+      if (e.left()) return r->done(e);
+      deleteObjects(r, objects, true, [=](EitherError<void> e) { r->done(e); });
+    });
   };
-  return std::make_shared<Request>(shared_from_this(), item, callback, visitor)
+  return std::make_shared<Request>(shared_from_this(), callback, resolver)
       ->run();
 }
 
@@ -337,6 +302,88 @@ IItem::Pointer HubiC::createDirectoryResponse(const IItem &parent,
       IItem::UnknownSize, IItem::UnknownTimeStamp, IItem::FileType::Directory);
 }
 
+uint64_t HubiC::uploadSessionPartSize() const { return part_size_; }
+
+uint64_t HubiC::uploadSessionMaxPartCount() const { return MAX_SEGMENT_COUNT; }
+
+bool HubiC::uploadSessionStreaming() const { return true; }
+
+IHttpRequest::Pointer HubiC::uploadSessionStartRequest(const IItem &,
+                                                       const std::string &,
+                                                       uint64_t,
+                                                       std::ostream &) const {
+  // creates the segment container unless it exists already
+  return http()->create(openstack_endpoint() + "/" + SEGMENT_CONTAINER, "PUT");
+}
+
+IHttpRequest::Pointer HubiC::uploadPartRequest(const IItem &directory,
+                                               const std::string &filename,
+                                               const UploadSession &session,
+                                               uint64_t part, std::ostream &,
+                                               std::ostream &) const {
+  return http()->create(
+      objectUrl(SEGMENT_CONTAINER,
+                segmentName(directory, filename, session, part)),
+      "PUT");
+}
+
+IHttpRequest::Pointer HubiC::uploadSessionCommitRequest(
+    const IItem &directory, const std::string &filename,
+    const UploadSession &session, std::ostream &input_stream) const {
+  auto r = http()->create(
+      objectUrl(CONTAINER, joinPath(directory.id(), filename)), "PUT");
+  r->setParameter("multipart-manifest", "put");
+  Json::Value manifest(Json::arrayValue);
+  for (uint64_t i = 0; i < session.parts_.size(); i++) {
+    Json::Value segment;
+    segment["path"] = "/" + SEGMENT_CONTAINER + "/" +
+                      segmentName(directory, filename, session, i);
+    segment["etag"] = session.parts_[i];
+    segment["size_bytes"] = Json::UInt64(session.length(i));
+    manifest.append(segment);
+  }
+  input_stream << util::json::to_string(manifest);
+  return r;
+}
+
+IHttpRequest::Pointer HubiC::uploadSessionAbortRequest(
+    const IItem &directory, const std::string &filename,
+    const UploadSession &session, std::ostream &input_stream) const {
+  if (session.id_.empty() || session.size_ == IItem::UnknownSize ||
+      session.part_count() == 0)
+    return nullptr;
+  auto r = http()->create(openstack_endpoint(), "POST");
+  r->setParameter("bulk-delete", "");
+  r->setHeaderParameter("Content-Type", "text/plain");
+  r->setHeaderParameter("Accept", "application/json");
+  for (uint64_t i = 0; i < session.part_count(); i++)
+    input_stream << "/" << SEGMENT_CONTAINER << "/"
+                 << util::Url::escape(
+                        segmentName(directory, filename, session, i))
+                 << "\n";
+  return r;
+}
+
+std::string HubiC::uploadSessionStartResponse(
+    const IHttpRequest::HeaderParameters &, std::istream &) const {
+  return std::to_string(
+      std::chrono::system_clock::now().time_since_epoch().count());
+}
+
+std::string HubiC::uploadPartResponse(const UploadSession &, uint64_t,
+                                      const IHttpRequest::HeaderParameters &h,
+                                      std::istream &) const {
+  auto etag = h.find("etag");
+  if (etag == h.end()) throw std::logic_error("no etag header");
+  return etag->second;
+}
+
+IItem::Pointer HubiC::uploadSessionCommitResponse(
+    const IItem &directory, const std::string &filename,
+    const UploadSession &session, std::istream &response) const {
+  return uploadFileResponse(directory, filename, session.size_, response);
+}
+
 IItem::Pointer HubiC::toItem(const Json::Value &v) const {
   auto item = std::make_shared<Item>(
       CloudProvider::getFilename(v["name"].asString()), v["name"].asString(),
@@ -360,6 +407,222 @@ std::string HubiC::openstack_token() const {
   return openstack_token_;
 }
 
+std::string HubiC::objectUrl(const std::string &container,
+                             const std::string &name) const {
+  return openstack_endpoint() + "/" + container + "/" + util::Url::escape(name);
+}
+
+std::string HubiC::segmentName(const IItem &directory,
+                               const std::string &filename,
+                               const UploadSession &session,
+                               uint64_t part) const {
+  char index[sizeof("00000000")];
+  snprintf(index, sizeof(index), "%08u", static_cast<uint32_t>(part));
+  return joinPath(directory.id(), filename) + "/" + session.id_ + "/" + index;
+}
+
+ICloudProvider::MoveItemRequest::Pointer HubiC::transferItemAsync(
+    IItem::Pointer item, const std::string &new_id, MoveItemCallback callback) {
+  using Request = Request<EitherError<IItem>>;
+  auto resolver = [=](Request::Pointer r) {
+    auto transferred = [=](EitherError<void> e) {
+      if (e.left()) return r->done(e.left());
+      r->done(EitherError<IItem>(
+          std::make_shared<Item>(getFilename(new_id), new_id, item->size(),
+                                 item->timestamp(), item->type())));
+    };
+    auto objects = std::make_shared<ObjectList>();
+    auto copy = [=](uint64_t index, Completed complete) {
+      const auto &object = (*objects)[index];
+      auto source = object.name_;
+      auto destination = new_id + source.substr(item->id().size());
+      r->request(
+          [=](util::Output) {
+            auto request = http()->create(objectUrl(CONTAINER, destination),
+                                          "PUT");
+            // copies manifests of large objects instead of their contents
+            request->setParameter("multipart-manifest", "get");
+            request->setHeaderParameter(
+                "X-Copy-From",
+                "/" + CONTAINER + "/" + util::Url::escape(source));
+            return request;
+          },
+          [=](EitherError<Response> e) { complete(result(e)); });
+    };
+    listObjects(r, item, objects, [=](EitherError<void> e) {
+      if (e.left()) return transferred(e);
+      std::make_shared<ParallelTasks>(
+          objects->size(), BULK_PARALLELISM, [=] { return r->is_cancelled(); },
+          copy,
+          [=](EitherError<void> e) {
+            if (e.left()) return transferred(e);
+            // segments are shared with the copied manifests
+            deleteObjects(r, objects, false, transferred);
+          })
+          ->start();
+    });
+  };
+  return std::make_shared<Request>(shared_from_this(), callback, resolver)
+      ->run();
+}
+
+template <class T>
+void HubiC::listObjects(std::shared_ptr<Request<T>> r, IItem::Pointer item,
+                        std::shared_ptr<ObjectList> objects,
+                        Completed complete) const {
+  if (item->type() != IItem::FileType::Directory) {
+    // the listing tells whether the file is a manifest of a large object
+    return r->request(
+        [=](util::Output input) {
+          return getItemDataRequest(item->id(), *input);
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return complete(e.left());
+          try {
+            auto json = util::json::from_stream(e.right()->output());
+            objects->push_back({item->id(), item->size(),
+                                json.size() > 0 &&
+                                    json[0]["name"].asString() == item->id() &&
+                                    json[0].isMember("slo_etag")});
+          } catch (const Json::Exception &e) {
+            return complete(Error{IHttpRequest::Failure, e.what()});
+          }
+          complete(nullptr);
+        });
+  }
+  // a directory's marker object precedes objects under it in the listing
+  listObjects(r, item->id(), "", objects, [=](EitherError<void> e) {
+    if (e.left()) return complete(e);
+    auto prefix = item->id().empty() ? "" : item->id() + "/";
+    objects->erase(
+        std::remove_if(objects->begin(), objects->end(),
+                       [=](const Object &o) {
+                         return o.name_ != item->id() &&
+                                o.name_.compare(0, prefix.size(), prefix) != 0;
+                       }),
+        objects->end());
+    complete(nullptr);
+  });
+}
+
+template <class T>
+void HubiC::listObjects(std::shared_ptr<Request<T>> r,
+                        const std::string &prefix, const std::string &marker,
+                        std::shared_ptr<ObjectList> objects,
+                        Completed complete) const {
+  r->request(
+      [=](util::Output) {
+        auto request = http()->create(openstack_endpoint() + "/" + CONTAINER);
+        request->setParameter("format", "json");
+        request->setParameter("limit", std::to_string(LIST_LIMIT));
+        request->setParameter("prefix", util::Url::escape(prefix));
+        if (!marker.empty())
+          request->setParameter("marker", util::Url::escape(marker));
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        if (e.left()) return complete(e.left());
+        Json::ArrayIndex count;
+        try {
+          auto json = util::json::from_stream(e.right()->output());
+          count = json.size();
+          for (auto &&v : json)
+            objects->push_back({v["name"].asString(), v["bytes"].asUInt64(),
+                                v.isMember("slo_etag")});
+        } catch (const Json::Exception &e) {
+          return complete(Error{IHttpRequest::Failure, e.what()});
+        }
+        if (count < LIST_LIMIT) return complete(nullptr);
+        listObjects(r, prefix, objects->back().name_, objects, complete);
+      });
+}
+
+template <class T>
+void HubiC::deleteObjects(std::shared_ptr<Request<T>> r,
+                          std::shared_ptr<ObjectList> objects, bool segments,
+                          Completed complete) const {
+  auto names = std::make_shared<std::vector<std::string>>();
+  auto manifests = std::make_shared<std::vector<std::string>>();
+  for (auto &&o : *objects)
+    (segments && o.manifest_ ? manifests : names)->push_back(o.name_);
+  // tasks delete batches of names, or single names if bulk delete is
+  // unavailable, and then manifests
+  bool bulk = bulk_delete_;
+  auto batch_count =
+      bulk ? (names->size() + DELETE_BATCH_SIZE - 1) / DELETE_BATCH_SIZE : 0;
+  auto first = bulk ? 0 : names->size();
+  auto task = [=](uint64_t index, Completed complete) {
+    if (index >= batch_count + first)
+      return deleteObject(r, (*manifests)[index - batch_count - first], true,
+                          complete);
+    if (index >= batch_count)
+      return deleteObject(r, (*names)[index - batch_count], false, complete);
+    auto begin = index * DELETE_BATCH_SIZE;
+    auto end = std::min<uint64_t>(begin + DELETE_BATCH_SIZE, names->size());
+    r->request(
+        [=](util::Output input) {
+          auto request = http()->create(openstack_endpoint(), "POST");
+          request->setParameter("bulk-delete", "");
+          request->setHeaderParameter("Content-Type", "text/plain");
+          request->setHeaderParameter("Accept", "application/json");
+          for (auto i = begin; i < end; i++)
+            *input << "/" << CONTAINER << "/" << util::Url::escape((*names)[i])
+                   << "\n";
+          return request;
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return complete(e.left());
+          Json::Value json;
+          try {
+            json = util::json::from_stream(e.right()->output());
+          } catch (const Json::Exception &) {
+          }
+          if (!json.isObject() || !json.isMember("Response Status")) {
+            // without the bulk middleware the request is a plain account POST
+            util::log("bulk delete unavailable, deleting objects one by one");
+            bulk_delete_ = false;
+            auto batch = std::make_shared<ObjectList>();
+            for (auto i = begin; i < end; i++)
+              batch->push_back({(*names)[i], 0, false});
+            return deleteObjects(r, batch, false, complete);
+          }
+          // failures of bulk deletes come with 200 OK
+          auto status = json["Response Status"].asString();
+          if (status.empty() || status[0] != '2' || !json["Errors"].empty()) {
+            std::string description = status;
+            for (auto &&error : json["Errors"])
+              description +=
+                  ", " + error[0].asString() + ": " + error[1].asString();
+            return complete(Error{IHttpRequest::Failure, description});
+          }
+          complete(nullptr);
+        });
+  };
+  std::make_shared<ParallelTasks>(batch_count + first + manifests->size(),
+                                  BULK_PARALLELISM,
+                                  [=] { return r->is_cancelled(); }, task,
+                                  complete)
+      ->start();
+}
+
+template <class T>
+void HubiC::deleteObject(std::shared_ptr<Request<T>> r,
+                         const std::string &name, bool segments,
+                         Completed complete) const {
+  r->request(
+      [=](util::Output) {
+        auto request = http()->create(objectUrl(CONTAINER, name), "DELETE");
+        if (segments) request->setParameter("multipart-manifest", "delete");
+        return request;
+      },
+      [=](EitherError<Response> e) {
+        // already removed, as bulk deletes do
+        if (e.left() && e.left()->code_ == IHttpRequest::NotFound)
+          return complete(nullptr);
+        complete(result(e));
+      });
+}
+
 void HubiC::Auth::initialize(IHttp *http, IHttpServerFactory *factory) {
   cloudstorage::Auth::initialize(http, factory);
   if (client_id().empty()) {
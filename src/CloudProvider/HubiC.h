@@ -24,14 +24,28 @@
 #define HUBIC_H
 
 #include <json/json.h>
+#include <atomic>
 #include "CloudProvider.h"
 
 namespace cloudstorage {
 
+/**
+ * HubiC stores files in the "default" container of its OpenStack Swift
+ * storage; directories are objects of application/directory content type.
+ *
+ * Recursive operations list everything under the item at once, copy objects
+ * server side concurrently and remove them with the bulk delete middleware,
+ * or one by one if it isn't available. Files larger than upload_part_size
+ * hint are uploaded as Static Large Objects, with segments in the
+ * "default_segments" container; Swift accepts up to 1000 segments per
+ * manifest, so segments of larger files are made bigger.
+ */
 class HubiC : public CloudProvider {
  public:
   HubiC();
 
+  void initialize(InitData&& data) override;
+
   std::string name() const override;
   std::string endpoint() const override;
   void authorizeRequest(IHttpRequest& request) const override;
@@ -78,6 +92,32 @@ class HubiC : public CloudProvider {
   IItem::List listDirectoryResponse(
       const IItem&, std::istream&, std::string& next_page_token) const override;
 
+  uint64_t uploadSessionPartSize() const override;
+  uint64_t uploadSessionMaxPartCount() const override;
+  bool uploadSessionStreaming() const override;
+  IHttpRequest::Pointer uploadSessionStartRequest(
+      const IItem& directory, const std::string& filename, uint64_t size,
+      std::ostream& input_stream) const override;
+  IHttpRequest::Pointer uploadPartRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, uint64_t part, std::ostream& prefix_stream,
+      std::ostream& suffix_stream) const override;
+  IHttpRequest::Pointer uploadSessionCommitRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const override;
+  IHttpRequest::Pointer uploadSessionAbortRequest(
+      const IItem& directory, const std::string& filename,
+      const UploadSession& session, std::ostream& input_stream) const override;
+  std::string uploadSessionStartResponse(
+      const IHttpRequest::HeaderParameters&,
+      std::istream& response) const override;
+  std::string uploadPartResponse(const UploadSession&, uint64_t part,
+                                 const IHttpRequest::HeaderParameters&,
+                                 std::istream& response) const override;
+  IItem::Pointer uploadSessionCommitResponse(
+      const IItem& directory, const std::string& filename,
+      const UploadSession&, std::istream& response) const override;
+
   IItem::Pointer toItem(const Json::Value&) const;
 
   class Auth : public cloudstorage::Auth {
@@ -96,11 +136,57 @@ class HubiC : public CloudProvider {
   };
 
  private:
+  struct Object {
+    std::string name_;
+    uint64_t size_;
+    // static large object manifest
+    bool manifest_;
+  };
+  using ObjectList = std::vector<Object>;
+  using Completed = std::function<void(EitherError<void>)>;
+
   std::string openstack_endpoint() const;
   std::string openstack_token() const;
+  std::string objectUrl(const std::string& container,
+                        const std::string& name) const;
+  std::string segmentName(const IItem& directory, const std::string& filename,
+                          const UploadSession&, uint64_t part) const;
+
+  /**
+   * Copies item, and everything under it if it's a directory, to new_id and
+   * removes the originals.
+   */
+  MoveItemRequest::Pointer transferItemAsync(IItem::Pointer item,
+                                             const std::string& new_id,
+                                             MoveItemCallback);
+
+  /**
+   * Lists the item and, if it's a directory, all objects under it.
+   */
+  template <class T>
+  void listObjects(std::shared_ptr<Request<T>>, IItem::Pointer item,
+                   std::shared_ptr<ObjectList>, Completed) const;
+  template <class T>
+  void listObjects(std::shared_ptr<Request<T>>, const std::string& prefix,
+                   const std::string& marker, std::shared_ptr<ObjectList>,
+                   Completed) const;
+
+  /**
+   * Removes objects with bulk delete requests, or one by one once bulk delete
+   * turned out to be unavailable; with segments, manifests are deleted one by
+   * one together with their segments.
+   */
+  template <class T>
+  void deleteObjects(std::shared_ptr<Request<T>>, std::shared_ptr<ObjectList>,
+                     bool segments, Completed) const;
+  template <class T>
+  void deleteObject(std::shared_ptr<Request<T>>, const std::string& name,
+                    bool segments, Completed) const;
 
   std::string openstack_endpoint_;
   std::string openstack_token_;
+  uint64_t part_size_;
+  mutable std::atomic_bool bulk_delete_;
 };
 
 }  // namespace cloudstorage
@@ -164,6 +164,16 @@ IHttpRequest::Pointer OneDrive::listDirectoryRequest(
   return request;
 }
 
+bool OneDrive::hasChangeFeed() const { return true; }
+
+IHttpRequest::Pointer OneDrive::listChangesRequest(const std::string& cursor,
+                                                   std::ostream&) const {
+  if (!cursor.empty()) return http()->create(cursor, "GET");
+  auto request = http()->create(endpoint() + "/me/drive/root/delta", "GET");
+  request->setParameter("token", "latest");
+  return request;
+}
+
 IHttpRequest::Pointer OneDrive::downloadFileRequest(const IItem& f,
                                                     std::ostream&) const {
   const Item& item = static_cast<const Item&>(f);
@@ -248,6 +258,33 @@ IItem::List OneDrive::listDirectoryResponse(
   return result;
 }
 
+ChangeSet OneDrive::listChangesResponse(std::istream& stream,
+                                        bool& has_more) const {
+  auto response = util::json::from_stream(stream);
+  ChangeSet result;
+  for (const Json::Value& v : response["value"]) {
+    if (v.isMember("root")) continue;
+    if (v.isMember("deleted")) {
+      result.changes_.push_back({v["id"].asString(), nullptr});
+    } else {
+      auto item = toItem(v);
+      const auto& parent = v["parentReference"];
+      static_cast<Item*>(item.get())
+          ->set_parents({parent["path"].asString() == "/drive/root:"
+                             ? rootDirectory()->id()
+                             : parent["id"].asString()});
+      result.changes_.push_back({item->id(), item});
+    }
+  }
+  if (response.isMember("@odata.nextLink")) {
+    result.cursor_ = response["@odata.nextLink"].asString();
+    has_more = true;
+  } else {
+    result.cursor_ = response["@odata.deltaLink"].asString();
+  }
+  return result;
+}
+
 void OneDrive::Auth::initialize(IHttp* http, IHttpServerFactory* factory) {
   cloudstorage::Auth::initialize(http, factory);
   if (client_id().empty()) {
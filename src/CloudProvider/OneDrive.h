@@ -51,6 +51,9 @@ class OneDrive : public CloudProvider {
   IHttpRequest::Pointer listDirectoryRequest(
       const IItem&, const std::string& page_token,
       std::ostream& input_stream) const override;
+  bool hasChangeFeed() const override;
+  IHttpRequest::Pointer listChangesRequest(
+      const std::string& cursor, std::ostream& input_stream) const override;
   IHttpRequest::Pointer downloadFileRequest(
       const IItem&, std::ostream& input_stream) const override;
   IHttpRequest::Pointer deleteItemRequest(
@@ -65,6 +68,8 @@ class OneDrive : public CloudProvider {
 
   IItem::List listDirectoryResponse(const IItem&, std::istream&,
                                     std::string&) const override;
+  ChangeSet listChangesResponse(std::istream&,
+                                bool& has_more) const override;
   IItem::Pointer getItemDataResponse(std::istream& response) const override;
 
  private:
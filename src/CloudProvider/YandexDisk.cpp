@@ -333,6 +333,8 @@ IHttpRequest::Pointer YandexDisk::listDirectoryRequest(
   return request;
 }
 
+bool YandexDisk::listDirectoryOffsetTokens() const { return true; }
+
 IHttpRequest::Pointer YandexDisk::moveItemRequest(const IItem& source,
                                                   const IItem& destination,
                                                   std::ostream&) const {
@@ -56,6 +56,7 @@ class CLOUDSTORAGE_API ICloudProvider {
   using MoveItemRequest = IRequest<EitherError<IItem>>;
   using RenameItemRequest = IRequest<EitherError<IItem>>;
   using GeneralDataRequest = IRequest<EitherError<GeneralData>>;
+  using ListChangesRequest = IRequest<EitherError<ChangeSet>>;
 
   using OperationSet = uint32_t;
 
@@ -99,7 +100,23 @@ class CLOUDSTORAGE_API ICloudProvider {
     DeleteItem = 1 << 7,
     CreateDirectory = 1 << 8,
     MoveItem = 1 << 9,
-    RenameItem = 1 << 10
+    RenameItem = 1 << 10,
+    ListChanges = 1 << 11,
+    UploadFileStream = 1 << 12  // uploads files of unknown size
+  };
+
+  /**
+   * Statistics of the metadata cache used by getItemAsync.
+   */
+  struct CacheStatistics {
+    // path components resolved without listing a directory
+    uint64_t hits_;
+    // directories which had to be listed
+    uint64_t misses_;
+
+    double hit_rate() const {
+      return hits_ + misses_ == 0 ? 0 : double(hits_) / (hits_ + misses_);
+    }
   };
 
   /**
@@ -154,9 +171,32 @@ class CLOUDSTORAGE_API ICloudProvider {
      *  - access_token
      *  - file_url (used by mega.nz, url provider's base url)
      *  - metadata_url, content_url (amazon drive's endpoints)
-     *  - temporary_directory (used by mega.nz, has to use native path
-     * separators i.e. \ for windows and / for others; has to end with a
-     * separator)
+     *  - temporary_directory (used by mega.nz, by the file cache and for
+     * checkpoints of chunked uploads, has to use
+     * native path separators i.e. \ for windows and / for others; has to end
+     * with a separator)
+     *  - file_cache_memory_size (bytes of streamed files kept in memory,
+     *    memory cache is disabled by default)
+     *  - file_cache_disk_size (bytes of streamed files kept in
+     *    temporary_directory, disk cache is disabled by default)
+     *  - upload_parallelism (count of parts of a chunked upload sent at once,
+     *    4 by default)
+     *  - upload_part_size (bytes per part of amazon s3's multipart uploads,
+     *    16 MiB by default, at least 5 MiB; bytes per segment of hubic's
+     *    static large objects, 64 MiB by default, at least 1 MiB; bytes per
+     *    append to dropbox's upload sessions, 60 MiB by default, at most
+     *    150 MiB, rounded down to a multiple of 4 MiB)
+     *  - list_directory_parallelism (count of directory pages fetched or
+     *    buffered at once, pages are fetched concurrently only by providers
+     *    with offset page tokens; 4 by default)
+     *  - recursive_request_parallelism (count of directories listed or items
+     *    visited at once while walking a whole tree, e.g. to list changes of
+     *    providers without a change feed; 1 by default, since every one of
+     *    them is a separate request counted against the provider's rate
+     *    limits)
+     *  - metadata_cache_ttl (seconds for which getItemAsync may reuse resolved
+     *    paths and directory listings; the cache is disabled unless set to a
+     *    positive value)
      *  - login_page (login page to be displayed when cloud provider doesn't use
      *    oauth; check for DEFAULT_LOGIN_PAGE to see what is the expected layout
      *    of the page)
@@ -469,6 +509,42 @@ class CLOUDSTORAGE_API ICloudProvider {
   virtual GetItemUrlRequest::Pointer getFileDaemonUrlAsync(
       IItem::Pointer item,
       GetItemUrlCallback = [](EitherError<std::string>) {}) = 0;
+
+  /**
+   * Returns hit and miss counts of the metadata cache, which remembers
+   * resolved paths and directory listings for getItemAsync when enabled with
+   * the metadata_cache_ttl hint. Entries expire after metadata_cache_ttl
+   * seconds and are dropped when an item is created, uploaded, moved, renamed
+   * or deleted through this provider.
+   *
+   * @return metadata cache statistics, zeroed by default
+   */
+  virtual CacheStatistics metadataCacheStatistics() const;
+
+  /**
+   * Lists changes made anywhere in the cloud provider since the position
+   * described by cursor. Google Drive, Dropbox, OneDrive and Box use their
+   * change feeds, so the cost is proportional to the count of changes; other
+   * providers walk the whole tree and compare it with the snapshot taken by
+   * the previous call, only the latest cursor returned by them stays valid.
+   *
+   * A change is reported for created, modified, moved and removed items, a
+   * move may be reported as a removal and a creation. If the cursor expired,
+   * the request fails with code IHttpRequest::Bad and description "change
+   * cursor expired"; caller should then drop anything it derived from earlier
+   * changes and start over with an empty cursor.
+   *
+   * @param cursor cursor returned by the previous call, empty to obtain the
+   * current position without any changes
+   *
+   * @param callback called when done
+   *
+   * @return object representing the pending request, by default one which
+   * failed with util::Error::UNIMPLEMENTED
+   */
+  virtual ListChangesRequest::Pointer listChangesAsync(
+      const std::string& cursor,
+      ListChangesCallback callback = [](EitherError<ChangeSet>) {});
 };
 
 }  // namespace cloudstorage
@@ -24,18 +24,39 @@
 #ifndef ICRYPTO_H
 #define ICRYPTO_H
 
+#include <cstddef>
 #include <memory>
 #include <string>
 
+#include "IItem.h"
+
 namespace cloudstorage {
 
 /**
  * Provides cryptographic methods.
  */
-class ICrypto {
+class CLOUDSTORAGE_API ICrypto {
  public:
   using Pointer = std::unique_ptr<ICrypto>;
 
+  /**
+   * Hash computed incrementally over message's pieces.
+   */
+  class Hash {
+   public:
+    using Pointer = std::unique_ptr<Hash>;
+
+    virtual ~Hash() = default;
+
+    virtual void update(const char* data, size_t length) = 0;
+
+    /**
+     * @return hash of data passed to update since the hash was created or
+     * since the previous digest call
+     */
+    virtual std::string digest() = 0;
+  };
+
   virtual ~ICrypto() = default;
 
   /**
@@ -71,6 +92,14 @@ class ICrypto {
    */
   virtual std::string hex(const std::string& hash) = 0;
 
+  /**
+   * Creates incremental SHA256 hash. Default implementation gathers the
+   * message and hashes it with sha256.
+   *
+   * @return SHA256 hash
+   */
+  virtual Hash::Pointer sha256_hash();
+
   static ICrypto::Pointer create();
 };
 
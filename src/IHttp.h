@@ -58,6 +58,7 @@ class CLOUDSTORAGE_API IHttpRequest {
   static constexpr int Unauthorized = 401;
   static constexpr int Forbidden = 403;
   static constexpr int NotFound = 404;
+  static constexpr int Gone = 410;
   static constexpr int RangeInvalid = 416;
   static constexpr int InternalServerError = 500;
   static constexpr int ServiceUnavailable = 503;
@@ -182,6 +183,55 @@ class CLOUDSTORAGE_API IHttp {
  public:
   using Pointer = std::unique_ptr<IHttp>;
 
+  /**
+   * Tuning knobs of the default http engine.
+   */
+  struct Options {
+    Options()
+        : worker_count_(1),
+          http2_(false),
+          max_connections_(0),
+          max_host_connections_(0),
+          max_connection_age_(0) {}
+
+    /**
+     * Number of threads which perform network transfers and run request
+     * callbacks. Requests are spread over them by host, so that all
+     * connections to a host stay in a single connection cache.
+     */
+    uint32_t worker_count_;
+
+    /**
+     * Whether to require HTTP/2 over TLS and make requests to the same host
+     * wait for a connection to multiplex on instead of opening new ones; when
+     * off, protocol negotiation is left to curl's defaults.
+     */
+    bool http2_;
+
+    /**
+     * Size of each worker's cache of idle connections, 0 for curl's default.
+     */
+    long max_connections_;
+
+    /**
+     * Limit of simultaneous connections to a single host, 0 for no limit;
+     * requests over the limit wait for a free connection.
+     */
+    long max_host_connections_;
+
+    /**
+     * Number of seconds an idle connection may be reused for, 0 for curl's
+     * default.
+     */
+    long max_connection_age_;
+  };
+
+  struct Statistics {
+    uint64_t requests_;            // sent requests
+    uint64_t reused_handles_;      // requests which reused a pooled handle
+    uint64_t reused_connections_;  // requests which didn't open a connection
+  };
+
   virtual ~IHttp() = default;
 
   /**
@@ -196,7 +246,29 @@ class CLOUDSTORAGE_API IHttp {
                                        const std::string& method = "GET",
                                        bool follow_redirect = true) const = 0;
 
+  /**
+   * @return connection and handle reuse counters, zeroed if the engine doesn't
+   * track them
+   */
+  virtual Statistics statistics() const { return {}; }
+
+  /**
+   * Creates the default http engine with a single worker.
+   *
+   * @return http engine
+   */
   static IHttp::Pointer create();
+
+  /**
+   * Creates the default http engine.
+   *
+   * @param worker_count number of threads which perform network transfers and
+   * run request callbacks; requests to one host always go to the same worker
+   * @return http engine
+   */
+  static IHttp::Pointer create(uint32_t worker_count);
+
+  static IHttp::Pointer create(const Options&);
 };
 
 }  // namespace cloudstorage
@@ -23,6 +23,7 @@
 #ifndef IHTTP_SERVER_H
 #define IHTTP_SERVER_H
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -46,7 +47,7 @@ class CLOUDSTORAGE_API IHttpServer {
     using Headers = std::unordered_map<std::string, std::string>;
     using CompletedCallback = GenericCallback<>;
 
-    static constexpr int UnknownSize = -1;
+    static constexpr uint64_t UnknownSize = -1;
 
     class ICallback {
      public:
@@ -77,7 +78,7 @@ class CLOUDSTORAGE_API IHttpServer {
     virtual std::string url() const = 0;
 
     virtual IResponse::Pointer response(
-        int code, const IResponse::Headers&, int size,
+        int code, const IResponse::Headers&, uint64_t size,
         IResponse::ICallback::Pointer) const = 0;
   };
 
@@ -97,6 +98,27 @@ class CLOUDSTORAGE_API IHttpServerFactory {
  public:
   using Pointer = std::unique_ptr<IHttpServerFactory>;
 
+  static constexpr size_t DefaultBlockSize = 128 * 1024;
+
+  /**
+   * Tuning knobs of the default http server.
+   */
+  struct Options {
+    Options() : block_size_(DefaultBlockSize), thread_pool_size_(1) {}
+
+    /**
+     * Size of the buffer which responses are read into.
+     */
+    size_t block_size_;
+
+    /**
+     * Number of threads which serve connections; with more than one thread
+     * connections are spread over a pool of event loops, so a slow response
+     * doesn't stall the others.
+     */
+    uint32_t thread_pool_size_;
+  };
+
   virtual ~IHttpServerFactory() = default;
 
   virtual IHttpServer::Pointer create(IHttpServer::ICallback::Pointer,
@@ -104,6 +126,8 @@ class CLOUDSTORAGE_API IHttpServerFactory {
                                       IHttpServer::Type) = 0;
 
   static IHttpServerFactory::Pointer create();
+
+  static IHttpServerFactory::Pointer create(const Options&);
 };
 
 }  // namespace cloudstorage
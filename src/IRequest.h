@@ -26,6 +26,7 @@
 
 #include <functional>
 #include <memory>
+#include <type_traits>
 #include <vector>
 
 #include "IItem.h"
@@ -34,6 +35,7 @@ namespace cloudstorage {
 
 struct Error;
 struct PageData;
+struct ChangeSet;
 
 template <class Left, class Right>
 class Either;
@@ -52,6 +54,16 @@ struct PageData {
   std::string next_token_;  // empty if no next page
 };
 
+struct Change {
+  std::string id_;       // id of the changed item
+  IItem::Pointer item_;  // current metadata, nullptr if the item was removed
+};
+
+struct ChangeSet {
+  std::vector<Change> changes_;
+  std::string cursor_;  // position following the changes
+};
+
 struct Token {
   std::string token_;
   std::string access_token_;
@@ -124,6 +136,15 @@ class IListDirectoryCallback
    * @param item fetched item
    */
   virtual void receivedItem(IItem::Pointer item) = 0;
+
+  /**
+   * Whether fetched items should be also gathered and passed to done; when
+   * false, done receives an empty list and listing doesn't keep items in
+   * memory.
+   *
+   * @return true by default
+   */
+  virtual bool collectItems() { return true; }
 };
 
 class IDownloadFileCallback : public IGenericCallback<EitherError<void>> {
@@ -162,10 +183,27 @@ class IUploadFileCallback : public IGenericCallback<EitherError<IItem>> {
   virtual uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) = 0;
 
   /**
-   * @return size of currently uploaded file
+   * @return size of currently uploaded file or IItem::UnknownSize if the file
+   * is still being written; such files can be uploaded only by providers
+   * which support ICloudProvider::UploadFileStream
    */
   virtual uint64_t size() = 0;
 
+  /**
+   * Called before putData for files of unknown size. ready should be called
+   * once data at [offset, offset + length) can be read, possibly from another
+   * thread, with count of available bytes; less than length means the file
+   * ends there. Upload can't finish until ready is called, an error aborts it.
+   *
+   * By default the file is assumed to end at offset.
+   *
+   * @param offset
+   * @param length
+   * @param ready
+   */
+  virtual void waitData(uint64_t offset, uint64_t length,
+                        std::function<void(EitherError<uint64_t>)> ready);
+
   /**
    * Called when upload progress changed.
    *
@@ -173,6 +211,14 @@ class IUploadFileCallback : public IGenericCallback<EitherError<IItem>> {
    * @param now count of bytes already uploaded
    */
   virtual void progress(uint64_t total, uint64_t now) = 0;
+
+  /**
+   * An interrupted upload is resumed only if the file's modification time
+   * didn't change; IItem::UnknownTimeStamp by default.
+   *
+   * @return modification time of the uploaded file
+   */
+  virtual IItem::TimeStamp timestamp();
 };
 
 struct Error {
@@ -211,6 +257,15 @@ class Either<Left, void> {
   std::shared_ptr<Left> left_;
 };
 
+inline void IUploadFileCallback::waitData(
+    uint64_t, uint64_t, std::function<void(EitherError<uint64_t>)> ready) {
+  ready(static_cast<uint64_t>(0));
+}
+
+inline IItem::TimeStamp IUploadFileCallback::timestamp() {
+  return IItem::UnknownTimeStamp;
+}
+
 template <class... Arguments>
 class GenericCallback {
  public:
@@ -218,9 +273,22 @@ class GenericCallback {
 
   GenericCallback(const GenericCallback& d) : functor_(d.functor_) {}
 
-  template <class Function>
-  GenericCallback(const Function& callback)
-      : functor_(std::make_shared<Functor>(callback)) {}
+  GenericCallback(GenericCallback&& d) : functor_(std::move(d.functor_)) {}
+
+  GenericCallback& operator=(const GenericCallback&) = default;
+  GenericCallback& operator=(GenericCallback&&) = default;
+
+  template <class Function,
+            class = typename std::enable_if<
+                !std::is_same<typename std::decay<Function>::type,
+                              GenericCallback>::value &&
+                !std::is_convertible<Function, typename IGenericCallback<
+                                                   Arguments...>::Pointer>::
+                    value>::type>
+  GenericCallback(Function&& callback)
+      : functor_(
+            std::make_shared<Functor<typename std::decay<Function>::type>>(
+                std::forward<Function>(callback))) {}
 
   GenericCallback(typename IGenericCallback<Arguments...>::Pointer functor)
       : functor_(functor) {}
@@ -244,15 +312,18 @@ class GenericCallback {
   }
 
  private:
+  // keeps the callable itself, so move-only callables are accepted too
+  template <class Function>
   class Functor : public IGenericCallback<Arguments...> {
    public:
-    Functor(const std::function<void(Arguments...)> callback)
-        : callback_(callback) {}
+    template <class Callable>
+    Functor(Callable&& callback)
+        : callback_(std::forward<Callable>(callback)) {}
 
     void done(Arguments... args) override { callback_(args...); }
 
    private:
-    std::function<void(Arguments...)> callback_;
+    Function callback_;
   };
 
   typename IGenericCallback<Arguments...>::Pointer functor_;
@@ -272,6 +343,7 @@ using DownloadFileCallback = GenericCallback<EitherError<void>>;
 using UploadFileCallback = GenericCallback<EitherError<IItem>>;
 using GetThumbnailCallback = GenericCallback<EitherError<void>>;
 using GeneralDataCallback = GenericCallback<EitherError<GeneralData>>;
+using ListChangesCallback = GenericCallback<EitherError<ChangeSet>>;
 
 }  // namespace cloudstorage
 
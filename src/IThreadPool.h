@@ -40,6 +40,12 @@ class CLOUDSTORAGE_API IThreadPool {
   static Pointer create(uint32_t thread_count);
 
   virtual void schedule(const Task& f) = 0;
+
+  /**
+   * Schedules a task which may be moved from instead of being copied; by
+   * default it's scheduled as an lvalue.
+   */
+  virtual void schedule(Task&& f);
 };
 
 }  // namespace cloudstorage
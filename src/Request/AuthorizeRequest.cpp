@@ -49,6 +49,7 @@ AuthorizeRequest::~AuthorizeRequest() { cancel(); }
 void AuthorizeRequest::resolve(Request::Pointer request,
                                AuthorizationFlow callback) {
   auto on_complete = [=](EitherError<void> result) {
+    if (!result.left()) provider()->scheduleTokenRefresh();
     std::unique_lock<std::mutex> lock(provider()->current_authorization_mutex_);
     while (!provider()->auth_callbacks_.empty()) {
       {
@@ -87,7 +88,7 @@ void AuthorizeRequest::sendCancel() {
       std::string url() const override { return "/"; }
       std::string method() const override { return "GET"; }
       IHttpServer::IResponse::Pointer response(
-          int, const IHttpServer::IResponse::Headers&, int,
+          int, const IHttpServer::IResponse::Headers&, uint64_t,
           IHttpServer::IResponse::ICallback::Pointer) const override {
         return nullptr;
       }
@@ -24,6 +24,7 @@
 #include "GetItemRequest.h"
 
 #include "CloudProvider/CloudProvider.h"
+#include "Utility/MetadataCache.h"
 
 namespace cloudstorage {
 
@@ -33,7 +34,21 @@ GetItemRequest::GetItemRequest(std::shared_ptr<CloudProvider> p,
         if (path.empty() || path.front() != '/')
           return done(
               Error{IHttpRequest::Forbidden, util::Error::INVALID_PATH});
-        work(provider()->rootDirectory(), path, callback);
+        auto cache = provider()->metadata_cache();
+        auto normalized = path;
+        while (normalized.size() > 1 && normalized.back() == '/')
+          normalized.pop_back();
+        if (normalized.size() == 1)
+          return done(provider()->rootDirectory());
+        auto prefix = normalized;
+        IItem::Pointer item;
+        while (!prefix.empty() && !(item = cache->item(prefix)))
+          prefix.erase(prefix.find_last_of('/'));
+        if (!item) {
+          item = provider()->rootDirectory();
+          cache->set_root(item->id());
+        }
+        work(item, prefix, normalized.substr(prefix.size()), callback);
       }) {}
 
 GetItemRequest::~GetItemRequest() { cancel(); }
@@ -45,8 +60,8 @@ IItem::Pointer GetItemRequest::getItem(const IItem::List& items,
   return nullptr;
 }
 
-void GetItemRequest::work(IItem::Pointer item, std::string p,
-                          Callback complete) {
+void GetItemRequest::work(IItem::Pointer item, std::string resolved,
+                          std::string p, Callback complete) {
   if (!item)
     return done(Error{IHttpRequest::NotFound, util::Error::ITEM_NOT_FOUND});
   if (p.empty() || p.size() == 1) return done(item);
@@ -59,13 +74,21 @@ void GetItemRequest::work(IItem::Pointer item, std::string p,
               rest = it == std::string::npos
                          ? ""
                          : std::string(path.begin() + it, path.end());
+  auto cache = provider()->metadata_cache();
+  auto generation = cache->generation();
+  auto next = [=](const IItem::List& children) {
+    auto child = getItem(children, name);
+    if (child) cache->set_item(resolved + "/" + name, child, generation);
+    work(child, resolved + "/" + name, rest, complete);
+  };
+  IItem::List children;
+  if (cache->children(item->id(), children)) return next(children);
   auto request = this->shared_from_this();
   make_subrequest(&CloudProvider::listDirectorySimpleAsync, item,
                   [=](EitherError<IItem::List> e) {
-                    if (e.left())
-                      request->done(e.left());
-                    else
-                      work(getItem(*e.right(), name), rest, complete);
+                    if (e.left()) return request->done(e.left());
+                    cache->set_children(item->id(), *e.right(), generation);
+                    next(*e.right());
                   });
 }
 
@@ -39,7 +39,8 @@ class GetItemRequest : public Request<EitherError<IItem>> {
  private:
   IItem::Pointer getItem(const IItem::List& items,
                          const std::string& name) const;
-  void work(IItem::Pointer item, std::string path, Callback);
+  void work(IItem::Pointer item, std::string resolved, std::string path,
+            Callback);
 };
 
 }  // namespace cloudstorage
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * ListChangesRequest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "ListChangesRequest.h"
+
+#include <iomanip>
+#include <random>
+
+#include "CloudProvider/CloudProvider.h"
+
+using namespace std::placeholders;
+
+namespace cloudstorage {
+
+namespace {
+
+bool modified(const ChangeSnapshot::Entry& previous,
+              const ChangeSnapshot::Entry& current) {
+  return previous.parent_ != current.parent_ ||
+         previous.item_->filename() != current.item_->filename() ||
+         previous.item_->size() != current.item_->size() ||
+         previous.item_->timestamp() != current.item_->timestamp() ||
+         previous.item_->type() != current.item_->type();
+}
+
+std::string snapshot_cursor() {
+  std::stringstream stream;
+  stream << "snapshot-" << std::hex << std::setfill('0') << std::setw(8)
+         << std::random_device()();
+  return stream.str();
+}
+
+}  // namespace
+
+ListChangesRequest::ListChangesRequest(std::shared_ptr<CloudProvider> p,
+                                       const std::string& cursor,
+                                       ListChangesCallback callback)
+    : Request(p, callback,
+              std::bind(&ListChangesRequest::resolve, this, _1, cursor)) {}
+
+void ListChangesRequest::resolve(Request::Pointer r, std::string cursor) {
+  r->request(
+      [=](util::Output input) {
+        return r->provider()->listChangesRequest(cursor, *input);
+      },
+      [=](EitherError<Response> e) {
+        if (e.left()) {
+          if (!cursor.empty() && r->provider()->listChangesExpired(*e.left()))
+            return r->done(Error{IHttpRequest::Bad,
+                                 util::Error::CHANGE_CURSOR_EXPIRED});
+          return r->done(e.left());
+        }
+        try {
+          bool has_more = false;
+          auto page = r->provider()->listChangesResponse(e.right()->output(),
+                                                         has_more);
+          result_.changes_.insert(result_.changes_.end(),
+                                  page.changes_.begin(), page.changes_.end());
+          result_.cursor_ = page.cursor_;
+          if (has_more && !page.cursor_.empty())
+            resolve(r, page.cursor_);
+          else
+            r->done(result_);
+        } catch (const std::exception& e) {
+          r->done(Error{IHttpRequest::Failure, e.what()});
+        }
+      });
+}
+
+SnapshotChangesRequest::SnapshotChangesRequest(std::shared_ptr<CloudProvider> p,
+                                               const std::string& cursor,
+                                               ListChangesCallback callback)
+    : RecursiveRequest(p, p->rootDirectory(), callback,
+                       visitor(p->rootDirectory()->id(), cursor),
+                       p->recursiveRequestParallelism()) {}
+
+SnapshotChangesRequest::Visitor SnapshotChangesRequest::visitor(
+    const std::string& root, const std::string& cursor) {
+  struct Tree {
+    std::mutex mutex_;
+    std::unordered_map<std::string, ChangeSnapshot::Entry> items_;
+  };
+  auto tree = std::make_shared<Tree>();
+  return [=](Request::Pointer r, IItem::Pointer item, IItem::Pointer parent,
+             CompleteCallback complete) {
+    if (item->id() != root) {
+      {
+        std::lock_guard<std::mutex> lock(tree->mutex_);
+        tree->items_[item->id()] = {item, parent ? parent->id() : ""};
+      }
+      return complete(ChangeSet());
+    }
+    auto snapshot = r->provider()->change_snapshot();
+    ChangeSet result;
+    {
+      std::lock_guard<std::mutex> lock(snapshot->mutex_);
+      if (!cursor.empty() && cursor != snapshot->cursor_)
+        return complete(
+            Error{IHttpRequest::Bad, util::Error::CHANGE_CURSOR_EXPIRED});
+      if (!cursor.empty()) {
+        for (auto&& i : tree->items_) {
+          auto it = snapshot->items_.find(i.first);
+          if (it == snapshot->items_.end() || modified(it->second, i.second))
+            result.changes_.push_back({i.first, i.second.item_});
+        }
+        for (auto&& i : snapshot->items_)
+          if (tree->items_.find(i.first) == tree->items_.end())
+            result.changes_.push_back({i.first, nullptr});
+      }
+      snapshot->cursor_ = result.cursor_ = snapshot_cursor();
+      snapshot->items_ = std::move(tree->items_);
+    }
+    complete(result);
+  };
+}
+
+}  // namespace cloudstorage
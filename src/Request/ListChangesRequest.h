@@ -0,0 +1,80 @@
+/*****************************************************************************
+ * ListChangesRequest.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef LISTCHANGESREQUEST_H
+#define LISTCHANGESREQUEST_H
+
+#include <mutex>
+#include <unordered_map>
+
+#include "RecursiveRequest.h"
+
+namespace cloudstorage {
+
+/**
+ * Tree of a provider without a change feed, as seen by the last
+ * listChangesAsync; cursor_ is the only cursor which is still valid.
+ */
+struct ChangeSnapshot {
+  struct Entry {
+    IItem::Pointer item_;
+    std::string parent_;  // id of the directory the item was listed in
+  };
+
+  std::mutex mutex_;
+  std::string cursor_;
+  std::unordered_map<std::string, Entry> items_;
+};
+
+/**
+ * Follows provider's change feed until it has no more changes available.
+ */
+class ListChangesRequest : public Request<EitherError<ChangeSet>> {
+ public:
+  ListChangesRequest(std::shared_ptr<CloudProvider>, const std::string& cursor,
+                     ListChangesCallback);
+
+ private:
+  void resolve(Request::Pointer, std::string cursor);
+
+  ChangeSet result_;
+};
+
+/**
+ * Walks the whole tree and reports differences from the ChangeSnapshot, which
+ * is then replaced with the new tree; an item which was moved to another
+ * directory is reported as modified.
+ */
+class SnapshotChangesRequest
+    : public RecursiveRequest<EitherError<ChangeSet>> {
+ public:
+  SnapshotChangesRequest(std::shared_ptr<CloudProvider>,
+                         const std::string& cursor, ListChangesCallback);
+
+ private:
+  static Visitor visitor(const std::string& root, const std::string& cursor);
+};
+
+}  // namespace cloudstorage
+
+#endif  // LISTCHANGESREQUEST_H
@@ -23,46 +23,172 @@
 
 #include "ListDirectoryRequest.h"
 
+#include <algorithm>
+
 #include "CloudProvider/CloudProvider.h"
 
 using namespace std::placeholders;
 
 namespace cloudstorage {
 
+namespace {
+
+bool offset(const std::string& token, uint64_t& result) {
+  if (token.empty()) {
+    result = 0;
+    return true;
+  }
+  try {
+    size_t length;
+    result = std::stoull(token, &length);
+    return length == token.size();
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+}  // namespace
+
 ListDirectoryRequest::ListDirectoryRequest(std::shared_ptr<CloudProvider> p,
                                            IItem::Pointer directory,
                                            ICallback::Pointer cb)
     : Request(p, [=](EitherError<IItem::List> e) { cb->done(e); },
-              std::bind(&ListDirectoryRequest::resolve, this, _1, directory,
-                        cb.get())) {}
+              std::bind(&ListDirectoryRequest::resolve, this, _1, directory)),
+      directory_(directory),
+      callback_(cb.get()),
+      collect_(cb->collectItems()),
+      offset_tokens_(p->listDirectoryOffsetTokens()),
+      parallelism_(std::max<uint32_t>(p->listDirectoryParallelism(), 1)),
+      next_page_(),
+      next_id_(),
+      delivered_(),
+      next_token_known_(true),
+      stride_(),
+      last_requested_(false),
+      finished_(false),
+      delivering_(false) {}
 
 ListDirectoryRequest::~ListDirectoryRequest() { cancel(); }
 
 void ListDirectoryRequest::resolve(Request::Pointer request,
-                                   IItem::Pointer directory,
-                                   ICallback* callback) {
+                                   IItem::Pointer directory) {
   if (directory->type() != IItem::FileType::Directory)
-    request->done(Error{IHttpRequest::Forbidden, util::Error::NOT_A_DIRECTORY});
-  else
-    work(directory, "", callback);
+    return request->done(
+        Error{IHttpRequest::Forbidden, util::Error::NOT_A_DIRECTORY});
+  std::vector<Fetch> fetches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fetches = schedule();
+  }
+  fetch(request, fetches);
+}
+
+// called with mutex_ locked; requests pages while their tokens are known and
+// there is room for them
+std::vector<ListDirectoryRequest::Fetch> ListDirectoryRequest::schedule() {
+  std::vector<Fetch> result;
+  if (finished_ ||
+      std::any_of(pages_.begin(), pages_.end(),
+                  [](const std::pair<const uint64_t, Page>& p) {
+                    return p.second.fetched_ && p.second.data_.left();
+                  }))
+    return result;
+  while (!last_requested_ && next_token_known_ &&
+         pages_.size() < parallelism_) {
+    Fetch f{next_page_++, next_id_++, next_token_};
+    pages_[f.index_] = Page{f.id_, f.token_, false, {}};
+    uint64_t current;
+    if (stride_ > 0 && offset(f.token_, current))
+      next_token_ = std::to_string(current + stride_);
+    else
+      next_token_known_ = false;
+    result.push_back(f);
+  }
+  return result;
+}
+
+void ListDirectoryRequest::fetch(Request::Pointer request,
+                                 const std::vector<Fetch>& fetches) {
+  for (auto&& f : fetches) {
+    auto index = f.index_;
+    auto id = f.id_;
+    request->make_subrequest(&CloudProvider::listDirectoryPageAsync,
+                             directory_, f.token_,
+                             [=](EitherError<PageData> e) {
+                               fetched(request, index, id, e);
+                             });
+  }
+}
+
+void ListDirectoryRequest::fetched(Request::Pointer request, uint64_t index,
+                                   uint64_t id, EitherError<PageData> e) {
+  std::vector<Fetch> fetches;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pages_.find(index);
+    if (it == pages_.end() || it->second.id_ != id) return;
+    auto& page = it->second;
+    page.fetched_ = true;
+    page.data_ = e;
+    if (e.right()) {
+      const auto& next = e.right()->next_token_;
+      if (index + 1 < next_page_ &&
+          (next.empty() || pages_[index + 1].token_ != next)) {
+        // pages were requested past the end of the listing or with wrongly
+        // predicted tokens; drop them and carry on sequentially
+        pages_.erase(pages_.upper_bound(index), pages_.end());
+        next_page_ = index + 1;
+        last_requested_ = false;
+        if (!next.empty()) {
+          offset_tokens_ = false;
+          stride_ = 0;
+        }
+      }
+      uint64_t current, following;
+      if (next.empty()) {
+        last_requested_ = true;
+      } else if (index + 1 == next_page_) {
+        next_token_ = next;
+        next_token_known_ = true;
+        if (offset_tokens_ && stride_ == 0 && offset(page.token_, current) &&
+            offset(next, following) && following > current)
+          stride_ = following - current;
+      }
+    }
+    fetches = schedule();
+  }
+  fetch(request, fetches);
+  deliver(request);
 }
 
-void ListDirectoryRequest::work(IItem::Pointer directory,
-                                std::string page_token, ICallback* callback) {
-  auto request = this->shared_from_this();
-  request->make_subrequest(&CloudProvider::listDirectoryPageAsync, directory,
-                           page_token, [=](EitherError<PageData> e) {
-                             if (e.left()) return request->done(e.left());
-                             for (auto& t : e.right()->items_) {
-                               callback->receivedItem(t);
-                               result_.push_back(t);
-                             }
-                             if (!e.right()->next_token_.empty())
-                               work(directory, e.right()->next_token_,
-                                    callback);
-                             else
-                               request->done(result_);
-                           });
+void ListDirectoryRequest::deliver(Request::Pointer request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (delivering_ || finished_) return;
+  delivering_ = true;
+  while (true) {
+    auto it = pages_.find(delivered_);
+    if (it == pages_.end() || !it->second.fetched_) break;
+    auto data = std::move(it->second.data_);
+    pages_.erase(it);
+    delivered_++;
+    if (data.left()) {
+      finished_ = true;
+      lock.unlock();
+      return request->done(data.left());
+    }
+    auto last = data.right()->next_token_.empty();
+    if (last) finished_ = true;
+    auto fetches = schedule();
+    lock.unlock();
+    fetch(request, fetches);
+    for (auto& t : data.right()->items_) {
+      callback_->receivedItem(t);
+      if (collect_) result_.push_back(t);
+    }
+    if (last) return request->done(result_);
+    lock.lock();
+  }
+  delivering_ = false;
 }
 
 }  // namespace cloudstorage
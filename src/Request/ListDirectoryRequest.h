@@ -24,11 +24,23 @@
 #ifndef LISTDIRECTORYREQUEST_H
 #define LISTDIRECTORYREQUEST_H
 
+#include <map>
+#include <mutex>
+#include <vector>
+
 #include "IItem.h"
 #include "Request.h"
 
 namespace cloudstorage {
 
+/**
+ * Lists directory page by page, the next page is requested before items of
+ * the current one are passed to the callback. When provider's page tokens are
+ * offsets, up to CloudProvider::listDirectoryParallelism pages are fetched at
+ * once; pages are buffered until their predecessors are delivered, which
+ * bounds the memory used by the listing to that many pages (plus the items
+ * passed to done, unless ICallback::collectItems returns false).
+ */
 class ListDirectoryRequest : public Request<EitherError<IItem::List>> {
  public:
   using ICallback = IListDirectoryCallback;
@@ -38,9 +50,42 @@ class ListDirectoryRequest : public Request<EitherError<IItem::List>> {
   ~ListDirectoryRequest();
 
  private:
-  void resolve(Request::Pointer, IItem::Pointer directory, ICallback* cb);
-  void work(IItem::Pointer directory, std::string page_token, ICallback*);
+  struct Page {
+    uint64_t id_;
+    std::string token_;
+    bool fetched_;
+    EitherError<PageData> data_;
+  };
+
+  struct Fetch {
+    uint64_t index_;
+    uint64_t id_;
+    std::string token_;
+  };
+
+  void resolve(Request::Pointer, IItem::Pointer directory);
+  std::vector<Fetch> schedule();
+  void fetch(Request::Pointer, const std::vector<Fetch>&);
+  void fetched(Request::Pointer, uint64_t index, uint64_t id,
+               EitherError<PageData>);
+  void deliver(Request::Pointer);
 
+  IItem::Pointer directory_;
+  ICallback* callback_;
+  bool collect_;
+  bool offset_tokens_;
+  uint32_t parallelism_;
+  std::mutex mutex_;
+  std::map<uint64_t, Page> pages_;
+  uint64_t next_page_;
+  uint64_t next_id_;
+  uint64_t delivered_;
+  std::string next_token_;
+  bool next_token_known_;
+  uint64_t stride_;
+  bool last_requested_;
+  bool finished_;
+  bool delivering_;
   IItem::List result_;
 };
 
@@ -0,0 +1,84 @@
+/*****************************************************************************
+ * ParallelTasks.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#include "ParallelTasks.h"
+
+#include "IHttp.h"
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+ParallelTasks::ParallelTasks(uint64_t count, uint32_t max_in_flight,
+                             std::function<bool()> cancelled, Task task,
+                             Completed complete)
+    : count_(count),
+      max_in_flight_(max_in_flight),
+      cancelled_(cancelled),
+      task_(task),
+      complete_(complete),
+      next_(),
+      running_(),
+      scheduling_(),
+      rescheduled_(),
+      done_(),
+      result_(nullptr) {}
+
+void ParallelTasks::start() { schedule(); }
+
+void ParallelTasks::schedule() {
+  auto self = shared_from_this();
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (scheduling_) {
+    rescheduled_ = true;
+    return;
+  }
+  scheduling_ = true;
+  do {
+    rescheduled_ = false;
+    if (!result_.left() && cancelled_())
+      result_ = Error{IHttpRequest::Aborted, util::Error::ABORTED};
+    while (!result_.left() && running_ < max_in_flight_ && next_ < count_) {
+      auto index = next_++;
+      running_++;
+      lock.unlock();
+      task_(index, [=](EitherError<void> e) { self->finished(e); });
+      lock.lock();
+    }
+  } while (rescheduled_);
+  scheduling_ = false;
+  if (done_ || running_ > 0 || (!result_.left() && next_ < count_)) return;
+  done_ = true;
+  auto result = result_;
+  lock.unlock();
+  complete_(result);
+}
+
+void ParallelTasks::finished(EitherError<void> e) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_--;
+    if (e.left() && !result_.left()) result_ = e;
+  }
+  schedule();
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * ParallelTasks.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef PARALLELTASKS_H
+#define PARALLELTASKS_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "IRequest.h"
+
+namespace cloudstorage {
+
+/**
+ * Runs task for indices in [0, count), at most max_in_flight at once; stops
+ * on the first error or when cancelled. Complete is called once, after all
+ * started tasks finished.
+ */
+class ParallelTasks : public std::enable_shared_from_this<ParallelTasks> {
+ public:
+  using Completed = std::function<void(EitherError<void>)>;
+  using Task = std::function<void(uint64_t index, Completed)>;
+
+  ParallelTasks(uint64_t count, uint32_t max_in_flight,
+                std::function<bool()> cancelled, Task task,
+                Completed complete);
+
+  void start();
+
+ private:
+  void schedule();
+  void finished(EitherError<void>);
+
+  uint64_t count_;
+  uint32_t max_in_flight_;
+  std::function<bool()> cancelled_;
+  Task task_;
+  Completed complete_;
+  std::mutex mutex_;
+  uint64_t next_;
+  uint32_t running_;
+  bool scheduling_;
+  bool rescheduled_;
+  bool done_;
+  EitherError<void> result_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // PARALLELTASKS_H
@@ -22,54 +22,166 @@
  *****************************************************************************/
 #include "RecursiveRequest.h"
 
+#include <vector>
+
 #include "CloudProvider/CloudProvider.h"
 
 namespace cloudstorage {
 
+template <class T>
+class RecursiveRequest<T>::Walker
+    : public std::enable_shared_from_this<RecursiveRequest<T>::Walker> {
+ public:
+  Walker(typename Request<T>::Pointer r, CompleteCallback callback,
+         Visitor visitor, uint32_t max_in_flight)
+      : request_(r),
+        callback_(callback),
+        visitor_(visitor),
+        max_in_flight_(std::max<uint32_t>(max_in_flight, 1)),
+        running_(),
+        scheduling_(),
+        rescheduled_(),
+        failed_(),
+        done_() {}
+
+  void start(IItem::Pointer item) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      add(std::make_shared<Node>(Node{item, nullptr, 0}));
+    }
+    schedule();
+  }
+
+ private:
+  struct Node {
+    IItem::Pointer item_;
+    std::shared_ptr<Node> parent_;
+    size_t remaining_;
+  };
+  using NodePointer = std::shared_ptr<Node>;
+
+  struct Task {
+    NodePointer node_;
+    bool list_;
+  };
+
+  void add(NodePointer node) {
+    tasks_.push_back(
+        {node, node->item_->type() == IItem::FileType::Directory});
+  }
+
+  void schedule() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (scheduling_) {
+      rescheduled_ = true;
+      return;
+    }
+    scheduling_ = true;
+    do {
+      rescheduled_ = false;
+      if (!failed_ && request_->is_cancelled())
+        fail(Error{IHttpRequest::Aborted, util::Error::ABORTED});
+      while (!failed_ && running_ < max_in_flight_ && !tasks_.empty()) {
+        auto task = tasks_.back();
+        tasks_.pop_back();
+        running_++;
+        lock.unlock();
+        run(task);
+        lock.lock();
+      }
+    } while (rescheduled_);
+    scheduling_ = false;
+    finish(lock);
+  }
+
+  void run(const Task& task) {
+    auto self = this->shared_from_this();
+    auto node = task.node_;
+    if (task.list_)
+      request_->make_subrequest(
+          &CloudProvider::listDirectorySimpleAsync, node->item_,
+          [=](EitherError<IItem::List> e) { self->listed(node, e); });
+    else
+      visitor_(request_, node->item_,
+               node->parent_ ? node->parent_->item_ : nullptr,
+               [=](const T& e) { self->visited(node, e); });
+  }
+
+  void listed(NodePointer node, EitherError<IItem::List> e) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_--;
+    if (e.left())
+      fail(e.left());
+    else if (!failed_) {
+      if (e.right()->empty()) tasks_.push_back({node, false});
+      node->remaining_ = e.right()->size();
+      for (auto&& item : *e.right())
+        add(std::make_shared<Node>(Node{item, node, 0}));
+    }
+    lock.unlock();
+    schedule();
+  }
+
+  void visited(NodePointer node, const T& e) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    running_--;
+    if (e.left()) {
+      fail(e);
+    } else if (!failed_) {
+      if (!node->parent_) {
+        done_ = true;
+        lock.unlock();
+        return callback_(e);
+      }
+      if (--node->parent_->remaining_ == 0)
+        tasks_.push_back({node->parent_, false});
+    }
+    lock.unlock();
+    schedule();
+  }
+
+  void fail(const T& e) {
+    if (failed_) return;
+    failed_ = true;
+    result_ = e;
+    tasks_.clear();
+  }
+
+  void finish(std::unique_lock<std::mutex>& lock) {
+    if (!failed_ || running_ > 0 || done_ || scheduling_) return;
+    done_ = true;
+    auto result = result_;
+    lock.unlock();
+    callback_(result);
+  }
+
+  typename Request<T>::Pointer request_;
+  CompleteCallback callback_;
+  Visitor visitor_;
+  uint32_t max_in_flight_;
+  std::mutex mutex_;
+  std::vector<Task> tasks_;
+  uint32_t running_;
+  bool scheduling_;
+  bool rescheduled_;
+  bool failed_;
+  bool done_;
+  T result_;
+};
+
 template <class T>
 RecursiveRequest<T>::RecursiveRequest(std::shared_ptr<CloudProvider> p,
                                       IItem::Pointer item,
                                       CompleteCallback callback,
-                                      Visitor visitor)
+                                      Visitor visitor, uint32_t max_in_flight)
     : Request<T>(p, callback, [=](typename Request<T>::Pointer r) {
-        visit(r, item, [=](const T& e) { r->done(e); }, visitor);
+        std::make_shared<Walker>(r, [=](const T& e) { r->done(e); }, visitor,
+                                 max_in_flight)
+            ->start(item);
       }) {}
 
-template <class T>
-void RecursiveRequest<T>::visit(typename Request<T>::Pointer r,
-                                IItem::Pointer item, CompleteCallback callback,
-                                Visitor visitor) {
-  if (item->type() != IItem::FileType::Directory)
-    visitor(r, item, callback);
-  else
-    r->make_subrequest(&CloudProvider::listDirectorySimpleAsync, item,
-                       [=](EitherError<IItem::List> lst) {
-                         if (lst.left()) return callback(lst.left());
-                         visit(r, lst.right(),
-                               [=](const T& e) {
-                                 if (e.left()) return callback(e);
-                                 visitor(r, item, callback);
-                               },
-                               visitor);
-                       });
-}
-
-template <class T>
-void RecursiveRequest<T>::visit(typename Request<T>::Pointer r,
-                                std::shared_ptr<IItem::List> lst,
-                                CompleteCallback callback, Visitor visitor) {
-  if (lst->empty()) return callback(T());
-  auto i = lst->back();
-  lst->pop_back();
-  visit(r, i,
-        [=](const T& e) {
-          if (e.left()) return callback(e.left());
-          visit(r, lst, callback, visitor);
-        },
-        visitor);
-}
-
 template class RecursiveRequest<EitherError<void>>;
 template class RecursiveRequest<EitherError<IItem>>;
+template class RecursiveRequest<EitherError<ChangeSet>>;
 
 }  // namespace cloudstorage
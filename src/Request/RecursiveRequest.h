@@ -28,22 +28,27 @@
 
 namespace cloudstorage {
 
+/**
+ * Calls visitor on every item of the tree rooted at item, together with the
+ * directory it was listed in (nullptr for item itself); a directory is
+ * visited after all of its children were visited successfully. Siblings are
+ * listed and visited concurrently, at most max_in_flight listings and visits
+ * run at once. The walk stops on the first error or when the request is
+ * cancelled. The request's result is the result of visiting the root.
+ */
 template <class ReturnValue>
 class RecursiveRequest : public Request<ReturnValue> {
  public:
   using CompleteCallback = std::function<void(ReturnValue)>;
   using Visitor = std::function<void(typename Request<ReturnValue>::Pointer,
-                                     IItem::Pointer, CompleteCallback)>;
+                                     IItem::Pointer item,
+                                     IItem::Pointer parent, CompleteCallback)>;
 
   RecursiveRequest(std::shared_ptr<CloudProvider>, IItem::Pointer item,
-                   CompleteCallback, Visitor);
+                   CompleteCallback, Visitor, uint32_t max_in_flight);
 
  private:
-  static void visit(typename Request<ReturnValue>::Pointer, IItem::Pointer item,
-                    CompleteCallback, Visitor);
-  static void visit(typename Request<ReturnValue>::Pointer,
-                    std::shared_ptr<IItem::List> lst, CompleteCallback,
-                    Visitor);
+  class Walker;
 };
 
 }  // namespace cloudstorage
@@ -154,7 +154,8 @@ void Request<T>::cancel() {
         }
         p->auth_callbacks_.erase(it);
       }
-      if (p->auth_callbacks_.empty() && p->current_authorization_) {
+      if (p->auth_callbacks_.empty() && p->current_authorization_ &&
+          p->current_authorization_ != p->token_refresh_.lock()) {
         auto auth = util::exchange(p->current_authorization_, nullptr);
         if (!compare<T, EitherError<void>>()(this, auth.get())) {
           lock.unlock();
@@ -388,5 +389,6 @@ template class Request<EitherError<IItem>>;
 template class Request<EitherError<IItem::List>>;
 template class Request<EitherError<void>>;
 template class Request<EitherError<GeneralData>>;
+template class Request<EitherError<ChangeSet>>;
 
 }  // namespace cloudstorage
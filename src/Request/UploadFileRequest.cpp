@@ -23,12 +23,561 @@
 
 #include "UploadFileRequest.h"
 
+#include <json/json.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <set>
+
 #include "CloudProvider/CloudProvider.h"
 
 using namespace std::placeholders;
 
 namespace cloudstorage {
 
+namespace {
+
+const int MAX_PART_RETRIES = 3;
+// bytes hashed at the beginning and at the end of a file to fingerprint it
+const uint64_t FINGERPRINT_SAMPLE_SIZE = 64 * 1024;
+const uint64_t FNV_OFFSET = 14695981039346656037ull;
+
+// checkpoints of uploads running in this process
+std::mutex checkpoints_mutex;
+std::set<std::string> checkpoints;
+
+uint64_t hash(const char* data, size_t size, uint64_t hash = FNV_OFFSET) {
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+  return hash;
+}
+
+uint64_t hash(const std::string& data) {
+  return hash(data.c_str(), data.size());
+}
+
+std::string checkpoint_name(const std::string& key) {
+  std::stringstream stream;
+  stream << "libcloudstorage-upload-" << std::hex << hash(key) << ".json";
+  return stream.str();
+}
+
+/**
+ * Uploads a file in parts: starts an upload session, uploads up to
+ * uploadSessionParallelism() parts at once, retries parts which failed and
+ * commits the session. The list of uploaded parts is saved after each part in
+ * temporary_directory, so that an upload of the same file interrupted by a
+ * restart continues from where it stopped. Checkpoints are keyed with the
+ * account, directory, filename and size; an upload is resumed only if the
+ * file's fingerprint (modification time and hash of the first and the last
+ * FINGERPRINT_SAMPLE_SIZE bytes) matches the one saved with the checkpoint. Uploads of the same file
+ * running at once don't share a checkpoint, only the first one is saved.
+ *
+ * Files of unknown size are streamed: every part is uploaded once the callback
+ * reports its data available, the part which comes out short fixes the size.
+ * Streamed uploads aren't checkpointed.
+ *
+ * Parts of files of known size grow so that there are no more of them than
+ * uploadSessionMaxPartCount(); a streamed upload which exceeds it fails.
+ *
+ * If the provider asks for it, the last part of a file of known size is held
+ * back until all the other parts are uploaded.
+ *
+ * A cancelled upload removes its checkpoint and discards the session with
+ * uploadSessionAbortRequest.
+ */
+class ChunkedUpload : public std::enable_shared_from_this<ChunkedUpload> {
+ public:
+  using RequestPointer = Request<EitherError<IItem>>::Pointer;
+
+  ChunkedUpload(RequestPointer r, IItem::Pointer directory,
+                const std::string& filename, IUploadFileCallback::Pointer cb,
+                uint64_t size)
+      : request_(r),
+        directory_(directory),
+        filename_(filename),
+        callback_(cb),
+        parallelism_(std::max<uint32_t>(
+            r->provider()->uploadSessionParallelism(), 1)),
+        max_part_count_(r->provider()->uploadSessionMaxPartCount()),
+        streaming_(size == IItem::UnknownSize),
+        last_part_after_others_(
+            r->provider()->uploadSessionLastPartAfterOthers()),
+        next_(),
+        running_(),
+        waiting_(),
+        uploaded_(),
+        resumed_(),
+        end_(!streaming_),
+        failed_(),
+        checkpointed_() {
+    session_.size_ = size;
+    session_.part_size_ = r->provider()->uploadSessionPartSize();
+    if (!streaming_ && max_part_count_ > 0)
+      session_.part_size_ = std::max(
+          session_.part_size_, (size + max_part_count_ - 1) / max_part_count_);
+    std::stringstream key;
+    key << r->provider()->name() << "\n"
+        << std::hex << hash(r->provider()->token()) << std::dec << "\n"
+        << directory->id() << "\n"
+        << filename << "\n"
+        << size;
+    key_ = key.str();
+    checkpoint_ = r->provider()->temporary_directory() + checkpoint_name(key_);
+  }
+
+  ~ChunkedUpload() { release_checkpoint(); }
+
+  void start() {
+    if (!streaming_ && claim_checkpoint()) fingerprint_ = fingerprint();
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!checkpointed_ || !load_checkpoint()) {
+      lock.unlock();
+      return start_session();
+    }
+    resumed_ = true;
+    for (uint64_t i = 0; i < parts_.size(); i++)
+      if (parts_[i].uploaded_)
+        uploaded_ += session_.length(i);
+      else
+        pending_.push_back(i);
+    bool commit = pending_.empty();
+    lock.unlock();
+    if (commit)
+      this->commit();
+    else
+      schedule();
+  }
+
+ private:
+  struct Part {
+    bool uploaded_;
+    std::string tag_;
+    int retries_;
+    uint64_t progress_;
+  };
+
+  void start_session() {
+    auto self = shared_from_this();
+    uint64_t size;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      size = session_.size_;
+    }
+    request_->request(
+        [=](util::Output stream) {
+          return request_->provider()->uploadSessionStartRequest(
+              *directory_, filename_, size, *stream);
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return done(e.left());
+          try {
+            auto id = request_->provider()->uploadSessionStartResponse(
+                e.right()->headers(), e.right()->output());
+            std::unique_lock<std::mutex> lock(mutex_);
+            session_.id_ = id;
+            parts_.assign(streaming_ ? 0 : session_.part_count(), Part{});
+            pending_.clear();
+            for (uint64_t i = 0; i < parts_.size(); i++) pending_.push_back(i);
+            uploaded_ = 0;
+            save_checkpoint();
+          } catch (const std::exception&) {
+            return done(
+                Error{IHttpRequest::Failure, e.right()->output().str()});
+          }
+          self->schedule();
+        });
+  }
+
+  void schedule() {
+    std::vector<uint64_t> parts, awaited;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (!failed_ && running_ + waiting_ < parallelism_) {
+        if (!pending_.empty() && last_part_after_others_ && !streaming_ &&
+            pending_.front() + 1 == session_.part_count() &&
+            (running_ > 0 || pending_.size() > 1)) {
+          if (pending_.size() == 1) break;
+          pending_.push_back(pending_.front());
+          pending_.pop_front();
+        }
+        if (!pending_.empty()) {
+          parts.push_back(pending_.front());
+          pending_.pop_front();
+          running_++;
+        } else if (!end_) {
+          awaited.push_back(next_++);
+          waiting_++;
+        } else {
+          break;
+        }
+      }
+    }
+    for (auto part : parts) upload(part);
+    for (auto part : awaited) wait(part);
+  }
+
+  void wait(uint64_t part) {
+    auto self = shared_from_this();
+    callback_->waitData(
+        session_.offset(part), session_.part_size_,
+        [=](EitherError<uint64_t> e) { self->available(part, e); });
+  }
+
+  void available(uint64_t part, EitherError<uint64_t> e) {
+    bool upload = false, finished, failed;
+    Error error;
+    if (!e.left() && request_->is_cancelled())
+      e = Error{IHttpRequest::Aborted, util::Error::ABORTED};
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      waiting_--;
+      if (e.left()) {
+        if (!failed_) {
+          failed_ = true;
+          error_ = *e.left();
+        }
+      } else if (!failed_) {
+        auto length = std::min(*e.right(), session_.part_size_);
+        if (length < session_.part_size_) {
+          end_ = true;
+          session_.size_ =
+              std::min(session_.size_, session_.offset(part) + length);
+        }
+        if (length > 0 && max_part_count_ > 0 && part >= max_part_count_) {
+          if (!failed_) {
+            failed_ = true;
+            error_ = Error{IHttpRequest::Bad, util::Error::UPLOAD_TOO_LARGE};
+          }
+        } else if (length > 0) {
+          if (parts_.size() <= part) parts_.resize(part + 1, Part{});
+          running_++;
+          upload = true;
+        }
+      }
+      finished = running_ == 0 && waiting_ == 0 &&
+                 (failed_ || (pending_.empty() && end_));
+      failed = failed_;
+      error = error_;
+    }
+    if (upload) return this->upload(part);
+    if (!finished) return schedule();
+    if (failed)
+      fail(error);
+    else
+      commit();
+  }
+
+  void upload(uint64_t part) {
+    auto self = shared_from_this();
+    // available() may set the size of a streamed session meanwhile
+    UploadSession session;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      session = session_;
+    }
+    auto offset = session.offset(part);
+    auto length = session.length(part);
+    auto stream_wrapper = std::make_shared<UploadStreamWrapper>(
+        [=](char* data, uint32_t size, uint64_t position) {
+          std::unique_lock<std::mutex> lock(self->read_mutex_);
+          return self->callback_->putData(data, size, offset + position);
+        },
+        length);
+    request_->send(
+        [=](util::Output) {
+          stream_wrapper->reset();
+          return request_->provider()->uploadPartRequest(
+              *directory_, filename_, session, part, stream_wrapper->prefix_,
+              stream_wrapper->suffix_);
+        },
+        [=](EitherError<Response> e) { self->uploaded(part, session, e); },
+        [=] { return std::make_shared<std::iostream>(stream_wrapper.get()); },
+        std::make_shared<std::stringstream>(), nullptr,
+        [=](uint64_t, uint64_t now) { self->progress(part, now); }, true);
+  }
+
+  void uploaded(uint64_t part, const UploadSession& session,
+                EitherError<Response> e) {
+    std::string tag;
+    auto error = e.left();
+    if (!error && request_->is_cancelled())
+      error = std::make_shared<Error>(
+          Error{IHttpRequest::Aborted, util::Error::ABORTED});
+    if (!error) {
+      try {
+        tag = request_->provider()->uploadPartResponse(
+            session, part, e.right()->headers(), e.right()->output());
+      } catch (const std::exception&) {
+        error = std::make_shared<Error>(
+            Error{IHttpRequest::Failure, e.right()->output().str()});
+      }
+    }
+    bool finished, failed;
+    Error failure;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      running_--;
+      auto& p = parts_[part];
+      p.progress_ = 0;
+      if (error && p.retries_ > 0 && error->code_ != IHttpRequest::Aborted &&
+          request_->provider()->uploadPartUploaded(session, part, *error)) {
+        util::log("part", part, "of", filename_, "was already uploaded");
+        error = nullptr;
+      }
+      if (!error) {
+        p.uploaded_ = true;
+        p.tag_ = tag;
+        uploaded_ += session_.length(part);
+        save_checkpoint();
+      } else if (error->code_ == IHttpRequest::Aborted ||
+                 request_->is_cancelled() || ++p.retries_ > MAX_PART_RETRIES) {
+        if (!failed_) {
+          failed_ = true;
+          error_ = *error;
+        }
+      } else {
+        util::log("retrying part", part, "of", filename_, error->code_,
+                  error->description_);
+        pending_.push_front(part);
+      }
+      finished = running_ == 0 && waiting_ == 0 &&
+                 (failed_ || (pending_.empty() && end_));
+      failed = failed_;
+      failure = error_;
+    }
+    report_progress();
+    if (!finished) return schedule();
+    if (failed)
+      fail(failure);
+    else
+      commit();
+  }
+
+  void commit() {
+    auto self = shared_from_this();
+    UploadSession session;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      session_.parts_.clear();
+      for (auto&& p : parts_) session_.parts_.push_back(p.tag_);
+      session = session_;
+    }
+    request_->request(
+        [=](util::Output stream) {
+          return request_->provider()->uploadSessionCommitRequest(
+              *directory_, filename_, session, *stream);
+        },
+        [=](EitherError<Response> e) {
+          if (e.left()) return self->fail(*e.left());
+          try {
+            auto item = request_->provider()->uploadSessionCommitResponse(
+                *directory_, filename_, session, e.right()->output());
+            remove_checkpoint();
+            done(item);
+          } catch (const std::exception&) {
+            done(
+                Error{IHttpRequest::Failure, e.right()->output().str()});
+          }
+        });
+  }
+
+  void fail(const Error& e) {
+    if (request_->is_cancelled()) {
+      abort();
+      return done(e);
+    }
+    if (resumed_ && e.code_ == IHttpRequest::NotFound &&
+        !request_->is_cancelled()) {
+      util::log("upload session of", filename_, "expired, starting again");
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        resumed_ = false;
+        failed_ = false;
+        remove_checkpoint();
+      }
+      return start_session();
+    }
+    done(e);
+  }
+
+  void done(EitherError<IItem> e) {
+    release_checkpoint();
+    request_->done(e);
+  }
+
+  void abort() {
+    remove_checkpoint();
+    UploadSession session;
+    {
+      // parts of a streamed upload which may have been uploaded
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (session_.size_ == IItem::UnknownSize)
+        session_.size_ = parts_.size() * session_.part_size_;
+      session = session_;
+    }
+    auto provider = request_->provider();
+    auto input = std::make_shared<std::stringstream>();
+    auto r = provider->uploadSessionAbortRequest(*directory_, filename_,
+                                                 session, *input);
+    if (!r) return;
+    // the request is cancelled already, so this one is sent on its own
+    provider->authorizeRequest(*r);
+    r->send([r](IHttpRequest::Response) {}, input,
+            std::make_shared<std::stringstream>(),
+            std::make_shared<std::stringstream>(), nullptr);
+  }
+
+  void progress(uint64_t part, uint64_t now) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      parts_[part].progress_ = std::min(now, session_.length(part));
+    }
+    report_progress();
+  }
+
+  void report_progress() {
+    uint64_t total, uploaded;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      total = session_.size_;
+      uploaded = uploaded_;
+      for (auto&& p : parts_) uploaded += p.progress_;
+    }
+    callback_->progress(total, uploaded);
+  }
+
+  bool claim_checkpoint() {
+    std::lock_guard<std::mutex> lock(checkpoints_mutex);
+    checkpointed_ = checkpoints.insert(checkpoint_).second;
+    return checkpointed_;
+  }
+
+  void release_checkpoint() {
+    std::lock_guard<std::mutex> lock(checkpoints_mutex);
+    if (checkpointed_.exchange(false)) checkpoints.erase(checkpoint_);
+  }
+
+  // modification time and hash of the first and the last
+  // FINGERPRINT_SAMPLE_SIZE bytes; the size is a part of the checkpoint's key
+  std::string fingerprint() {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    uint64_t result = FNV_OFFSET;
+    auto size = session_.size_;
+    std::vector<char> buffer(FINGERPRINT_SAMPLE_SIZE);
+    auto head = std::min(size, FINGERPRINT_SAMPLE_SIZE);
+    auto tail = std::max(head, size - std::min(size, FINGERPRINT_SAMPLE_SIZE));
+    for (auto range : {Range{0, head}, Range{tail, size - tail}}) {
+      auto offset = range.start_, length = range.size_;
+      while (length > 0) {
+        auto read = callback_->putData(
+            buffer.data(),
+            static_cast<uint32_t>(std::min<uint64_t>(length, buffer.size())),
+            offset);
+        if (read == 0) break;
+        result = hash(buffer.data(), read, result);
+        offset += read;
+        length -= read;
+      }
+    }
+    std::stringstream stream;
+    stream << std::chrono::duration_cast<std::chrono::seconds>(
+                  callback_->timestamp().time_since_epoch())
+                  .count()
+           << "-" << std::hex << result;
+    return stream.str();
+  }
+
+  bool load_checkpoint() {
+    try {
+      std::ifstream file(checkpoint_);
+      if (!file) return false;
+      auto json = util::json::from_stream(file);
+      if (json["key"].asString() != key_ ||
+          json["fingerprint"].asString() != fingerprint_ ||
+          json["part_size"].asUInt64() != session_.part_size_ ||
+          json["parts"].size() != session_.part_count())
+        return false;
+      session_.id_ = json["session"].asString();
+      parts_.clear();
+      for (auto&& p : json["parts"])
+        parts_.push_back(
+            Part{!p.isNull(), p.isNull() ? "" : p.asString(), 0, 0});
+      return true;
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+
+  void save_checkpoint() {
+    if (!checkpointed_) return;
+    Json::Value json;
+    json["key"] = key_;
+    json["fingerprint"] = fingerprint_;
+    json["part_size"] = Json::UInt64(session_.part_size_);
+    json["session"] = session_.id_;
+    json["parts"] = Json::arrayValue;
+    for (auto&& p : parts_)
+      json["parts"].append(p.uploaded_ ? Json::Value(p.tag_) : Json::Value());
+    auto temporary = checkpoint_ + ".tmp";
+    {
+      std::ofstream file(temporary);
+      file << util::json::to_string(json);
+      if (!file) return util::log("couldn't write", temporary);
+    }
+    std::remove(checkpoint_.c_str());
+    if (std::rename(temporary.c_str(), checkpoint_.c_str()) != 0)
+      util::log("couldn't write", checkpoint_);
+  }
+
+  void remove_checkpoint() {
+    if (checkpointed_) std::remove(checkpoint_.c_str());
+  }
+
+  RequestPointer request_;
+  IItem::Pointer directory_;
+  std::string filename_;
+  IUploadFileCallback::Pointer callback_;
+  std::string key_;
+  std::string checkpoint_;
+  std::string fingerprint_;
+  uint32_t parallelism_;
+  uint64_t max_part_count_;
+  std::mutex mutex_;
+  std::mutex read_mutex_;
+  UploadSession session_;
+  std::vector<Part> parts_;
+  std::deque<uint64_t> pending_;
+  bool streaming_;
+  bool last_part_after_others_;
+  uint64_t next_;
+  uint32_t running_;
+  uint32_t waiting_;
+  uint64_t uploaded_;
+  bool resumed_;
+  bool end_;
+  bool failed_;
+  Error error_;
+  // whether this upload owns its checkpoint
+  std::atomic_bool checkpointed_;
+};
+
+}  // namespace
+
+uint64_t UploadSession::part_count() const {
+  return (size_ + part_size_ - 1) / part_size_;
+}
+
+uint64_t UploadSession::offset(uint64_t part) const {
+  return part * part_size_;
+}
+
+uint64_t UploadSession::length(uint64_t part) const {
+  return std::min(part_size_, size_ - offset(part));
+}
+
 UploadFileRequest::UploadFileRequest(std::shared_ptr<CloudProvider> p,
                                      IItem::Pointer directory,
                                      const std::string& filename,
@@ -45,6 +594,18 @@ void UploadFileRequest::resolve(Request::Pointer r,
                                 UploadStreamWrapper::Pointer stream_wrapper,
                                 IItem::Pointer directory, std::string filename,
                                 ICallback::Pointer callback) {
+  if (stream_wrapper->size_ != IItem::UnknownSize &&
+      stream_wrapper->size_ > r->provider()->uploadMaxSize())
+    return r->done(Error{IHttpRequest::Bad, util::Error::UPLOAD_TOO_LARGE});
+  auto part_size = r->provider()->uploadSessionPartSize();
+  if (stream_wrapper->size_ == IItem::UnknownSize &&
+      (part_size == 0 || !r->provider()->uploadSessionStreaming()))
+    return r->done(Error{IHttpRequest::ServiceUnavailable,
+                         util::Error::UNKNOWN_UPLOAD_SIZE});
+  if (part_size > 0 && stream_wrapper->size_ > part_size)
+    return std::make_shared<ChunkedUpload>(r, directory, filename, callback,
+                                           stream_wrapper->size_)
+        ->start();
   r->send(
       [=](util::Output) {
         stream_wrapper->reset();
@@ -96,8 +657,9 @@ std::streambuf::int_type UploadStreamWrapper::underflow() {
     read_data += prefix_.gcount();
   }
   if (read_ < size_ && !prefix_) {
-    uint32_t size =
-        callback_(buffer_ + read_data, BUFFER_SIZE - read_data, read_);
+    uint32_t size = callback_(
+        buffer_ + read_data,
+        std::min<uint64_t>(BUFFER_SIZE - read_data, size_ - read_), read_);
     read_data += size;
     read_ += size;
   }
@@ -24,11 +24,30 @@
 #ifndef UPLOADFILEREQUEST_H
 #define UPLOADFILEREQUEST_H
 
+#include <vector>
+
 #include "IItem.h"
 #include "Request.h"
 
 namespace cloudstorage {
 
+/**
+ * Upload session of a file split into parts of equal size (except the last
+ * one); parts_ holds identifiers of uploaded parts as returned by
+ * CloudProvider::uploadPartResponse, it is filled before the session is
+ * committed.
+ */
+struct UploadSession {
+  std::string id_;
+  uint64_t size_;
+  uint64_t part_size_;
+  std::vector<std::string> parts_;
+
+  uint64_t part_count() const;
+  uint64_t offset(uint64_t part) const;
+  uint64_t length(uint64_t part) const;
+};
+
 class UploadStreamWrapper : public std::streambuf {
  public:
   using Pointer = std::shared_ptr<UploadStreamWrapper>;
@@ -0,0 +1,224 @@
+/*****************************************************************************
+ * BlockCache.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "BlockCache.h"
+
+#include <cstdio>
+
+namespace cloudstorage {
+
+constexpr uint64_t BlockCache::BlockSize;
+
+namespace {
+
+std::string block_key(const std::string& key, uint64_t index) {
+  return key + "#" + std::to_string(index);
+}
+
+}  // namespace
+
+BlockCache::BlockCache(uint64_t memory_size, const std::string& disk_path,
+                       uint64_t disk_size)
+    : memory_size_(memory_size),
+      memory_used_(0),
+      disk_path_(disk_path),
+      disk_slots_(disk_size / BlockSize),
+      generation_(0) {
+  if (!disk_path_.empty() && disk_slots_ > 0) {
+    disk_.open(disk_path_, std::ios::in | std::ios::out | std::ios::trunc |
+                               std::ios::binary);
+    if (!disk_) {
+      util::log("couldn't open block cache file", disk_path_);
+      disk_slots_ = 0;
+    }
+  } else {
+    disk_slots_ = 0;
+  }
+  for (uint64_t i = 0; i < disk_slots_; i++)
+    free_slots_.push_back(disk_slots_ - i - 1);
+}
+
+BlockCache::~BlockCache() {
+  if (disk_.is_open()) {
+    disk_.close();
+    std::remove(disk_path_.c_str());
+  }
+}
+
+std::string BlockCache::key(const std::string& provider, const std::string& id,
+                            uint64_t size) {
+  return provider + "/" + std::to_string(size) + "/" + id;
+}
+
+BlockCache::Status BlockCache::get(const std::string& key, uint64_t index,
+                                   Block& block, const Callback& callback,
+                                   bool download) {
+  auto id = block_key(key, index);
+  std::unique_lock<std::mutex> lock(mutex_);
+  block = find(id);
+  if (block) return Status::Cached;
+  auto disk = disk_index_.find(id);
+  if (disk != disk_index_.end()) {
+    auto entry = disk->second;
+    lock.unlock();
+    auto loaded = load(entry);
+    lock.lock();
+    disk = disk_index_.find(id);
+    if (disk != disk_index_.end() &&
+        disk->second.generation_ == entry.generation_) {
+      if (loaded) {
+        disk_lru_.splice(disk_lru_.begin(), disk_lru_, disk->second.lru_);
+        auto evicted = insert(id, loaded);
+        lock.unlock();
+        store(evicted);
+        block = loaded;
+        return Status::Cached;
+      }
+      free_slots_.push_back(disk->second.slot_);
+      disk_lru_.erase(disk->second.lru_);
+      disk_index_.erase(disk);
+    }
+    block = find(id);
+    if (block) return Status::Cached;
+  }
+  auto it = pending_.find(id);
+  if (it != pending_.end()) {
+    it->second.push_back(callback);
+    return Status::Pending;
+  }
+  if (!download) return Status::Missing;
+  pending_[id] = {};
+  return Status::Download;
+}
+
+void BlockCache::put(const std::string& key, uint64_t index, Block block) {
+  auto id = block_key(key, index);
+  std::vector<Callback> callbacks;
+  Evicted evicted;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(id);
+    if (it != pending_.end()) {
+      callbacks = std::move(it->second);
+      pending_.erase(it);
+    }
+    evicted = insert(id, block);
+  }
+  for (auto&& c : callbacks) c(block);
+  store(evicted);
+}
+
+void BlockCache::fail(const std::string& key, uint64_t index) {
+  std::vector<Callback> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(block_key(key, index));
+    if (it == pending_.end()) return;
+    callbacks = std::move(it->second);
+    pending_.erase(it);
+  }
+  for (auto&& c : callbacks) c(nullptr);
+}
+
+BlockCache::Block BlockCache::find(const std::string& key) {
+  auto it = memory_.find(key);
+  if (it == memory_.end()) return nullptr;
+  memory_lru_.splice(memory_lru_.begin(), memory_lru_, it->second.lru_);
+  return it->second.block_;
+}
+
+BlockCache::Evicted BlockCache::insert(const std::string& key, Block block) {
+  if (memory_.find(key) != memory_.end()) return {};
+  if (block->size() > memory_size_) return {{key, block}};
+  Evicted evicted;
+  while (memory_used_ + block->size() > memory_size_) {
+    auto it = memory_.find(memory_lru_.back());
+    evicted.push_back({it->first, it->second.block_});
+    memory_used_ -= it->second.block_->size();
+    memory_.erase(it);
+    memory_lru_.pop_back();
+  }
+  memory_lru_.push_front(key);
+  memory_[key] = {block, memory_lru_.begin()};
+  memory_used_ += block->size();
+  return evicted;
+}
+
+void BlockCache::store(const Evicted& evicted) {
+  for (auto&& e : evicted) store(e.first, e.second);
+}
+
+void BlockCache::store(const std::string& key, const Block& block) {
+  if (disk_slots_ == 0 || block->size() > BlockSize) return;
+  DiskEntry entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = disk_index_.find(key);
+    if (it != disk_index_.end()) {
+      disk_lru_.splice(disk_lru_.begin(), disk_lru_, it->second.lru_);
+      return;
+    }
+    if (free_slots_.empty()) {
+      // every slot is being written
+      if (disk_lru_.empty()) return;
+      auto evicted = disk_index_.find(disk_lru_.back());
+      free_slots_.push_back(evicted->second.slot_);
+      disk_index_.erase(evicted);
+      disk_lru_.pop_back();
+    }
+    entry.slot_ = free_slots_.back();
+    entry.size_ = block->size();
+    entry.generation_ = ++generation_;
+    free_slots_.pop_back();
+  }
+  bool written;
+  {
+    std::lock_guard<std::mutex> lock(disk_mutex_);
+    disk_.seekp(entry.slot_ * BlockSize);
+    disk_.write(block->data(), block->size());
+    written = static_cast<bool>(disk_);
+    disk_.clear();
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!written || disk_index_.find(key) != disk_index_.end()) {
+    free_slots_.push_back(entry.slot_);
+    return;
+  }
+  disk_lru_.push_front(key);
+  entry.lru_ = disk_lru_.begin();
+  disk_index_[key] = entry;
+}
+
+BlockCache::Block BlockCache::load(const DiskEntry& entry) {
+  auto block = std::make_shared<std::vector<char>>(entry.size_);
+  std::lock_guard<std::mutex> lock(disk_mutex_);
+  disk_.seekg(entry.slot_ * BlockSize);
+  disk_.read(block->data(), block->size());
+  if (!disk_) {
+    disk_.clear();
+    return nullptr;
+  }
+  return block;
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,132 @@
+/*****************************************************************************
+ * BlockCache.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Utility/Utility.h"
+
+namespace cloudstorage {
+
+/**
+ * Cache of fixed size file blocks shared by all streams of a FileServer.
+ *
+ * Blocks are identified by an item key (provider, item id, size) and a block
+ * index. Recently used blocks are kept in memory; blocks evicted from memory
+ * may be spilled to a slot file on disk. Concurrent readers of a block which
+ * is being downloaded are coalesced: only the first one downloads it, the rest
+ * are notified when it arrives.
+ *
+ * The slot file is read and written outside of the lock of the index; a block
+ * read from disk is used only if its slot wasn't reassigned meanwhile. A cache
+ * of zero size keeps no blocks and only coalesces downloads.
+ */
+class BlockCache {
+ public:
+  using Pointer = std::shared_ptr<BlockCache>;
+  using Block = util::ChunkQueue::Chunk;
+  using Callback = std::function<void(Block)>;
+
+  static constexpr uint64_t BlockSize = 1024 * 1024;
+
+  enum class Status {
+    // block was found, it is returned immediately
+    Cached,
+    // block is being downloaded by someone else, callback will be called
+    // with the block or with nullptr if the download failed
+    Pending,
+    // caller is responsible for downloading the block and calling put or fail
+    Download,
+    // block is not available and caller didn't want to download it
+    Missing
+  };
+
+  /**
+   * @param memory_size maximum number of bytes kept in memory
+   * @param disk_path path of the slot file, disk tier is disabled if empty
+   * @param disk_size maximum number of bytes kept on disk
+   */
+  BlockCache(uint64_t memory_size, const std::string& disk_path = "",
+             uint64_t disk_size = 0);
+  ~BlockCache();
+
+  static std::string key(const std::string& provider, const std::string& id,
+                         uint64_t size);
+
+  Status get(const std::string& key, uint64_t index, Block& block,
+             const Callback& callback, bool download = true);
+  void put(const std::string& key, uint64_t index, Block block);
+  void fail(const std::string& key, uint64_t index);
+
+ private:
+  struct Entry {
+    Block block_;
+    std::list<std::string>::iterator lru_;
+  };
+
+  struct DiskEntry {
+    uint64_t slot_;
+    uint64_t size_;
+    // distinguishes blocks which were stored in the same slot
+    uint64_t generation_;
+    std::list<std::string>::iterator lru_;
+  };
+
+  // blocks evicted from memory, to be stored on disk
+  using Evicted = std::vector<std::pair<std::string, Block>>;
+
+  Block find(const std::string& key);
+  Evicted insert(const std::string& key, Block block);
+  void store(const Evicted& evicted);
+  void store(const std::string& key, const Block& block);
+  Block load(const DiskEntry& entry);
+
+  std::mutex mutex_;
+  uint64_t memory_size_;
+  uint64_t memory_used_;
+  std::list<std::string> memory_lru_;
+  std::unordered_map<std::string, Entry> memory_;
+  std::string disk_path_;
+  uint64_t disk_slots_;
+  uint64_t generation_;
+  std::mutex disk_mutex_;
+  std::fstream disk_;
+  std::list<std::string> disk_lru_;
+  std::unordered_map<std::string, DiskEntry> disk_index_;
+  std::vector<uint64_t> free_slots_;
+  std::unordered_map<std::string, std::vector<Callback>> pending_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // BLOCKCACHE_H
@@ -40,12 +40,48 @@
 #include "CloudProvider/YandexDisk.h"
 #include "CloudProvider/YouTube.h"
 
+#include "Utility/MetadataCache.h"
 #include "Utility/Utility.h"
 
 namespace cloudstorage {
 
 namespace {
 
+class InvalidatingUploadCallback : public IUploadFileCallback {
+ public:
+  InvalidatingUploadCallback(IUploadFileCallback::Pointer callback,
+                             MetadataCache::Pointer cache,
+                             const std::string& parent)
+      : callback_(callback), cache_(cache), parent_(parent) {}
+
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
+    return callback_->putData(data, maxlength, offset);
+  }
+
+  uint64_t size() override { return callback_->size(); }
+
+  void done(EitherError<IItem> e) override {
+    cache_->invalidate(parent_);
+    callback_->done(e);
+  }
+
+  void progress(uint64_t total, uint64_t now) override {
+    callback_->progress(total, now);
+  }
+
+  IItem::TimeStamp timestamp() override { return callback_->timestamp(); }
+
+  void waitData(uint64_t offset, uint64_t length,
+                std::function<void(EitherError<uint64_t>)> ready) override {
+    callback_->waitData(offset, length, ready);
+  }
+
+ private:
+  IUploadFileCallback::Pointer callback_;
+  MetadataCache::Pointer cache_;
+  std::string parent_;
+};
+
 class CloudProviderWrapper : public ICloudProvider {
  public:
   CloudProviderWrapper(std::shared_ptr<CloudProvider> p) : p_(p) {}
@@ -64,6 +100,10 @@ class CloudProviderWrapper : public ICloudProvider {
     return p_->supportedOperations();
   }
 
+  CacheStatistics metadataCacheStatistics() const override {
+    return p_->metadataCacheStatistics();
+  }
+
   std::string authorizeLibraryUrl() const override {
     return p_->authorizeLibraryUrl();
   }
@@ -106,7 +146,10 @@ class CloudProviderWrapper : public ICloudProvider {
   UploadFileRequest::Pointer uploadFileAsync(
       IItem::Pointer parent, const std::string& filename,
       IUploadFileCallback::Pointer cb) override {
-    return p_->uploadFileAsync(parent, filename, cb);
+    return p_->uploadFileAsync(
+        parent, filename,
+        std::make_shared<InvalidatingUploadCallback>(
+            cb, p_->metadata_cache(), parent->id()));
   }
 
   GetItemDataRequest::Pointer getItemDataAsync(
@@ -121,25 +164,43 @@ class CloudProviderWrapper : public ICloudProvider {
 
   DeleteItemRequest::Pointer deleteItemAsync(
       IItem::Pointer item, DeleteItemCallback callback) override {
-    return p_->deleteItemAsync(item, callback);
+    auto cache = p_->metadata_cache();
+    return p_->deleteItemAsync(item, [=](EitherError<void> e) {
+      cache->invalidate(item->id());
+      callback(e);
+    });
   }
 
   CreateDirectoryRequest::Pointer createDirectoryAsync(
       IItem::Pointer parent, const std::string& name,
       CreateDirectoryCallback callback) override {
-    return p_->createDirectoryAsync(parent, name, callback);
+    auto cache = p_->metadata_cache();
+    return p_->createDirectoryAsync(parent, name, [=](EitherError<IItem> e) {
+      cache->invalidate(parent->id());
+      callback(e);
+    });
   }
 
   MoveItemRequest::Pointer moveItemAsync(IItem::Pointer source,
                                          IItem::Pointer destination,
                                          MoveItemCallback callback) override {
-    return p_->moveItemAsync(source, destination, callback);
+    auto cache = p_->metadata_cache();
+    return p_->moveItemAsync(
+        source, destination, [=](EitherError<IItem> e) {
+          cache->invalidate(source->id());
+          cache->invalidate(destination->id());
+          callback(e);
+        });
   }
 
   RenameItemRequest::Pointer renameItemAsync(
       IItem::Pointer item, const std::string& name,
       RenameItemCallback callback) override {
-    return p_->renameItemAsync(item, name, callback);
+    auto cache = p_->metadata_cache();
+    return p_->renameItemAsync(item, name, [=](EitherError<IItem> e) {
+      cache->invalidate(item->id());
+      callback(e);
+    });
   }
 
   ListDirectoryPageRequest::Pointer listDirectoryPageAsync(
@@ -168,7 +229,12 @@ class CloudProviderWrapper : public ICloudProvider {
   UploadFileRequest::Pointer uploadFileAsync(
       IItem::Pointer parent, const std::string& path,
       const std::string& filename, UploadFileCallback callback) override {
-    return p_->uploadFileAsync(parent, path, filename, callback);
+    auto cache = p_->metadata_cache();
+    return p_->uploadFileAsync(parent, path, filename,
+                               [=](EitherError<IItem> e) {
+                                 cache->invalidate(parent->id());
+                                 callback(e);
+                               });
   }
 
   GeneralDataRequest::Pointer getGeneralDataAsync(
@@ -176,6 +242,18 @@ class CloudProviderWrapper : public ICloudProvider {
     return p_->getGeneralDataAsync(callback);
   }
 
+  ListChangesRequest::Pointer listChangesAsync(
+      const std::string& cursor, ListChangesCallback callback) override {
+    auto cache = p_->metadata_cache();
+    return p_->listChangesAsync(cursor, [=](EitherError<ChangeSet> e) {
+      if (e.right())
+        cache->invalidate(*e.right());
+      else if (e.left()->description_ == util::Error::CHANGE_CURSOR_EXPIRED)
+        cache->clear();
+      callback(e);
+    });
+  }
+
   GetItemUrlRequest::Pointer getFileDaemonUrlAsync(
       IItem::Pointer item, GetItemUrlCallback callback) override {
     return p_->getFileDaemonUrlAsync(item, callback);
@@ -21,18 +21,74 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 
-#ifdef WITH_CRYPTOPP
-
 #include "CryptoPP.h"
 
+#ifdef WITH_CRYPTOPP
 #include <cryptopp/cryptlib.h>
 #include <cryptopp/hex.h>
 #include <cryptopp/hmac.h>
 #include <cryptopp/sha.h>
+#endif
+
+#include "ICrypto.h"
 #include "Utility/Utility.h"
 
 namespace cloudstorage {
 
+namespace {
+
+// gathers the message and hashes it at once with ICrypto::sha256
+class BufferedSha256 : public ICrypto::Hash {
+ public:
+  BufferedSha256(ICrypto& crypto) : crypto_(crypto) {}
+
+  void update(const char* data, size_t length) override {
+    message_.append(data, length);
+  }
+
+  std::string digest() override {
+    std::string message;
+    message.swap(message_);
+    return crypto_.sha256(message);
+  }
+
+ private:
+  ICrypto& crypto_;
+  std::string message_;
+};
+
+}  // namespace
+
+ICrypto::Hash::Pointer ICrypto::sha256_hash() {
+  return util::make_unique<BufferedSha256>(*this);
+}
+
+}  // namespace cloudstorage
+
+#ifdef WITH_CRYPTOPP
+
+namespace cloudstorage {
+
+namespace {
+
+class Sha256 : public ICrypto::Hash {
+ public:
+  void update(const char* data, size_t length) override {
+    hash_.Update(reinterpret_cast<const uint8_t*>(data), length);
+  }
+
+  std::string digest() override {
+    std::string result(::CryptoPP::SHA256::DIGESTSIZE, 0);
+    hash_.Final(reinterpret_cast<uint8_t*>(&result[0]));
+    return result;
+  }
+
+ private:
+  ::CryptoPP::SHA256 hash_;
+};
+
+}  // namespace
+
 ICrypto::Pointer ICrypto::create() { return util::make_unique<CryptoPP>(); }
 
 std::string CryptoPP::sha256(const std::string& message) {
@@ -44,6 +100,10 @@ std::string CryptoPP::sha256(const std::string& message) {
   return result;
 }
 
+ICrypto::Hash::Pointer CryptoPP::sha256_hash() {
+  return util::make_unique<Sha256>();
+}
+
 std::string CryptoPP::hmac_sha256(const std::string& key,
                                   const std::string& message) {
   std::string mac;
@@ -80,8 +140,6 @@ std::string CryptoPP::hex(const std::string& hash) {
 
 #else
 
-#include "ICrypto.h"
-
 namespace cloudstorage {
 ICrypto::Pointer ICrypto::create() { return nullptr; }
 }  // namespace cloudstorage
@@ -33,6 +33,7 @@ namespace cloudstorage {
 class CryptoPP : public ICrypto {
  public:
   std::string sha256(const std::string& message) override;
+  Hash::Pointer sha256_hash() override;
   std::string hmac_sha256(const std::string& key,
                           const std::string& message) override;
   std::string hmac_sha1(const std::string& key,
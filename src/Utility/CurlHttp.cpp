@@ -26,8 +26,10 @@
 #include "CurlHttp.h"
 
 #include <json/json.h>
+#include <algorithm>
 #include <array>
 #include <cstring>
+#include <functional>
 #include <sstream>
 
 #include "IRequest.h"
@@ -35,10 +37,21 @@
 
 const uint32_t MAX_URL_LENGTH = 1024;
 const uint32_t POLL_TIMEOUT = 100;
+const size_t MAX_POOLED_HANDLES = 32;
 
 namespace cloudstorage {
 
-IHttp::Pointer IHttp::create() { return util::make_unique<curl::CurlHttp>(); }
+IHttp::Pointer IHttp::create() { return create(Options()); }
+
+IHttp::Pointer IHttp::create(uint32_t worker_count) {
+  Options options;
+  options.worker_count_ = worker_count;
+  return create(options);
+}
+
+IHttp::Pointer IHttp::create(const Options& options) {
+  return util::make_unique<curl::CurlHttp>(options);
+}
 
 namespace curl {
 
@@ -118,6 +131,27 @@ int progress_callback(void* clientp, curl_off_t dltotal, curl_off_t dlnow,
   return 0;
 }
 
+std::unique_ptr<CURLM, CurlMultiDeleter> multi_handle(
+    const IHttp::Options& options) {
+  std::unique_ptr<CURLM, CurlMultiDeleter> handle(curl_multi_init());
+  if (options.http2_)
+    curl_multi_setopt(handle.get(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  if (options.max_connections_ > 0)
+    curl_multi_setopt(handle.get(), CURLMOPT_MAXCONNECTS,
+                      options.max_connections_);
+  if (options.max_host_connections_ > 0)
+    curl_multi_setopt(handle.get(), CURLMOPT_MAX_HOST_CONNECTIONS,
+                      options.max_host_connections_);
+  return handle;
+}
+
+// scheme, host and port of url
+std::string origin(const std::string& url) {
+  auto scheme = url.find("://");
+  auto begin = scheme == std::string::npos ? 0 : scheme + 3;
+  return url.substr(0, url.find_first_of("/?#", begin));
+}
+
 std::ios::pos_type stream_length(std::istream& data) {
   data.seekg(0, data.end);
   std::ios::pos_type length = data.tellg();
@@ -127,16 +161,19 @@ std::ios::pos_type stream_length(std::istream& data) {
 
 }  // namespace
 
-CurlHttp::Worker::Worker() : done_(), thread_(std::bind(&Worker::work, this)) {}
+CurlHttp::Worker::Worker(const Options& options)
+    : done_(),
+      multi_(multi_handle(options)),
+      thread_(std::bind(&Worker::work, this)) {}
 
 CurlHttp::Worker::~Worker() {
   done_ = true;
-  nonempty_.notify_one();
+  wakeup();
   thread_.join();
 }
 
 void CurlHttp::Worker::work() {
-  auto handle = curl_multi_init();
+  auto handle = multi_.get();
   while (!done_ || !pending_.empty()) {
     std::unique_lock<std::mutex> lock(lock_);
     nonempty_.wait(lock, [=]() {
@@ -148,10 +185,6 @@ void CurlHttp::Worker::work() {
       curl_multi_add_handle(handle, r->handle_.get());
       pending_[r->handle_.get()] = std::move(r);
     }
-    int rc;
-    curl_multi_wait(handle, nullptr, 0, POLL_TIMEOUT, &rc);
-    if (rc == 0)
-      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT));
     int running_handles = 0;
     curl_multi_perform(handle, &running_handles);
     CURLMsg* msg;
@@ -166,8 +199,18 @@ void CurlHttp::Worker::work() {
         pending_.erase(it);
       }
     } while (msg);
+    if (pending_.empty()) continue;
+#if LIBCURL_VERSION_NUM >= 0x074400
+    // Returns early on socket activity or when woken up by add(); the timeout
+    // only bounds how often paused transfers get their progress callback.
+    curl_multi_poll(handle, nullptr, 0, POLL_TIMEOUT, nullptr);
+#else
+    int rc;
+    curl_multi_wait(handle, nullptr, 0, POLL_TIMEOUT, &rc);
+    if (rc == 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(POLL_TIMEOUT));
+#endif
   }
-  curl_multi_cleanup(handle);
 }
 
 void CurlHttp::Worker::add(RequestData::Pointer r) {
@@ -175,7 +218,14 @@ void CurlHttp::Worker::add(RequestData::Pointer r) {
     std::lock_guard<std::mutex> lock(lock_);
     requests_.push_back(std::move(r));
   }
+  wakeup();
+}
+
+void CurlHttp::Worker::wakeup() {
   nonempty_.notify_all();
+#if LIBCURL_VERSION_NUM >= 0x074400
+  curl_multi_wakeup(multi_.get());
+#endif
 }
 
 void RequestData::done(int code) {
@@ -184,6 +234,10 @@ void RequestData::done(int code) {
     long http_code = static_cast<long>(IHttpRequest::Unknown);
     curl_easy_getinfo(handle_.get(), CURLINFO_RESPONSE_CODE, &http_code);
     ret = http_code;
+    long connects = 0;
+    curl_easy_getinfo(handle_.get(), CURLINFO_NUM_CONNECTS, &connects);
+    if (connects == 0 && handle_.get_deleter().pool_)
+      handle_.get_deleter().pool_->reused_connection();
     if (!follow_redirect_ && IHttpRequest::isRedirect(http_code)) {
       std::array<char, MAX_URL_LENGTH> redirect_url;
       char* data = redirect_url.data();
@@ -200,14 +254,16 @@ void RequestData::done(int code) {
 CurlHttpRequest::CurlHttpRequest(const std::string& url,
                                  const std::string& method,
                                  bool follow_redirect,
+                                 std::shared_ptr<HandlePool> pool,
                                  std::shared_ptr<CurlHttp::Worker> worker)
     : url_(url),
       method_(method),
       follow_redirect_(follow_redirect),
+      pool_(pool),
       worker_(worker) {}
 
 std::unique_ptr<CURL, CurlDeleter> CurlHttpRequest::init() const {
-  std::unique_ptr<CURL, CurlDeleter> handle(curl_easy_init());
+  auto handle = pool_->get();
   curl_easy_setopt(handle.get(), CURLOPT_WRITEFUNCTION, write_callback);
   curl_easy_setopt(handle.get(), CURLOPT_READFUNCTION, read_callback);
   curl_easy_setopt(handle.get(), CURLOPT_HEADERFUNCTION, header_callback);
@@ -217,6 +273,18 @@ std::unique_ptr<CURL, CurlDeleter> CurlHttpRequest::init() const {
                    static_cast<long>(follow_redirect_));
   curl_easy_setopt(handle.get(), CURLOPT_XFERINFOFUNCTION, progress_callback);
   curl_easy_setopt(handle.get(), CURLOPT_NOPROGRESS, static_cast<long>(false));
+  curl_easy_setopt(handle.get(), CURLOPT_TCP_KEEPALIVE, 1L);
+  const auto& options = pool_->options();
+#if LIBCURL_VERSION_NUM >= 0x074100
+  if (options.max_connection_age_ > 0)
+    curl_easy_setopt(handle.get(), CURLOPT_MAXAGE_CONN,
+                     options.max_connection_age_);
+#endif
+  if (options.http2_) {
+    curl_easy_setopt(handle.get(), CURLOPT_HTTP_VERSION,
+                     static_cast<long>(CURL_HTTP_VERSION_2TLS));
+    curl_easy_setopt(handle.get(), CURLOPT_PIPEWAIT, 1L);
+  }
   std::string parameters = parametersToString();
   std::string url = url_ + (!parameters.empty() ? ("?" + parameters) : "");
   curl_easy_setopt(handle.get(), CURLOPT_URL, url.c_str());
@@ -322,21 +390,104 @@ CurlHttpRequest::headerParametersToList() const {
   return std::unique_ptr<curl_slist, CurlListDeleter>(list);
 }
 
-void CurlDeleter::operator()(CURL* handle) const { curl_easy_cleanup(handle); }
+void CurlDeleter::operator()(CURL* handle) const {
+  if (pool_)
+    pool_->put(handle);
+  else
+    curl_easy_cleanup(handle);
+}
 
 void CurlListDeleter::operator()(curl_slist* lst) const {
   curl_slist_free_all(lst);
 }
 
-CurlHttp::CurlHttp() : worker_(std::make_shared<Worker>()) {}
+void CurlMultiDeleter::operator()(CURLM* handle) const {
+  curl_multi_cleanup(handle);
+}
+
+void CurlShareDeleter::operator()(CURLSH* handle) const {
+  curl_share_cleanup(handle);
+}
+
+HandlePool::HandlePool(const IHttp::Options& options)
+    : options_(options),
+      share_(curl_share_init()),
+      requests_(),
+      reused_handles_(),
+      reused_connections_() {
+  curl_share_setopt(share_.get(), CURLSHOPT_LOCKFUNC, lock);
+  curl_share_setopt(share_.get(), CURLSHOPT_UNLOCKFUNC, unlock);
+  curl_share_setopt(share_.get(), CURLSHOPT_USERDATA, this);
+  curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share_.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+HandlePool::~HandlePool() {
+  for (auto handle : handles_) curl_easy_cleanup(handle);
+}
+
+std::unique_ptr<CURL, CurlDeleter> HandlePool::get() {
+  requests_++;
+  CURL* handle = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!handles_.empty()) {
+      handle = handles_.back();
+      handles_.pop_back();
+    }
+  }
+  if (handle)
+    reused_handles_++;
+  else
+    handle = curl_easy_init();
+  curl_easy_setopt(handle, CURLOPT_SHARE, share());
+  return std::unique_ptr<CURL, CurlDeleter>(handle,
+                                            CurlDeleter{shared_from_this()});
+}
+
+void HandlePool::put(CURL* handle) {
+  curl_easy_reset(handle);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (handles_.size() < MAX_POOLED_HANDLES) {
+      handles_.push_back(handle);
+      return;
+    }
+  }
+  curl_easy_cleanup(handle);
+}
+
+IHttp::Statistics HandlePool::statistics() const {
+  return {requests_, reused_handles_, reused_connections_};
+}
+
+void HandlePool::lock(CURL*, curl_lock_data data, curl_lock_access,
+                      void* userptr) {
+  static_cast<HandlePool*>(userptr)->share_mutex_[data].lock();
+}
+
+void HandlePool::unlock(CURL*, curl_lock_data data, void* userptr) {
+  static_cast<HandlePool*>(userptr)->share_mutex_[data].unlock();
+}
+
+CurlHttp::CurlHttp(const Options& options)
+    : pool_(std::make_shared<HandlePool>(options)) {
+  for (uint32_t i = 0; i < std::max<uint32_t>(options.worker_count_, 1); i++)
+    workers_.push_back(std::make_shared<Worker>(options));
+}
 
 IHttpRequest::Pointer CurlHttp::create(const std::string& url,
                                        const std::string& method,
                                        bool follow_redirect) const {
+  // requests to a host share one worker, so that they share its connections
+  auto& worker =
+      workers_[std::hash<std::string>()(origin(url)) % workers_.size()];
   return util::make_unique<CurlHttpRequest>(url, method, follow_redirect,
-                                            worker_);
+                                            pool_, worker);
 }
 
+IHttp::Statistics CurlHttp::statistics() const { return pool_->statistics(); }
+
 }  // namespace curl
 
 }  // namespace cloudstorage
@@ -347,6 +498,8 @@ IHttpRequest::Pointer CurlHttp::create(const std::string& url,
 
 namespace cloudstorage {
 IHttp::Pointer IHttp::create() { return nullptr; }
+IHttp::Pointer IHttp::create(uint32_t) { return nullptr; }
+IHttp::Pointer IHttp::create(const Options&) { return nullptr; }
 }  // namespace cloudstorage
 
 #endif  // WITH_CURL
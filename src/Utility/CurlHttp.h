@@ -27,10 +27,12 @@
 #ifdef WITH_CURL
 
 #include <curl/curl.h>
+#include <array>
 #include <atomic>
 #include <cctype>
 #include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
@@ -42,14 +44,61 @@ namespace cloudstorage {
 
 namespace curl {
 
+class HandlePool;
+
 struct CurlDeleter {
   void operator()(CURL*) const;
+
+  std::shared_ptr<HandlePool> pool_;
 };
 
 struct CurlListDeleter {
   void operator()(curl_slist*) const;
 };
 
+struct CurlMultiDeleter {
+  void operator()(CURLM*) const;
+};
+
+struct CurlShareDeleter {
+  void operator()(CURLSH*) const;
+};
+
+/**
+ * Recycles easy handles, so that requests don't allocate new ones, and owns
+ * the share object through which all of them exchange dns cache and tls
+ * sessions. Connections aren't kept by handles but by the connection cache of
+ * the multi handle which performs them; curl doesn't support sharing that
+ * cache between threads.
+ */
+class HandlePool : public std::enable_shared_from_this<HandlePool> {
+ public:
+  HandlePool(const IHttp::Options&);
+  ~HandlePool();
+
+  std::unique_ptr<CURL, CurlDeleter> get();
+  void put(CURL*);
+
+  const IHttp::Options& options() const { return options_; }
+  CURLSH* share() const { return share_.get(); }
+
+  IHttp::Statistics statistics() const;
+  void reused_connection() { reused_connections_++; }
+
+ private:
+  static void lock(CURL*, curl_lock_data, curl_lock_access, void*);
+  static void unlock(CURL*, curl_lock_data, void*);
+
+  IHttp::Options options_;
+  std::mutex mutex_;
+  std::vector<CURL*> handles_;
+  std::array<std::mutex, CURL_LOCK_DATA_LAST> share_mutex_;
+  std::unique_ptr<CURLSH, CurlShareDeleter> share_;
+  std::atomic<uint64_t> requests_;
+  std::atomic<uint64_t> reused_handles_;
+  std::atomic<uint64_t> reused_connections_;
+};
+
 struct RequestData {
   using Pointer = std::unique_ptr<RequestData>;
 
@@ -71,37 +120,41 @@ struct RequestData {
 
 class CurlHttp : public IHttp {
  public:
-  CurlHttp();
+  CurlHttp(const Options& = Options());
 
   IHttpRequest::Pointer create(const std::string&, const std::string&,
                                bool) const override;
+  Statistics statistics() const override;
 
  private:
   friend class CurlHttpRequest;
 
   struct Worker {
-    Worker();
+    Worker(const Options&);
     ~Worker();
 
     void work();
     void add(RequestData::Pointer r);
+    void wakeup();
 
     std::atomic_bool done_;
     std::condition_variable nonempty_;
     std::vector<RequestData::Pointer> requests_;
     std::unordered_map<CURL*, RequestData::Pointer> pending_;
     std::mutex lock_;
+    std::unique_ptr<CURLM, CurlMultiDeleter> multi_;
     std::thread thread_;
   };
 
-  std::shared_ptr<Worker> worker_;
+  std::shared_ptr<HandlePool> pool_;
+  std::vector<std::shared_ptr<Worker>> workers_;
 };
 
 class CurlHttpRequest : public IHttpRequest,
                         public std::enable_shared_from_this<CurlHttpRequest> {
  public:
   CurlHttpRequest(const std::string& url, const std::string& method,
-                  bool follow_redirect,
+                  bool follow_redirect, std::shared_ptr<HandlePool> pool,
                   std::shared_ptr<CurlHttp::Worker> worker);
   std::unique_ptr<CURL, CurlDeleter> init() const;
 
@@ -138,6 +191,7 @@ class CurlHttpRequest : public IHttpRequest,
   HeaderParameters header_parameters_;
   std::string method_;
   bool follow_redirect_;
+  std::shared_ptr<HandlePool> pool_;
   std::shared_ptr<CurlHttp::Worker> worker_;
 };
 
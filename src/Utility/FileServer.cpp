@@ -22,13 +22,19 @@
  *****************************************************************************/
 #include "FileServer.h"
 
-#include <queue>
+#include <chrono>
+#include <map>
 
+#include "Utility/BlockCache.h"
 #include "Utility/Item.h"
 
 namespace cloudstorage {
 
-const int CHUNK_SIZE = 8 * 1024 * 1024;
+const uint64_t INITIAL_CHUNK_SIZE = 8 * 1024 * 1024;
+const uint64_t MIN_CHUNK_SIZE = BlockCache::BlockSize;
+const uint64_t MAX_CHUNK_SIZE = 16 * 1024 * 1024;
+const uint64_t BUFFER_BUDGET = 64 * 1024 * 1024;
+const double CHUNK_DURATION = 1;
 const int CACHE_SIZE = 128;
 
 namespace {
@@ -43,46 +49,87 @@ class HttpServerCallback : public IHttpServer::ICallback {
 
  private:
   std::shared_ptr<Cache> item_cache_;
+  BlockCache::Pointer block_cache_;
   std::shared_ptr<CloudProvider> provider_;
 };
 
+/**
+ * Receives a run of consecutive blocks, puts each complete block to the block
+ * cache and hands it to the buffer.
+ */
 class HttpDataCallback : public IDownloadFileCallback {
  public:
-  HttpDataCallback(std::shared_ptr<Buffer> d) : buffer_(d) {}
+  HttpDataCallback(std::shared_ptr<Buffer> d, uint64_t first, uint64_t count);
 
   void receivedData(const char* data, uint32_t length) override;
   void done(EitherError<void> e) override;
   void progress(uint64_t, uint64_t) override {}
 
   std::shared_ptr<Buffer> buffer_;
+  uint64_t index_;
+  uint64_t end_;
+  uint64_t received_;
+  std::chrono::steady_clock::time_point started_;
+  BlockCache::Block block_;
 };
 
+/**
+ * Streams the file as a sequence of blocks. Blocks are looked up in the block
+ * cache shared with other streams; runs of missing blocks are downloaded with
+ * up to window_.size() ranged requests in flight. The window and the length of
+ * the runs adapt to measured throughput; the blocks which are requested but not
+ * yet read are limited by BUFFER_BUDGET.
+ */
 struct Buffer : public std::enable_shared_from_this<Buffer> {
   using Pointer = std::shared_ptr<Buffer>;
+  using Clock = std::chrono::steady_clock;
+
+  struct Segment {
+    bool ready_;
+    BlockCache::Block block_;
+  };
+
+  struct Run {
+    uint64_t first_;
+    uint64_t count_;
+  };
+
+  Buffer(BlockCache::Pointer cache) : cache_(cache) {}
 
   int read(char* buf, uint32_t max) {
-    if (2 * size() < CHUNK_SIZE) {
-      std::unique_lock<std::mutex> lock(delayed_mutex_);
-      if (delayed_) {
-        delayed_ = false;
-        lock.unlock();
-        run_download();
-      }
-    }
     std::unique_lock<std::mutex> lock(mutex_);
     if (abort_) return IHttpServer::IResponse::ICallback::Abort;
-    if (data_.empty()) return IHttpServer::IResponse::ICallback::Suspend;
-    size_t cnt = std::min<size_t>(data_.size(), static_cast<size_t>(max));
-    for (size_t i = 0; i < cnt; i++) {
-      buf[i] = data_.front();
-      data_.pop();
-    }
+    auto runs = schedule();
+    flush();
+    auto cnt = data_.pop(buf, max);
+    auto abort = abort_;
+    lock.unlock();
+    download(runs);
+    if (abort) return IHttpServer::IResponse::ICallback::Abort;
+    if (cnt == 0) return IHttpServer::IResponse::ICallback::Suspend;
     return cnt;
   }
 
-  void put(const char* data, uint32_t length) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (uint32_t i = 0; i < length; i++) data_.push(data[i]);
+  void received(uint64_t index, BlockCache::Block block) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = segments_.find(index);
+    if (abort_ || it == segments_.end() || it->second.ready_) return;
+    std::vector<Run> runs;
+    if (block) {
+      it->second = {true, block};
+    } else {
+      auto status = cache_->get(key_, index, block, waiter(index));
+      if (status == BlockCache::Status::Cached) {
+        it->second = {true, block};
+      } else if (status == BlockCache::Status::Download) {
+        runs.push_back({index, 1});
+        in_flight_++;
+      }
+    }
+    auto head = it->second.ready_ && it == segments_.begin();
+    lock.unlock();
+    download(runs);
+    if (head) resume();
   }
 
   void done(EitherError<void> e) {
@@ -101,51 +148,167 @@ struct Buffer : public std::enable_shared_from_this<Buffer> {
     if (response_) response_->resume();
   }
 
-  std::size_t size() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return data_.size();
+  void continue_download(uint64_t size, Clock::duration time,
+                         EitherError<void> e) {
+    if (e.left()) return done(e);
+    std::unique_lock<std::mutex> lock(mutex_);
+    in_flight_--;
+    window_.adapt(size, time);
+    auto runs = schedule();
+    lock.unlock();
+    download(runs);
+  }
+
+  uint64_t block_size(uint64_t index) const {
+    return std::min(BlockCache::BlockSize,
+                    size_ - index * BlockCache::BlockSize);
+  }
+
+  uint64_t reserved() const {
+    return data_.size() + segments_.size() * BlockCache::BlockSize;
+  }
+
+  BlockCache::Callback waiter(uint64_t index) {
+    std::weak_ptr<Buffer> buffer = shared_from_this();
+    return [=](BlockCache::Block block) {
+      if (auto b = buffer.lock()) b->received(index, block);
+    };
+  }
+
+  // moves consecutive ready blocks from the front of segments_ to data_
+  void flush() {
+    while (!abort_ && !segments_.empty()) {
+      auto it = segments_.begin();
+      if (!it->second.ready_) break;
+      const auto& block = it->second.block_;
+      auto start = it->first * BlockCache::BlockSize;
+      auto end = std::min(start + block->size(), end_);
+      if (end < std::min(start + BlockCache::BlockSize, end_)) {
+        abort_ = true;
+        break;
+      }
+      if (position_ == start && end == start + block->size())
+        data_.push(block);
+      else
+        data_.push(block->data() + position_ - start, end - position_);
+      position_ = end;
+      segments_.erase(it);
+    }
+  }
+
+  std::vector<Run> schedule() {
+    std::vector<Run> result;
+    auto run_length = window_.chunk_size() / BlockCache::BlockSize;
+    auto last = (end_ + BlockCache::BlockSize - 1) / BlockCache::BlockSize;
+    bool open = false;
+    while (!abort_ && item_ && next_ < last) {
+      if (!open && !segments_.empty() &&
+          reserved() + run_length * BlockCache::BlockSize > BUFFER_BUDGET)
+        break;
+      BlockCache::Block block;
+      auto status = cache_->get(key_, next_, block, waiter(next_),
+                                open || in_flight_ < window_.size());
+      if (status == BlockCache::Status::Missing) break;
+      if (status == BlockCache::Status::Download) {
+        if (!open) {
+          result.push_back({next_, 0});
+          in_flight_++;
+          open = true;
+        }
+        if (++result.back().count_ == run_length) open = false;
+        segments_[next_] = {false, nullptr};
+      } else {
+        open = false;
+        segments_[next_] = {status == BlockCache::Status::Cached, block};
+      }
+      next_++;
+    }
+    return result;
   }
 
-  void continue_download(EitherError<void> e) {
-    if (e.left() || range_.size_ < CHUNK_SIZE) return done(e);
-    range_.size_ -= CHUNK_SIZE;
-    range_.start_ += CHUNK_SIZE;
-    if (2 * size() < CHUNK_SIZE)
-      run_download();
-    else {
-      std::unique_lock<std::mutex> lock(delayed_mutex_);
-      delayed_ = true;
+  void download(const std::vector<Run>& runs) {
+    for (auto&& run : runs) {
+      auto start = run.first_ * BlockCache::BlockSize;
+      auto end = std::min((run.first_ + run.count_) * BlockCache::BlockSize,
+                          size_);
+      request_->make_subrequest(
+          &CloudProvider::downloadFileRangeAsync, item_,
+          Range{start, end - start},
+          util::make_unique<HttpDataCallback>(shared_from_this(), run.first_,
+                                              run.count_));
     }
   }
 
-  void run_download() {
-    request_->make_subrequest(
-        &CloudProvider::downloadFileRangeAsync, item_,
-        Range{range_.start_, std::min<uint64_t>(range_.size_, CHUNK_SIZE)},
-        util::make_unique<HttpDataCallback>(shared_from_this()));
+  void start(IItem::Pointer item, Range range) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    item_ = item;
+    key_ = BlockCache::key(request_->provider()->name(), item->id(),
+                           item->size());
+    size_ = item->size();
+    position_ = range.start_;
+    end_ = range.start_ + range.size_;
+    next_ = range.start_ / BlockCache::BlockSize;
+    auto runs = schedule();
+    lock.unlock();
+    download(runs);
   }
 
+  BlockCache::Pointer cache_;
   std::mutex mutex_;
-  std::queue<char> data_;
+  std::map<uint64_t, Segment> segments_;
+  util::ChunkQueue data_;
   std::mutex response_mutex_;
-  IHttpServer::IResponse* response_;
+  IHttpServer::IResponse* response_ = nullptr;
   Request<EitherError<void>>::Pointer request_;
   IItem::Pointer item_;
-  Range range_;
-  std::mutex delayed_mutex_;
-  bool delayed_ = false;
+  std::string key_;
+  uint64_t size_ = 0;
+  uint64_t position_ = 0;
+  uint64_t end_ = 0;
+  uint64_t next_ = 0;
+  uint32_t in_flight_ = 0;
+  DownloadWindow window_;
   bool done_ = false;
   bool abort_ = false;
 };
 
+HttpDataCallback::HttpDataCallback(std::shared_ptr<Buffer> d, uint64_t first,
+                                   uint64_t count)
+    : buffer_(d),
+      index_(first),
+      end_(first + count),
+      received_(0),
+      started_(std::chrono::steady_clock::now()) {}
+
 void HttpDataCallback::receivedData(const char* data, uint32_t length) {
-  buffer_->put(data, length);
-  buffer_->resume();
+  received_ += length;
+  while (length > 0 && index_ < end_) {
+    auto size = buffer_->block_size(index_);
+    if (!block_) {
+      block_ = std::make_shared<std::vector<char>>();
+      block_->reserve(size);
+    }
+    auto cnt = std::min<uint64_t>(length, size - block_->size());
+    block_->insert(block_->end(), data, data + cnt);
+    data += cnt;
+    length -= cnt;
+    if (block_->size() == size) {
+      buffer_->cache_->put(buffer_->key_, index_, block_);
+      buffer_->received(index_, block_);
+      block_ = nullptr;
+      index_++;
+    }
+  }
 }
 
 void HttpDataCallback::done(EitherError<void> e) {
+  if (!e.left() && index_ < end_)
+    e = Error{IHttpRequest::Failure, util::Error::INVALID_RANGE};
+  for (; index_ < end_; index_++)
+    buffer_->cache_->fail(buffer_->key_, index_);
+  buffer_->continue_download(
+      received_, std::chrono::steady_clock::now() - started_, e);
   buffer_->resume();
-  buffer_->continue_download(e);
 }
 
 class HttpData : public IHttpServer::IResponse::ICallback {
@@ -182,15 +345,9 @@ class HttpData : public IHttpServer::IResponse::ICallback {
             buffer_->done(Error{IHttpRequest::Bad, util::Error::INVALID_RANGE});
           } else {
             status_ = Success;
-            buffer_->item_ = e.right();
-            buffer_->range_ = range;
             cache->put(file, e.right());
             p->addStreamRequest(r);
-            r->make_subrequest(
-                &CloudProvider::downloadFileRangeAsync, e.right(),
-                Range{range.start_,
-                      std::min<uint64_t>(range.size_, CHUNK_SIZE)},
-                util::make_unique<HttpDataCallback>(buffer_));
+            buffer_->start(e.right(), range);
           }
         }
         buffer_->resume();
@@ -228,7 +385,9 @@ class HttpData : public IHttpServer::IResponse::ICallback {
 };
 
 HttpServerCallback::HttpServerCallback(std::shared_ptr<CloudProvider> p)
-    : item_cache_(util::make_unique<Cache>(CACHE_SIZE)), provider_(p) {}
+    : item_cache_(util::make_unique<Cache>(CACHE_SIZE)),
+      block_cache_(p->block_cache()),
+      provider_(p) {}
 
 IHttpServer::IResponse::Pointer HttpServerCallback::handle(
     const IHttpServer::IRequest& request) {
@@ -265,7 +424,7 @@ IHttpServer::IResponse::Pointer HttpServerCallback::handle(
     headers["Content-Range"] = stream.str();
     code = IHttpRequest::Partial;
   }
-  auto buffer = std::make_shared<Buffer>();
+  auto buffer = std::make_shared<Buffer>(block_cache_);
   auto data = util::make_unique<HttpData>(
       buffer, provider_, util::from_base64(id), range, item_cache_);
   auto response = request.response(code, headers, range.size_, std::move(data));
@@ -279,6 +438,28 @@ IHttpServer::IResponse::Pointer HttpServerCallback::handle(
 
 }  // namespace
 
+constexpr uint32_t DownloadWindow::MaxSize;
+
+DownloadWindow::DownloadWindow()
+    : size_(1), chunk_size_(INITIAL_CHUNK_SIZE), best_rate_(0) {}
+
+void DownloadWindow::adapt(uint64_t size,
+                           std::chrono::steady_clock::duration time) {
+  auto seconds = std::chrono::duration<double>(time).count();
+  if (seconds <= 0) return;
+  auto rate = size / seconds;
+  chunk_size_ = std::max<uint64_t>(
+      MIN_CHUNK_SIZE,
+      std::min<uint64_t>(MAX_CHUNK_SIZE, rate * CHUNK_DURATION));
+  auto total_rate = rate * size_;
+  if (total_rate > 1.1 * best_rate_) {
+    best_rate_ = total_rate;
+    size_ = std::min(size_ + 1, MaxSize);
+  } else if (total_rate < 0.7 * best_rate_) {
+    size_ = std::max(size_ - 1, 1u);
+  }
+}
+
 IHttpServer::Pointer FileServer::create(std::shared_ptr<CloudProvider> p,
                                         const std::string& session) {
   return p->http_server()->create(util::make_unique<HttpServerCallback>(p),
@@ -23,10 +23,36 @@
 #ifndef FILESERVER_H
 #define FILESERVER_H
 
+#include <chrono>
+#include <cstdint>
+
 #include "CloudProvider/CloudProvider.h"
 
 namespace cloudstorage {
 
+/**
+ * Prefetch window of a stream: the number of ranged requests kept in flight
+ * and the length of each of them. Every finished request reports its
+ * throughput; the window grows while the total throughput improves by more
+ * than 10% and shrinks when it falls below 70% of the best one.
+ */
+class DownloadWindow {
+ public:
+  static constexpr uint32_t MaxSize = 8;
+
+  DownloadWindow();
+
+  void adapt(uint64_t size, std::chrono::steady_clock::duration time);
+
+  uint32_t size() const { return size_; }
+  uint64_t chunk_size() const { return chunk_size_; }
+
+ private:
+  uint32_t size_;
+  uint64_t chunk_size_;
+  double best_rate_;
+};
+
 class FileServer : public IHttpServer {
  public:
   static IHttpServer::Pointer create(std::shared_ptr<CloudProvider> p,
@@ -0,0 +1,172 @@
+/*****************************************************************************
+ * MetadataCache.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "MetadataCache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Utility/Item.h"
+
+namespace cloudstorage {
+
+namespace {
+
+const size_t MIN_SWEEP_SIZE = 1024;
+
+bool descendant(const std::string& path, const std::string& ancestor) {
+  return path.size() > ancestor.size() &&
+         path.compare(0, ancestor.size(), ancestor) == 0 &&
+         path[ancestor.size()] == '/';
+}
+
+}  // namespace
+
+MetadataCache::MetadataCache(Clock::duration ttl)
+    : ttl_(ttl), sweep_size_(MIN_SWEEP_SIZE), generation_(), statistics_() {}
+
+uint64_t MetadataCache::generation() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return generation_;
+}
+
+IItem::Pointer MetadataCache::item(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = items_.find(path);
+  if (it == items_.end()) return nullptr;
+  if (it->second.expires_ <= Clock::now()) {
+    items_.erase(it);
+    return nullptr;
+  }
+  statistics_.hits_++;
+  return it->second.value_;
+}
+
+void MetadataCache::set_item(const std::string& path, IItem::Pointer item,
+                             uint64_t generation) {
+  if (ttl_ == Clock::duration::zero()) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (generation != generation_) return;
+  auto now = Clock::now();
+  items_[path] = {item, now + ttl_};
+  sweep(now);
+}
+
+void MetadataCache::set_root(const std::string& id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  root_ = id;
+}
+
+bool MetadataCache::children(const std::string& id, IItem::List& result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = children_.find(id);
+  if (it != children_.end() && it->second.expires_ <= Clock::now()) {
+    children_.erase(it);
+    it = children_.end();
+  }
+  if (it == children_.end()) {
+    statistics_.misses_++;
+    return false;
+  }
+  statistics_.hits_++;
+  result = it->second.value_;
+  return true;
+}
+
+void MetadataCache::set_children(const std::string& id,
+                                 const IItem::List& children,
+                                 uint64_t generation) {
+  if (ttl_ == Clock::duration::zero()) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (generation != generation_) return;
+  auto now = Clock::now();
+  children_[id] = {children, now + ttl_};
+  sweep(now);
+}
+
+void MetadataCache::invalidate(const std::string& id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  generation_++;
+  children_.erase(id);
+  for (auto it = children_.begin(); it != children_.end();) {
+    const auto& lst = it->second.value_;
+    if (std::any_of(lst.begin(), lst.end(),
+                    [&](const IItem::Pointer& i) { return i->id() == id; }))
+      it = children_.erase(it);
+    else
+      ++it;
+  }
+  std::vector<std::string> paths;
+  // every path is a descendant of the root's empty path
+  if (id == root_) paths.push_back("");
+  for (auto&& i : items_)
+    if (i.second.value_->id() == id) paths.push_back(i.first);
+  for (auto it = items_.begin(); it != items_.end();) {
+    if (std::any_of(paths.begin(), paths.end(), [&](const std::string& p) {
+          return it->first == p || descendant(it->first, p);
+        }))
+      it = items_.erase(it);
+    else
+      ++it;
+  }
+}
+
+void MetadataCache::invalidate(const ChangeSet& changes) {
+  for (auto&& c : changes.changes_) {
+    invalidate(c.id_);
+    if (!c.item_) continue;
+    const auto& parents = static_cast<const Item&>(*c.item_).parents();
+    if (parents.empty()) return clear();
+    for (auto&& p : parents) invalidate(p);
+  }
+}
+
+void MetadataCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  generation_++;
+  items_.clear();
+  children_.clear();
+}
+
+ICloudProvider::CacheStatistics MetadataCache::statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
+
+void MetadataCache::sweep(Clock::time_point now) {
+  if (items_.size() + children_.size() < sweep_size_) return;
+  for (auto it = items_.begin(); it != items_.end();)
+    if (it->second.expires_ <= now)
+      it = items_.erase(it);
+    else
+      ++it;
+  for (auto it = children_.begin(); it != children_.end();)
+    if (it->second.expires_ <= now)
+      it = children_.erase(it);
+    else
+      ++it;
+  sweep_size_ =
+      std::max(MIN_SWEEP_SIZE, 2 * (items_.size() + children_.size()));
+}
+
+}  // namespace cloudstorage
@@ -0,0 +1,109 @@
+/*****************************************************************************
+ * MetadataCache.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef METADATACACHE_H
+#define METADATACACHE_H
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "ICloudProvider.h"
+#include "IItem.h"
+
+namespace cloudstorage {
+
+/**
+ * Per provider index of resolved paths (path -> item) and directory listings
+ * (directory id -> children) used by GetItemRequest.
+ *
+ * Entries expire after ttl; invalidate should be called with ids of items
+ * which were modified, it drops the item's listing, listings which contain the
+ * item and paths which resolve to the item or to its descendants. The root
+ * directory isn't stored as a path, its id set with set_root is an ancestor of
+ * every path.
+ *
+ * Entries are stored with the generation read before the data was fetched;
+ * each invalidation starts a new generation, so that data fetched before it
+ * isn't stored after it.
+ */
+class MetadataCache {
+ public:
+  using Pointer = std::shared_ptr<MetadataCache>;
+  using Clock = std::chrono::steady_clock;
+
+  MetadataCache(Clock::duration ttl);
+
+  uint64_t generation() const;
+
+  /**
+   * @param path absolute path without a trailing slash
+   * @return cached item or nullptr, counts a hit if found
+   */
+  IItem::Pointer item(const std::string& path);
+  void set_item(const std::string& path, IItem::Pointer item,
+                uint64_t generation);
+  void set_root(const std::string& id);
+
+  /**
+   * @return whether children of the directory were cached, counts a hit or a
+   * miss
+   */
+  bool children(const std::string& id, IItem::List& result);
+  void set_children(const std::string& id, const IItem::List& children,
+                    uint64_t generation);
+
+  void invalidate(const std::string& id);
+  void clear();
+
+  /**
+   * Invalidates changed items and parents of created or modified ones; if
+   * parents of an item are unknown, the whole cache is cleared.
+   */
+  void invalidate(const ChangeSet& changes);
+
+  ICloudProvider::CacheStatistics statistics() const;
+
+ private:
+  template <class T>
+  struct Entry {
+    T value_;
+    Clock::time_point expires_;
+  };
+
+  void sweep(Clock::time_point now);
+
+  Clock::duration ttl_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, Entry<IItem::Pointer>> items_;
+  std::unordered_map<std::string, Entry<IItem::List>> children_;
+  std::string root_;
+  size_t sweep_size_;
+  uint64_t generation_;
+  ICloudProvider::CacheStatistics statistics_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // METADATACACHE_H
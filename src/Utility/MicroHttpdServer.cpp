@@ -29,7 +29,8 @@
 
 namespace cloudstorage {
 
-const int CHUNK_SIZE = 1024;
+constexpr size_t IHttpServerFactory::DefaultBlockSize;
+
 const int AUTHORIZATION_PORT = 12345;
 const int FILE_PROVIDER_PORT = 12346;
 
@@ -49,7 +50,8 @@ int http_request_callback(void* cls, MHD_Connection* c, const char* url,
     int ret = MHD_YES;
     if (*upload_data_size == 0) {
       auto response =
-          server->callback()->handle(MicroHttpdServer::Request(c, url, method));
+          server->callback()->handle(MicroHttpdServer::Request(
+              c, url, method, server->block_size()));
       auto p = static_cast<MicroHttpdServer::Response*>(response.get());
       ret = MHD_queue_response(c, p->code(), p->response());
       d->response_ = std::move(response);
@@ -71,15 +73,39 @@ void http_request_completed(void*, MHD_Connection*, void** con_cls,
   delete d;
 }
 
+MHD_Daemon* start_daemon(MicroHttpdServer* server, int port,
+                         uint32_t thread_pool_size) {
+  if (thread_pool_size <= 1)
+    return MHD_start_daemon(MHD_USE_POLL_INTERNALLY | MHD_USE_SUSPEND_RESUME,
+                            port, NULL, NULL, http_request_callback, server,
+                            MHD_OPTION_NOTIFY_COMPLETED, http_request_completed,
+                            server, MHD_OPTION_END);
+  unsigned int flags = MHD_USE_SELECT_INTERNALLY;
+#if MHD_VERSION >= 0x00093600
+  if (MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES)
+    flags = MHD_USE_EPOLL_INTERNALLY;
+#endif
+  return MHD_start_daemon(
+      flags | MHD_USE_SUSPEND_RESUME, port, NULL, NULL, http_request_callback,
+      server, MHD_OPTION_NOTIFY_COMPLETED, http_request_completed, server,
+      MHD_OPTION_THREAD_POOL_SIZE, static_cast<unsigned int>(thread_pool_size),
+      MHD_OPTION_END);
+}
+
 }  // namespace
 
 IHttpServerFactory::Pointer IHttpServerFactory::create() {
-  return util::make_unique<MicroHttpdServerFactory>();
+  return create(Options());
+}
+
+IHttpServerFactory::Pointer IHttpServerFactory::create(
+    const Options& options) {
+  return util::make_unique<MicroHttpdServerFactory>(options);
 }
 
 MicroHttpdServer::Response::Response(MHD_Connection* connection, int code,
                                      const IResponse::Headers& headers,
-                                     int size,
+                                     uint64_t size, size_t block_size,
                                      IResponse::ICallback::Pointer callback)
     : data_(std::make_shared<SharedData>()),
       connection_(connection),
@@ -115,7 +141,7 @@ MicroHttpdServer::Response::Response(MHD_Connection* connection, int code,
   auto data = util::make_unique<DataType>(
       DataType{data_, connection, std::move(callback)});
   response_ = MHD_create_response_from_callback(
-      size == UnknownSize ? MHD_SIZE_UNKNOWN : size, CHUNK_SIZE, data_provider,
+      size == UnknownSize ? MHD_SIZE_UNKNOWN : size, block_size, data_provider,
       data.release(), release_data);
   for (auto it : headers)
     MHD_add_response_header(response_, it.first.c_str(), it.second.c_str());
@@ -134,8 +160,8 @@ void MicroHttpdServer::Response::resume() {
 }
 
 MicroHttpdServer::Request::Request(MHD_Connection* c, const char* url,
-                                   const char* method)
-    : connection_(c), url_(url), method_(method) {}
+                                   const char* method, size_t block_size)
+    : connection_(c), url_(url), method_(method), block_size_(block_size) {}
 
 const char* MicroHttpdServer::Request::get(const std::string& name) const {
   return MHD_lookup_connection_value(connection_, MHD_GET_ARGUMENT_KIND,
@@ -151,25 +177,31 @@ std::string MicroHttpdServer::Request::url() const { return url_; }
 
 std::string MicroHttpdServer::Request::method() const { return method_; }
 
-MicroHttpdServer::MicroHttpdServer(IHttpServer::ICallback::Pointer cb, int port)
-    : http_server_(MHD_start_daemon(
-          MHD_USE_POLL_INTERNALLY | MHD_USE_SUSPEND_RESUME, port, NULL, NULL,
-          http_request_callback, this, MHD_OPTION_NOTIFY_COMPLETED,
-          http_request_completed, this, MHD_OPTION_END)),
-      callback_(cb) {}
+MicroHttpdServer::MicroHttpdServer(
+    IHttpServer::ICallback::Pointer cb, int port,
+    const IHttpServerFactory::Options& options)
+    : callback_(cb),
+      block_size_(options.block_size_),
+      http_server_(start_daemon(this, port, options.thread_pool_size_)) {}
 
 MicroHttpdServer::~MicroHttpdServer() {
   if (http_server_) MHD_stop_daemon(http_server_);
 }
 
+uint16_t MicroHttpdServer::port() const {
+  auto info = MHD_get_daemon_info(http_server_, MHD_DAEMON_INFO_BIND_PORT);
+  return info ? info->port : 0;
+}
+
 MicroHttpdServer::IResponse::Pointer MicroHttpdServer::Request::response(
-    int code, const IResponse::Headers& headers, int size,
+    int code, const IResponse::Headers& headers, uint64_t size,
     IResponse::ICallback::Pointer cb) const {
   return util::make_unique<Response>(connection_, code, headers, size,
-                                     std::move(cb));
+                                     block_size_, std::move(cb));
 }
 
-MicroHttpdServerFactory::MicroHttpdServerFactory() {
+MicroHttpdServerFactory::MicroHttpdServerFactory(const Options& options)
+    : options_(options) {
   MHD_set_panic_func(
       [](void*, const char* file, unsigned int line, const char* reason) {
         util::log(file, line, reason);
@@ -180,7 +212,7 @@ MicroHttpdServerFactory::MicroHttpdServerFactory() {
 
 IHttpServer::Pointer MicroHttpdServerFactory::create(
     IHttpServer::ICallback::Pointer cb, uint16_t port) {
-  auto result = util::make_unique<MicroHttpdServer>(cb, port);
+  auto result = util::make_unique<MicroHttpdServer>(cb, port, options_);
   if (result->valid())
     return result;
   else
@@ -202,7 +234,13 @@ IHttpServer::Pointer MicroHttpdServerFactory::create(
 #include "IHttpServer.h"
 
 namespace cloudstorage {
+constexpr size_t IHttpServerFactory::DefaultBlockSize;
+
 IHttpServerFactory::Pointer IHttpServerFactory::create() { return nullptr; }
+
+IHttpServerFactory::Pointer IHttpServerFactory::create(const Options&) {
+  return nullptr;
+}
 }  // namespace cloudstorage
 
 #endif  // WITH_MICROHTTPD
@@ -36,13 +36,14 @@ namespace cloudstorage {
 
 class MicroHttpdServer : public IHttpServer {
  public:
-  MicroHttpdServer(IHttpServer::ICallback::Pointer cb, int port);
+  MicroHttpdServer(IHttpServer::ICallback::Pointer cb, int port,
+                   const IHttpServerFactory::Options&);
   ~MicroHttpdServer();
 
   class Response : public IResponse {
    public:
     Response(MHD_Connection* connection, int code, const IResponse::Headers&,
-             int size, IResponse::ICallback::Pointer);
+             uint64_t size, size_t block_size, IResponse::ICallback::Pointer);
     ~Response();
 
     MHD_Response* response() const { return response_; }
@@ -66,7 +67,8 @@ class MicroHttpdServer : public IHttpServer {
 
   class Request : public IRequest {
    public:
-    Request(MHD_Connection*, const char* url, const char* method);
+    Request(MHD_Connection*, const char* url, const char* method,
+            size_t block_size);
 
     MHD_Connection* connection() const { return connection_; }
 
@@ -75,31 +77,41 @@ class MicroHttpdServer : public IHttpServer {
     std::string method() const override;
     std::string url() const override;
 
-    IResponse::Pointer response(int code, const IResponse::Headers&, int size,
+    IResponse::Pointer response(int code, const IResponse::Headers&,
+                                uint64_t size,
                                 IResponse::ICallback::Pointer) const override;
 
    private:
     MHD_Connection* connection_;
     std::string url_;
     std::string method_;
+    size_t block_size_;
   };
 
   ICallback::Pointer callback() const override { return callback_; }
 
   bool valid() const { return http_server_; }
+  size_t block_size() const { return block_size_; }
+
+  // port the server listens on, useful when it was started on port 0
+  uint16_t port() const;
 
  private:
-  MHD_Daemon* http_server_;
   ICallback::Pointer callback_;
+  size_t block_size_;
+  MHD_Daemon* http_server_;
 };
 
 class MicroHttpdServerFactory : public IHttpServerFactory {
  public:
-  MicroHttpdServerFactory();
+  MicroHttpdServerFactory(const Options& = Options());
   IHttpServer::Pointer create(IHttpServer::ICallback::Pointer, uint16_t port);
   IHttpServer::Pointer create(IHttpServer::ICallback::Pointer,
                               const std::string& session_id,
                               IHttpServer::Type) override;
+
+ private:
+  Options options_;
 };
 
 }  // namespace cloudstorage
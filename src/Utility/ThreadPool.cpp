@@ -22,56 +22,130 @@
  *****************************************************************************/
 #include "ThreadPool.h"
 
-#include <algorithm>
 #include "Utility/Utility.h"
 
 namespace cloudstorage {
 
-ThreadPool::ThreadPool(uint32_t thread_count) : destroyed_(false) {
-  for (uint32_t i = 0; i < thread_count; ++i) {
-    workers_.emplace_back([this]() {
-      while (true) {
-        Task task;
-        {
-          std::unique_lock<std::mutex> lock(mutex_);
-          if (destroyed_) {
-            break;
-          }
-          while (tasks_.empty() && !destroyed_) {
-            worker_cv_.wait(lock);
-          }
-          if (!tasks_.empty()) {
-            task = std::move(tasks_.front());
-            tasks_.pop();
-          } else {
-            break;
-          }
-        }
-        task();
-      }
-    });
-  }
+namespace {
+
+thread_local const void *current_pool;
+thread_local uint32_t current_queue;
+
+}  // namespace
+
+ThreadPool::ThreadPool(uint32_t thread_count)
+    : next_queue_(0),
+      pending_(0),
+      searching_(0),
+      sleeping_(0),
+      idle_(0),
+      waking_(false),
+      destroyed_(false) {
+  for (uint32_t i = 0; i < thread_count; ++i)
+    queues_.push_back(util::make_unique<Queue>());
+  for (uint32_t i = 0; i < thread_count; ++i)
+    workers_.emplace_back([this, i]() { run(i); });
 }
 
 ThreadPool::~ThreadPool() {
-  std::unique_lock<std::mutex> lock(mutex_);
-  destroyed_ = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    destroyed_ = true;
+  }
   worker_cv_.notify_all();
-  for (auto &worker : workers_) {
-    lock.unlock();
-    worker.join();
-    lock.lock();
+  for (auto &worker : workers_) worker.join();
+}
+
+void ThreadPool::schedule(const Task &f) { schedule(Task(f)); }
+
+void ThreadPool::schedule(Task &&f) {
+  if (queues_.empty()) {
+    f();
+    return;
+  }
+  auto index = current_pool == this
+                   ? current_queue
+                   : next_queue_++ % static_cast<uint32_t>(queues_.size());
+  {
+    auto &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    queue.tasks_.push_back(std::move(f));
+    pending_++;
   }
+  // an awake worker which looks for a task will find this one, otherwise wake
+  // up a sleeping one; workers count themselves as sleeping before they stop
+  // searching and check pending_ under mutex_, so no wakeup is lost
+  if (searching_ == 0 && sleeping_ > 0) wakeup();
 }
 
-void ThreadPool::schedule(const Task &f) {
-  std::unique_lock<std::mutex> lock(mutex_);
-  tasks_.emplace(std::move(f));
-  if (tasks_.size() == 1) {
+void ThreadPool::wakeup() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (idle_ > 0 && !waking_) {
+    waking_ = true;
     worker_cv_.notify_one();
   }
 }
 
+void ThreadPool::run(uint32_t index) {
+  current_pool = this;
+  current_queue = index;
+  // queue to steal from first, the one a task was stolen from the last time
+  auto victim = index;
+  searching_++;
+  while (!destroyed_) {
+    Task task;
+    if (pop(index, victim, task)) {
+      // the last searching worker passes the search on if there is more work
+      if (--searching_ == 0 && pending_ > 0 && sleeping_ > 0) wakeup();
+      task();
+      searching_++;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    sleeping_++;
+    searching_--;
+    while (!destroyed_ && pending_ == 0) {
+      idle_++;
+      worker_cv_.wait(lock);
+      idle_--;
+      waking_ = false;
+    }
+    searching_++;
+    sleeping_--;
+  }
+}
+
+bool ThreadPool::pop(uint32_t index, uint32_t &victim, Task &task) {
+  if (pending_ == 0) return false;
+  {
+    auto &queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    if (!queue.tasks_.empty()) {
+      task = std::move(queue.tasks_.front());
+      queue.tasks_.pop_front();
+      pending_--;
+      return true;
+    }
+  }
+  // stop looking once every task was taken, without locking the other queues
+  for (size_t i = 0; i < queues_.size() && pending_ > 0; i++) {
+    auto current = static_cast<uint32_t>((victim + i) % queues_.size());
+    if (current == index) continue;
+    auto &queue = *queues_[current];
+    std::lock_guard<std::mutex> lock(queue.mutex_);
+    if (!queue.tasks_.empty()) {
+      victim = current;
+      task = std::move(queue.tasks_.back());
+      queue.tasks_.pop_back();
+      pending_--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void IThreadPool::schedule(Task &&f) { schedule(static_cast<const Task &>(f)); }
+
 IThreadPool::Pointer IThreadPool::create(uint32_t threads) {
   return util::make_unique<ThreadPool>(threads);
 }
@@ -23,27 +23,56 @@
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
+#include <atomic>
 #include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
 #include <vector>
 #include "IThreadPool.h"
 
 namespace cloudstorage {
 
+/**
+ * Work stealing thread pool. Each worker has its own queue of tasks; tasks
+ * scheduled from a worker go to its queue, others are spread over the queues
+ * in a round-robin fashion. A worker runs tasks from its queue in order and
+ * steals from the other queues when its own is empty. A pool without threads
+ * runs tasks on the thread which schedules them.
+ */
 class ThreadPool : public IThreadPool {
  public:
   ThreadPool(uint32_t thread_count);
   ~ThreadPool();
   void schedule(const Task &f) override;
+  void schedule(Task &&f) override;
 
  private:
+  struct Queue {
+    std::mutex mutex_;
+    std::deque<Task> tasks_;
+  };
+
+  void run(uint32_t index);
+  bool pop(uint32_t index, uint32_t &victim, Task &task);
+  // wakes up an idle worker unless one is already being woken up
+  void wakeup();
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic_uint next_queue_;
+  // tasks in all the queues
+  std::atomic<uint64_t> pending_;
+  // workers which are awake and look for a task
+  std::atomic_uint searching_;
+  std::atomic_uint sleeping_;
   std::mutex mutex_;
   std::condition_variable worker_cv_;
-  std::queue<Task> tasks_;
-  std::vector<std::thread> workers_;
-  bool destroyed_;
+  // workers waiting on worker_cv_, guarded by mutex_
+  uint32_t idle_;
+  bool waking_;
+  std::atomic_bool destroyed_;
 };
 
 }  // namespace cloudstorage
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ * Timer.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "Timer.h"
+
+namespace cloudstorage {
+
+Timer::Timer(Clock clock) : state_(std::make_shared<State>()) {
+  state_->clock_ = clock;
+  state_->destroyed_ = false;
+}
+
+Timer::~Timer() {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex_);
+    state_->destroyed_ = true;
+    state_->task_ = nullptr;
+  }
+  state_->condition_.notify_one();
+  if (!thread_.joinable()) return;
+  if (thread_.get_id() == std::this_thread::get_id())
+    thread_.detach();
+  else
+    thread_.join();
+}
+
+void Timer::schedule(std::chrono::steady_clock::duration delay, Task task) {
+  {
+    std::lock_guard<std::mutex> lock(state_->mutex_);
+    state_->time_ = state_->clock_() + delay;
+    state_->task_ = task;
+    if (!thread_.joinable()) thread_ = std::thread(run, state_);
+  }
+  state_->condition_.notify_one();
+}
+
+void Timer::cancel() {
+  std::lock_guard<std::mutex> lock(state_->mutex_);
+  state_->task_ = nullptr;
+}
+
+void Timer::wakeup() { state_->condition_.notify_one(); }
+
+void Timer::run(std::shared_ptr<State> state) {
+  std::unique_lock<std::mutex> lock(state->mutex_);
+  while (!state->destroyed_) {
+    if (!state->task_) {
+      state->condition_.wait(lock);
+      continue;
+    }
+    auto now = state->clock_();
+    if (now < state->time_) {
+      state->condition_.wait_for(lock, state->time_ - now);
+      continue;
+    }
+    Task task;
+    std::swap(task, state->task_);
+    lock.unlock();
+    task();
+    task = nullptr;
+    lock.lock();
+  }
+}
+
+}  // namespace cloudstorage
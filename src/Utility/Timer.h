@@ -0,0 +1,84 @@
+/*****************************************************************************
+ * Timer.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace cloudstorage {
+
+/**
+ * Runs a task on a thread of its own once a delay passes; the thread is
+ * started with the first scheduled task. Time is read from the clock given to
+ * the constructor.
+ */
+class Timer {
+ public:
+  using Clock = std::function<std::chrono::steady_clock::time_point()>;
+  using Task = std::function<void()>;
+
+  Timer(Clock clock = std::chrono::steady_clock::now);
+  ~Timer();
+
+  /**
+   * Runs task after delay, replaces the task scheduled before.
+   */
+  void schedule(std::chrono::steady_clock::duration delay, Task task);
+
+  /**
+   * Drops the scheduled task.
+   */
+  void cancel();
+
+  /**
+   * Reads the clock again; needed only by clocks which don't follow
+   * std::chrono::steady_clock.
+   */
+  void wakeup();
+
+ private:
+  // shared with the thread, which may outlive the timer when the timer is
+  // destroyed by its own task
+  struct State {
+    Clock clock_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::chrono::steady_clock::time_point time_;
+    Task task_;
+    bool destroyed_;
+  };
+
+  static void run(std::shared_ptr<State>);
+
+  std::shared_ptr<State> state_;
+  std::thread thread_;
+};
+
+}  // namespace cloudstorage
+
+#endif  // TIMER_H
@@ -341,6 +341,48 @@ std::string Url::path() const { return data_.path_; }
 
 std::string Url::query() const { return data_.query_; }
 
+ChunkQueue::ChunkQueue(size_t chunk_size)
+    : chunk_size_(chunk_size), offset_(), size_() {}
+
+void ChunkQueue::push(const char* data, size_t length) {
+  size_ += length;
+  while (length > 0) {
+    if (chunks_.empty() || chunks_.back().use_count() > 1 ||
+        chunks_.back()->size() >= chunk_size_) {
+      chunks_.push_back(std::make_shared<std::vector<char>>());
+      chunks_.back()->reserve(chunk_size_);
+    }
+    auto& chunk = *chunks_.back();
+    auto cnt = std::min(length, chunk_size_ - chunk.size());
+    chunk.insert(chunk.end(), data, data + cnt);
+    data += cnt;
+    length -= cnt;
+  }
+}
+
+void ChunkQueue::push(Chunk chunk) {
+  if (chunk->empty()) return;
+  size_ += chunk->size();
+  chunks_.push_back(std::move(chunk));
+}
+
+size_t ChunkQueue::pop(char* data, size_t max) {
+  size_t result = 0;
+  while (result < max && !chunks_.empty()) {
+    const auto& chunk = *chunks_.front();
+    auto cnt = std::min(max - result, chunk.size() - offset_);
+    memcpy(data + result, chunk.data() + offset_, cnt);
+    result += cnt;
+    offset_ += cnt;
+    if (offset_ == chunk.size()) {
+      chunks_.pop_front();
+      offset_ = 0;
+    }
+  }
+  size_ -= result;
+  return result;
+}
+
 IHttpServer::IResponse::Pointer response_from_string(
     const IHttpServer::IRequest& request, int code,
     const IHttpServer::IResponse::Headers& headers, const std::string& data) {
@@ -24,12 +24,14 @@
 #ifndef UTILITY_H
 #define UTILITY_H
 
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 #include "IHttpServer.h"
 #include "IItem.h"
@@ -123,6 +125,45 @@ class CLOUDSTORAGE_API Url {
   } data_;
 };
 
+/**
+ * FIFO byte queue kept as a list of reference counted chunks; data goes in and
+ * out with memcpy, a whole span at a time. Not thread safe.
+ */
+class CLOUDSTORAGE_API ChunkQueue {
+ public:
+  using Chunk = std::shared_ptr<std::vector<char>>;
+
+  static constexpr size_t DefaultChunkSize = 64 * 1024;
+
+  ChunkQueue(size_t chunk_size = DefaultChunkSize);
+
+  /**
+   * Copies data to the end of the queue, filling up the last chunk first.
+   */
+  void push(const char* data, size_t length);
+
+  /**
+   * Appends the chunk to the queue without copying it.
+   */
+  void push(Chunk chunk);
+
+  /**
+   * Moves at most max bytes from the front of the queue to data.
+   *
+   * @return count of bytes moved
+   */
+  size_t pop(char* data, size_t max);
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+ private:
+  std::deque<Chunk> chunks_;
+  size_t chunk_size_;
+  size_t offset_;
+  size_t size_;
+};
+
 CLOUDSTORAGE_API IHttpServer::IResponse::Pointer response_from_string(
     const IHttpServer::IRequest&, int code,
     const IHttpServer::IResponse::Headers&, const std::string&);
@@ -178,6 +219,9 @@ constexpr auto COULD_NOT_START_HTTP_SERVER = "couldn't start http server";
 constexpr auto YOUTUBE_CONFIG_NOT_FOUND = "ytplayer.config not found";
 constexpr auto INVALID_RADIX_BASE = "invalid radix base";
 constexpr auto UNIMPLEMENTED = "unimplemented";
+constexpr auto CHANGE_CURSOR_EXPIRED = "change cursor expired";
+constexpr auto UNKNOWN_UPLOAD_SIZE = "unknown upload size";
+constexpr auto UPLOAD_TOO_LARGE = "upload too large";
 
 }  // namespace Error
 
@@ -0,0 +1,394 @@
+/*****************************************************************************
+ * AmazonS3Test.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "CloudProvider/AmazonS3.h"
+#include "Utility/FakeHttp.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t PART_SIZE = 5 * 1024 * 1024;
+const std::string ENDPOINT = "https://bucket.s3.us-east-1.amazonaws.com/";
+const uint64_t PAGE_SIZE = 1000;
+const auto LATENCY = std::chrono::milliseconds(1);
+const uint32_t WORKER_COUNT = 32;
+
+struct Object {
+  std::string data_;
+  uint64_t size_;
+};
+
+// bucket of a local S3 stand-in
+class Bucket {
+ public:
+  Bucket()
+      : uploads_(),
+        aborts_(),
+        lists_(),
+        copies_(),
+        deletes_(),
+        server_(this, WORKER_COUNT, LATENCY) {}
+
+  IHttpRequest::Response handle(const std::string& url,
+                                const std::string& method,
+                                const IHttpRequest::GetParameters& parameters,
+                                const IHttpRequest::HeaderParameters& headers,
+                                std::istream& body,
+                                std::shared_ptr<std::ostream> output,
+                                std::shared_ptr<std::ostream> error) {
+    std::stringstream stream;
+    stream << body.rdbuf();
+    auto data = stream.str();
+    auto key = util::Url::unescape(url.substr(ENDPOINT.size()));
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(method + " " + key);
+    auto copy_source = headers.find("x-amz-copy-source");
+    auto source = copy_source == headers.end()
+                      ? ""
+                      : util::Url::unescape(copy_source->second.substr(
+                            std::string("bucket/").size()));
+    if (parameters.count("list-type")) {
+      list(parameters, *output);
+    } else if (parameters.count("delete")) {
+      // DeleteObjects requires a checksum of the body, FakeCrypto's sha256
+      // is identity
+      auto algorithm = headers.find("x-amz-sdk-checksum-algorithm");
+      auto checksum = headers.find("x-amz-checksum-sha256");
+      if (algorithm == headers.end() || algorithm->second != "SHA256" ||
+          checksum == headers.end() ||
+          checksum->second != util::to_base64(data)) {
+        *error << "<Error><Code>InvalidRequest</Code></Error>";
+        return {IHttpRequest::Bad, {}, output, error};
+      }
+      deletes_++;
+      for (auto it = data.find("<Key>"); it != std::string::npos;
+           it = data.find("<Key>", it + 1)) {
+        auto end = data.find("</Key>", it);
+        objects_.erase(data.substr(it + 5, end - it - 5));
+      }
+      *output << "<DeleteResult></DeleteResult>";
+    } else if (parameters.count("uploads")) {
+      parts_.clear();
+      *output << "<InitiateMultipartUploadResult><UploadId>upload"
+              << ++uploads_ << "</UploadId></InitiateMultipartUploadResult>";
+    } else if (method == "PUT" && parameters.count("partNumber")) {
+      auto part = parameters.at("partNumber");
+      if (!source.empty()) {
+        auto range = headers.find("x-amz-copy-source-range")->second;
+        ranges_.push_back(range);
+        auto separator = range.find('-');
+        auto first = std::stoull(range.substr(6, separator - 6));
+        auto last = std::stoull(range.substr(separator + 1));
+        parts_[std::stoi(part)] = {"", last - first + 1};
+        *output << "<CopyPartResult><ETag>\"tag" << part
+                << "\"</ETag></CopyPartResult>";
+      } else {
+        parts_[std::stoi(part)] = {data, data.size()};
+        return {IHttpRequest::Ok, {{"etag", "\"tag" + part + "\""}}, output,
+                error};
+      }
+    } else if (method == "POST" && parameters.count("uploadId")) {
+      commit_ = data;
+      Object object{"", 0};
+      for (auto&& p : parts_) {
+        object.data_ += p.second.data_;
+        object.size_ += p.second.size_;
+      }
+      objects_[key] = object;
+      *output << "<CompleteMultipartUploadResult><Key>" << key
+              << "</Key></CompleteMultipartUploadResult>";
+    } else if (method == "DELETE" && parameters.count("uploadId")) {
+      aborts_++;
+    } else if (method == "PUT" && !source.empty()) {
+      copies_++;
+      objects_[key] = objects_.at(source);
+      *output << "<CopyObjectResult></CopyObjectResult>";
+    } else if (method == "PUT") {
+      objects_[key] = {data, data.size()};
+    } else if (method == "DELETE") {
+      objects_.erase(key);
+    }
+    return {IHttpRequest::Ok, {}, output, error};
+  }
+
+  void list(const IHttpRequest::GetParameters& parameters,
+            std::ostream& output) {
+    lists_++;
+    auto prefix = parameters.at("prefix");
+    auto token = parameters.find("continuation-token");
+    uint64_t start = token == parameters.end() ? 0 : std::stoull(token->second);
+    uint64_t index = 0;
+    output << "<ListBucketResult><Name>bucket</Name>";
+    for (auto&& o : objects_) {
+      if (o.first.compare(0, prefix.size(), prefix) != 0) continue;
+      if (index >= start + PAGE_SIZE) break;
+      if (index++ < start) continue;
+      output << "<Contents><Key>" << o.first << "</Key><Size>" << o.second.size_
+             << "</Size><LastModified>2018-01-01T00:00:00.000Z</LastModified>"
+             << "</Contents>";
+    }
+    if (index == start + PAGE_SIZE)
+      output << "<IsTruncated>true</IsTruncated><NextContinuationToken>"
+             << index << "</NextContinuationToken>";
+    else
+      output << "<IsTruncated>false</IsTruncated>";
+    output << "</ListBucketResult>";
+  }
+
+  std::mutex mutex_;
+  int uploads_;
+  int aborts_;
+  int lists_;
+  int copies_;
+  int deletes_;
+  std::vector<std::string> requests_;
+  std::vector<std::string> ranges_;
+  std::map<int, Object> parts_;
+  std::map<std::string, Object> objects_;
+  std::string commit_;
+  FakeServer server_;
+};
+
+struct CryptoCalls {
+  CryptoCalls() : hmac_sha256_() {}
+
+  int hmac_sha256_;
+  std::string sha256_;
+};
+
+class FakeCrypto : public ICrypto {
+ public:
+  FakeCrypto(CryptoCalls* calls) : calls_(calls) {}
+
+  std::string sha256(const std::string& message) override {
+    if (calls_) calls_->sha256_ = message;
+    return message;
+  }
+  std::string hmac_sha256(const std::string&,
+                          const std::string& message) override {
+    if (calls_) calls_->hmac_sha256_++;
+    return message;
+  }
+  std::string hmac_sha1(const std::string&,
+                        const std::string& message) override {
+    return message;
+  }
+  std::string hex(const std::string&) override { return "00"; }
+
+ private:
+  CryptoCalls* calls_;
+};
+
+std::shared_ptr<AmazonS3> provider(Bucket& bucket,
+                                   CryptoCalls* calls = nullptr) {
+  Json::Value credentials;
+  credentials["username"] = "access_id";
+  credentials["password"] = "secret";
+  credentials["bucket"] = "bucket";
+  ICloudProvider::InitData data;
+  data.token_ = CloudProvider::credentialsToString(credentials);
+  data.http_engine_ = util::make_unique<FakeHttp>(bucket.server_);
+  data.crypto_engine_ = util::make_unique<FakeCrypto>(calls);
+  data.hints_["upload_part_size"] = std::to_string(PART_SIZE);
+  return make_provider<AmazonS3>(std::move(data));
+}
+
+EitherError<IItem> upload(AmazonS3& p, const std::string& data) {
+  return p
+      .uploadFileAsync(directory("directory/"), "file",
+                       std::make_shared<UploadData>(data))
+      ->result();
+}
+
+// directory/ with a marker and count files, some of them in subdirectories
+void add_files(Bucket& bucket, int count) {
+  bucket.objects_["directory/"] = {"", 0};
+  for (int i = 0; i < count; i++) {
+    auto name = "directory/" + std::to_string(i % 3) + "/" + std::to_string(i);
+    bucket.objects_[name] = {name, name.size()};
+  }
+}
+
+}  // namespace
+
+TEST(AmazonS3Test, UploadsLargeFileInParts) {
+  Bucket bucket;
+  auto p = provider(bucket);
+  auto data = file_data(2 * PART_SIZE + 123);
+  auto result = upload(*p, data);
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->size(), data.size());
+  EXPECT_EQ(bucket.uploads_, 1);
+  ASSERT_EQ(bucket.parts_.size(), 3u);
+  EXPECT_EQ(bucket.parts_[3].size_, 123u);
+  EXPECT_EQ(bucket.objects_["directory/file"].data_, data);
+  EXPECT_EQ(bucket.commit_,
+            "<CompleteMultipartUpload>"
+            "<Part><PartNumber>1</PartNumber><ETag>\"tag1\"</ETag></Part>"
+            "<Part><PartNumber>2</PartNumber><ETag>\"tag2\"</ETag></Part>"
+            "<Part><PartNumber>3</PartNumber><ETag>\"tag3\"</ETag></Part>"
+            "</CompleteMultipartUpload>");
+  EXPECT_EQ(bucket.aborts_, 0);
+}
+
+TEST(AmazonS3Test, UploadsSmallFileAtOnce) {
+  Bucket bucket;
+  auto p = provider(bucket);
+  auto data = file_data(PART_SIZE);
+  ASSERT_EQ(upload(*p, data).left(), nullptr);
+  EXPECT_EQ(bucket.uploads_, 0);
+  EXPECT_EQ(bucket.requests_, std::vector<std::string>{"PUT directory/file"});
+  EXPECT_EQ(bucket.objects_["directory/file"].data_, data);
+}
+
+TEST(AmazonS3Test, RejectsFileLargerThanObjectLimit) {
+  Bucket bucket;
+  auto p = provider(bucket);
+  // data is never read
+  class HugeData : public UploadData {
+   public:
+    HugeData() : UploadData("") {}
+    uint64_t size() override { return 5ull * 1024 * 1024 * 1024 * 1024 + 1; }
+  };
+  auto result = p->uploadFileAsync(directory("directory/"), "file",
+                                   std::make_shared<HugeData>())
+                    ->result();
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->description_, util::Error::UPLOAD_TOO_LARGE);
+  EXPECT_TRUE(bucket.requests_.empty());
+}
+
+TEST(AmazonS3Test, DeletesDirectoryInBatches) {
+  Bucket bucket;
+  add_files(bucket, 2500);
+  bucket.objects_["other"] = {"other", 5};
+  std::shared_ptr<ICloudProvider> p = provider(bucket);
+  ASSERT_EQ(p->deleteItemAsync(directory("directory/"))->result().left(),
+            nullptr);
+  EXPECT_EQ(bucket.objects_.size(), 1u);
+  EXPECT_EQ(bucket.lists_, 3);
+  EXPECT_EQ(bucket.deletes_, 3);
+  EXPECT_EQ(bucket.requests_.size(), 6u);
+}
+
+TEST(AmazonS3Test, RenamesDirectoryWithConcurrentCopies) {
+  Bucket bucket;
+  add_files(bucket, 300);
+  std::shared_ptr<ICloudProvider> p = provider(bucket);
+  auto result =
+      p->renameItemAsync(directory("directory/"), "renamed")->result();
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->id(), "renamed/");
+  EXPECT_EQ(bucket.objects_.size(), 301u);
+  for (auto&& o : bucket.objects_) {
+    ASSERT_EQ(o.first.substr(0, 8), "renamed/");
+    if (o.first != "renamed/") {
+      EXPECT_EQ(o.second.data_, "directory/" + o.first.substr(8));
+    }
+  }
+  EXPECT_EQ(bucket.copies_, 301);
+  EXPECT_EQ(bucket.deletes_, 1);
+  EXPECT_GT(bucket.server_.max_running_, 1);
+}
+
+TEST(AmazonS3Test, CopiesLargeObjectInParts) {
+  Bucket bucket;
+  const uint64_t size = 6ull * 1024 * 1024 * 1024 + 1;
+  bucket.objects_["directory/large"] = {"", size};
+  std::shared_ptr<ICloudProvider> p = provider(bucket);
+  auto large = std::make_shared<Item>("large", "directory/large", size,
+                                      IItem::UnknownTimeStamp,
+                                      IItem::FileType::Unknown);
+  auto result = p->moveItemAsync(large, directory("other/"))->result();
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->id(), "other/large");
+  EXPECT_EQ(bucket.objects_.count("directory/large"), 0u);
+  EXPECT_EQ(bucket.objects_["other/large"].size_, size);
+  EXPECT_EQ(bucket.copies_, 0);
+  ASSERT_EQ(bucket.ranges_.size(), 7u);
+  EXPECT_NE(std::find(bucket.ranges_.begin(), bucket.ranges_.end(),
+                      "bytes=6442450944-6442450944"),
+            bucket.ranges_.end());
+  EXPECT_EQ(bucket.aborts_, 0);
+}
+
+TEST(AmazonS3Test, SignsCanonicalRequest) {
+  Bucket bucket;
+  CryptoCalls calls;
+  auto p = provider(bucket, &calls);
+  FakeRequest request(ENDPOINT + "directory/file", "GET", bucket.server_);
+  request.setParameter("prefix", "a b/");
+  request.setHeaderParameter("X-Amz-Meta", "value");
+  p->authorizeRequest(request);
+  std::vector<std::string> lines;
+  std::stringstream stream(calls.sha256_);
+  for (std::string line; std::getline(stream, line);) lines.push_back(line);
+  ASSERT_EQ(lines.size(), 8u);
+  EXPECT_EQ(lines[0], "GET");
+  EXPECT_EQ(lines[1], "/directory/file");
+  auto date = request.parameters().at("X-Amz-Date");
+  auto credential =
+      "access_id%2F" + date.substr(0, 8) + "%2Fus-east-1%2Fs3%2Faws4_request";
+  EXPECT_EQ(lines[2],
+            "X-Amz-Algorithm=AWS4-HMAC-SHA256&X-Amz-Credential=" + credential +
+                "&X-Amz-Date=" + date +
+                "&X-Amz-Expires=86400&X-Amz-SignedHeaders=host%3Bx-amz-meta"
+                "&prefix=a%20b%2F");
+  EXPECT_EQ(lines[3], "host:bucket.s3.us-east-1.amazonaws.com");
+  EXPECT_EQ(lines[4], "x-amz-meta:value");
+  EXPECT_EQ(lines[5], "");
+  EXPECT_EQ(lines[6], "host;x-amz-meta");
+  EXPECT_EQ(lines[7], "UNSIGNED-PAYLOAD");
+  EXPECT_EQ(request.parameters().at("prefix"), "a%20b%2F");
+  EXPECT_EQ(request.parameters().at("X-Amz-Credential"), credential);
+  EXPECT_EQ(request.parameters().at("X-Amz-Signature"), "00");
+}
+
+TEST(AmazonS3Test, ReusesSigningKey) {
+  const int count = 1000;
+  Bucket bucket;
+  CryptoCalls calls;
+  auto p = provider(bucket, &calls);
+  for (int i = 0; i < count; i++) {
+    FakeRequest request(ENDPOINT, "GET", bucket.server_);
+    request.setParameter("list-type", "2");
+    request.setParameter("prefix", "directory/" + std::to_string(i) + "/");
+    request.setParameter("delimiter", "/");
+    p->authorizeRequest(request);
+  }
+  // one hmac per signature, the signing key is derived with four of them
+  // once, or twice if the date changed meanwhile
+  EXPECT_GE(calls.hmac_sha256_, count + 4);
+  EXPECT_LE(calls.hmac_sha256_, count + 8);
+}
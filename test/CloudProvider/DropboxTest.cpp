@@ -0,0 +1,275 @@
+/*****************************************************************************
+ * DropboxTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "CloudProvider/Dropbox.h"
+#include "Request/UploadFileRequest.h"
+#include "Utility/FakeHttp.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t PART_SIZE = 4 * 1024 * 1024;
+const std::string API_ENDPOINT = "https://api.dropboxapi.com/2/files";
+const std::string UPLOAD_ENDPOINT =
+    "https://content.dropboxapi.com/2/files/upload_session";
+const std::string TOKEN = "token";
+const auto LATENCY = std::chrono::milliseconds(1);
+const uint32_t WORKER_COUNT = 32;
+
+struct Session {
+  bool concurrent_;
+  bool closed_;
+  // appended data keyed with its offset
+  std::map<uint64_t, std::string> data_;
+};
+
+// local stand-in for dropbox's upload sessions
+class Server {
+ public:
+  Server()
+      : session_count_(),
+        finish_batches_(),
+        lost_appends_(),
+        server_(this, WORKER_COUNT, LATENCY) {}
+
+  IHttpRequest::Response handle(const std::string& url, const std::string&,
+                                const IHttpRequest::GetParameters&,
+                                const IHttpRequest::HeaderParameters& headers,
+                                std::istream& body,
+                                std::shared_ptr<std::ostream> output,
+                                std::shared_ptr<std::ostream> error) {
+    std::stringstream stream;
+    stream << body.rdbuf();
+    auto data = stream.str();
+    auto token = headers.find("Authorization");
+    if (token == headers.end() || token->second != "Bearer " + TOKEN)
+      return {IHttpRequest::Unauthorized, {}, output, error};
+    auto argument = headers.find("Dropbox-API-Arg");
+    auto json = util::json::from_stream(std::stringstream(
+        argument == headers.end() ? data : argument->second));
+    std::lock_guard<std::mutex> lock(mutex_);
+    Json::Value result;
+    if (url == UPLOAD_ENDPOINT + "/start") {
+      auto id = std::to_string(++session_count_);
+      auto& session = sessions_[id];
+      session.concurrent_ = json["session_type"].asString() == "concurrent";
+      session.closed_ = json["close"].asBool();
+      if (!data.empty()) session.data_[0] = data;
+      result["session_id"] = id;
+    } else if (url == UPLOAD_ENDPOINT + "/append_v2") {
+      auto session = sessions_.find(json["cursor"]["session_id"].asString());
+      if (session == sessions_.end())
+        return {IHttpRequest::NotFound, {}, output, error};
+      if (session->second.closed_ ||
+          (!session->second.concurrent_ &&
+           json["cursor"]["offset"].asUInt64() != size(session->second)))
+        return {IHttpRequest::Bad, {}, output, error};
+      auto offset = json["cursor"]["offset"].asUInt64();
+      auto stored = session->second.data_.find(offset);
+      if (stored != session->second.data_.end()) {
+        Json::Value e;
+        e["error"][".tag"] = "incorrect_offset";
+        e["error"]["correct_offset"] =
+            Json::UInt64(offset + stored->second.size());
+        *error << util::json::to_string(e);
+        return {409, {}, output, error};
+      }
+      session->second.data_[offset] = data;
+      session->second.closed_ = json["close"].asBool();
+      if (lost_appends_ > 0) {
+        lost_appends_--;
+        return {IHttpRequest::ServiceUnavailable, {}, output, error};
+      }
+    } else if (url == UPLOAD_ENDPOINT + "/finish") {
+      if (!commit(json, result)) return {IHttpRequest::Bad, {}, output, error};
+    } else if (url == API_ENDPOINT + "/upload_session/finish_batch_v2") {
+      finish_batches_++;
+      for (auto&& entry : json["entries"]) {
+        Json::Value metadata;
+        if (commit(entry, metadata))
+          metadata[".tag"] = "success";
+        else
+          metadata[".tag"] = "failure";
+        result["entries"].append(metadata);
+      }
+    } else {
+      return {IHttpRequest::NotFound, {}, output, error};
+    }
+    *output << util::json::to_string(result);
+    return {IHttpRequest::Ok, {}, output, error};
+  }
+
+  uint64_t size(const Session& session) const {
+    uint64_t size = 0;
+    for (auto&& d : session.data_)
+      if (d.first == size) size += d.second.size();
+    return size;
+  }
+
+  bool commit(const Json::Value& json, Json::Value& metadata) {
+    auto it = sessions_.find(json["cursor"]["session_id"].asString());
+    if (it == sessions_.end()) return false;
+    const auto& session = it->second;
+    auto path = json["commit"]["path"].asString();
+    if (path == rejected_ || (session.concurrent_ && !session.closed_) ||
+        size(session) != json["cursor"]["offset"].asUInt64())
+      return false;
+    std::string data;
+    for (auto&& d : session.data_) data += d.second;
+    files_[path] = data;
+    sessions_.erase(it);
+    metadata[".tag"] = "file";
+    metadata["name"] = CloudProvider::getFilename(path);
+    metadata["path_display"] = path;
+    metadata["size"] = Json::UInt64(data.size());
+    metadata["client_modified"] = "2018-01-01T00:00:00Z";
+    return true;
+  }
+
+  std::mutex mutex_;
+  int session_count_;
+  int finish_batches_;
+  // count of appends which are stored, but answered with an error
+  int lost_appends_;
+  std::map<std::string, Session> sessions_;
+  std::map<std::string, std::string> files_;
+  // path which can't be committed
+  std::string rejected_;
+  FakeServer server_;
+};
+
+std::shared_ptr<Dropbox> provider(Server& server,
+                                  uint64_t part_size = PART_SIZE + 1) {
+  ICloudProvider::InitData data;
+  data.token_ = TOKEN;
+  data.http_engine_ = util::make_unique<FakeHttp>(server.server_);
+  data.hints_["upload_part_size"] = std::to_string(part_size);
+  return make_provider<Dropbox>(std::move(data));
+}
+
+ICloudProvider::UploadFileRequest::Pointer upload(ICloudProvider& p,
+                                                  const std::string& filename,
+                                                  const std::string& data) {
+  return p.uploadFileAsync(directory("/directory"), filename,
+                           std::make_shared<UploadData>(data));
+}
+
+}  // namespace
+
+TEST(DropboxTest, AppendsPartsConcurrently) {
+  Server server;
+  auto p = provider(server);
+  EXPECT_EQ(p->uploadSessionPartSize(), PART_SIZE);
+  auto data = file_data(3 * PART_SIZE + 123);
+  auto result = upload(*p, "file", data)->result();
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->id(), "/directory/file");
+  EXPECT_EQ(result.right()->size(), data.size());
+  EXPECT_EQ(server.files_["/directory/file"], data);
+  EXPECT_GT(server.server_.max_running_, 1);
+  EXPECT_EQ(server.finish_batches_, 0);
+}
+
+TEST(DropboxTest, LimitsPartSize) {
+  Server server;
+  EXPECT_EQ(provider(server, 1024 * 1024 * 1024)->uploadSessionPartSize(),
+            148 * 1024 * 1024u);
+  EXPECT_EQ(provider(server, 1)->uploadSessionPartSize(), PART_SIZE);
+}
+
+TEST(DropboxTest, AcceptsRetriedAppendWhichWasStored) {
+  Server server;
+  server.lost_appends_ = 2;
+  auto p = provider(server);
+  auto data = file_data(3 * PART_SIZE + 123);
+  auto result = upload(*p, "file", data)->result();
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->size(), data.size());
+  EXPECT_EQ(server.files_["/directory/file"], data);
+}
+
+TEST(DropboxTest, SendsOffsetsBeyondFourGigabytes) {
+  Server server;
+  auto p = provider(server);
+  UploadSession session{"id", 5 * 1024 * 1024 * 1024ull, PART_SIZE, {}};
+  std::stringstream prefix, suffix;
+  auto last = session.part_count() - 1;
+  auto request = p->uploadPartRequest(*directory("/directory"), "file",
+                                      session, last, prefix, suffix);
+  auto argument = util::json::from_stream(std::stringstream(
+      request->headerParameters().find("Dropbox-API-Arg")->second));
+  EXPECT_EQ(argument["cursor"]["offset"].asUInt64(), last * PART_SIZE);
+  EXPECT_TRUE(argument["close"].asBool());
+  request = p->uploadSessionCommitRequest(*directory("/directory"), "file",
+                                          session, prefix);
+  argument = util::json::from_stream(std::stringstream(
+      request->headerParameters().find("Dropbox-API-Arg")->second));
+  EXPECT_EQ(argument["cursor"]["offset"].asUInt64(), session.size_);
+}
+
+TEST(DropboxTest, CommitsSmallFilesInBatches) {
+  Server server;
+  auto p = provider(server);
+  const int count = 50;
+  std::vector<ICloudProvider::UploadFileRequest::Pointer> requests;
+  for (int i = 0; i < count; i++)
+    requests.push_back(upload(*p, std::to_string(i), file_data(i * 1000)));
+  for (int i = 0; i < count; i++) {
+    auto result = requests[i]->result();
+    ASSERT_EQ(result.left(), nullptr);
+    EXPECT_EQ(result.right()->id(), "/directory/" + std::to_string(i));
+    EXPECT_EQ(result.right()->size(), i * 1000u);
+  }
+  ASSERT_EQ(server.files_.size(), static_cast<size_t>(count));
+  for (int i = 0; i < count; i++)
+    EXPECT_EQ(server.files_["/directory/" + std::to_string(i)],
+              file_data(i * 1000));
+  EXPECT_TRUE(server.sessions_.empty());
+  EXPECT_GE(server.finish_batches_, 1);
+  EXPECT_LT(server.finish_batches_, count);
+}
+
+TEST(DropboxTest, ReportsFailedBatchEntries) {
+  Server server;
+  auto p = provider(server);
+  server.rejected_ = "/directory/rejected";
+  auto rejected = upload(*p, "rejected", "abc");
+  auto accepted = upload(*p, "accepted", "def");
+  auto result = rejected->result();
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->code_, static_cast<int>(IHttpRequest::Failure));
+  ASSERT_EQ(accepted->result().left(), nullptr);
+  EXPECT_EQ(server.files_.size(), 1u);
+  EXPECT_EQ(server.files_["/directory/accepted"], "def");
+}
@@ -21,9 +21,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
  *****************************************************************************/
 #include <json/json.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include "CloudProvider/GoogleDrive.h"
 #include "ICloudStorage.h"
 #include "Utility/HttpMock.h"
 #include "Utility/HttpServerMock.h"
+#include "Utility/Timer.h"
 #include "Utility/Utility.h"
 #include "gtest/gtest.h"
 
@@ -34,6 +39,7 @@ using ::testing::ByMove;
 using ::testing::DoAll;
 using ::testing::Invoke;
 using ::testing::InvokeArgument;
+using ::testing::InvokeWithoutArgs;
 using ::testing::Return;
 using ::testing::WithArgs;
 
@@ -45,6 +51,27 @@ class AuthCallback : public ICloudProvider::IAuthCallback {
   void done(const ICloudProvider&, EitherError<void>) override {}
 };
 
+// google drive whose token refreshes follow a clock moved by advance()
+class ClockedGoogleDrive : public GoogleDrive {
+ public:
+  ClockedGoogleDrive() : now_(std::make_shared<std::atomic<int64_t>>(0)) {
+    auto now = now_;
+    timer_ = std::make_shared<Timer>([now] {
+      return std::chrono::steady_clock::time_point(std::chrono::seconds(*now));
+    });
+    setTokenRefreshTimer(timer_);
+  }
+
+  void advance(std::chrono::seconds duration) {
+    *now_ += duration.count();
+    timer_->wakeup();
+  }
+
+ private:
+  std::shared_ptr<std::atomic<int64_t>> now_;
+  std::shared_ptr<Timer> timer_;
+};
+
 class GoogleDriveTest : public ::testing::Test {
  public:
   void SetUp() {}
@@ -99,8 +126,21 @@ ACTION(CreateServer) {
   return std::move(server);
 }
 
+ACTION_P2(RefreshedSend, token, expires_in) {
+  Json::Value json;
+  json["access_token"] = token;
+  json["expires_in"] = expires_in;
+  *arg2 << json;
+  arg0(IHttpRequest::Response{IHttpRequest::Ok, {}, arg2, arg3});
+}
+
 ACTION(CreateFileServer) { return util::make_unique<HttpServerMock>(); }
 
+ACTION_P(SendJson, json) {
+  *arg2 << json;
+  arg0(IHttpRequest::Response{IHttpRequest::Ok, {}, arg2, arg3});
+}
+
 TEST_F(GoogleDriveTest, ListDirectoryTest) {
   ICloudProvider::InitData data;
   data.http_engine_ = util::make_unique<HttpMock>();
@@ -159,3 +199,104 @@ TEST_F(GoogleDriveTest, AuthorizationTest) {
   ASSERT_EQ(r.right()->size(), 2);
   ASSERT_EQ(r.right()->front()->filename(), "test");
 }
+
+TEST_F(GoogleDriveTest, ListChangesTest) {
+  ICloudProvider::InitData data;
+  data.http_engine_ = util::make_unique<HttpMock>();
+  data.callback_ = util::make_unique<AuthCallback>();
+  const HttpMock& http = static_cast<const HttpMock&>(*data.http_engine_);
+  auto provider = ICloudStorage::create()->provider("google", std::move(data));
+  Json::Value first_page;
+  first_page["changes"][0]["changeType"] = "file";
+  first_page["changes"][0]["fileId"] = "removed_id";
+  first_page["changes"][0]["removed"] = true;
+  first_page["nextPageToken"] = "2";
+  Json::Value second_page;
+  second_page["changes"][0]["changeType"] = "file";
+  second_page["changes"][0]["fileId"] = "id";
+  second_page["changes"][0]["file"]["id"] = "id";
+  second_page["changes"][0]["file"]["name"] = "test";
+  second_page["changes"][0]["file"]["parents"][0] = "parent_id";
+  second_page["newStartPageToken"] = "3";
+  auto first_request = request_mock();
+  EXPECT_CALL(*first_request, setParameter("pageToken", "1"));
+  EXPECT_CALL(*first_request, send(_, _, _, _, _))
+      .WillOnce(SendJson(first_page));
+  auto second_request = request_mock();
+  EXPECT_CALL(*second_request, setParameter("pageToken", "2"));
+  EXPECT_CALL(*second_request, send(_, _, _, _, _))
+      .WillOnce(SendJson(second_page));
+  EXPECT_CALL(http, create("https://www.googleapis.com/drive/v3/changes",
+                           "GET", true))
+      .WillOnce(Return(first_request))
+      .WillOnce(Return(second_request));
+  auto r = provider->listChangesAsync("1")->result();
+  ASSERT_NE(r.right(), nullptr);
+  ASSERT_EQ(r.right()->changes_.size(), 2);
+  EXPECT_EQ(r.right()->changes_[0].id_, "removed_id");
+  EXPECT_EQ(r.right()->changes_[0].item_, nullptr);
+  EXPECT_EQ(r.right()->changes_[1].id_, "id");
+  ASSERT_NE(r.right()->changes_[1].item_, nullptr);
+  EXPECT_EQ(r.right()->changes_[1].item_->filename(), "test");
+  EXPECT_EQ(r.right()->cursor_, "3");
+}
+
+TEST_F(GoogleDriveTest, RefreshesExpiringTokenTest) {
+  ICloudProvider::InitData data;
+  data.token_ = "refresh_token";
+  data.http_engine_ = util::make_unique<HttpMock>();
+  data.http_server_ = util::make_unique<HttpServerFactoryMock>();
+  data.callback_ = util::make_unique<AuthCallback>();
+  const HttpMock& http = static_cast<const HttpMock&>(*data.http_engine_);
+  HttpServerFactoryMock& http_factory =
+      static_cast<HttpServerFactoryMock&>(*data.http_server_);
+  EXPECT_CALL(http_factory, create(_, _, IHttpServer::Type::FileProvider))
+      .WillOnce(CreateFileServer());
+  auto drive = std::make_shared<ClockedGoogleDrive>();
+  drive->initialize(std::move(data));
+  std::shared_ptr<ICloudProvider> provider = drive;
+  auto unauthorized_request = request_mock();
+  EXPECT_CALL(*unauthorized_request, send(_, _, _, _, _))
+      .WillOnce(UnauthorizedSend());
+  auto first_request = std::make_shared<HttpRequestMock>();
+  EXPECT_CALL(*first_request, setParameter(_, _)).Times(AtLeast(0));
+  EXPECT_CALL(*first_request,
+              setHeaderParameter("Authorization", "Bearer first_token"));
+  EXPECT_CALL(*first_request, send(_, _, _, _, _)).WillOnce(CallSend());
+  auto second_request = std::make_shared<HttpRequestMock>();
+  EXPECT_CALL(*second_request, setParameter(_, _)).Times(AtLeast(0));
+  EXPECT_CALL(*second_request,
+              setHeaderParameter("Authorization", "Bearer second_token"));
+  EXPECT_CALL(*second_request, send(_, _, _, _, _)).WillOnce(CallSend());
+  EXPECT_CALL(http,
+              create("https://www.googleapis.com/drive/v3/files", "GET", true))
+      .WillOnce(Return(unauthorized_request))
+      .WillOnce(Return(first_request))
+      .WillOnce(Return(second_request));
+  std::promise<void> refreshed;
+  auto first_token_request = request_mock();
+  EXPECT_CALL(*first_token_request, send(_, _, _, _, _))
+      .WillOnce(RefreshedSend("first_token", 3600));
+  auto second_token_request = request_mock();
+  EXPECT_CALL(*second_token_request, send(_, _, _, _, _))
+      .WillOnce(DoAll(RefreshedSend("second_token", 3600),
+                      InvokeWithoutArgs([&] { refreshed.set_value(); })));
+  EXPECT_CALL(
+      http, create("https://accounts.google.com/o/oauth2/token", "POST", true))
+      .WillOnce(Return(first_token_request))
+      .WillOnce(Return(second_token_request));
+  ASSERT_NE(provider->listDirectorySimpleAsync(provider->rootDirectory())
+                ->result()
+                .right(),
+            nullptr);
+  // first_token is refreshed five minutes before it expires, while no
+  // request is running
+  drive->advance(std::chrono::minutes(55));
+  ASSERT_EQ(refreshed.get_future().wait_for(std::chrono::seconds(10)),
+            std::future_status::ready);
+  ASSERT_NE(provider->listDirectorySimpleAsync(provider->rootDirectory())
+                ->result()
+                .right(),
+            nullptr);
+  drive->destroy();
+}
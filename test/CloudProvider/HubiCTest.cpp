@@ -0,0 +1,307 @@
+/*****************************************************************************
+ * HubiCTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <json/json.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "CloudProvider/HubiC.h"
+#include "Utility/FakeHttp.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t PART_SIZE = 1024 * 1024;
+const std::string ENDPOINT = "https://swift.hubic.com/v1/AUTH_test";
+const std::string TOKEN = "token";
+const auto LATENCY = std::chrono::milliseconds(1);
+const uint32_t WORKER_COUNT = 32;
+
+struct Object {
+  std::string data_;
+  // segments of a static large object manifest
+  std::vector<std::string> segments_;
+};
+
+std::string etag(const std::string& data) {
+  return std::to_string(std::hash<std::string>()(data));
+}
+
+// local OpenStack Swift stand-in; objects_ are keyed with container/name
+class Swift {
+ public:
+  Swift()
+      : bulk_delete_(true),
+        bulk_deletes_(),
+        object_deletes_(),
+        manifest_deletes_(),
+        copies_(),
+        server_(this, WORKER_COUNT, LATENCY) {}
+
+  IHttpRequest::Response handle(const std::string& url,
+                                const std::string& method,
+                                const IHttpRequest::GetParameters& parameters,
+                                const IHttpRequest::HeaderParameters& headers,
+                                std::istream& body,
+                                std::shared_ptr<std::ostream> output,
+                                std::shared_ptr<std::ostream> error) {
+    std::stringstream stream;
+    stream << body.rdbuf();
+    auto data = stream.str();
+    if (url == "https://api.hubic.com/oauth/token") {
+      *output << R"({ "access_token": "access", "expires_in": 3600 })";
+      return {IHttpRequest::Ok, {}, output, error};
+    }
+    if (url == "https://api.hubic.com/1.0/account/credentials") {
+      *output << R"({ "endpoint": ")" << ENDPOINT << R"(", "token": ")"
+              << TOKEN << R"(" })";
+      return {IHttpRequest::Ok, {}, output, error};
+    }
+    auto token = headers.find("X-Auth-Token");
+    if (url.compare(0, ENDPOINT.size(), ENDPOINT) != 0 ||
+        token == headers.end() || token->second != TOKEN)
+      return {IHttpRequest::Unauthorized, {}, output, error};
+    auto path = util::Url::unescape(url.substr(ENDPOINT.size()));
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path.empty() && parameters.count("bulk-delete") && bulk_delete_) {
+      bulk_deletes_++;
+      std::stringstream lines(data);
+      for (std::string line; std::getline(lines, line);)
+        objects_.erase(util::Url::unescape(line).substr(1));
+      *output << R"({ "Response Status": "200 OK", "Errors": [] })";
+    } else if (path.empty()) {
+      // account metadata update, answered with 204 No Content
+      return {204, {}, output, error};
+    } else if (path == "/default" && method == "GET") {
+      list(parameters, *output);
+    } else if (path.find('/', 1) == std::string::npos) {
+      if (method == "PUT") containers_.push_back(path.substr(1));
+    } else if (method == "PUT") {
+      return put(path.substr(1), parameters, headers, data, output, error);
+    } else if (method == "DELETE") {
+      auto it = objects_.find(path.substr(1));
+      if (it == objects_.end())
+        return {IHttpRequest::NotFound, {}, output, error};
+      object_deletes_++;
+      if (parameters.count("multipart-manifest")) {
+        manifest_deletes_++;
+        for (auto&& s : it->second.segments_) objects_.erase(s);
+      }
+      objects_.erase(it);
+    }
+    return {IHttpRequest::Ok, {}, output, error};
+  }
+
+  IHttpRequest::Response put(const std::string& name,
+                             const IHttpRequest::GetParameters& parameters,
+                             const IHttpRequest::HeaderParameters& headers,
+                             const std::string& data,
+                             std::shared_ptr<std::ostream> output,
+                             std::shared_ptr<std::ostream> error) {
+    auto copy_from = headers.find("X-Copy-From");
+    auto manifest = parameters.find("multipart-manifest");
+    if (copy_from != headers.end()) {
+      auto source =
+          objects_.find(util::Url::unescape(copy_from->second).substr(1));
+      if (source == objects_.end() || manifest == parameters.end() ||
+          manifest->second != "get")
+        return {IHttpRequest::NotFound, {}, output, error};
+      copies_++;
+      objects_[name] = source->second;
+    } else if (manifest != parameters.end()) {
+      Object object;
+      for (auto&& s : util::json::from_stream(std::stringstream(data))) {
+        auto segment = objects_.find(s["path"].asString().substr(1));
+        if (segment == objects_.end() ||
+            s["etag"].asString() != etag(segment->second.data_) ||
+            s["size_bytes"].asUInt64() != segment->second.data_.size())
+          return {IHttpRequest::Bad, {}, output, error};
+        object.data_ += segment->second.data_;
+        object.segments_.push_back(segment->first);
+      }
+      objects_[name] = object;
+    } else {
+      objects_[name] = {data, {}};
+      return {IHttpRequest::Ok, {{"etag", etag(data)}}, output, error};
+    }
+    return {IHttpRequest::Ok, {}, output, error};
+  }
+
+  void list(const IHttpRequest::GetParameters& parameters,
+            std::ostream& output) {
+    auto prefix = "default/" + parameters.at("prefix");
+    auto marker = parameters.find("marker");
+    auto limit = std::stoul(parameters.at("limit"));
+    Json::Value result(Json::arrayValue);
+    auto it = marker == parameters.end()
+                  ? objects_.lower_bound(prefix)
+                  : objects_.upper_bound("default/" + marker->second);
+    for (; it != objects_.end() && result.size() < limit; ++it) {
+      if (it->first.compare(0, prefix.size(), prefix) != 0) break;
+      Json::Value v;
+      v["name"] = it->first.substr(std::string("default/").size());
+      v["bytes"] = Json::UInt64(it->second.data_.size());
+      v["content_type"] = "application/octet-stream";
+      v["last_modified"] = "2018-01-01T00:00:00.000000";
+      if (!it->second.segments_.empty()) v["slo_etag"] = etag(it->second.data_);
+      result.append(v);
+    }
+    output << util::json::to_string(result);
+  }
+
+  std::mutex mutex_;
+  bool bulk_delete_;
+  int bulk_deletes_;
+  int object_deletes_;
+  int manifest_deletes_;
+  int copies_;
+  std::vector<std::string> containers_;
+  std::map<std::string, Object> objects_;
+  FakeServer server_;
+};
+
+std::shared_ptr<ICloudProvider> provider(Swift& swift) {
+  ICloudProvider::InitData data;
+  data.token_ = "refresh";
+  data.http_engine_ = util::make_unique<FakeHttp>(swift.server_);
+  data.hints_["upload_part_size"] = std::to_string(PART_SIZE);
+  return make_provider<HubiC>(std::move(data));
+}
+
+EitherError<IItem> upload(ICloudProvider& p, const std::string& data) {
+  return p
+      .uploadFileAsync(directory("directory"), "file",
+                       std::make_shared<UploadData>(data))
+      ->result();
+}
+
+// directory with count files, some of them in subdirectories, and a large
+// object of two segments
+void add_files(Swift& swift, int count) {
+  swift.objects_["default/directory"] = {"", {}};
+  for (int i = 0; i < count; i++) {
+    auto name = "directory/" + std::to_string(i % 3) + "/" + std::to_string(i);
+    swift.objects_["default/" + name] = {name, {}};
+  }
+  swift.objects_["default_segments/directory/large/1/0"] = {"abc", {}};
+  swift.objects_["default_segments/directory/large/1/1"] = {"def", {}};
+  swift.objects_["default/directory/large"] = {
+      "abcdef",
+      {"default_segments/directory/large/1/0",
+       "default_segments/directory/large/1/1"}};
+}
+
+}  // namespace
+
+TEST(HubiCTest, UploadsLargeFileAsStaticLargeObject) {
+  Swift swift;
+  auto p = provider(swift);
+  auto data = file_data(2 * PART_SIZE + 123);
+  auto result = upload(*p, data);
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->id(), "directory/file");
+  EXPECT_EQ(result.right()->size(), data.size());
+  EXPECT_EQ(swift.containers_, std::vector<std::string>{"default_segments"});
+  const auto& object = swift.objects_["default/directory/file"];
+  EXPECT_EQ(object.data_, data);
+  ASSERT_EQ(object.segments_.size(), 3u);
+  EXPECT_EQ(swift.objects_[object.segments_[2]].data_.size(), 123u);
+}
+
+TEST(HubiCTest, UploadsSmallFileAtOnce) {
+  Swift swift;
+  auto p = provider(swift);
+  auto data = file_data(PART_SIZE);
+  ASSERT_EQ(upload(*p, data).left(), nullptr);
+  EXPECT_TRUE(swift.containers_.empty());
+  ASSERT_EQ(swift.objects_.size(), 1u);
+  EXPECT_EQ(swift.objects_["default/directory/file"].data_, data);
+}
+
+TEST(HubiCTest, DeletesDirectoryWithBulkRequests) {
+  Swift swift;
+  add_files(swift, 2500);
+  swift.objects_["default/directory2"] = {"", {}};
+  auto p = provider(swift);
+  ASSERT_EQ(p->deleteItemAsync(directory("directory"))->result().left(),
+            nullptr);
+  ASSERT_EQ(swift.objects_.size(), 1u);
+  EXPECT_EQ(swift.objects_.begin()->first, "default/directory2");
+  EXPECT_EQ(swift.bulk_deletes_, 3);
+  EXPECT_EQ(swift.manifest_deletes_, 1);
+}
+
+TEST(HubiCTest, RenamesDirectoryWithConcurrentCopies) {
+  Swift swift;
+  add_files(swift, 300);
+  auto p = provider(swift);
+  auto result = p->renameItemAsync(directory("directory"), "renamed")->result();
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->id(), "renamed");
+  EXPECT_EQ(swift.copies_, 302);
+  EXPECT_GT(swift.server_.max_running_, 1);
+  for (auto&& o : swift.objects_) {
+    if (o.first.compare(0, 17, "default_segments/") == 0) continue;
+    ASSERT_EQ(o.first.substr(0, 15), "default/renamed");
+    if (o.first.size() > 15 && o.first != "default/renamed/large") {
+      EXPECT_EQ(o.second.data_, "directory" + o.first.substr(15));
+    }
+  }
+  // the copied manifest still refers to the segments
+  EXPECT_EQ(swift.objects_["default/renamed/large"].segments_.size(), 2u);
+  EXPECT_EQ(swift.objects_.count("default_segments/directory/large/1/0"), 1u);
+  EXPECT_EQ(swift.objects_.size(), 304u);
+}
+
+TEST(HubiCTest, DeletesSegmentsOfLargeFile) {
+  Swift swift;
+  add_files(swift, 0);
+  auto p = provider(swift);
+  auto file = std::make_shared<Item>("large", "directory/large", 6,
+                                     IItem::UnknownTimeStamp,
+                                     IItem::FileType::Unknown);
+  ASSERT_EQ(p->deleteItemAsync(file)->result().left(), nullptr);
+  ASSERT_EQ(swift.objects_.size(), 1u);
+  EXPECT_EQ(swift.objects_.begin()->first, "default/directory");
+  EXPECT_EQ(swift.manifest_deletes_, 1);
+}
+
+TEST(HubiCTest, DeletesObjectsOneByOneWithoutBulkDelete) {
+  Swift swift;
+  swift.bulk_delete_ = false;
+  add_files(swift, 30);
+  auto p = provider(swift);
+  ASSERT_EQ(p->deleteItemAsync(directory("directory"))->result().left(),
+            nullptr);
+  EXPECT_TRUE(swift.objects_.empty());
+  EXPECT_EQ(swift.bulk_deletes_, 0);
+  EXPECT_EQ(swift.object_deletes_, 32);
+  EXPECT_EQ(swift.manifest_deletes_, 1);
+}
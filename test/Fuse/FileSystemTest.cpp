@@ -0,0 +1,235 @@
+/*****************************************************************************
+ * FileSystemTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FileSystem.h"
+#include "Request/Request.h"
+#include "Utility/FakeHttp.h"
+#include "Utility/Item.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t PART_SIZE = 1024 * 1024;
+// inode of the directory of the only provider
+const IFileSystem::FileId PROVIDER_DIRECTORY = 2;
+
+class Directory {
+ public:
+  Directory() {
+    std::string pattern = util::temporary_directory() + "file-system-XXXXXX";
+    path_ = mkdtemp(&pattern[0]) ? pattern + "/" : "";
+  }
+
+  ~Directory() {
+    if (!path_.empty())
+      (void)std::system(("rm -rf \"" + path_ + "\"").c_str());
+  }
+
+  std::string path_;
+};
+
+// stores uploaded files; transfers run on threads joined when it's destroyed,
+// after the file system and the provider
+class Storage {
+ public:
+  Storage() : uploads_(), streams_() {}
+
+  ~Storage() {
+    for (auto&& t : thread_) t.join();
+  }
+
+  void transfer(Request<EitherError<IItem>>::Pointer r,
+                const std::string& filename, IUploadFileCallback::Pointer cb) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cb->size() == IItem::UnknownSize) streams_++;
+    thread_.emplace_back([=] {
+      std::string data;
+      auto size = cb->size();
+      while (size == IItem::UnknownSize || data.size() < size) {
+        auto length = PART_SIZE;
+        if (size == IItem::UnknownSize) {
+          std::promise<EitherError<uint64_t>> available;
+          cb->waitData(data.size(), PART_SIZE,
+                       [&](EitherError<uint64_t> e) { available.set_value(e); });
+          auto e = available.get_future().get();
+          if (e.left()) return r->done(e.left());
+          length = *e.right();
+        } else {
+          length = std::min(length, size - data.size());
+        }
+        std::string part(length, 0);
+        data += part.substr(0, cb->putData(&part[0], length, data.size()));
+        if (length < PART_SIZE) break;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uploads_++;
+        file_[filename] = data;
+      }
+      r->done(std::static_pointer_cast<IItem>(std::make_shared<Item>(
+          filename, filename, data.size(), IItem::UnknownTimeStamp,
+          IItem::FileType::Unknown)));
+    });
+  }
+
+  std::string file(const std::string& filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_[filename];
+  }
+
+  std::mutex mutex_;
+  std::map<std::string, std::string> file_;
+  int uploads_;
+  int streams_;
+  std::vector<std::thread> thread_;
+};
+
+class StorageProvider : public CloudProvider {
+ public:
+  StorageProvider(Storage& storage, bool streaming)
+      : CloudProvider(util::make_unique<FakeAuth>()),
+        storage_(storage),
+        streaming_(streaming) {}
+
+  std::string name() const override { return "storage"; }
+  std::string endpoint() const override { return ""; }
+
+  IItem::Pointer rootDirectory() const override { return directory("root"); }
+
+  using CloudProvider::uploadFileAsync;
+  UploadFileRequest::Pointer uploadFileAsync(
+      IItem::Pointer, const std::string& filename,
+      IUploadFileCallback::Pointer cb) override {
+    auto& storage = storage_;
+    return std::make_shared<Request<EitherError<IItem>>>(
+               shared_from_this(), [=](EitherError<IItem> e) { cb->done(e); },
+               [=, &storage](Request<EitherError<IItem>>::Pointer r) {
+                 storage.transfer(r, filename, cb);
+               })
+        ->run();
+  }
+
+ protected:
+  uint64_t uploadSessionPartSize() const override { return PART_SIZE; }
+  bool uploadSessionStreaming() const override { return streaming_; }
+
+ private:
+  Storage& storage_;
+  bool streaming_;
+};
+
+std::shared_ptr<StorageProvider> provider(Storage& storage, bool streaming) {
+  return make_provider<StorageProvider>(ICloudProvider::InitData{}, storage,
+                                        streaming);
+}
+
+std::unique_ptr<FileSystem> file_system(std::shared_ptr<ICloudProvider> p,
+                                        const std::string& directory) {
+  return util::make_unique<FileSystem>(
+      std::vector<IFileSystem::ProviderEntry>{{"storage", p}},
+      util::make_unique<NullHttp>(), directory, 0);
+}
+
+bool write(IFileSystem& fs, IFileSystem::FileId node, const std::string& data,
+           uint64_t offset) {
+  auto written = std::make_shared<std::promise<uint32_t>>();
+  fs.write(node, data.data(), data.size(), offset,
+           [=](EitherError<uint32_t> e) {
+             written->set_value(e.right() ? *e.right() : 0);
+           });
+  return written->get_future().get() == data.size();
+}
+
+bool fsync(IFileSystem& fs, IFileSystem::FileId node) {
+  auto synchronized = std::make_shared<std::promise<bool>>();
+  fs.fsync(node, [=](EitherError<void> e) {
+    synchronized->set_value(e.left() == nullptr);
+  });
+  return synchronized->get_future().get();
+}
+
+bool exists(const std::string& path) { return std::ifstream(path).good(); }
+
+}  // namespace
+
+TEST(FileSystemTest, UploadsFileOnceAndDropsStagingFile) {
+  Directory directory;
+  Storage storage;
+  auto fs = file_system(provider(storage, false), directory.path_);
+  auto node = fs->mknod(PROVIDER_DIRECTORY, "file");
+  ASSERT_NE(node, 0u);
+  auto staging = directory.path_ + "cloudstorage" + std::to_string(node);
+  EXPECT_TRUE(exists(staging));
+  auto data = file_data(3 * PART_SIZE + 17);
+  ASSERT_TRUE(write(*fs, node, data, 0));
+  ASSERT_TRUE(fsync(*fs, node));
+  ASSERT_TRUE(fsync(*fs, node));
+  EXPECT_EQ(storage.uploads_, 1);
+  EXPECT_EQ(storage.streams_, 0);
+  EXPECT_EQ(storage.file("file"), data);
+  EXPECT_FALSE(exists(staging));
+}
+
+TEST(FileSystemTest, StreamsSequentialWrites) {
+  Directory directory;
+  Storage storage;
+  auto fs = file_system(provider(storage, true), directory.path_);
+  auto node = fs->mknod(PROVIDER_DIRECTORY, "file");
+  auto data = file_data(WRITE_BACK_THRESHOLD + PART_SIZE / 2);
+  for (uint64_t offset = 0; offset < data.size(); offset += PART_SIZE)
+    ASSERT_TRUE(write(*fs, node, data.substr(offset, PART_SIZE), offset));
+  // the upload started before the size of the file was known
+  EXPECT_EQ(storage.streams_, 1);
+  ASSERT_TRUE(fsync(*fs, node));
+  EXPECT_EQ(storage.uploads_, 1);
+  EXPECT_EQ(storage.file("file"), data);
+}
+
+TEST(FileSystemTest, RandomWriteAbortsStream) {
+  Directory directory;
+  Storage storage;
+  auto fs = file_system(provider(storage, true), directory.path_);
+  auto node = fs->mknod(PROVIDER_DIRECTORY, "file");
+  auto data = file_data(WRITE_BACK_THRESHOLD);
+  for (uint64_t offset = 0; offset < data.size(); offset += PART_SIZE)
+    ASSERT_TRUE(write(*fs, node, data.substr(offset, PART_SIZE), offset));
+  EXPECT_EQ(storage.streams_, 1);
+  ASSERT_TRUE(write(*fs, node, "rewritten", 0));
+  data.replace(0, 9, "rewritten");
+  ASSERT_TRUE(fsync(*fs, node));
+  EXPECT_EQ(storage.streams_, 1);
+  EXPECT_EQ(storage.uploads_, 1);
+  EXPECT_EQ(storage.file("file"), data);
+}
@@ -0,0 +1,154 @@
+/*****************************************************************************
+ * ReadCacheTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ReadCache.h"
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t BLOCK = ReadCache::BlockSize;
+
+std::string file_data(uint64_t size, char first = 'a') {
+  std::string data(size, 0);
+  for (uint64_t i = 0; i < size; i++) data[i] = first + i % 26;
+  return data;
+}
+
+// fresh cache directory, removed with its content
+class Directory {
+ public:
+  Directory() {
+    std::string pattern = util::temporary_directory() + "read-cache-XXXXXX";
+    path_ = mkdtemp(&pattern[0]) ? pattern + "/" : "";
+  }
+
+  ~Directory() {
+    if (!path_.empty())
+      (void)std::system(("rm -rf \"" + path_ + "\"").c_str());
+  }
+
+  std::string path_;
+};
+
+std::string get(ReadCache& cache, const std::string& key, uint64_t offset,
+                uint64_t length) {
+  ReadCache::Buffer buffer;
+  if (!cache.get(key, offset, length, buffer)) return "";
+  return std::string(buffer.data(), buffer.size());
+}
+
+}  // namespace
+
+TEST(ReadCacheTest, StoresBlocksCoveredByData) {
+  Directory directory;
+  ReadCache cache(directory.path_, 16 * BLOCK);
+  ASSERT_TRUE(cache.enabled());
+  auto data = file_data(2 * BLOCK + 123);
+  // a part of the first block only: nothing is stored
+  EXPECT_FALSE(cache.put("file", data.size(), 0, data.data(), BLOCK - 1));
+  EXPECT_FALSE(cache.contains("file", 0, 1));
+  EXPECT_TRUE(cache.put("file", data.size(), 0, data.data(), data.size()));
+  EXPECT_TRUE(cache.contains("file", 0, data.size()));
+  EXPECT_EQ(get(cache, "file", 0, data.size()), data);
+  EXPECT_EQ(get(cache, "file", BLOCK - 10, 20), data.substr(BLOCK - 10, 20));
+  EXPECT_EQ(get(cache, "file", 2 * BLOCK, 123), data.substr(2 * BLOCK));
+}
+
+TEST(ReadCacheTest, RejectsDataWhenDisabled) {
+  Directory directory;
+  ReadCache cache(directory.path_, 0);
+  EXPECT_FALSE(cache.enabled());
+  auto data = file_data(BLOCK);
+  EXPECT_FALSE(cache.put("file", data.size(), 0, data.data(), data.size()));
+  EXPECT_FALSE(cache.contains("file", 0, data.size()));
+  ReadCache enabled(directory.path_, BLOCK);
+  EXPECT_FALSE(enabled.put("", data.size(), 0, data.data(), data.size()));
+}
+
+TEST(ReadCacheTest, SurvivesRestart) {
+  Directory directory;
+  auto data = file_data(3 * BLOCK);
+  {
+    ReadCache cache(directory.path_, 16 * BLOCK);
+    ASSERT_TRUE(cache.put("file", data.size(), BLOCK, data.data() + BLOCK,
+                          2 * BLOCK));
+  }
+  ReadCache cache(directory.path_, 16 * BLOCK);
+  EXPECT_FALSE(cache.contains("file", 0, BLOCK));
+  EXPECT_TRUE(cache.contains("file", BLOCK, 2 * BLOCK));
+  EXPECT_EQ(get(cache, "file", BLOCK, 2 * BLOCK), data.substr(BLOCK));
+}
+
+TEST(ReadCacheTest, EvictsLeastRecentlyUsedBlocks) {
+  Directory directory;
+  auto first = file_data(2 * BLOCK, 'a'), second = file_data(BLOCK, 'b');
+  {
+    ReadCache cache(directory.path_, 2 * BLOCK);
+    ASSERT_TRUE(cache.put("first", first.size(), 0, first.data(), BLOCK));
+    ASSERT_TRUE(cache.put("first", first.size(), BLOCK, first.data() + BLOCK,
+                          BLOCK));
+    // first block of "first" becomes the most recently used one
+    EXPECT_EQ(get(cache, "first", 0, BLOCK), first.substr(0, BLOCK));
+    ASSERT_TRUE(cache.put("second", second.size(), 0, second.data(), BLOCK));
+    EXPECT_TRUE(cache.contains("first", 0, BLOCK));
+    EXPECT_FALSE(cache.contains("first", BLOCK, BLOCK));
+    EXPECT_TRUE(cache.contains("second", 0, BLOCK));
+  }
+  // the index of the evicted block was rewritten
+  ReadCache cache(directory.path_, 2 * BLOCK);
+  EXPECT_EQ(get(cache, "first", 0, BLOCK), first.substr(0, BLOCK));
+  EXPECT_FALSE(cache.contains("first", BLOCK, BLOCK));
+  EXPECT_EQ(get(cache, "second", 0, BLOCK), second);
+}
+
+TEST(ReadCacheTest, StoresFilesFromManyThreads) {
+  Directory directory;
+  const int count = 8;
+  ReadCache cache(directory.path_, 4 * BLOCK);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < count; i++)
+    threads.emplace_back([&, i] {
+      auto data = file_data(BLOCK, 'a' + i);
+      for (int j = 0; j < 4; j++)
+        cache.put(std::to_string(i), data.size(), 0, data.data(), BLOCK);
+    });
+  for (auto&& t : threads) t.join();
+  int cached = 0;
+  for (int i = 0; i < count; i++) {
+    auto data = get(cache, std::to_string(i), 0, BLOCK);
+    if (data.empty()) continue;
+    EXPECT_EQ(data, file_data(BLOCK, 'a' + i));
+    cached++;
+  }
+  EXPECT_GE(cached, 1);
+  EXPECT_LE(cached, 4);
+}
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * ListChangesRequestTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <map>
+
+#include "Request/ListChangesRequest.h"
+#include "Utility/FakeProvider.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+std::shared_ptr<TreeProvider> provider() {
+  auto p = make_provider<TreeProvider>(ICloudProvider::InitData());
+  p->set("/a", 0, true);
+  p->set("/a/1", 1);
+  p->set("/a/2", 2);
+  p->set("/b", 3);
+  return p;
+}
+
+EitherError<ChangeSet> changes(ICloudProvider& p, const std::string& cursor) {
+  return p.listChangesAsync(cursor)->result();
+}
+
+std::map<std::string, IItem::Pointer> by_id(const ChangeSet& changes) {
+  std::map<std::string, IItem::Pointer> result;
+  for (auto&& c : changes.changes_) result[c.id_] = c.item_;
+  return result;
+}
+
+}  // namespace
+
+TEST(ListChangesRequestTest, EmptyCursorReturnsCurrentPosition) {
+  auto p = provider();
+  auto result = changes(*p, "");
+  ASSERT_NE(result.right(), nullptr);
+  EXPECT_TRUE(result.right()->changes_.empty());
+  EXPECT_FALSE(result.right()->cursor_.empty());
+  result = changes(*p, result.right()->cursor_);
+  ASSERT_NE(result.right(), nullptr);
+  EXPECT_TRUE(result.right()->changes_.empty());
+}
+
+TEST(ListChangesRequestTest, ReportsCreatedModifiedAndRemovedItems) {
+  auto p = provider();
+  auto cursor = changes(*p, "").right()->cursor_;
+  p->set("/a/3", 3);
+  p->set("/a/1", 10);
+  p->remove("/b");
+  auto result = changes(*p, cursor);
+  ASSERT_NE(result.right(), nullptr);
+  auto changed = by_id(*result.right());
+  ASSERT_EQ(changed.size(), 3u);
+  ASSERT_NE(changed["/a/3"], nullptr);
+  ASSERT_NE(changed["/a/1"], nullptr);
+  EXPECT_EQ(changed["/a/1"]->size(), 10u);
+  ASSERT_EQ(changed.count("/b"), 1u);
+  EXPECT_EQ(changed["/b"], nullptr);
+  EXPECT_NE(result.right()->cursor_, cursor);
+}
+
+TEST(ListChangesRequestTest, OldCursorExpires) {
+  auto p = provider();
+  auto first = changes(*p, "").right()->cursor_;
+  ASSERT_NE(changes(*p, first).right(), nullptr);
+  auto result = changes(*p, first);
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->code_, static_cast<int>(IHttpRequest::Bad));
+  EXPECT_EQ(result.left()->description_, util::Error::CHANGE_CURSOR_EXPIRED);
+}
+
+TEST(ListChangesRequestTest, ReportsMovedItems) {
+  auto p = provider();
+  p->set("/c", 0, true);
+  auto cursor = changes(*p, "").right()->cursor_;
+  p->move("/a/1", "/c");
+  auto result = changes(*p, cursor);
+  ASSERT_NE(result.right(), nullptr);
+  auto changed = by_id(*result.right());
+  ASSERT_EQ(changed.size(), 1u);
+  ASSERT_NE(changed["/a/1"], nullptr);
+  EXPECT_EQ(changed["/a/1"]->size(), 1u);
+}
@@ -0,0 +1,230 @@
+/*****************************************************************************
+ * ListDirectoryRequestTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "Request/ListDirectoryRequest.h"
+#include "Utility/FakeProvider.h"
+#include "Utility/Item.h"
+#include "Utility/ThreadPool.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const int ITEM_COUNT = 100;
+const int PAGE_SIZE = 10;
+const auto LATENCY = std::chrono::milliseconds(10);
+
+// directory with ITEM_COUNT items named "0", "1", ...; page tokens are
+// offsets, prefixed with "cursor" if offset_tokens is false; every page fetch
+// takes LATENCY
+class PagedProvider : public CloudProvider {
+ public:
+  PagedProvider(bool offset_tokens)
+      : CloudProvider(util::make_unique<FakeAuth>()),
+        offset_tokens_(offset_tokens),
+        first_page_size_(PAGE_SIZE),
+        page_size_(PAGE_SIZE),
+        failing_offset_(-1),
+        requested_(),
+        in_flight_(),
+        max_in_flight_(),
+        pool_(8) {}
+
+  std::string name() const override { return "paged"; }
+  std::string endpoint() const override { return ""; }
+
+  IItem::Pointer rootDirectory() const override {
+    return std::make_shared<Item>("/", "", IItem::UnknownSize,
+                                  IItem::UnknownTimeStamp,
+                                  IItem::FileType::Directory);
+  }
+
+  bool listDirectoryOffsetTokens() const override { return offset_tokens_; }
+
+  ListDirectoryPageRequest::Pointer listDirectoryPageAsync(
+      IItem::Pointer, const std::string& token,
+      ListDirectoryPageCallback callback) override {
+    requested_++;
+    auto resolver = [=](Request<EitherError<PageData>>::Pointer r) {
+      pool_.schedule([=] {
+        int current = ++in_flight_;
+        int max = max_in_flight_;
+        while (current > max &&
+               !max_in_flight_.compare_exchange_weak(max, current))
+          ;
+        std::this_thread::sleep_for(LATENCY);
+        in_flight_--;
+        auto offset = std::stoi(token.empty() ? "0" : token.substr(prefix()));
+        if (offset == failing_offset_)
+          return r->done(Error{IHttpRequest::Failure, "page failed"});
+        PageData page;
+        auto size = offset == 0 ? first_page_size_ : page_size_;
+        for (int i = offset; i < std::min(offset + size, ITEM_COUNT); i++)
+          page.items_.push_back(std::make_shared<Item>(
+              std::to_string(i), std::to_string(i), 0, IItem::UnknownTimeStamp,
+              IItem::FileType::Unknown));
+        if (offset + size < ITEM_COUNT)
+          page.next_token_ = (offset_tokens_ ? "" : "cursor") +
+                             std::to_string(offset + size);
+        r->done(page);
+      });
+    };
+    return std::make_shared<Request<EitherError<PageData>>>(
+               shared_from_this(), callback, resolver)
+        ->run();
+  }
+
+  size_t prefix() const { return offset_tokens_ ? 0 : strlen("cursor"); }
+
+  bool offset_tokens_;
+  int first_page_size_;
+  int page_size_;
+  int failing_offset_;
+  std::atomic_int requested_;
+  std::atomic_int in_flight_;
+  std::atomic_int max_in_flight_;
+  ThreadPool pool_;
+};
+
+std::shared_ptr<PagedProvider> provider(bool offset_tokens,
+                                        uint32_t parallelism) {
+  ICloudProvider::InitData data;
+  data.hints_["list_directory_parallelism"] = std::to_string(parallelism);
+  return make_provider<PagedProvider>(std::move(data), offset_tokens);
+}
+
+class Listing : public IListDirectoryCallback {
+ public:
+  Listing(PagedProvider& p, bool collect, std::chrono::milliseconds delay =
+                                              std::chrono::milliseconds(0))
+      : provider_(p), collect_(collect), delay_(delay), overlapped_(true) {}
+
+  void receivedItem(IItem::Pointer item) override {
+    auto index = static_cast<int>(received_.size());
+    if (index % PAGE_SIZE == 0) {
+      // next page is requested before items of the current one are passed
+      if (index + PAGE_SIZE < ITEM_COUNT &&
+          provider_.requested_ < index / PAGE_SIZE + 2)
+        overlapped_ = false;
+      std::this_thread::sleep_for(delay_);
+    }
+    received_.push_back(item->id());
+  }
+
+  void done(EitherError<IItem::List> e) override { result_ = e; }
+
+  bool collectItems() override { return collect_; }
+
+  PagedProvider& provider_;
+  bool collect_;
+  std::chrono::milliseconds delay_;
+  bool overlapped_;
+  std::vector<std::string> received_;
+  EitherError<IItem::List> result_;
+};
+
+void list(PagedProvider& p, std::shared_ptr<Listing> listing) {
+  p.listDirectoryAsync(p.rootDirectory(), listing)->finish();
+}
+
+bool in_order(const std::vector<std::string>& ids) {
+  if (ids.size() != static_cast<size_t>(ITEM_COUNT)) return false;
+  for (int i = 0; i < ITEM_COUNT; i++)
+    if (ids[i] != std::to_string(i)) return false;
+  return true;
+}
+
+// returns seconds it took to list the directory
+double list_time(uint32_t parallelism) {
+  auto p = provider(true, parallelism);
+  auto listing = std::make_shared<Listing>(*p, true);
+  auto start = std::chrono::steady_clock::now();
+  list(*p, listing);
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  EXPECT_NE(listing->result_.right(), nullptr);
+  EXPECT_TRUE(in_order(listing->received_));
+  return time.count();
+}
+
+}  // namespace
+
+TEST(ListDirectoryRequestTest, FetchesOffsetPagesConcurrently) {
+  auto sequential = list_time(1);
+  auto parallel = list_time(4);
+  util::log("listed", ITEM_COUNT / PAGE_SIZE, "pages one at a time in",
+            sequential, "s, four at once in", parallel, "s");
+  EXPECT_LT(parallel, sequential / 2);
+}
+
+TEST(ListDirectoryRequestTest, CollectsItemsInOrder) {
+  auto p = provider(true, 4);
+  auto listing = std::make_shared<Listing>(*p, true);
+  list(*p, listing);
+  ASSERT_NE(listing->result_.right(), nullptr);
+  EXPECT_TRUE(in_order(listing->received_));
+  std::vector<std::string> ids;
+  for (auto&& i : *listing->result_.right()) ids.push_back(i->id());
+  EXPECT_EQ(ids, listing->received_);
+  EXPECT_LE(p->max_in_flight_, 4);
+  EXPECT_LE(p->requested_, ITEM_COUNT / PAGE_SIZE + 4);
+}
+
+TEST(ListDirectoryRequestTest, StreamsWithoutCollecting) {
+  auto p = provider(false, 4);
+  auto listing = std::make_shared<Listing>(*p, false, LATENCY);
+  list(*p, listing);
+  ASSERT_NE(listing->result_.right(), nullptr);
+  EXPECT_TRUE(listing->result_.right()->empty());
+  EXPECT_TRUE(in_order(listing->received_));
+  EXPECT_TRUE(listing->overlapped_);
+  EXPECT_EQ(p->max_in_flight_, 1);
+  EXPECT_EQ(p->requested_, ITEM_COUNT / PAGE_SIZE);
+}
+
+TEST(ListDirectoryRequestTest, FallsBackOnMispredictedTokens) {
+  auto p = provider(true, 4);
+  p->page_size_ = 7;
+  auto listing = std::make_shared<Listing>(*p, true);
+  list(*p, listing);
+  ASSERT_NE(listing->result_.right(), nullptr);
+  EXPECT_TRUE(in_order(listing->received_));
+  EXPECT_EQ(listing->result_.right()->size(), static_cast<size_t>(ITEM_COUNT));
+}
+
+TEST(ListDirectoryRequestTest, StopsOnFailedPage) {
+  auto p = provider(true, 4);
+  p->failing_offset_ = 3 * PAGE_SIZE;
+  auto listing = std::make_shared<Listing>(*p, true);
+  list(*p, listing);
+  ASSERT_NE(listing->result_.left(), nullptr);
+  EXPECT_EQ(listing->result_.left()->description_, "page failed");
+  EXPECT_EQ(listing->received_.size(), static_cast<size_t>(3 * PAGE_SIZE));
+}
@@ -0,0 +1,154 @@
+/*****************************************************************************
+ * RecursiveRequestTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "Request/RecursiveRequest.h"
+#include "Utility/FakeProvider.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const int TREE_WIDTH = 4;
+const int TREE_DEPTH = 3;
+const int TREE_SIZE = 1 + 4 + 16 + 64;
+const auto LATENCY = std::chrono::milliseconds(5);
+const uint32_t WORKER_COUNT = 16;
+const uint32_t MAX_IN_FLIGHT = 8;
+
+std::shared_ptr<TreeProvider> provider() {
+  // directories at depth lower than TREE_DEPTH contain TREE_WIDTH items
+  auto p = make_provider<TreeProvider>(ICloudProvider::InitData(), LATENCY,
+                                       WORKER_COUNT);
+  p->grow("", TREE_WIDTH, TREE_DEPTH);
+  return p;
+}
+
+using Walk = RecursiveRequest<EitherError<void>>;
+
+// visits the tree, every visit takes LATENCY; failing item's visit fails
+struct Visits {
+  std::mutex mutex_;
+  std::map<std::string, int> order_;
+  std::atomic_bool done_{false};
+  std::atomic_int after_done_{0};
+  std::string failing_;
+
+  Walk::Visitor visitor(TreeProvider& p) {
+    return [=, &p](Walk::Pointer, IItem::Pointer item, IItem::Pointer,
+                   Walk::CompleteCallback complete) {
+      if (done_) after_done_++;
+      p.pool_.schedule([=] {
+        std::this_thread::sleep_for(LATENCY);
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          order_[item->id()] = order_.size();
+        }
+        if (!failing_.empty() && item->id() == failing_)
+          complete(Error{IHttpRequest::Failure, "visit failed"});
+        else
+          complete(nullptr);
+      });
+    };
+  }
+};
+
+EitherError<void> walk(std::shared_ptr<TreeProvider> p, Visits& visits,
+                       uint32_t max_in_flight) {
+  auto r = std::make_shared<Walk>(
+      p, p->rootDirectory(), [&](EitherError<void>) { visits.done_ = true; },
+      visits.visitor(*p), max_in_flight);
+  return r->run()->result();
+}
+
+// returns seconds it took to walk the tree
+double walk_time(uint32_t max_in_flight) {
+  auto p = provider();
+  Visits visits;
+  auto start = std::chrono::steady_clock::now();
+  auto result = walk(p, visits, max_in_flight);
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(result.left(), nullptr);
+  EXPECT_EQ(visits.order_.size(), static_cast<size_t>(TREE_SIZE));
+  return time.count();
+}
+
+}  // namespace
+
+TEST(RecursiveRequestTest, VisitsChildrenBeforeParents) {
+  auto p = provider();
+  Visits visits;
+  ASSERT_EQ(walk(p, visits, MAX_IN_FLIGHT).left(), nullptr);
+  ASSERT_EQ(visits.order_.size(), static_cast<size_t>(TREE_SIZE));
+  for (auto&& v : visits.order_) {
+    if (v.first.empty()) continue;
+    auto parent = v.first.substr(0, v.first.find_last_of('/'));
+    EXPECT_LT(v.second, visits.order_[parent]) << v.first;
+  }
+}
+
+TEST(RecursiveRequestTest, WalksSiblingsConcurrently) {
+  auto serial = walk_time(1);
+  auto parallel = walk_time(MAX_IN_FLIGHT);
+  util::log("walked", TREE_SIZE, "items one at a time in", serial, "s,",
+            MAX_IN_FLIGHT, "at a time in", parallel, "s");
+  EXPECT_LT(parallel, serial / 2);
+}
+
+TEST(RecursiveRequestTest, StopsOnFirstError) {
+  auto p = provider();
+  Visits visits;
+  visits.failing_ = "/0/1/2";
+  auto result = walk(p, visits, MAX_IN_FLIGHT);
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->description_, "visit failed");
+  EXPECT_LT(visits.order_.size(), static_cast<size_t>(TREE_SIZE));
+  EXPECT_EQ(visits.after_done_, 0);
+}
+
+TEST(RecursiveRequestTest, StopsWhenCancelled) {
+  auto p = provider();
+  Visits visits;
+  EitherError<void> result;
+  auto r = std::make_shared<Walk>(
+      p, p->rootDirectory(),
+      [&](EitherError<void> e) {
+        result = e;
+        visits.done_ = true;
+      },
+      visits.visitor(*p), MAX_IN_FLIGHT);
+  auto wrapper = r->run();
+  std::this_thread::sleep_for(4 * LATENCY);
+  wrapper->cancel();
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->code_, static_cast<int>(IHttpRequest::Aborted));
+  EXPECT_LT(visits.order_.size(), static_cast<size_t>(TREE_SIZE));
+  EXPECT_EQ(visits.after_done_, 0);
+}
@@ -0,0 +1,530 @@
+/*****************************************************************************
+ * UploadFileRequestTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "Request/UploadFileRequest.h"
+#include "Utility/FakeHttp.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t PART_SIZE = 64 * 1024;
+const uint64_t PART_COUNT = 16;
+const uint64_t FILE_SIZE = PART_SIZE * PART_COUNT - 123;
+const auto PART_LATENCY = std::chrono::milliseconds(20);
+
+// remote side of chunked uploads
+class Storage {
+ public:
+  Storage()
+      : sessions_(),
+        commits_(),
+        aborted_size_(),
+        server_(this, PART_COUNT, std::chrono::milliseconds(0)) {}
+
+  IHttpRequest::Response handle(const std::string& url, const std::string&,
+                                const IHttpRequest::GetParameters& parameters,
+                                const IHttpRequest::HeaderParameters&,
+                                std::istream& body,
+                                std::shared_ptr<std::ostream> output,
+                                std::shared_ptr<std::ostream> error) {
+    if (url == "part") std::this_thread::sleep_for(PART_LATENCY);
+    std::stringstream data;
+    data << body.rdbuf();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (url == "start") {
+      *output << "session" << ++sessions_;
+    } else if (url == "part") {
+      auto part = std::stoull(parameters.at("part"));
+      requests_[part]++;
+      auto it = failures_.find(part);
+      if (it != failures_.end() && it->second > 0) {
+        it->second--;
+        *error << "part failed";
+        return {IHttpRequest::ServiceUnavailable, {}, output, error};
+      }
+      parts_[part] = data.str();
+      *output << "tag" << part;
+    } else if (url == "commit") {
+      commits_++;
+      std::string content;
+      for (auto&& p : parts_) content += p.second;
+      content_ = content;
+      *output << data.str();
+    } else if (url == "abort") {
+      aborted_.push_back(parameters.at("session"));
+      aborted_size_ = std::stoull(parameters.at("size"));
+    }
+    return {IHttpRequest::Ok, {}, output, error};
+  }
+
+  std::mutex mutex_;
+  int sessions_;
+  int commits_;
+  std::map<uint64_t, int> requests_;
+  std::map<uint64_t, int> failures_;
+  std::map<uint64_t, std::string> parts_;
+  std::vector<std::string> aborted_;
+  uint64_t aborted_size_;
+  std::string content_;
+  FakeServer server_;
+};
+
+class ChunkedProvider : public CloudProvider {
+ public:
+  ChunkedProvider() : CloudProvider(util::make_unique<FakeAuth>()) {}
+
+  bool streaming_ = false;
+  bool last_part_after_others_ = false;
+  uint64_t max_part_count_ = 0;
+  // parts uploaded before the last one was started
+  mutable std::atomic<int> uploaded_{0};
+  mutable std::atomic<int> uploaded_before_last_{-1};
+
+  std::string name() const override { return "chunked"; }
+  std::string endpoint() const override { return ""; }
+
+  uint64_t uploadSessionPartSize() const override { return PART_SIZE; }
+
+  uint64_t uploadSessionMaxPartCount() const override {
+    return max_part_count_;
+  }
+
+  bool uploadSessionStreaming() const override { return streaming_; }
+
+  bool uploadSessionLastPartAfterOthers() const override {
+    return last_part_after_others_;
+  }
+
+  IHttpRequest::Pointer uploadSessionStartRequest(
+      const IItem&, const std::string&, uint64_t,
+      std::ostream&) const override {
+    return http()->create("start");
+  }
+
+  IHttpRequest::Pointer uploadPartRequest(const IItem&, const std::string&,
+                                          const UploadSession& session,
+                                          uint64_t part, std::ostream&,
+                                          std::ostream&) const override {
+    if (part + 1 == session.part_count())
+      uploaded_before_last_ = uploaded_.load();
+    auto request = http()->create("part");
+    request->setParameter("session", session.id_);
+    request->setParameter("part", std::to_string(part));
+    return request;
+  }
+
+  IHttpRequest::Pointer uploadSessionCommitRequest(
+      const IItem&, const std::string&, const UploadSession& session,
+      std::ostream& input) const override {
+    for (auto&& tag : session.parts_) input << tag << " ";
+    return http()->create("commit");
+  }
+
+  IHttpRequest::Pointer uploadSessionAbortRequest(
+      const IItem&, const std::string&, const UploadSession& session,
+      std::ostream&) const override {
+    auto request = http()->create("abort");
+    request->setParameter("session", session.id_);
+    request->setParameter("size", std::to_string(session.size_));
+    return request;
+  }
+
+  std::string uploadSessionStartResponse(
+      const IHttpRequest::HeaderParameters&,
+      std::istream& response) const override {
+    std::string id;
+    response >> id;
+    return id;
+  }
+
+  std::string uploadPartResponse(const UploadSession&, uint64_t,
+                                 const IHttpRequest::HeaderParameters&,
+                                 std::istream& response) const override {
+    uploaded_++;
+    std::string tag;
+    response >> tag;
+    return tag;
+  }
+
+  IItem::Pointer uploadSessionCommitResponse(
+      const IItem&, const std::string& filename, const UploadSession& session,
+      std::istream&) const override {
+    return std::make_shared<Item>(filename, filename, session.size_,
+                                  IItem::UnknownTimeStamp,
+                                  IItem::FileType::Unknown);
+  }
+};
+
+// file of unknown size, written one part at a time
+class StreamedData : public IUploadFileCallback {
+ public:
+  StreamedData() : closed_() {}
+
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto size = std::min<uint64_t>(maxlength, data_.size() - offset);
+    std::copy(data_.begin() + offset, data_.begin() + offset + size, data);
+    return size;
+  }
+
+  uint64_t size() override { return IItem::UnknownSize; }
+
+  void waitData(uint64_t offset, uint64_t length,
+                std::function<void(EitherError<uint64_t>)> ready) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      waiting_.push_back({offset, length, ready});
+    }
+    notify();
+  }
+
+  void write(const std::string& data) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      data_ += data;
+    }
+    notify();
+  }
+
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    notify();
+  }
+
+  void done(EitherError<IItem>) override {}
+
+  void progress(uint64_t, uint64_t) override {}
+
+ private:
+  struct Wait {
+    uint64_t offset_;
+    uint64_t length_;
+    std::function<void(EitherError<uint64_t>)> ready_;
+  };
+
+  void notify() {
+    std::vector<std::pair<Wait, uint64_t>> ready;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto it = waiting_.begin(); it != waiting_.end();) {
+        if (closed_ || data_.size() >= it->offset_ + it->length_) {
+          auto end = std::min<uint64_t>(data_.size(), it->offset_ + it->length_);
+          ready.push_back({*it, end - std::min(end, it->offset_)});
+          it = waiting_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+    for (auto&& r : ready) r.first.ready_(r.second);
+  }
+
+  std::mutex mutex_;
+  std::string data_;
+  std::vector<Wait> waiting_;
+  bool closed_;
+};
+
+std::shared_ptr<ChunkedProvider> provider(
+    Storage& storage, uint32_t parallelism,
+    const std::string& token = "token") {
+  ICloudProvider::InitData data;
+  data.token_ = token;
+  data.http_engine_ = util::make_unique<FakeHttp>(storage.server_);
+  data.hints_["upload_parallelism"] = std::to_string(parallelism);
+  return make_provider<ChunkedProvider>(std::move(data));
+}
+
+EitherError<IItem> upload(ICloudProvider& p, const std::string& data) {
+  return p
+      .uploadFileAsync(p.rootDirectory(), "file",
+                       std::make_shared<UploadData>(data))
+      ->result();
+}
+
+// returns seconds it took to upload the file
+double upload_time(uint32_t parallelism) {
+  Storage storage;
+  auto p = provider(storage, parallelism);
+  auto data = file_data(FILE_SIZE);
+  auto start = std::chrono::steady_clock::now();
+  auto result = upload(*p, data);
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  EXPECT_EQ(result.left(), nullptr);
+  EXPECT_EQ(storage.content_, data);
+  return time.count();
+}
+
+}  // namespace
+
+TEST(UploadFileRequestTest, UploadsPartsConcurrently) {
+  auto sequential = upload_time(1);
+  auto parallel = upload_time(4);
+  util::log("uploaded", PART_COUNT, "parts sequentially in", sequential,
+            "s, four at once in", parallel, "s");
+  EXPECT_LT(parallel, sequential);
+}
+
+TEST(UploadFileRequestTest, RetriesOnlyFailedParts) {
+  Storage storage;
+  storage.failures_[3] = 2;
+  auto p = provider(storage, 4);
+  auto data = file_data(FILE_SIZE);
+  auto result = upload(*p, data);
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(storage.content_, data);
+  EXPECT_EQ(storage.sessions_, 1);
+  for (uint64_t i = 0; i < PART_COUNT; i++)
+    EXPECT_EQ(storage.requests_[i], i == 3 ? 3 : 1);
+}
+
+TEST(UploadFileRequestTest, UploadsLastPartAfterOthers) {
+  Storage storage;
+  storage.failures_[2] = 1;
+  auto p = provider(storage, 4);
+  p->last_part_after_others_ = true;
+  auto data = file_data(FILE_SIZE);
+  auto result = upload(*p, data);
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(storage.content_, data);
+  EXPECT_EQ(p->uploaded_before_last_, static_cast<int>(PART_COUNT - 1));
+}
+
+TEST(UploadFileRequestTest, ResumesFromCheckpoint) {
+  Storage storage;
+  storage.failures_[5] = 100;
+  auto data = file_data(FILE_SIZE);
+  {
+    auto p = provider(storage, 4);
+    ASSERT_NE(upload(*p, data).left(), nullptr);
+  }
+  EXPECT_EQ(storage.commits_, 0);
+  storage.failures_.clear();
+  storage.requests_.clear();
+  {
+    auto p = provider(storage, 4);
+    auto result = upload(*p, data);
+    ASSERT_EQ(result.left(), nullptr);
+  }
+  EXPECT_EQ(storage.content_, data);
+  EXPECT_EQ(storage.sessions_, 1);
+  EXPECT_EQ(storage.requests_.size(), 1u);
+  EXPECT_EQ(storage.requests_[5], 1);
+  {
+    // checkpoint is removed after the upload was committed
+    storage.requests_.clear();
+    auto p = provider(storage, 4);
+    ASSERT_EQ(upload(*p, data).left(), nullptr);
+    EXPECT_EQ(storage.sessions_, 2);
+    EXPECT_EQ(storage.requests_.size(), PART_COUNT);
+  }
+}
+
+TEST(UploadFileRequestTest, DoesNotResumeChangedFile) {
+  Storage storage;
+  storage.failures_[5] = 100;
+  auto data = file_data(FILE_SIZE);
+  {
+    auto p = provider(storage, 4);
+    ASSERT_NE(upload(*p, data).left(), nullptr);
+  }
+  storage.failures_.clear();
+  storage.requests_.clear();
+  data[0] = 'z';
+  auto p = provider(storage, 4);
+  ASSERT_EQ(upload(*p, data).left(), nullptr);
+  EXPECT_EQ(storage.sessions_, 2);
+  EXPECT_EQ(storage.requests_.size(), PART_COUNT);
+  EXPECT_EQ(storage.content_, data);
+}
+
+TEST(UploadFileRequestTest, DoesNotResumeOtherAccountsUpload) {
+  Storage storage;
+  storage.failures_[5] = 100;
+  auto data = file_data(FILE_SIZE);
+  {
+    auto p = provider(storage, 4, "first");
+    ASSERT_NE(upload(*p, data).left(), nullptr);
+  }
+  storage.failures_.clear();
+  storage.requests_.clear();
+  {
+    auto p = provider(storage, 4, "second");
+    ASSERT_EQ(upload(*p, data).left(), nullptr);
+    EXPECT_EQ(storage.sessions_, 2);
+    EXPECT_EQ(storage.requests_.size(), PART_COUNT);
+  }
+  storage.requests_.clear();
+  auto p = provider(storage, 4, "first");
+  ASSERT_EQ(upload(*p, data).left(), nullptr);
+  EXPECT_EQ(storage.sessions_, 2);
+  EXPECT_EQ(storage.requests_.size(), 1u);
+  EXPECT_EQ(storage.content_, data);
+}
+
+TEST(UploadFileRequestTest, DoesNotShareCheckpointBetweenRunningUploads) {
+  Storage storage;
+  auto p = provider(storage, 4);
+  auto data = file_data(FILE_SIZE);
+  auto first = p->uploadFileAsync(p->rootDirectory(), "file",
+                                  std::make_shared<UploadData>(data));
+  auto second = p->uploadFileAsync(p->rootDirectory(), "file",
+                                   std::make_shared<UploadData>(data));
+  ASSERT_EQ(first->result().left(), nullptr);
+  ASSERT_EQ(second->result().left(), nullptr);
+  EXPECT_EQ(storage.sessions_, 2);
+  EXPECT_EQ(storage.commits_, 2);
+  for (uint64_t i = 0; i < PART_COUNT; i++) EXPECT_EQ(storage.requests_[i], 2);
+  // neither upload left a checkpoint behind
+  storage.requests_.clear();
+  ASSERT_EQ(upload(*p, data).left(), nullptr);
+  EXPECT_EQ(storage.sessions_, 3);
+  EXPECT_EQ(storage.requests_.size(), PART_COUNT);
+}
+
+TEST(UploadFileRequestTest, StreamsFileOfUnknownSize) {
+  Storage storage;
+  auto p = provider(storage, 4);
+  std::static_pointer_cast<ChunkedProvider>(p)->streaming_ = true;
+  auto data = file_data(FILE_SIZE);
+  auto callback = std::make_shared<StreamedData>();
+  auto request = p->uploadFileAsync(p->rootDirectory(), "file", callback);
+  for (uint64_t i = 0; i < PART_COUNT; i++) {
+    callback->write(data.substr(i * PART_SIZE, PART_SIZE));
+    std::this_thread::sleep_for(PART_LATENCY);
+  }
+  {
+    // parts were uploaded while the file was being written
+    std::lock_guard<std::mutex> lock(storage.mutex_);
+    EXPECT_GE(storage.parts_.size(), PART_COUNT / 2);
+  }
+  callback->close();
+  auto result = request->result();
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(result.right()->size(), FILE_SIZE);
+  EXPECT_EQ(storage.content_, data);
+  EXPECT_EQ(storage.parts_.size(), PART_COUNT);
+}
+
+TEST(UploadFileRequestTest, FailsOnUnknownSizeWithoutStreaming) {
+  Storage storage;
+  auto p = provider(storage, 4);
+  auto result = p->uploadFileAsync(p->rootDirectory(), "file",
+                                   std::make_shared<StreamedData>())
+                    ->result();
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->code_,
+            static_cast<int>(IHttpRequest::ServiceUnavailable));
+  EXPECT_EQ(storage.sessions_, 0);
+}
+
+TEST(UploadFileRequestTest, AbortsSessionWhenCancelled) {
+  Storage storage;
+  auto data = file_data(FILE_SIZE);
+  {
+    auto p = provider(storage, 1);
+    auto request = p->uploadFileAsync(p->rootDirectory(), "file",
+                                      std::make_shared<UploadData>(data));
+    std::this_thread::sleep_for(3 * PART_LATENCY);
+    request->cancel();
+    auto result = request->result();
+    ASSERT_NE(result.left(), nullptr);
+    EXPECT_EQ(result.left()->code_, static_cast<int>(IHttpRequest::Aborted));
+  }
+  std::this_thread::sleep_for(PART_LATENCY);
+  {
+    std::lock_guard<std::mutex> lock(storage.mutex_);
+    EXPECT_EQ(storage.commits_, 0);
+    ASSERT_EQ(storage.aborted_.size(), 1u);
+    EXPECT_EQ(storage.aborted_[0], "session1");
+  }
+  // cancelled upload isn't resumed
+  auto p = provider(storage, 4);
+  ASSERT_EQ(upload(*p, data).left(), nullptr);
+  EXPECT_EQ(storage.sessions_, 2);
+  EXPECT_EQ(storage.content_, data);
+}
+
+TEST(UploadFileRequestTest, GrowsPartsToStayWithinPartLimit) {
+  Storage storage;
+  auto p = provider(storage, 4);
+  p->max_part_count_ = 5;
+  auto data = file_data(FILE_SIZE);
+  auto result = upload(*p, data);
+  ASSERT_EQ(result.left(), nullptr);
+  EXPECT_EQ(storage.content_, data);
+  EXPECT_EQ(storage.parts_.size(), 5u);
+}
+
+TEST(UploadFileRequestTest, FailsStreamExceedingPartLimit) {
+  Storage storage;
+  auto p = provider(storage, 4);
+  p->streaming_ = true;
+  p->max_part_count_ = 2;
+  auto callback = std::make_shared<StreamedData>();
+  auto request = p->uploadFileAsync(p->rootDirectory(), "file", callback);
+  callback->write(file_data(3 * PART_SIZE));
+  callback->close();
+  auto result = request->result();
+  ASSERT_NE(result.left(), nullptr);
+  EXPECT_EQ(result.left()->description_, util::Error::UPLOAD_TOO_LARGE);
+  EXPECT_EQ(storage.commits_, 0);
+}
+
+TEST(UploadFileRequestTest, AbortsStreamedSessionWithUploadedParts) {
+  Storage storage;
+  {
+    auto p = provider(storage, 4);
+    p->streaming_ = true;
+    auto callback = std::make_shared<StreamedData>();
+    auto request = p->uploadFileAsync(p->rootDirectory(), "file", callback);
+    callback->write(file_data(3 * PART_SIZE));
+    std::this_thread::sleep_for(3 * PART_LATENCY);
+    // cancel waits for parts awaiting data, which are let go once the writer
+    // finishes
+    std::thread cancel([&] { request->cancel(); });
+    std::this_thread::sleep_for(PART_LATENCY);
+    callback->close();
+    cancel.join();
+    ASSERT_NE(request->result().left(), nullptr);
+  }
+  std::this_thread::sleep_for(PART_LATENCY);
+  std::lock_guard<std::mutex> lock(storage.mutex_);
+  ASSERT_EQ(storage.aborted_.size(), 1u);
+  // size covers every part which was started
+  EXPECT_GE(storage.aborted_size_, 3 * PART_SIZE);
+}
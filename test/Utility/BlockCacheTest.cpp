@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * BlockCacheTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2018 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+#include "Utility/BlockCache.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+BlockCache::Block block(char c) {
+  return std::make_shared<std::vector<char>>(BlockCache::BlockSize, c);
+}
+
+}  // namespace
+
+TEST(BlockCacheTest, CoalescesDownloads) {
+  BlockCache cache(4 * BlockCache::BlockSize);
+  BlockCache::Block result, notified;
+  int calls = 0;
+  auto callback = [&](BlockCache::Block b) {
+    notified = b;
+    calls++;
+  };
+  ASSERT_EQ(cache.get("file", 0, result, callback, false),
+            BlockCache::Status::Missing);
+  ASSERT_EQ(cache.get("file", 0, result, callback),
+            BlockCache::Status::Download);
+  ASSERT_EQ(cache.get("file", 0, result, callback),
+            BlockCache::Status::Pending);
+  ASSERT_EQ(cache.get("file", 0, result, callback, false),
+            BlockCache::Status::Pending);
+  cache.put("file", 0, block('a'));
+  ASSERT_EQ(calls, 2);
+  ASSERT_EQ((*notified)[0], 'a');
+  ASSERT_EQ(cache.get("file", 0, result, callback),
+            BlockCache::Status::Cached);
+  ASSERT_EQ(result, notified);
+
+  ASSERT_EQ(cache.get("file", 1, result, callback),
+            BlockCache::Status::Download);
+  ASSERT_EQ(cache.get("file", 1, result, callback),
+            BlockCache::Status::Pending);
+  cache.fail("file", 1);
+  ASSERT_EQ(calls, 3);
+  ASSERT_EQ(notified, nullptr);
+  ASSERT_EQ(cache.get("file", 1, result, callback),
+            BlockCache::Status::Download);
+}
+
+TEST(BlockCacheTest, SpillsToDisk) {
+  auto path = util::temporary_directory() + "libcloudstorage-test.cache";
+  BlockCache memory(2 * BlockCache::BlockSize);
+  BlockCache disk(2 * BlockCache::BlockSize, path, 8 * BlockCache::BlockSize);
+  for (int i = 0; i < 8; i++) {
+    memory.put("file", i, block('a' + i));
+    disk.put("file", i, block('a' + i));
+  }
+  BlockCache::Block result;
+  auto callback = [](BlockCache::Block) {};
+  ASSERT_EQ(memory.get("file", 0, result, callback, false),
+            BlockCache::Status::Missing);
+  for (int i = 0; i < 8; i++) {
+    ASSERT_EQ(disk.get("file", i, result, callback, false),
+              BlockCache::Status::Cached);
+    ASSERT_EQ(result->size(), BlockCache::BlockSize);
+    ASSERT_EQ((*result)[BlockCache::BlockSize - 1], 'a' + i);
+  }
+  ASSERT_EQ(disk.get("file", 8, result, callback, false),
+            BlockCache::Status::Missing);
+}
+
+TEST(BlockCacheTest, DisabledCacheOnlyCoalesces) {
+  BlockCache cache(0);
+  BlockCache::Block result;
+  int calls = 0;
+  auto callback = [&](BlockCache::Block) { calls++; };
+  ASSERT_EQ(cache.get("file", 0, result, callback),
+            BlockCache::Status::Download);
+  ASSERT_EQ(cache.get("file", 0, result, callback),
+            BlockCache::Status::Pending);
+  cache.put("file", 0, block('a'));
+  ASSERT_EQ(calls, 1);
+  ASSERT_EQ(cache.get("file", 0, result, callback, false),
+            BlockCache::Status::Missing);
+}
+
+TEST(BlockCacheTest, SharesDiskBetweenThreads) {
+  auto path = util::temporary_directory() + "libcloudstorage-threads.cache";
+  const int count = 4;
+  // more blocks than slots, so that slots are reassigned while being read
+  const int blocks = 8;
+  BlockCache cache(BlockCache::BlockSize, path, 4 * BlockCache::BlockSize);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < count; i++)
+    threads.emplace_back([&, i] {
+      auto callback = [](BlockCache::Block) {};
+      for (int j = 0; j < 16 * blocks; j++) {
+        auto index = (i + j * (i + 1)) % blocks;
+        std::string key(1, 'a' + index);
+        BlockCache::Block result;
+        auto status = cache.get(key, index, result, callback);
+        if (status == BlockCache::Status::Cached) {
+          // a block read from a reassigned slot would carry another key
+          EXPECT_EQ((*result)[0], key[0]);
+          EXPECT_EQ((*result)[BlockCache::BlockSize - 1], key[0]);
+        } else if (status == BlockCache::Status::Download) {
+          cache.put(key, index, block(key[0]));
+        }
+      }
+    });
+  for (auto&& t : threads) t.join();
+}
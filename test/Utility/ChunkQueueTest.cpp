@@ -0,0 +1,71 @@
+/*****************************************************************************
+ * ChunkQueueTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+TEST(ChunkQueueTest, KeepsOrder) {
+  util::ChunkQueue queue(4);
+  queue.push("abcdef", 6);
+  queue.push(std::make_shared<std::vector<char>>(3, 'g'));
+  queue.push("hi", 2);
+  ASSERT_EQ(queue.size(), 11u);
+  std::string result(11, 0);
+  ASSERT_EQ(queue.pop(&result[0], 5), 5u);
+  ASSERT_EQ(queue.pop(&result[5], 100), 6u);
+  ASSERT_EQ(result, "abcdefggghi");
+  ASSERT_TRUE(queue.empty());
+  ASSERT_EQ(queue.pop(&result[0], 1), 0u);
+}
+
+TEST(ChunkQueueTest, MatchesByteQueue) {
+  util::ChunkQueue queue(7);
+  std::string expected, result;
+  char next = 'a';
+  // sizes cross chunk boundaries at different offsets
+  for (size_t i = 1; i <= 200; i++) {
+    std::string data(i * 13 % 29, 0);
+    for (auto&& c : data) c = next = next == 'z' ? 'a' : next + 1;
+    if (i % 5 == 0)
+      queue.push(std::make_shared<std::vector<char>>(data.begin(), data.end()));
+    else
+      queue.push(data.data(), data.size());
+    expected += data;
+    std::string output(i * 11 % 23, 0);
+    output.resize(queue.pop(&output[0], output.size()));
+    result += output;
+    ASSERT_EQ(queue.size(), expected.size() - result.size());
+  }
+  std::string rest(queue.size(), 0);
+  ASSERT_EQ(queue.pop(&rest[0], rest.size() + 1), rest.size());
+  result += rest;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(result, expected);
+}
@@ -0,0 +1,106 @@
+/*****************************************************************************
+ * CurlHttpTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <sstream>
+#include <vector>
+
+#include "IHttp.h"
+#include "Utility/MicroHttpdServer.h"
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+#if defined(WITH_CURL) && defined(WITH_MICROHTTPD)
+
+const uint64_t REQUEST_COUNT = 200;
+
+namespace {
+
+class StubCallback : public IHttpServer::ICallback {
+ public:
+  IHttpServer::IResponse::Pointer handle(
+      const IHttpServer::IRequest& request) override {
+    return util::response_from_string(request, IHttpRequest::Ok, {}, "ok");
+  }
+};
+
+class HttpCallback : public IHttpRequest::ICallback {
+ public:
+  bool isSuccess(int code,
+                 const IHttpRequest::HeaderParameters&) const override {
+    return IHttpRequest::isSuccess(code);
+  }
+
+  bool abort() override { return false; }
+
+  bool pause() override { return false; }
+
+  void progressDownload(uint64_t, uint64_t) override {}
+
+  void progressUpload(uint64_t, uint64_t) override {}
+};
+
+}  // namespace
+
+TEST(CurlHttpTest, SequentialRequestLatency) {
+  // port 0 lets the system pick a free one
+  auto server = MicroHttpdServerFactory().create(
+      std::make_shared<StubCallback>(), 0);
+  ASSERT_NE(server, nullptr);
+  auto port = static_cast<MicroHttpdServer&>(*server).port();
+  ASSERT_NE(port, 0);
+  auto http = IHttp::create();
+  auto url = "http://127.0.0.1:" + std::to_string(port) + "/";
+  std::vector<double> latency;
+  for (uint64_t i = 0; i < REQUEST_COUNT; i++) {
+    std::promise<int> result;
+    auto start = std::chrono::steady_clock::now();
+    http->create(url)->send(
+        [&](IHttpRequest::Response r) { result.set_value(r.http_code_); },
+        std::make_shared<std::stringstream>(),
+        std::make_shared<std::stringstream>(),
+        std::make_shared<std::stringstream>(),
+        std::make_shared<HttpCallback>());
+    ASSERT_EQ(result.get_future().get(), IHttpRequest::Ok);
+    latency.push_back(std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count());
+  }
+  std::sort(latency.begin(), latency.end());
+  auto p50 = latency[latency.size() / 2];
+  auto p99 = latency[latency.size() * 99 / 100];
+  util::log("curl request latency p50:", p50, "ms p99:", p99, "ms");
+  auto statistics = http->statistics();
+  util::log("reused handles:", statistics.reused_handles_,
+            "reused connections:", statistics.reused_connections_, "of",
+            statistics.requests_);
+  EXPECT_EQ(statistics.requests_, REQUEST_COUNT);
+  EXPECT_GT(statistics.reused_handles_, 0u);
+}
+
+#endif  // WITH_CURL && WITH_MICROHTTPD
@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * FakeHttp.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef FAKE_HTTP_H
+#define FAKE_HTTP_H
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "FakeProvider.h"
+#include "Utility/Item.h"
+#include "Utility/ThreadPool.h"
+
+// remote side of FakeHttp's requests: stand_in->handle answers every request
+// on pool_ after latency; stand-ins keep it as their last member, so that it's
+// destroyed, and its pending requests are finished, first
+class FakeServer {
+ public:
+  using Handler = std::function<IHttpRequest::Response(
+      const std::string& url, const std::string& method,
+      const IHttpRequest::GetParameters& parameters,
+      const IHttpRequest::HeaderParameters& headers, std::istream& body,
+      std::shared_ptr<std::ostream> output,
+      std::shared_ptr<std::ostream> error)>;
+
+  template <class T>
+  FakeServer(T* stand_in, uint32_t worker_count,
+             std::chrono::milliseconds latency)
+      : handler_([stand_in](const std::string& url, const std::string& method,
+                            const IHttpRequest::GetParameters& parameters,
+                            const IHttpRequest::HeaderParameters& headers,
+                            std::istream& body,
+                            std::shared_ptr<std::ostream> output,
+                            std::shared_ptr<std::ostream> error) {
+          return stand_in->handle(url, method, parameters, headers, body,
+                                  output, error);
+        }),
+        latency_(latency),
+        running_(),
+        max_running_(),
+        pool_(worker_count) {}
+
+  Handler handler_;
+  std::chrono::milliseconds latency_;
+  std::mutex mutex_;
+  // requests being handled at once
+  int running_;
+  int max_running_;
+  // outlives providers, which may be released by the last request
+  ThreadPool pool_;
+};
+
+class FakeRequest : public IHttpRequest {
+ public:
+  FakeRequest(const std::string& url, const std::string& method,
+              FakeServer& server)
+      : url_(url), method_(method), server_(server) {}
+
+  void setParameter(const std::string& parameter,
+                    const std::string& value) override {
+    parameters_[parameter] = value;
+  }
+
+  void setHeaderParameter(const std::string& parameter,
+                          const std::string& value) override {
+    headers_.insert({parameter, value});
+  }
+
+  const GetParameters& parameters() const override { return parameters_; }
+  const HeaderParameters& headerParameters() const override {
+    return headers_;
+  }
+  const std::string& url() const override { return url_; }
+  const std::string& method() const override { return method_; }
+  bool follow_redirect() const override { return false; }
+
+  void send(CompleteCallback complete, std::shared_ptr<std::istream> data,
+            std::shared_ptr<std::ostream> response,
+            std::shared_ptr<std::ostream> error_stream,
+            ICallback::Pointer) const override {
+    GetParameters parameters;
+    for (auto&& p : parameters_)
+      parameters[p.first] = util::Url::unescape(p.second);
+    auto url = url_;
+    auto method = method_;
+    auto headers = headers_;
+    auto& server = server_;
+    server.pool_.schedule([=, &server] {
+      {
+        std::lock_guard<std::mutex> lock(server.mutex_);
+        server.max_running_ = std::max(++server.running_, server.max_running_);
+      }
+      std::this_thread::sleep_for(server.latency_);
+      {
+        std::lock_guard<std::mutex> lock(server.mutex_);
+        server.running_--;
+      }
+      complete(server.handler_(url, method, parameters, headers, *data,
+                               response, error_stream));
+    });
+  }
+
+ private:
+  std::string url_;
+  std::string method_;
+  GetParameters parameters_;
+  HeaderParameters headers_;
+  FakeServer& server_;
+};
+
+class FakeHttp : public IHttp {
+ public:
+  FakeHttp(FakeServer& server) : server_(server) {}
+
+  IHttpRequest::Pointer create(const std::string& url,
+                               const std::string& method,
+                               bool) const override {
+    return std::make_shared<FakeRequest>(url, method, server_);
+  }
+
+ private:
+  FakeServer& server_;
+};
+
+class UploadData : public IUploadFileCallback {
+ public:
+  UploadData(const std::string& data) : data_(data) {}
+
+  uint32_t putData(char* data, uint32_t maxlength, uint64_t offset) override {
+    auto size = std::min<uint64_t>(maxlength, data_.size() - offset);
+    std::copy(data_.begin() + offset, data_.begin() + offset + size, data);
+    return size;
+  }
+
+  uint64_t size() override { return data_.size(); }
+
+  void done(EitherError<IItem>) override {}
+
+  void progress(uint64_t, uint64_t) override {}
+
+ private:
+  std::string data_;
+};
+
+inline IItem::Pointer directory(const std::string& id) {
+  return std::make_shared<Item>(CloudProvider::getFilename(id), id,
+                                IItem::UnknownSize, IItem::UnknownTimeStamp,
+                                IItem::FileType::Directory);
+}
+
+inline std::string file_data(uint64_t size) {
+  std::string data(size, 0);
+  for (uint64_t i = 0; i < size; i++) data[i] = 'a' + i % 26;
+  return data;
+}
+
+#endif  // FAKE_HTTP_H
@@ -0,0 +1,193 @@
+/*****************************************************************************
+ * FakeProvider.h
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#ifndef FAKE_PROVIDER_H
+#define FAKE_PROVIDER_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "CloudProvider/CloudProvider.h"
+#include "Request/Request.h"
+#include "Utility/Auth.h"
+#include "Utility/Item.h"
+#include "Utility/ThreadPool.h"
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+// auth of providers which are never authorized
+class FakeAuth : public Auth {
+ public:
+  std::string authorizeLibraryUrl() const override { return ""; }
+
+  IHttpRequest::Pointer exchangeAuthorizationCodeRequest(
+      std::ostream&) const override {
+    return nullptr;
+  }
+
+  IHttpRequest::Pointer refreshTokenRequest(std::ostream&) const override {
+    return nullptr;
+  }
+
+  Token::Pointer exchangeAuthorizationCodeResponse(
+      std::istream&) const override {
+    return nullptr;
+  }
+
+  Token::Pointer refreshTokenResponse(std::istream&) const override {
+    return nullptr;
+  }
+};
+
+// http engine of providers which never send requests
+class NullHttp : public IHttp {
+ public:
+  IHttpRequest::Pointer create(const std::string&, const std::string&,
+                               bool) const override {
+    return nullptr;
+  }
+};
+
+class FakeHttpServerFactory : public IHttpServerFactory {
+ public:
+  IHttpServer::Pointer create(IHttpServer::ICallback::Pointer,
+                              const std::string&, IHttpServer::Type) override {
+    return nullptr;
+  }
+};
+
+class FakeAuthCallback : public ICloudProvider::IAuthCallback {
+  Status userConsentRequired(const ICloudProvider&) override {
+    return Status::None;
+  }
+
+  void done(const ICloudProvider&, EitherError<void>) override {}
+};
+
+// initializes provider T with data, engines missing in data are replaced with
+// the fakes above
+template <class T, class... Arguments>
+std::shared_ptr<T> make_provider(ICloudProvider::InitData&& data,
+                                 Arguments&&... arguments) {
+  if (!data.http_engine_) data.http_engine_ = util::make_unique<NullHttp>();
+  if (!data.http_server_)
+    data.http_server_ = util::make_unique<FakeHttpServerFactory>();
+  if (!data.callback_) data.callback_ = util::make_unique<FakeAuthCallback>();
+  auto p = std::make_shared<T>(std::forward<Arguments>(arguments)...);
+  p->initialize(std::move(data));
+  return p;
+}
+
+// provider whose items are kept in a map id -> item; the root's id is "" and
+// the parent of "/a/b" is "/a", unless the item was moved. Listings are
+// counted; with a latency, they are answered after it from pool_.
+class TreeProvider : public CloudProvider {
+ public:
+  TreeProvider(std::chrono::milliseconds latency = std::chrono::milliseconds(),
+               uint32_t thread_count = 0)
+      : CloudProvider(util::make_unique<FakeAuth>()),
+        listed_(),
+        pool_(thread_count),
+        latency_(latency) {}
+
+  std::string name() const override { return "tree"; }
+  std::string endpoint() const override { return ""; }
+
+  IItem::Pointer rootDirectory() const override { return item("", 0, true); }
+
+  ListDirectoryRequest::Pointer listDirectorySimpleAsync(
+      IItem::Pointer directory, ListDirectoryCallback callback) override {
+    listed_++;
+    auto resolver = [=](Request<EitherError<IItem::List>>::Pointer r) {
+      pool_.schedule([=] {
+        if (latency_.count() > 0) std::this_thread::sleep_for(latency_);
+        IItem::List result;
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          for (auto&& i : items_)
+            if (parent(i.first) == directory->id()) result.push_back(i.second);
+        }
+        r->done(result);
+      });
+    };
+    return std::make_shared<Request<EitherError<IItem::List>>>(
+               shared_from_this(), callback, resolver)
+        ->run();
+  }
+
+  void set(const std::string& id, uint64_t size, bool directory = false) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    items_[id] = item(id, size, directory);
+  }
+
+  void remove(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    items_.erase(id);
+  }
+
+  void move(const std::string& id, const std::string& parent) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    moved_[id] = parent;
+  }
+
+  // adds width items named "0", "1", ... to the directory and to each of its
+  // descendant directories; items depth levels below it are files
+  void grow(const std::string& id, int width, int depth) {
+    for (int i = 0; i < width; i++) {
+      auto child = id + "/" + std::to_string(i);
+      set(child, 0, depth > 1);
+      if (depth > 1) grow(child, width, depth - 1);
+    }
+  }
+
+  static IItem::Pointer item(const std::string& id, uint64_t size,
+                             bool directory) {
+    return std::make_shared<Item>(
+        id.substr(id.find_last_of('/') + 1), id, size, IItem::UnknownTimeStamp,
+        directory ? IItem::FileType::Directory : IItem::FileType::Unknown);
+  }
+
+  std::atomic_int listed_;
+  ThreadPool pool_;
+
+ private:
+  std::string parent(const std::string& id) const {
+    auto it = moved_.find(id);
+    if (it != moved_.end()) return it->second;
+    return id.substr(0, id.find_last_of('/'));
+  }
+
+  std::chrono::milliseconds latency_;
+  std::mutex mutex_;
+  std::map<std::string, IItem::Pointer> items_;
+  std::map<std::string, std::string> moved_;
+};
+
+#endif  // FAKE_PROVIDER_H
@@ -0,0 +1,82 @@
+/*****************************************************************************
+ * FileServerTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+
+#include "Utility/BlockCache.h"
+#include "Utility/FileServer.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const uint64_t MiB = 1024 * 1024;
+const auto SECOND = std::chrono::seconds(1);
+
+}  // namespace
+
+TEST(FileServerTest, WindowGrowsWhileThroughputScales) {
+  DownloadWindow window;
+  EXPECT_EQ(window.size(), 1u);
+  // every request is as fast as the first one, however many are in flight
+  for (uint32_t i = 1; i < DownloadWindow::MaxSize; i++) {
+    window.adapt(4 * MiB, SECOND);
+    EXPECT_EQ(window.size(), i + 1);
+  }
+  window.adapt(4 * MiB, SECOND);
+  EXPECT_EQ(window.size(), DownloadWindow::MaxSize);
+}
+
+TEST(FileServerTest, WindowStopsGrowingWhenThroughputIsShared) {
+  DownloadWindow window;
+  // requests in flight share a fixed bandwidth
+  for (int i = 0; i < 10; i++)
+    window.adapt(4 * MiB / window.size(), SECOND);
+  EXPECT_EQ(window.size(), 2u);
+}
+
+TEST(FileServerTest, WindowShrinksWhenThroughputDrops) {
+  DownloadWindow window;
+  for (uint32_t i = 0; i < DownloadWindow::MaxSize; i++)
+    window.adapt(4 * MiB, SECOND);
+  ASSERT_EQ(window.size(), DownloadWindow::MaxSize);
+  for (uint32_t i = DownloadWindow::MaxSize - 1; i >= 1; i--) {
+    window.adapt(MiB, SECOND);
+    EXPECT_EQ(window.size(), i);
+  }
+  window.adapt(MiB, SECOND);
+  EXPECT_EQ(window.size(), 1u);
+}
+
+TEST(FileServerTest, ChunkSizeFollowsThroughput) {
+  DownloadWindow window;
+  window.adapt(4 * MiB, SECOND);
+  EXPECT_EQ(window.chunk_size(), 4 * MiB);
+  window.adapt(1024, SECOND);
+  EXPECT_EQ(window.chunk_size(), BlockCache::BlockSize);
+  // no time elapsed, no measurement
+  window.adapt(4 * MiB, std::chrono::seconds(0));
+  EXPECT_EQ(window.chunk_size(), BlockCache::BlockSize);
+}
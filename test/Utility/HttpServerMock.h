@@ -37,10 +37,10 @@ class HttpServerMock : public IHttpServer {
     MOCK_CONST_METHOD0(method, std::string());
     MOCK_CONST_METHOD0(url, std::string());
     MOCK_CONST_METHOD4(mocked_response,
-                       IResponse::Pointer(int, const IResponse::Headers&, int,
-                                          IResponse::ICallback*));
+                       IResponse::Pointer(int, const IResponse::Headers&,
+                                          uint64_t, IResponse::ICallback*));
     IResponse::Pointer response(int code, const IResponse::Headers& headers,
-                                int size,
+                                uint64_t size,
                                 IResponse::ICallback::Pointer cb) const {
       return mocked_response(code, headers, size, cb.get());
     }
@@ -0,0 +1,157 @@
+/*****************************************************************************
+ * MetadataCacheTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <thread>
+
+#include "Utility/FakeProvider.h"
+#include "Utility/Item.h"
+#include "Utility/MetadataCache.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const int TREE_WIDTH = 4;
+const int TREE_DEPTH = 4;
+const char* DEEP_PATH = "/1/2/3/0";
+
+IItem::Pointer directory(const std::string& path) {
+  return std::make_shared<Item>(path.substr(path.find_last_of('/') + 1), path,
+                                IItem::UnknownSize, IItem::UnknownTimeStamp,
+                                IItem::FileType::Directory);
+}
+
+std::shared_ptr<TreeProvider> provider(const std::string& ttl) {
+  ICloudProvider::InitData data;
+  if (!ttl.empty()) data.hints_["metadata_cache_ttl"] = ttl;
+  auto p = make_provider<TreeProvider>(std::move(data));
+  p->grow("", TREE_WIDTH, TREE_DEPTH);
+  p->set("/file", 1);
+  return p;
+}
+
+EitherError<IItem> get(ICloudProvider& p, const std::string& path) {
+  return p.getItemAsync(path)->result();
+}
+
+}  // namespace
+
+TEST(MetadataCacheTest, ResolvesWarmPathsWithoutListing) {
+  auto p = provider("60");
+  auto item = get(*p, DEEP_PATH);
+  ASSERT_NE(item.right(), nullptr);
+  EXPECT_EQ(item.right()->id(), DEEP_PATH);
+  EXPECT_EQ(p->listed_, 4);
+  item = get(*p, DEEP_PATH);
+  ASSERT_NE(item.right(), nullptr);
+  EXPECT_EQ(item.right()->id(), DEEP_PATH);
+  EXPECT_EQ(p->listed_, 4);
+  item = get(*p, "/1/2/0/");
+  ASSERT_NE(item.right(), nullptr);
+  EXPECT_EQ(item.right()->id(), "/1/2/0");
+  EXPECT_EQ(p->listed_, 4);
+  ASSERT_NE(get(*p, "/1/2/5").left(), nullptr);
+  EXPECT_EQ(p->listed_, 4);
+  auto statistics = p->metadataCacheStatistics();
+  util::log("hits:", statistics.hits_, "misses:", statistics.misses_,
+            "hit rate:", statistics.hit_rate());
+  EXPECT_EQ(statistics.misses_, 4u);
+  EXPECT_GT(statistics.hit_rate(), 0.5);
+}
+
+TEST(MetadataCacheTest, ResolvesFileUploadedToRoot) {
+  auto p = provider("60");
+  auto before = get(*p, "/file");
+  ASSERT_NE(before.right(), nullptr);
+  ASSERT_NE(get(*p, "/file").right(), nullptr);
+  EXPECT_EQ(p->listed_, 1);
+  p->set("/file", 2);
+  // ICloudProvider invalidates the parent once an upload is done
+  p->metadata_cache()->invalidate(p->rootDirectory()->id());
+  auto after = get(*p, "/file");
+  ASSERT_NE(after.right(), nullptr);
+  EXPECT_EQ(before.right()->size(), 1u);
+  EXPECT_EQ(after.right()->size(), 2u);
+  EXPECT_EQ(p->listed_, 2);
+}
+
+TEST(MetadataCacheTest, DisabledWithZeroTtl) {
+  auto p = provider("0");
+  ASSERT_NE(get(*p, DEEP_PATH).right(), nullptr);
+  ASSERT_NE(get(*p, DEEP_PATH).right(), nullptr);
+  EXPECT_EQ(p->listed_, 8);
+  EXPECT_EQ(p->metadataCacheStatistics().hits_, 0u);
+}
+
+TEST(MetadataCacheTest, DisabledByDefault) {
+  auto p = provider("");
+  ASSERT_NE(get(*p, DEEP_PATH).right(), nullptr);
+  ASSERT_NE(get(*p, DEEP_PATH).right(), nullptr);
+  EXPECT_EQ(p->listed_, 8);
+}
+
+TEST(MetadataCacheTest, InvalidatesItemListingsAndDescendants) {
+  MetadataCache cache(std::chrono::seconds(60));
+  auto generation = cache.generation();
+  cache.set_item("/a", directory("/a"), generation);
+  cache.set_item("/a/b", directory("/a/b"), generation);
+  cache.set_item("/ab", directory("/ab"), generation);
+  cache.set_children("", {directory("/a"), directory("/ab")}, generation);
+  cache.set_children("/a", {directory("/a/b")}, generation);
+  cache.invalidate("/a");
+  IItem::List children;
+  EXPECT_EQ(cache.item("/a"), nullptr);
+  EXPECT_EQ(cache.item("/a/b"), nullptr);
+  EXPECT_NE(cache.item("/ab"), nullptr);
+  EXPECT_FALSE(cache.children("", children));
+  EXPECT_FALSE(cache.children("/a", children));
+}
+
+TEST(MetadataCacheTest, ExpiresEntries) {
+  MetadataCache cache(std::chrono::milliseconds(10));
+  cache.set_item("/a", directory("/a"), cache.generation());
+  cache.set_children("/a", {}, cache.generation());
+  IItem::List children;
+  EXPECT_NE(cache.item("/a"), nullptr);
+  EXPECT_TRUE(cache.children("/a", children));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(cache.item("/a"), nullptr);
+  EXPECT_FALSE(cache.children("/a", children));
+}
+
+TEST(MetadataCacheTest, DropsDataFetchedBeforeInvalidation) {
+  MetadataCache cache(std::chrono::seconds(60));
+  // a listing of "/a" is in flight when "/a/b" gets deleted
+  auto generation = cache.generation();
+  cache.invalidate("/a/b");
+  cache.set_children("/a", {directory("/a/b")}, generation);
+  cache.set_item("/a/b", directory("/a/b"), generation);
+  IItem::List children;
+  EXPECT_FALSE(cache.children("/a", children));
+  EXPECT_EQ(cache.item("/a/b"), nullptr);
+  cache.set_children("/a", {}, cache.generation());
+  EXPECT_TRUE(cache.children("/a", children));
+}
@@ -0,0 +1,287 @@
+/*****************************************************************************
+ * MicroHttpdServerTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "IHttp.h"
+#include "Utility/MicroHttpdServer.h"
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+#if defined(WITH_CURL) && defined(WITH_MICROHTTPD)
+
+// size announced for the served file, its content is generated on the fly
+const uint64_t LARGE_FILE_SIZE = 3ull * 1024 * 1024 * 1024;
+const uint64_t TAIL_SIZE = 1024 * 1024;
+const uint64_t SMALL_FILE_SIZE = 4 * 1024 * 1024;
+const size_t SMALL_BLOCK_SIZE = 1024;
+const uint64_t STREAM_COUNT = 16;
+const uint64_t STREAM_SIZE = 1024 * 1024;
+const uint32_t THREAD_POOL_SIZE = 8;
+// bounds the wait of a server which can't read two responses at once
+const auto OVERLAP_TIMEOUT = std::chrono::seconds(1);
+
+namespace {
+
+char content(uint64_t offset) { return 'a' + offset % 26; }
+
+std::string content(uint64_t offset, uint64_t size) {
+  std::string data(size, 0);
+  for (uint64_t i = 0; i < size; i++) data[i] = content(offset + i);
+  return data;
+}
+
+// counts responses read at once; the first read waits until another one
+// runs alongside it, so that a server which can overlap them does
+class Overlap {
+ public:
+  Overlap() : running_(), max_running_(), open_() {}
+
+  void enter() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    max_running_ = std::max(max_running_, ++running_);
+    if (open_) return;
+    condition_.notify_all();
+    condition_.wait_for(lock, OVERLAP_TIMEOUT, [=] { return running_ >= 2; });
+    open_ = true;
+  }
+
+  void leave() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_--;
+  }
+
+  uint32_t max_running() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_running_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  uint32_t running_;
+  uint32_t max_running_;
+  bool open_;
+};
+
+class FileData : public IHttpServer::IResponse::ICallback {
+ public:
+  FileData(Range range, std::shared_ptr<Overlap> overlap)
+      : offset_(range.start_), remaining_(range.size_), overlap_(overlap) {}
+
+  int putData(char* buffer, size_t size) override {
+    if (overlap_) overlap_->enter();
+    auto length = std::min<uint64_t>(size, remaining_);
+    for (uint64_t i = 0; i < length; i++) buffer[i] = content(offset_ + i);
+    offset_ += length;
+    remaining_ -= length;
+    if (overlap_) overlap_->leave();
+    return length == 0 ? End : length;
+  }
+
+ private:
+  uint64_t offset_;
+  uint64_t remaining_;
+  std::shared_ptr<Overlap> overlap_;
+};
+
+class FileCallback : public IHttpServer::ICallback {
+ public:
+  FileCallback(uint64_t size, std::shared_ptr<Overlap> overlap)
+      : size_(size), overlap_(overlap) {}
+
+  IHttpServer::IResponse::Pointer handle(
+      const IHttpServer::IRequest& request) override {
+    Range range{0, size_};
+    int code = IHttpRequest::Ok;
+    if (auto header = request.header("Range")) {
+      range = util::parse_range(header);
+      if (range.size_ == Range::Full) range.size_ = size_ - range.start_;
+      code = IHttpRequest::Partial;
+    }
+    return request.response(code, {}, range.size_,
+                            util::make_unique<FileData>(range, overlap_));
+  }
+
+ private:
+  uint64_t size_;
+  std::shared_ptr<Overlap> overlap_;
+};
+
+class CountingBuffer : public std::streambuf {
+ public:
+  uint64_t size_ = 0;
+
+ protected:
+  std::streamsize xsputn(const char*, std::streamsize count) override {
+    size_ += count;
+    return count;
+  }
+
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) size_++;
+    return c;
+  }
+};
+
+class HttpCallback : public IHttpRequest::ICallback {
+ public:
+  bool isSuccess(int code,
+                 const IHttpRequest::HeaderParameters&) const override {
+    return IHttpRequest::isSuccess(code);
+  }
+
+  bool abort() override { return false; }
+
+  bool pause() override { return false; }
+
+  void progressDownload(uint64_t, uint64_t) override {}
+
+  void progressUpload(uint64_t, uint64_t) override {}
+};
+
+struct StreamResult {
+  uint64_t received_;
+  // most responses read at once
+  uint32_t overlap_;
+};
+
+// starts a server on a port picked by the system
+IHttpServer::Pointer server(uint64_t size,
+                            const IHttpServerFactory::Options& options,
+                            std::string& url,
+                            std::shared_ptr<Overlap> overlap = nullptr) {
+  auto server = MicroHttpdServerFactory(options).create(
+      std::make_shared<FileCallback>(size, overlap), 0);
+  if (!server) return nullptr;
+  auto port = static_cast<MicroHttpdServer&>(*server).port();
+  if (port == 0) return nullptr;
+  url = "http://127.0.0.1:" + std::to_string(port) + "/";
+  return server;
+}
+
+IHttpRequest::Response send(IHttpRequest::Pointer request,
+                            std::shared_ptr<std::ostream> output) {
+  std::promise<IHttpRequest::Response> result;
+  request->send(
+      [&](IHttpRequest::Response r) { result.set_value(r); },
+      std::make_shared<std::stringstream>(), output,
+      std::make_shared<std::stringstream>(), std::make_shared<HttpCallback>());
+  return result.get_future().get();
+}
+
+// returns the body of the file served with given block size
+std::string download(uint64_t size, size_t block_size) {
+  IHttpServerFactory::Options options;
+  options.block_size_ = block_size;
+  std::string url;
+  auto s = server(size, options, url);
+  if (!s) return "";
+  auto http = IHttp::create();
+  auto output = std::make_shared<std::stringstream>();
+  auto response = send(http->create(url), output);
+  if (response.http_code_ != IHttpRequest::Ok) return "";
+  return output->str();
+}
+
+// streams STREAM_COUNT ranges of the file at once
+StreamResult stream(uint32_t thread_pool_size) {
+  IHttpServerFactory::Options options;
+  options.thread_pool_size_ = thread_pool_size;
+  auto overlap = std::make_shared<Overlap>();
+  std::string url;
+  auto s = server(STREAM_COUNT * STREAM_SIZE, options, url, overlap);
+  if (!s) return {};
+  IHttp::Options http_options;
+  http_options.worker_count_ = 4;
+  auto http = IHttp::create(http_options);
+  std::vector<CountingBuffer> buffers(STREAM_COUNT);
+  std::vector<std::promise<void>> done(STREAM_COUNT);
+  for (uint64_t i = 0; i < STREAM_COUNT; i++) {
+    auto request = http->create(url);
+    std::stringstream range;
+    range << "bytes=" << i * STREAM_SIZE << "-" << (i + 1) * STREAM_SIZE - 1;
+    request->setHeaderParameter("Range", range.str());
+    request->send([&, i](IHttpRequest::Response) { done[i].set_value(); },
+                  std::make_shared<std::stringstream>(),
+                  std::make_shared<std::ostream>(&buffers[i]),
+                  std::make_shared<std::stringstream>(),
+                  std::make_shared<HttpCallback>());
+  }
+  for (auto&& d : done) d.get_future().wait();
+  uint64_t received = 0;
+  for (auto&& b : buffers) received += b.size_;
+  return {received, overlap->max_running()};
+}
+
+}  // namespace
+
+TEST(MicroHttpdServerTest, ServesFilesLargerThan2GiB) {
+  std::string url;
+  auto s = server(LARGE_FILE_SIZE, IHttpServerFactory::Options(), url);
+  ASSERT_NE(s, nullptr);
+  auto http = IHttp::create();
+  auto head = send(http->create(url, "HEAD"),
+                   std::make_shared<std::stringstream>());
+  ASSERT_EQ(head.http_code_, IHttpRequest::Ok);
+  auto content_length = head.headers_.find("content-length");
+  ASSERT_NE(content_length, head.headers_.end());
+  EXPECT_EQ(std::stoull(content_length->second), LARGE_FILE_SIZE);
+  auto request = http->create(url);
+  auto offset = LARGE_FILE_SIZE - TAIL_SIZE;
+  request->setHeaderParameter("Range",
+                              "bytes=" + std::to_string(offset) + "-");
+  auto output = std::make_shared<std::stringstream>();
+  ASSERT_EQ(send(request, output).http_code_, IHttpRequest::Partial);
+  EXPECT_TRUE(output->str() == content(offset, TAIL_SIZE));
+}
+
+TEST(MicroHttpdServerTest, ServesFilesWithAnyBlockSize) {
+  auto expected = content(0, SMALL_FILE_SIZE);
+  EXPECT_TRUE(download(SMALL_FILE_SIZE, SMALL_BLOCK_SIZE) == expected);
+  EXPECT_TRUE(download(SMALL_FILE_SIZE,
+                       IHttpServerFactory::DefaultBlockSize) == expected);
+}
+
+TEST(MicroHttpdServerTest, ConcurrentRangeStreams) {
+  auto single = stream(1);
+  auto pooled = stream(THREAD_POOL_SIZE);
+  EXPECT_EQ(single.received_, STREAM_COUNT * STREAM_SIZE);
+  EXPECT_EQ(pooled.received_, STREAM_COUNT * STREAM_SIZE);
+  // a single thread reads one response at a time, a pool reads them side by
+  // side
+  EXPECT_EQ(single.overlap_, 1u);
+  EXPECT_GE(pooled.overlap_, 2u);
+}
+
+#endif  // WITH_CURL && WITH_MICROHTTPD
@@ -0,0 +1,235 @@
+/*****************************************************************************
+ * ThreadPoolTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "Utility/ThreadPool.h"
+#include "Utility/Utility.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+const int PRODUCER_COUNT = 4;
+const int TASK_COUNT = 20000;
+const int CONTENTION_TASK_COUNT = 200000;
+const int NESTED_TASK_COUNT = 1000;
+const uint32_t BURST_THREAD_COUNT = 8;
+const auto TIMEOUT = std::chrono::seconds(10);
+
+// callable which can't be copied
+struct MoveOnlyTask {
+  void operator()() { result_->set_value(*value_); }
+
+  std::unique_ptr<int> value_;
+  std::shared_ptr<std::promise<int>> result_;
+};
+
+// single queue thread pool which ThreadPool replaced
+class SingleQueueThreadPool : public IThreadPool {
+ public:
+  SingleQueueThreadPool(uint32_t thread_count) : destroyed_(false) {
+    for (uint32_t i = 0; i < thread_count; ++i) {
+      workers_.emplace_back([this]() {
+        while (true) {
+          Task task;
+          {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (destroyed_) break;
+            while (tasks_.empty() && !destroyed_) worker_cv_.wait(lock);
+            if (tasks_.empty()) break;
+            task = std::move(tasks_.front());
+            tasks_.pop();
+          }
+          task();
+        }
+      });
+    }
+  }
+
+  ~SingleQueueThreadPool() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    destroyed_ = true;
+    worker_cv_.notify_all();
+    lock.unlock();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  void schedule(const Task& f) override { schedule(Task(f)); }
+
+  void schedule(Task&& f) override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_.emplace(std::move(f));
+    if (tasks_.size() == 1) worker_cv_.notify_one();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable worker_cv_;
+  std::queue<Task> tasks_;
+  std::vector<std::thread> workers_;
+  bool destroyed_;
+};
+
+// returns scheduled tasks per second
+double contention(IThreadPool& pool) {
+  std::atomic_int done(0);
+  std::promise<void> finished;
+  IThreadPool::Task task = [&] {
+    if (++done == CONTENTION_TASK_COUNT) finished.set_value();
+  };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (int i = 0; i < PRODUCER_COUNT; i++)
+    producers.emplace_back([&] {
+      for (int j = 0; j < CONTENTION_TASK_COUNT / PRODUCER_COUNT; j++)
+        pool.schedule(task);
+    });
+  for (auto& p : producers) p.join();
+  finished.get_future().wait();
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  return CONTENTION_TASK_COUNT / time.count();
+}
+
+}  // namespace
+
+TEST(ThreadPoolTest, RunsTasksInOrderOnSingleThread) {
+  ThreadPool pool(1);
+  std::vector<int> order;
+  std::promise<void> finished;
+  for (int i = 0; i < 100; i++)
+    pool.schedule([&, i] {
+      order.push_back(i);
+      if (i == 99) finished.set_value();
+    });
+  finished.get_future().wait();
+  for (int i = 0; i < 100; i++) ASSERT_EQ(order[i], i);
+}
+
+TEST(ThreadPoolTest, RunsNestedTasks) {
+  ThreadPool pool(4);
+  std::atomic_int done(0);
+  std::promise<void> finished;
+  std::function<void(int)> spawn = [&](int depth) {
+    if (depth > 0) {
+      pool.schedule([&, depth] { spawn(depth - 1); });
+      pool.schedule([&, depth] { spawn(depth - 1); });
+    } else if (++done == NESTED_TASK_COUNT) {
+      finished.set_value();
+    }
+  };
+  for (int i = 0; i < NESTED_TASK_COUNT / 8; i++)
+    pool.schedule([&] { spawn(3); });
+  ASSERT_EQ(finished.get_future().wait_for(TIMEOUT),
+            std::future_status::ready);
+}
+
+TEST(ThreadPoolTest, RunsEveryTaskOfManyProducers) {
+  for (uint32_t threads = 1; threads <= 64; threads *= 4) {
+    std::atomic_int done(0);
+    std::promise<void> finished;
+    {
+      ThreadPool pool(threads);
+      IThreadPool::Task task = [&] {
+        if (++done == TASK_COUNT) finished.set_value();
+      };
+      std::vector<std::thread> producers;
+      for (int i = 0; i < PRODUCER_COUNT; i++)
+        producers.emplace_back([&] {
+          for (int j = 0; j < TASK_COUNT / PRODUCER_COUNT; j++)
+            pool.schedule(task);
+        });
+      for (auto& p : producers) p.join();
+      ASSERT_EQ(finished.get_future().wait_for(TIMEOUT),
+                std::future_status::ready);
+    }
+    EXPECT_EQ(done, TASK_COUNT);
+  }
+}
+
+TEST(ThreadPoolTest, Contention) {
+  for (uint32_t threads = 1; threads <= 64; threads *= 2) {
+    double before, after;
+    {
+      SingleQueueThreadPool pool(threads);
+      before = contention(pool);
+    }
+    {
+      ThreadPool pool(threads);
+      after = contention(pool);
+    }
+    util::log(threads, "threads, single queue:", before,
+              "tasks/s, work stealing:", after, "tasks/s");
+  }
+}
+
+TEST(ThreadPoolTest, WakesUpEveryIdleWorkerOnBurst) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  uint32_t running = 0, met = 0;
+  {
+    ThreadPool pool(BURST_THREAD_COUNT);
+    // every task waits until all of them run at once, which happens only if
+    // each of them woke up a worker of its own
+    for (uint32_t i = 0; i < BURST_THREAD_COUNT; i++)
+      pool.schedule([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        running++;
+        cv.notify_all();
+        if (cv.wait_for(lock, TIMEOUT,
+                        [&] { return running == BURST_THREAD_COUNT; }))
+          met++;
+      });
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait_for(lock, TIMEOUT, [&] { return running == BURST_THREAD_COUNT; });
+  }
+  EXPECT_EQ(met, BURST_THREAD_COUNT);
+}
+
+TEST(ThreadPoolTest, RunsTasksInlineWithoutThreads) {
+  ThreadPool pool(0);
+  bool done = false;
+  pool.schedule([&] { done = true; });
+  EXPECT_TRUE(done);
+}
+
+TEST(ThreadPoolTest, RunsMoveOnlyTasks) {
+  auto result = std::make_shared<std::promise<int>>();
+  auto future = result->get_future();
+  ThreadPool pool(2);
+  IThreadPool& base = pool;
+  base.schedule(MoveOnlyTask{std::unique_ptr<int>(new int(42)), result});
+  ASSERT_EQ(future.wait_for(TIMEOUT), std::future_status::ready);
+  EXPECT_EQ(future.get(), 42);
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ * TimerTest.cpp
+ *
+ *****************************************************************************
+ * Copyright (C) 2016-2016 VideoLAN
+ *
+ * Authors: Paweł Wegner <pawel.wegner95@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston MA 02110-1301, USA.
+ *****************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+
+#include "Utility/Timer.h"
+
+using namespace cloudstorage;
+
+namespace {
+
+// clock which stands still until advance() is called
+class FakeClock {
+ public:
+  FakeClock() : now_(std::make_shared<std::atomic<int64_t>>(0)) {}
+
+  Timer::Clock clock() const {
+    auto now = now_;
+    return [now] {
+      return std::chrono::steady_clock::time_point(std::chrono::seconds(*now));
+    };
+  }
+
+  int64_t now() const { return *now_; }
+
+  void advance(Timer& timer, std::chrono::seconds duration) {
+    *now_ += duration.count();
+    timer.wakeup();
+  }
+
+ private:
+  std::shared_ptr<std::atomic<int64_t>> now_;
+};
+
+}  // namespace
+
+TEST(TimerTest, RunsTaskAfterDelay) {
+  FakeClock clock;
+  Timer timer(clock.clock());
+  std::promise<int64_t> run;
+  timer.schedule(std::chrono::seconds(10),
+                 [&] { run.set_value(clock.now()); });
+  clock.advance(timer, std::chrono::seconds(5));
+  clock.advance(timer, std::chrono::seconds(5));
+  EXPECT_EQ(run.get_future().get(), 10);
+}
+
+TEST(TimerTest, ReplacesAndCancelsTasks) {
+  FakeClock clock;
+  Timer timer(clock.clock());
+  std::atomic_bool replaced(false), cancelled(false);
+  std::promise<void> run;
+  timer.schedule(std::chrono::seconds(10), [&] { replaced = true; });
+  timer.schedule(std::chrono::seconds(20), [&] { cancelled = true; });
+  timer.cancel();
+  timer.schedule(std::chrono::seconds(30), [&] { run.set_value(); });
+  clock.advance(timer, std::chrono::seconds(30));
+  run.get_future().wait();
+  EXPECT_FALSE(replaced);
+  EXPECT_FALSE(cancelled);
+}
+
+TEST(TimerTest, IsDestroyedByOwnTask) {
+  auto timer = std::make_shared<std::shared_ptr<Timer>>(
+      std::make_shared<Timer>());
+  std::promise<void> scheduled, run;
+  auto ready = scheduled.get_future().share();
+  (*timer)->schedule(std::chrono::seconds(0), [timer, ready, &run] {
+    ready.wait();
+    timer->reset();
+    run.set_value();
+  });
+  scheduled.set_value();
+  run.get_future().wait();
+}